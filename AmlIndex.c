@@ -0,0 +1,756 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    AmlIndex.c
+
+Abstract:
+
+    AML namespace index over the DSDT and all SSDTs
+
+    The definition blocks are scanned once, without evaluating any method.
+    Scope, Device, Processor, PowerResource and ThermalZone are descended,
+    Name, Method and OperationRegion are recorded, all other objects with a
+    PkgLength are skipped. An unknown opcode ends the scan of the enclosing
+    scope, since its length can not be determined without a full AML parser.
+
+    Path and _HID strings are kept in an arena of large chunks, that is
+    released at once by AmlIndexDestroy4UEFI().
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+#define AMLPATH_MAX     256             // maximum length of an absolute path, deeper definitions are ignored
+#define AMLDEPTH_MAX    64              // maximum scope nesting
+#define ARENA_CHUNK     (64 * 1024)     // arena chunk size
+
+typedef struct _ARENACHUNK {
+    struct _ARENACHUNK* pNext;
+    size_t Used;
+    size_t Size;
+    char Data[];
+}ARENACHUNK;
+
+typedef struct _AMLCTX {
+    AMLIDX* pIdx;
+    uint32_t nMaxNodes;                 // nodes allocated in pIdx->pNode[]
+    const uint8_t* pTbl;                // current definition block
+    uint32_t Signature;                 // ... its signature
+    uint32_t Instance;                  // ... and instance
+    bool fOutOfMem;
+}AMLCTX;
+
+/** arenaalloc()
+
+    Allocate from the arena, add a new chunk if the current one is exhausted
+
+    @param[in] pIdx index holding the arena
+    @param[in] size number of bytes
+
+    @retval pointer to the memory
+    @retval NULL out of memory
+
+**/
+static void* arenaalloc(AMLIDX* pIdx, size_t size)
+{
+    ARENACHUNK* pChunk = pIdx->pArena;
+    void* pRet = NULL;
+
+    do {
+
+        if (NULL == pChunk || pChunk->Size - pChunk->Used < size)
+        {
+            size_t sizeChunk = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+
+            pChunk = malloc(sizeof(ARENACHUNK) + sizeChunk);
+
+            if (NULL == pChunk)
+                break;
+
+            pChunk->pNext = pIdx->pArena;
+            pChunk->Used = 0;
+            pChunk->Size = sizeChunk;
+            pIdx->pArena = pChunk;
+        }
+
+        pRet = &pChunk->Data[pChunk->Used];
+        pChunk->Used += size;
+
+    } while (0);
+
+    return pRet;
+}
+
+static char* arenastrdup(AMLIDX* pIdx, const char* str)
+{
+    size_t size = strlen(str) + 1;
+    char* pRet = arenaalloc(pIdx, size);
+
+    if (NULL != pRet)
+        memcpy(pRet, str, size);
+
+    return pRet;
+}
+
+/** hash()
+
+    FNV-1a hash of a string
+
+**/
+static uint32_t hash(const char* str)
+{
+    uint32_t h = 2166136261u;
+
+    while ('\0' != *str)
+        h = (h ^ (uint8_t)*str++) * 16777619u;
+
+    return h;
+}
+
+/** pkglength()
+
+    Decode a PkgLength
+
+    @param[in,out]  pp  pointer to the PkgLength, receives pointer behind it
+    @param[in]      end end of the enclosing scope
+
+    @retval pointer to the end of the package
+    @retval NULL    damaged PkgLength
+
+**/
+static const uint8_t* pkglength(const uint8_t** pp, const uint8_t* end)
+{
+    const uint8_t* p = *pp, * pRet = NULL;
+    uint32_t len, n, i;
+
+    do {
+
+        if (p >= end)
+            break;
+
+        n = p[0] >> 6;                                              // number of following bytes
+
+        if (p + 1 + n > end)
+            break;
+
+        if (0 == n)
+            len = p[0] & 0x3F;
+        else
+            for (len = p[0] & 0x0F, i = 0; i < n; i++)
+                len |= (uint32_t)p[1 + i] << (4 + 8 * i);
+
+        if (len < 1 + n || len > (uint32_t)(end - p))
+            break;                                                  // PkgLength counts itself
+
+        pRet = p + len;
+        *pp = p + 1 + n;
+
+    } while (0);
+
+    return pRet;
+}
+
+/** namestring()
+
+    Decode a NameString and resolve it to an absolute path
+
+    @param[in,out]  pp      pointer to the NameString, receives pointer behind it
+    @param[in]      end     end of the enclosing scope
+    @param[in]      strScope current scope, absolute path
+    @param[out]     strPath receives the absolute path, AMLPATH_MAX characters
+
+    @retval true    success
+    @retval false   damaged NameString or path too long
+
+**/
+static bool namestring(const uint8_t** pp, const uint8_t* end, const char* strScope, char* strPath)
+{
+    const uint8_t* p = *pp;
+    uint32_t nSeg = 1, nUp = 0, i;
+    size_t len;
+
+    if (p < end && '\\' == *p)
+    {
+        strScope = "\\";
+        p++;
+    }
+    else while (p < end && '^' == *p)
+    {
+        nUp++;
+        p++;
+    }
+
+    if (p >= end)
+        return false;
+
+    if (0x2E == *p)                                                 // DualNamePrefix
+        nSeg = 2, p++;
+    else if (0x2F == *p)                                            // MultiNamePrefix
+    {
+        if (p + 1 >= end)
+            return false;
+        nSeg = p[1], p += 2;
+    }
+    else if (0x00 == *p)                                            // NullName
+        nSeg = 0, p++;
+
+    if ((size_t)(end - p) < 4 * (size_t)nSeg)
+        return false;
+
+    len = strlen(strScope);
+    memcpy(strPath, strScope, len + 1);
+
+    for (i = 0; i < nUp; i++)                                       // ParentPrefixChar
+    {
+        while (len > 1 && '.' != strPath[len - 1] && '\\' != strPath[len - 1])
+            len--;
+        if (len > 1)
+            len--;                                                  // remove '.' separator
+        strPath[len] = '\0';
+    }
+
+    for (i = 0; i < nSeg; i++, p += 4)
+    {
+        if (len + 6 >= AMLPATH_MAX)
+            return false;
+
+        if (len > 1)
+            strPath[len++] = '.';
+
+        memcpy(&strPath[len], p, 4);
+        len += 4;
+        strPath[len] = '\0';
+    }
+
+    *pp = p;
+
+    return true;
+}
+
+/** skipdata()
+
+    Skip a constant DataObject
+
+    @retval pointer behind the object
+    @retval NULL    not a constant DataObject
+
+**/
+static const uint8_t* skipdata(const uint8_t* p, const uint8_t* end)
+{
+    const uint8_t* q = p + 1, * pRet = NULL;
+
+    if (p >= end)
+        return NULL;
+
+    switch (*p)
+    {
+    case 0x00: case 0x01: case 0xFF:    pRet = q;       break;      // Zero, One, Ones
+    case 0x0A:                          pRet = p + 2;   break;      // ByteConst
+    case 0x0B:                          pRet = p + 3;   break;      // WordConst
+    case 0x0C:                          pRet = p + 5;   break;      // DWordConst
+    case 0x0E:                          pRet = p + 9;   break;      // QWordConst
+    case 0x0D:                                                      // String
+        while (q < end && '\0' != *q)
+            q++;
+        pRet = q < end ? q + 1 : NULL;
+        break;
+    case 0x11: case 0x12: case 0x13:                                // Buffer, Package, VarPackage
+        pRet = pkglength(&q, end);
+        break;
+    case 0x5B:                                                      // Revision
+        pRet = (p + 1 < end && 0x30 == p[1]) ? p + 2 : NULL;
+        break;
+    }
+
+    return (NULL != pRet && pRet <= end) ? pRet : NULL;
+}
+
+/** skiptermarg()
+
+    Skip a TermArg, that is a constant, a local or argument, or a name without arguments
+
+**/
+static const uint8_t* skiptermarg(const uint8_t* p, const uint8_t* end)
+{
+    char strPath[AMLPATH_MAX];
+    const uint8_t* pRet = skipdata(p, end);
+
+    if (NULL == pRet && p < end)
+    {
+        if (0x60 <= *p && *p <= 0x6E)                               // Local0..7, Arg0..6
+            pRet = p + 1;
+        else if ('\\' == *p || '^' == *p || '_' == *p || ('A' <= *p && *p <= 'Z') || 0x2E == *p || 0x2F == *p)
+            if (true == namestring(&p, end, "\\", strPath))
+                pRet = p;
+    }
+
+    return pRet;
+}
+
+/** hid()
+
+    Decode the value of a _HID object, EISAID or string
+
+    @param[in]  p       DataRefObject
+    @param[in]  end     end of the enclosing scope
+    @param[out] strHid  receives the _HID, at least 9 characters
+
+    @retval true    success
+    @retval false   neither EISAID nor string
+
+**/
+static bool hid(const uint8_t* p, const uint8_t* end, char* strHid)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    uint32_t v, i;
+
+    if (p + 5 <= end && 0x0C == p[0])                               // DWordConst, compressed EISA ID, big endian
+    {
+        v = (uint32_t)p[1] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 8 | p[4];
+
+        strHid[0] = (char)(0x40 + ((v >> 26) & 0x1F));
+        strHid[1] = (char)(0x40 + ((v >> 21) & 0x1F));
+        strHid[2] = (char)(0x40 + ((v >> 16) & 0x1F));
+        for (i = 0; i < 4; i++)
+            strHid[3 + i] = hex[(v >> (12 - 4 * i)) & 0xF];
+        strHid[7] = '\0';
+
+        return true;
+    }
+
+    if (p < end && 0x0D == p[0])                                    // String
+    {
+        for (i = 0, p++; i < 8 && p < end && '\0' != *p; i++)
+            strHid[i] = (char)*p++;
+        strHid[i] = '\0';
+
+        return 0 != i;
+    }
+
+    return false;
+}
+
+/** addnode()
+
+    Append a node to the index
+
+    @retval index of the node
+    @retval AMLIDX_NIL out of memory
+
+**/
+static uint32_t addnode(AMLCTX* pCtx, const uint8_t* pOp, uint16_t Opcode, const char* strPath)
+{
+    AMLIDX* pIdx = pCtx->pIdx;
+    AMLIDXNODE* pNode;
+    uint32_t nRet = AMLIDX_NIL;
+
+    do {
+
+        if (pIdx->nNodes == pCtx->nMaxNodes)
+        {
+            uint32_t nMax = 0 == pCtx->nMaxNodes ? 1024 : 2 * pCtx->nMaxNodes;
+            void* pNew = realloc(pIdx->pNode, nMax * sizeof(AMLIDXNODE));
+
+            if (NULL == pNew)
+                break;
+
+            pIdx->pNode = pNew;
+            pCtx->nMaxNodes = nMax;
+        }
+
+        pNode = &pIdx->pNode[pIdx->nNodes];
+        pNode->strPath = arenastrdup(pIdx, strPath);
+
+        if (NULL == pNode->strPath)
+            break;
+
+        pNode->strHid = NULL;
+        pNode->Signature = pCtx->Signature;
+        pNode->Instance = pCtx->Instance;
+        pNode->Offset = (uint32_t)(pOp - pCtx->pTbl);
+        pNode->Opcode = Opcode;
+        pNode->Reserved = 0;
+        pNode->NextPath = AMLIDX_NIL;
+        pNode->NextHid = AMLIDX_NIL;
+
+        nRet = pIdx->nNodes++;
+
+    } while (0);
+
+    if (AMLIDX_NIL == nRet)
+        pCtx->fOutOfMem = true;
+
+    return nRet;
+}
+
+/** termlist()
+
+    Scan a TermList
+
+    @param[in] pCtx         scan context
+    @param[in] p            start of the TermList
+    @param[in] end          end of the TermList
+    @param[in] strScope     absolute path of the scope
+    @param[in] idxDevice    node of the enclosing device, AMLIDX_NIL if none
+    @param[in] nDepth       nesting level
+
+    @retval VOID
+
+**/
+static void termlist(AMLCTX* pCtx, const uint8_t* p, const uint8_t* end, const char* strScope, uint32_t idxDevice, uint32_t nDepth)
+{
+    char strPath[AMLPATH_MAX];
+    const uint8_t* pOp, * pEnd;
+    uint32_t idx;
+    uint16_t Opcode;
+
+    if (nDepth > AMLDEPTH_MAX)
+        return;
+
+    while (p < end && false == pCtx->fOutOfMem)
+    {
+        pOp = p;
+        Opcode = *p++;
+
+        if (0x5B == Opcode)                                         // ExtOpPrefix
+        {
+            if (p >= end)
+                break;
+            Opcode = 0x5B00 | *p++;
+        }
+
+        switch (Opcode)
+        {
+        case 0x10:                                                  // Scope
+            if (NULL == (pEnd = pkglength(&p, end)) || false == namestring(&p, pEnd, strScope, strPath))
+                return;
+            termlist(pCtx, p, pEnd, strPath, AMLIDX_NIL, nDepth + 1);
+            p = pEnd;
+            break;
+
+        case AMLOP_DEVICE:
+        case AMLOP_THERMALZONE:
+        case AMLOP_PROCESSOR:
+        case AMLOP_POWERRES:
+            if (NULL == (pEnd = pkglength(&p, end)) || false == namestring(&p, pEnd, strScope, strPath))
+                return;
+
+            idx = addnode(pCtx, pOp, Opcode, strPath);
+
+            if (AMLOP_PROCESSOR == Opcode)
+                p += 6;                                             // ProcID, PblkAddr, PblkLen
+            else if (AMLOP_POWERRES == Opcode)
+                p += 3;                                             // SystemLevel, ResourceOrder
+
+            termlist(pCtx, p, pEnd, strPath, AMLOP_DEVICE == Opcode ? idx : AMLIDX_NIL, nDepth + 1);
+            p = pEnd;
+            break;
+
+        case AMLOP_NAME:
+            if (false == namestring(&p, end, strScope, strPath))
+                return;
+
+            idx = addnode(pCtx, pOp, Opcode, strPath);
+
+            if (AMLIDX_NIL != idx && AMLIDX_NIL != idxDevice && 0 == memcmp(&pOp[1], "_HID", 4))
+            {
+                char strHid[16];
+
+                if (true == hid(p, end, strHid))
+                    pCtx->pIdx->pNode[idxDevice].strHid = arenastrdup(pCtx->pIdx, strHid);
+            }
+
+            if (NULL == (p = skipdata(p, end)))
+                return;
+            break;
+
+        case AMLOP_METHOD:
+            if (NULL == (pEnd = pkglength(&p, end)) || false == namestring(&p, pEnd, strScope, strPath))
+                return;
+            addnode(pCtx, pOp, Opcode, strPath);
+            p = pEnd;                                               // skip the method body
+            break;
+
+        case AMLOP_OPREGION:
+            if (false == namestring(&p, end, strScope, strPath))
+                return;
+            addnode(pCtx, pOp, Opcode, strPath);
+            p++;                                                    // RegionSpace
+            if (NULL == (p = skiptermarg(p, end)) || NULL == (p = skiptermarg(p, end)))
+                return;                                             // RegionOffset, RegionLen
+            break;
+
+        case 0x5B81: case 0x5B86: case 0x5B87:                      // Field, IndexField, BankField
+        case 0xA0: case 0xA1: case 0xA2:                            // If, Else, While
+        case 0x11: case 0x12: case 0x13:                            // Buffer, Package, VarPackage
+            if (NULL == (pEnd = pkglength(&p, end)))
+                return;
+            p = pEnd;
+            break;
+
+        case 0x15:                                                  // External
+            if (false == namestring(&p, end, strScope, strPath))
+                return;
+            p += 2;                                                 // ObjectType, ArgumentCount
+            break;
+
+        case 0x06:                                                  // Alias
+            if (false == namestring(&p, end, strScope, strPath) || false == namestring(&p, end, strScope, strPath))
+                return;
+            break;
+
+        case 0x5B01:                                                // Mutex
+            if (false == namestring(&p, end, strScope, strPath))
+                return;
+            p++;                                                    // SyncFlags
+            break;
+
+        case 0x5B02:                                                // Event
+            if (false == namestring(&p, end, strScope, strPath))
+                return;
+            break;
+
+        default:
+            return;                                                 // unknown length, skip the rest of the scope
+        }
+    }
+}
+
+/** buildhash()
+
+    Link all nodes into the path and _HID hash chains
+
+**/
+static bool buildhash(AMLIDX* pIdx)
+{
+    uint32_t i, h;
+
+    for (pIdx->nBuckets = 16; pIdx->nBuckets < pIdx->nNodes; pIdx->nBuckets *= 2)
+        ;
+
+    pIdx->pPathBucket = malloc(2 * pIdx->nBuckets * sizeof(uint32_t));
+
+    if (NULL == pIdx->pPathBucket)
+        return false;
+
+    pIdx->pHidBucket = &pIdx->pPathBucket[pIdx->nBuckets];
+    memset(pIdx->pPathBucket, 0xFF, 2 * pIdx->nBuckets * sizeof(uint32_t));   // AMLIDX_NIL
+
+    for (i = pIdx->nNodes; i-- > 0;)                                // reverse, first definition heads the chain
+    {
+        h = hash(pIdx->pNode[i].strPath) & (pIdx->nBuckets - 1);
+        pIdx->pNode[i].NextPath = pIdx->pPathBucket[h];
+        pIdx->pPathBucket[h] = i;
+
+        if (NULL != pIdx->pNode[i].strHid)
+        {
+            h = hash(pIdx->pNode[i].strHid) & (pIdx->nBuckets - 1);
+            pIdx->pNode[i].NextHid = pIdx->pHidBucket[h];
+            pIdx->pHidBucket[h] = i;
+        }
+    }
+
+    return true;
+}
+
+/** AmlIndexCreate4UEFI()
+Synopsis
+    AMLIDX* AmlIndexCreate4UEFI(void);
+Description
+    Scan the DSDT and all SSDTs and build the AML namespace index.
+    The index is kept until released by AmlIndexDestroy4UEFI().
+Paramters
+    none
+Returns
+    pointer to the index
+    NULL, if no DSDT available or out of memory
+**/
+AMLIDX* AmlIndexCreate4UEFI(void)
+{
+    AMLCTX Ctx;
+    FWTBLCURSOR Cur;
+    const void* pTbl;
+    uint32_t size, i;
+    AMLIDX* pIdx = calloc(1, sizeof(AMLIDX));
+    bool fOk = false;
+    INSTR_ENTER();
+
+    do {
+
+        if (NULL == pIdx)
+            break;
+
+        memset(&Ctx, 0, sizeof(Ctx));
+        Ctx.pIdx = pIdx;
+
+        //
+        // DSDT first, then the SSDTs in XSDT order
+        //
+        if (0 == GetSystemFirmwareTableView4UEFI('ACPI', 'TDSD', 0, NULL, NULL))
+            break;
+
+        for (i = 0; i < 2 && false == Ctx.fOutOfMem; i++)
+        {
+            FirmwareTableCursorInit4UEFI(&Cur, 'ACPI', 0 == i ? 'TDSD' : 'TDSS');
+
+            while (false == Ctx.fOutOfMem && 0 != (size = FirmwareTableCursorNext4UEFI(&Cur, &pTbl, NULL)))
+            {
+                if (size <= 36)                                     // sizeof(EFI_ACPI_DESCRIPTION_HEADER)
+                    continue;
+
+                Ctx.pTbl = pTbl;
+                Ctx.Signature = Cur.TableID;
+                Ctx.Instance = Cur.Instance;
+
+                termlist(&Ctx, &Ctx.pTbl[36], &Ctx.pTbl[size], "\\", AMLIDX_NIL, 0);
+            }
+        }
+
+        if (true == Ctx.fOutOfMem)
+            break;
+
+        fOk = buildhash(pIdx);
+
+    } while (0);
+
+    if (false == fOk)
+    {
+        AmlIndexDestroy4UEFI(pIdx);
+        pIdx = NULL;
+    }
+
+    INSTR_LEAVE(AmlIndexCreate, 0);
+
+    return pIdx;
+}
+
+/** AmlIndexDestroy4UEFI()
+Synopsis
+    void AmlIndexDestroy4UEFI(AMLIDX* pIdx);
+Description
+    Release an AML namespace index
+Paramters
+    AMLIDX* pIdx    :   index, may be NULL
+Returns
+    none
+**/
+void AmlIndexDestroy4UEFI(AMLIDX* pIdx)
+{
+    ARENACHUNK* pChunk, * pNext;
+    INSTR_ENTER();
+
+    if (NULL != pIdx)
+    {
+        for (pChunk = pIdx->pArena; NULL != pChunk; pChunk = pNext)
+        {
+            pNext = pChunk->pNext;
+            free(pChunk);
+        }
+
+        free(pIdx->pNode);
+        free(pIdx->pPathBucket);
+        free(pIdx);
+    }
+
+    INSTR_LEAVE(AmlIndexDestroy, 0);
+}
+
+/** AmlIndexFindPath4UEFI()
+Synopsis
+    const AMLIDXNODE* AmlIndexFindPath4UEFI(const AMLIDX* pIdx, const char* strPath);
+Description
+    Find a definition by its absolute path. Segments shorter than 4 characters
+    are padded with '_', e.g. "\\_SB.PCI0" finds "\\_SB_.PCI0".
+Paramters
+    const AMLIDX* pIdx  :   index
+    const char* strPath :   absolute path
+Returns
+    pointer to the first definition with that path
+    NULL, if not found
+**/
+const AMLIDXNODE* AmlIndexFindPath4UEFI(const AMLIDX* pIdx, const char* strPath)
+{
+    char strNorm[AMLPATH_MAX];
+    size_t len = 1, nSeg;
+    uint32_t idx;
+    const AMLIDXNODE* pRet = NULL;
+    INSTR_ENTER();
+
+    do {
+
+        if ('\\' != *strPath++)
+            break;
+
+        strNorm[0] = '\\';
+
+        while ('\0' != *strPath && len + 6 < AMLPATH_MAX)            // normalize to 4 character segments
+        {
+            if (len > 1)
+                strNorm[len++] = '.';
+
+            for (nSeg = 0; nSeg < 4 && '\0' != *strPath && '.' != *strPath; nSeg++)
+                strNorm[len++] = *strPath++;
+
+            for (; nSeg < 4; nSeg++)
+                strNorm[len++] = '_';
+
+            if ('.' == *strPath)
+                strPath++;
+        }
+
+        if ('\0' != *strPath)
+            break;                                                  // path too long
+
+        strNorm[len] = '\0';
+
+        for (idx = pIdx->pPathBucket[hash(strNorm) & (pIdx->nBuckets - 1)]; AMLIDX_NIL != idx; idx = pIdx->pNode[idx].NextPath)
+            if (0 == strcmp(strNorm, pIdx->pNode[idx].strPath))
+            {
+                pRet = &pIdx->pNode[idx];
+                break;
+            }
+
+    } while (0);
+
+    INSTR_LEAVE(AmlIndexFindPath, 0);
+
+    return pRet;
+}
+
+/** AmlIndexFindHid4UEFI()
+Synopsis
+    const AMLIDXNODE* AmlIndexFindHid4UEFI(const AMLIDX* pIdx, const char* strHid, const AMLIDXNODE* pPrev);
+Description
+    Find the devices with the given _HID
+Paramters
+    const AMLIDX* pIdx          :   index
+    const char* strHid          :   _HID, e.g. "PNP0A08" or "ACPI0007"
+    const AMLIDXNODE* pPrev     :   device returned by the previous call, NULL for the first one
+Returns
+    pointer to the device
+    NULL, if no more devices
+**/
+const AMLIDXNODE* AmlIndexFindHid4UEFI(const AMLIDX* pIdx, const char* strHid, const AMLIDXNODE* pPrev)
+{
+    uint32_t idx = NULL == pPrev ? pIdx->pHidBucket[hash(strHid) & (pIdx->nBuckets - 1)] : pPrev->NextHid;
+    const AMLIDXNODE* pRet = NULL;
+    INSTR_ENTER();
+
+    for (; AMLIDX_NIL != idx && NULL == pRet; idx = pIdx->pNode[idx].NextHid)
+        if (0 == strcmp(strHid, pIdx->pNode[idx].strHid))
+            pRet = &pIdx->pNode[idx];
+
+    INSTR_LEAVE(AmlIndexFindHid, 0);
+
+    return pRet;
+}
@@ -0,0 +1,80 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    CloseHandle.c
+
+Abstract:
+
+    Win32 API CloseHandle() for UEFI
+
+    Closes the handles of waitable objects created by this library.
+    Thread objects are released to the thread pool, when the thread has returned.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "Win324UEFI.h"
+
+/** CloseHandle()
+Synopsis
+    int CloseHandle4UEFI(void* hObject);
+    https://docs.microsoft.com/en-us/windows/win32/api/handleapi/nf-handleapi-closehandle#syntax
+Description
+    Closes an open object handle. An armed timer is cancelled before it is released,
+    a running thread continues.
+
+    NOTE: Timer handles can't be closed on APs, ERROR_NOT_SUPPORTED is set.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/handleapi/nf-handleapi-closehandle#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/handleapi/nf-handleapi-closehandle#return-value
+**/
+int CloseHandle4UEFI(void* hObject)
+{
+    WAITOBJ* pObj = hObject;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pObj)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        switch (pObj->Signature)
+        {
+            case WAITOBJ_TIMER:
+                if (0 <= __ThreadPoolSelf())                        // the timer wheel belongs to the BSP
+                {
+                    SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+                    break;
+                }
+                __TimerWheelCancel((TIMEROBJ*)pObj);
+                pObj->Signature = 0;                                // invalidate stale handles
+                free(pObj);
+                nRet = 1;
+                break;
+            case WAITOBJ_THREAD:
+                pObj->Signature = 0;
+                __ThreadRelease((THREADOBJ*)pObj);
+                nRet = 1;
+                break;
+            default:
+                SetLastError4UEFI(ERROR_INVALID_HANDLE);
+                break;
+        }
+
+    } while (0);
+
+    INSTR_LEAVE(CloseHandle, 0);
+
+    return nRet;
+}
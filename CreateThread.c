@@ -0,0 +1,145 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    CreateThread.c
+
+Abstract:
+
+    Win32 API CreateThread(), GetExitCodeThread() and GetCurrentThreadId() for UEFI
+
+    The thread runs to completion on an AP of the thread pool. The handle is
+    signaled when the thread function has returned.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Win324UEFI.h"
+
+/** CreateThread()
+Synopsis
+    void* CreateThread4UEFI(void* lpThreadAttributes, size_t dwStackSize, uint32_t (*lpStartAddress)(void* lpParameter), void* lpParameter, uint32_t dwCreationFlags, uint32_t* lpThreadId);
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-createthread#syntax
+Description
+    Creates a thread, that is queued to the thread pool.
+
+    NOTE: dwStackSize is ignored, the thread runs on the stack of the AP.
+    NOTE: CREATE_SUSPENDED is not supported.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-createthread#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-createthread#return-value
+**/
+void* CreateThread4UEFI(void* lpThreadAttributes, size_t dwStackSize, uint32_t (*lpStartAddress)(void* lpParameter), void* lpParameter, uint32_t dwCreationFlags, uint32_t* lpThreadId)
+{
+    THREADOBJ* pThread = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == lpStartAddress)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        if (CREATE_SUSPENDED & dwCreationFlags)
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        pThread = __ThreadAlloc();
+
+        if (NULL == pThread)
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        pThread->Hdr.Signature = WAITOBJ_THREAD;
+        pThread->pfnStart = lpStartAddress;
+        pThread->lpParameter = lpParameter;
+        pThread->nRef = 2;                                          // handle and execution
+
+        if (NULL != lpThreadId)
+            *lpThreadId = pThread->ThreadId;
+
+        __ThreadSubmit(pThread);
+
+    } while (0);
+
+    INSTR_LEAVE(CreateThread, 0);
+
+    return pThread;
+}
+
+/** GetExitCodeThread()
+Synopsis
+    int GetExitCodeThread4UEFI(void* hThread, uint32_t* lpExitCode);
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getexitcodethread#syntax
+Description
+    Retrieves the termination status of the specified thread, STILL_ACTIVE while it runs or is queued.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getexitcodethread#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getexitcodethread#return-value
+**/
+int GetExitCodeThread4UEFI(void* hThread, uint32_t* lpExitCode)
+{
+    THREADOBJ* pThread = hThread;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pThread || WAITOBJ_THREAD != pThread->Hdr.Signature)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        if (NULL == lpExitCode)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        *lpExitCode = pThread->ExitCode;
+        nRet = 1;
+
+    } while (0);
+
+    INSTR_LEAVE(GetExitCodeThread, 0);
+
+    return nRet;
+}
+
+/** GetCurrentThreadId()
+Synopsis
+    uint32_t GetCurrentThreadId4UEFI(void);
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getcurrentthreadid#syntax
+Description
+    Retrieves the thread identifier of the calling thread.
+
+    NOTE: The application itself is THREADID_MAIN, also while it helps running
+          queued items, these have their own identifier.
+Paramters
+    none
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getcurrentthreadid#return-value
+**/
+uint32_t GetCurrentThreadId4UEFI(void)
+{
+    uint32_t nRet;
+    INSTR_ENTER();
+
+    nRet = __ThreadSelfId();
+
+    INSTR_LEAVE(GetCurrentThreadId, 0);
+
+    return nRet;
+}
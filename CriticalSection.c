@@ -0,0 +1,173 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    CriticalSection.c
+
+Abstract:
+
+    Win32 API *CriticalSection*() for UEFI
+
+    The critical section is a test-and-test-and-set spin lock, that records the
+    owning thread, so that the owner can enter it recursively. A waiter spins
+    SpinCount PAUSE instructions, then with exponential backoff.
+
+    NOTE: Items run to completion, they are never preempted. The application must
+          not wait for an item, that enters a critical section owned by the application,
+          since the waiting application may run that item itself.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_InterlockedExchange, _ReadWriteBarrier)
+
+/** InitializeCriticalSection()
+Synopsis
+    void InitializeCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializecriticalsection#syntax
+Description
+    Initializes a critical section object.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializecriticalsection#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializecriticalsection#return-value
+**/
+void InitializeCriticalSection4UEFI(CRITSECT* lpCriticalSection)
+{
+    memset(lpCriticalSection, 0, sizeof(CRITSECT));
+}
+
+/** InitializeCriticalSectionAndSpinCount()
+Synopsis
+    int InitializeCriticalSectionAndSpinCount4UEFI(CRITSECT* lpCriticalSection, uint32_t dwSpinCount);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializecriticalsectionandspincount#syntax
+Description
+    Initializes a critical section object and sets the spin count for the critical section.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializecriticalsectionandspincount#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializecriticalsectionandspincount#return-value
+**/
+int InitializeCriticalSectionAndSpinCount4UEFI(CRITSECT* lpCriticalSection, uint32_t dwSpinCount)
+{
+    InitializeCriticalSection4UEFI(lpCriticalSection);
+    lpCriticalSection->SpinCount = dwSpinCount;
+
+    return 1;
+}
+
+/** EnterCriticalSection()
+Synopsis
+    void EnterCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-entercriticalsection#syntax
+Description
+    Waits for ownership of the specified critical section object.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-entercriticalsection#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-entercriticalsection#return-value
+**/
+void EnterCriticalSection4UEFI(CRITSECT* lpCriticalSection)
+{
+    uint32_t ThreadId = __ThreadSelfId(), nSpin = lpCriticalSection->SpinCount, Backoff = 1;
+
+    do {
+        if (ThreadId == lpCriticalSection->OwningThread)
+        {
+            lpCriticalSection->RecursionCount++;
+            break;
+        }
+
+        while (0 != lpCriticalSection->Lock || 0 != _InterlockedExchange(&lpCriticalSection->Lock, 1))
+        {
+            if (0 != nSpin)
+            {
+                nSpin--;
+                _mm_pause();
+            }
+            else
+                __SpinBackoff(&Backoff);
+        }
+
+        lpCriticalSection->OwningThread = ThreadId;
+        lpCriticalSection->RecursionCount = 1;
+
+    } while (0);
+}
+
+/** TryEnterCriticalSection()
+Synopsis
+    int TryEnterCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryentercriticalsection#syntax
+Description
+    Attempts to enter a critical section without blocking.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryentercriticalsection#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryentercriticalsection#return-value
+**/
+int TryEnterCriticalSection4UEFI(CRITSECT* lpCriticalSection)
+{
+    uint32_t ThreadId = __ThreadSelfId();
+    int nRet = 1;
+
+    if (ThreadId == lpCriticalSection->OwningThread)
+        lpCriticalSection->RecursionCount++;
+    else if (0 == lpCriticalSection->Lock && 0 == _InterlockedExchange(&lpCriticalSection->Lock, 1))
+    {
+        lpCriticalSection->OwningThread = ThreadId;
+        lpCriticalSection->RecursionCount = 1;
+    }
+    else
+        nRet = 0;
+
+    return nRet;
+}
+
+/** LeaveCriticalSection()
+Synopsis
+    void LeaveCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-leavecriticalsection#syntax
+Description
+    Releases ownership of the specified critical section object.
+
+    NOTE: Leaving a critical section, that is not owned by the calling thread, is ignored.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-leavecriticalsection#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-leavecriticalsection#return-value
+**/
+void LeaveCriticalSection4UEFI(CRITSECT* lpCriticalSection)
+{
+    if (__ThreadSelfId() == lpCriticalSection->OwningThread && 0 == --lpCriticalSection->RecursionCount)
+    {
+        lpCriticalSection->OwningThread = 0;
+        _ReadWriteBarrier();
+        lpCriticalSection->Lock = 0;                                // x64 stores are not reordered with older stores
+    }
+}
+
+/** DeleteCriticalSection()
+Synopsis
+    void DeleteCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-deletecriticalsection#syntax
+Description
+    Releases all resources used by an unowned critical section object.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-deletecriticalsection#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-deletecriticalsection#return-value
+**/
+void DeleteCriticalSection4UEFI(CRITSECT* lpCriticalSection)
+{
+    memset(lpCriticalSection, 0, sizeof(CRITSECT));
+}
@@ -20,10 +20,12 @@ Abstract:
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <Protocol\AcpiTable.h>
 #include <Guid\Acpi.h>
 #include <IndustryStandard/Acpi62.h>
 #include <Protocol\AcpiSystemDescriptionTable.h>
+#include "Win324UEFI.h"
 
 extern EFI_SYSTEM_TABLE* pEfiSystemTable;
 extern EFI_HANDLE hEfiImageHandle;
@@ -38,6 +40,8 @@ Description
     Enumerates all system firmware tables of the specified type.
     NOTE:   DSDT, XSDT is not returned by the function.
             If DataSize too small pFirmwareTableEnumBuffer is not touched
+            In validation mode a corrupt RSDP or XSDT returns 0 and sets ERROR_CRC
+            For 'RSMB' a single table ID 0 is returned
 Paramters
     https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-enumsystemfirmwaretables#parameters
 Returns
@@ -45,64 +49,51 @@ Returns
 **/
 uint32_t EnumSystemFirmwareTables4UEFI(uint32_t FirmwareTableProviderSignature, void* pFirmwareTableEnumBuffer, uint32_t BufferSize)
 {
-    static EFI_GUID EfiAcpi20TableGuid = EFI_ACPI_20_TABLE_GUID;
-    EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER* pRSD = NULL;
-    EFI_CONFIGURATION_TABLE* pCfg = pEfiSystemTable->ConfigurationTable;
-    EFI_ACPI_SDT_HEADER* pXSDT = NULL;
-    int i, n, nRet = 0;
+    ACPITBLIDX* pIdx = NULL;
+    int nRet = 0;
+    INSTR_ENTER();
 
     do
     {
-        if ((uint32_t)'ACPI' != FirmwareTableProviderSignature)
-            break;                                                          // currently only support 'ACPI'
-
-        for (i = 0; i < pEfiSystemTable->NumberOfTableEntries; i++)
+        if ((uint32_t)'RSMB' == FirmwareTableProviderSignature)
         {
-            int64_t qwSig;
-            char* pStr8 = NULL;
+            //
+            // a single table with ID 0, same as Windows
+            //
+            if (NULL == __SmbiosIdxGet())
+                break;
 
-            if (IsEqualGUID(&EfiAcpi20TableGuid, &pEfiSystemTable->ConfigurationTable[i].VendorGuid))
-            {
-                pRSD = pCfg[i].VendorTable;
+            nRet = sizeof(uint32_t);
 
-                qwSig = pRSD->Signature;
-                break;
-            }
+            if (BufferSize >= sizeof(uint32_t) && NULL != pFirmwareTableEnumBuffer)
+                memset(pFirmwareTableEnumBuffer, 0, sizeof(uint32_t));
+
+            break;
         }
 
-        if (NULL != pRSD)
+        if ((uint32_t)'ACPI' != FirmwareTableProviderSignature)
+            break;                                                          // currently only support 'ACPI' and 'RSMB'
+
+        pIdx = __AcpiTblIdxGet();
+
+        if (NULL != pIdx)
         {
-            pXSDT = (void*)pRSD->XsdtAddress;
-            EFI_ACPI_2_0_COMMON_HEADER* pTBLEnd = (void*)&(((char*)pXSDT)[pXSDT->Length]);
-            EFI_ACPI_2_0_COMMON_HEADER** ppTBL = (void*)&(((char*)pXSDT)[sizeof(EFI_ACPI_SDT_HEADER)]);
-            ptrdiff_t numtbl = pTBLEnd - (EFI_ACPI_2_0_COMMON_HEADER*)ppTBL;
-            uint32_t* pSig32 = (void*)pFirmwareTableEnumBuffer;
+            if (false == __AcpiTblIdxValid(__AcpiTblIdxFind('TDSX', 0)))
+                break;                                              // corrupt RSDP or XSDT, ERROR_CRC
 
-            nRet = (int)numtbl * sizeof('FACP');
+            nRet = (int)pIdx->nXsdtEntries * sizeof('FACP');
 
-            if (BufferSize < numtbl * sizeof('FACP'))
+            if (BufferSize < pIdx->nXsdtEntries * sizeof('FACP'))
                 break;                                              // if buffersize too small, break
 
             if (NULL == pFirmwareTableEnumBuffer)
                 break;                                              // if NULL buffer, break
 
-
-            //printf("Signature   : %p -> %c%c%c%c\n", pXSDT, 0xFF & (pXSDT->Signature >> 0), 0xFF & (pXSDT->Signature >> 8), 0xFF & (pXSDT->Signature >> 16), 0xFF & (pXSDT->Signature >> 24));
-            //printf("Length      : %d\n", pXSDT->Length);
-            //printf("Revision    : %d\n", pXSDT->Revision);
-            //printf("Checksum    : %02X\n", pXSDT->Checksum);
-
-            //printf("numtbl %d\n", (int)numtbl);
-
-            n = 0;
-            while ((void*)pTBLEnd > (void*)ppTBL)
-            {
-                //printf("Signature %2d: %p -> %s\n", n, *ppTBL, strAcpiSig32((*ppTBL)->Signature, NULL));
-                *pSig32++ = (*ppTBL)->Signature;
-                ppTBL++;
-            }
+            memcpy(pFirmwareTableEnumBuffer, pIdx->pSig32, pIdx->nXsdtEntries * sizeof('FACP'));
         }
     } while (0);
 
+    INSTR_LEAVE(EnumSystemFirmwareTables, NULL != pFirmwareTableEnumBuffer && (uint32_t)nRet <= BufferSize ? nRet : 0);
+
     return nRet;
 }
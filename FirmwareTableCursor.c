@@ -0,0 +1,243 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    FirmwareTableCursor.c
+
+Abstract:
+
+    Cursor over the ACPI table index
+
+    Each call of FirmwareTableCursorNext4UEFI() resumes at the position of the
+    previous call, so that walking all instances of a signature is O(n).
+    Tables are filtered by OEM ID, OEM Table ID and revision in place, without copying.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <Protocol\AcpiSystemDescriptionTable.h>
+#include "Win324UEFI.h"
+
+/** lowerbound()
+
+    Binary search the first index entry that is not below Signature, Instance
+
+    @param[in] pIdx         ACPI table index
+    @param[in] Signature    table signature
+    @param[in] Instance     instance
+
+    @retval position in pIdx->pEntry[], pIdx->nEntries if none
+
+**/
+static uint32_t lowerbound(const ACPITBLIDX* pIdx, uint32_t Signature, uint32_t Instance)
+{
+    uint32_t lo = 0, hi = pIdx->nEntries;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const ACPITBLIDXENTRY* pEntry = &pIdx->pEntry[mid];
+
+        if (pEntry->Signature < Signature || (pEntry->Signature == Signature && pEntry->Instance < Instance))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/** setfield()
+
+    Copy a filter string into a blank padded header field
+
+**/
+static void setfield(char* pField, size_t size, const char* str)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        pField[i] = (NULL != str && '\0' != *str) ? *str++ : ' ';
+}
+
+/** match()
+
+    Check a table against the filter of the cursor
+
+    @param[in] pCursor  cursor
+    @param[in] pEntry   index entry
+
+    @retval true    table passes the filter
+    @retval false   table is filtered out
+
+**/
+static bool match(const FWTBLCURSOR* pCursor, const ACPITBLIDXENTRY* pEntry)
+{
+    const EFI_ACPI_SDT_HEADER* pHdr = pEntry->pTable;
+    bool fRet = false;
+
+    do {
+
+        if (0 == pCursor->Flags)
+        {
+            fRet = true;
+            break;
+        }
+
+        if ('SCAF' == pEntry->Signature || pEntry->Length < sizeof(EFI_ACPI_SDT_HEADER))
+            break;                                                          // FACS has no OEM fields
+
+        if ((FWTBLFLT_OEMID & pCursor->Flags) && memcmp(pHdr->OemId, pCursor->OemId, sizeof(pHdr->OemId)))
+            break;
+
+        if ((FWTBLFLT_OEMTABLEID & pCursor->Flags) && memcmp(pHdr->OemTableId, pCursor->OemTableId, sizeof(pHdr->OemTableId)))
+            break;
+
+        if ((FWTBLFLT_REVISION & pCursor->Flags) && pHdr->Revision < pCursor->Revision)
+            break;
+
+        if ((FWTBLFLT_OEMREVISION & pCursor->Flags) && pHdr->OemRevision < pCursor->OemRevision)
+            break;
+
+        fRet = true;
+
+    } while (0);
+
+    return fRet;
+}
+
+/** FirmwareTableCursorInit4UEFI()
+Synopsis
+    void FirmwareTableCursorInit4UEFI(FWTBLCURSOR* pCursor, uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID);
+Description
+    Initialize a cursor to the first table with the given signature, without filter
+Paramters
+    FWTBLCURSOR* pCursor                    :   cursor
+    uint32_t FirmwareTableProviderSignature :   'ACPI'
+    uint32_t FirmwareTableID                :   table signature, e.g. 'TDSS', 0 for all tables
+Returns
+    none
+**/
+void FirmwareTableCursorInit4UEFI(FWTBLCURSOR* pCursor, uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID)
+{
+    INSTR_ENTER();
+
+    memset(pCursor, 0, sizeof(FWTBLCURSOR));
+
+    pCursor->Provider = FirmwareTableProviderSignature;
+    pCursor->Signature = FirmwareTableID;
+
+    INSTR_LEAVE(FirmwareTableCursorInit, 0);
+}
+
+/** FirmwareTableCursorFilter4UEFI()
+Synopsis
+    void FirmwareTableCursorFilter4UEFI(FWTBLCURSOR* pCursor, uint32_t Flags, const char* strOemId, const char* strOemTableId, uint8_t Revision, uint32_t OemRevision);
+Description
+    Set the filter of a cursor. Only the values selected by Flags are considered.
+    Tables without OEM fields, that is the FACS, never pass a filter.
+Paramters
+    FWTBLCURSOR* pCursor        :   cursor
+    uint32_t Flags              :   FWTBLFLT_OEMID, FWTBLFLT_OEMTABLEID, FWTBLFLT_REVISION, FWTBLFLT_OEMREVISION
+    const char* strOemId        :   OEM ID, up to 6 characters
+    const char* strOemTableId   :   OEM Table ID, up to 8 characters
+    uint8_t Revision            :   minimum table revision
+    uint32_t OemRevision        :   minimum OEM revision
+Returns
+    none
+**/
+void FirmwareTableCursorFilter4UEFI(FWTBLCURSOR* pCursor, uint32_t Flags, const char* strOemId, const char* strOemTableId, uint8_t Revision, uint32_t OemRevision)
+{
+    INSTR_ENTER();
+
+    pCursor->Flags = Flags;
+    setfield(pCursor->OemId, sizeof(pCursor->OemId), strOemId);
+    setfield(pCursor->OemTableId, sizeof(pCursor->OemTableId), strOemTableId);
+    pCursor->Revision = Revision;
+    pCursor->OemRevision = OemRevision;
+
+    INSTR_LEAVE(FirmwareTableCursorFilter, 0);
+}
+
+/** FirmwareTableCursorNext4UEFI()
+Synopsis
+    uint32_t FirmwareTableCursorNext4UEFI(FWTBLCURSOR* pCursor, const void** ppFirmwareTable, uint64_t* pAddress);
+Description
+    Get the next table, that matches signature and filter of the cursor.
+
+    NOTE:   If the index was rebuilt in between, the cursor continues behind the table
+            returned last.
+            In validation mode corrupt tables are skipped and the last error is set to ERROR_CRC.
+Paramters
+    FWTBLCURSOR* pCursor            :   cursor
+    const void** ppFirmwareTable    :   receives read-only pointer to the table, may be NULL
+    uint64_t* pAddress              :   receives physical address of the table, may be NULL
+Returns
+    size of the table in bytes
+    0, if no more tables
+**/
+uint32_t FirmwareTableCursorNext4UEFI(FWTBLCURSOR* pCursor, const void** ppFirmwareTable, uint64_t* pAddress)
+{
+    ACPITBLIDX* pIdx = NULL;
+    const ACPITBLIDXENTRY* pEntry = NULL;
+    uint32_t nRet = 0;
+    INSTR_ENTER();
+
+    do {
+
+        if ('ACPI' != pCursor->Provider)
+            break;                                                          // currently only support 'ACPI'
+
+        pIdx = __AcpiTblIdxGet();
+
+        if (NULL == pIdx)
+            break;
+
+        if (0 == pCursor->Generation)                                       // first call
+            pCursor->Position = lowerbound(pIdx, pCursor->Signature, 0);
+        else if (pIdx->Generation != pCursor->Generation)                   // index rebuilt, resume behind the last table
+            pCursor->Position = 0 == pCursor->TableID
+                ? lowerbound(pIdx, pCursor->Signature, 0)
+                : lowerbound(pIdx, pCursor->TableID, pCursor->Instance + 1);
+
+        pCursor->Generation = pIdx->Generation;
+
+        while (pCursor->Position < pIdx->nEntries)
+        {
+            pEntry = &pIdx->pEntry[pCursor->Position];
+
+            if (0 != pCursor->Signature && pCursor->Signature != pEntry->Signature)
+                break;                                                      // behind the last instance
+
+            pCursor->Position++;
+
+            if (true == match(pCursor, pEntry) && true == __AcpiTblIdxValid(pEntry))
+            {
+                pCursor->TableID = pEntry->Signature;
+                pCursor->Instance = pEntry->Instance;
+
+                if (NULL != ppFirmwareTable)
+                    *ppFirmwareTable = pEntry->pTable;
+
+                if (NULL != pAddress)
+                    *pAddress = pEntry->Address;
+
+                nRet = pEntry->Length;
+                break;
+            }
+        }
+
+    } while (0);
+
+    INSTR_LEAVE(FirmwareTableCursorNext, 0);
+
+    return nRet;
+}
@@ -0,0 +1,164 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetFirmwareTableSnapshot.c
+
+Abstract:
+
+    Capture all firmware tables in one pass into a single contiguous image
+
+    The image can be written to a file with a single write and replayed
+    by LoadFirmwareTableSnapshot4UEFI(). See FWSNAPHDR for the layout.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+/** GetFirmwareTableSnapshot4UEFI()
+Synopsis
+    uint64_t GetFirmwareTableSnapshot4UEFI(uint32_t FirmwareTableProviderSignature, void* pImage, uint64_t ImageSize);
+Description
+    Write all tables of the firmware table provider into a caller provided buffer:
+    the XSDT, all tables referenced by the XSDT including each SSDT instance and
+    the DSDT/FACS referenced by the FADT.
+
+    NOTE:   If ImageSize is too small or pImage is NULL, the buffer is not touched
+            and only the required size is returned
+Paramters
+    uint32_t FirmwareTableProviderSignature :   'ACPI'
+    void* pImage                            :   buffer that receives the image, 8 byte aligned
+    uint64_t ImageSize                      :   size of the buffer in bytes
+Returns
+    size of the image in bytes
+    0, if no tables available
+**/
+uint64_t GetFirmwareTableSnapshot4UEFI(uint32_t FirmwareTableProviderSignature, void* pImage, uint64_t ImageSize)
+{
+    ACPITBLIDX* pIdx = NULL;
+    FWSNAPHDR* pHdr = pImage;
+    FWSNAPDIRENTRY* pDir;
+    uint64_t qwSize = 0, qwOffs;
+    uint32_t i;
+    INSTR_ENTER();
+
+    do {
+
+        if ('ACPI' != FirmwareTableProviderSignature)
+            break;                                                          // currently only support 'ACPI'
+
+        pIdx = __AcpiTblIdxGet();
+
+        if (NULL == pIdx)
+            break;
+
+        //
+        // get the size: header, directory, XSDT signatures, payloads
+        //
+        qwOffs = ALIGN8(sizeof(FWSNAPHDR) + pIdx->nEntries * sizeof(FWSNAPDIRENTRY) + pIdx->nXsdtEntries * sizeof(uint32_t));
+
+        qwSize = qwOffs;
+        for (i = 0; i < pIdx->nEntries; i++)
+            qwSize += ALIGN8(pIdx->pEntry[i].Length);
+
+        if (NULL == pImage || ImageSize < qwSize)
+            break;                                                          // buffer too small, return size only
+
+        pHdr->Signature = FWSNAP_SIGNATURE;
+        pHdr->Version = FWSNAP_VERSION;
+        pHdr->HdrSize = sizeof(FWSNAPHDR);
+        pHdr->nEntries = pIdx->nEntries;
+        pHdr->nXsdtEntries = pIdx->nXsdtEntries;
+        pHdr->ImageSize = qwSize;
+        pHdr->RsdpAddress = pIdx->RsdpAddress;
+
+        pDir = (void*)&pHdr[1];
+
+        memcpy(&pDir[pIdx->nEntries], pIdx->pSig32, pIdx->nXsdtEntries * sizeof(uint32_t));
+
+        //
+        // directory and payloads, in index order that is already sorted by Signature, Instance
+        //
+        for (i = 0; i < pIdx->nEntries; i++)
+        {
+            const ACPITBLIDXENTRY* pEntry = &pIdx->pEntry[i];
+            uint32_t pad = (uint32_t)(ALIGN8(pEntry->Length) - pEntry->Length);
+
+            pDir[i].Provider = FirmwareTableProviderSignature;
+            pDir[i].Signature = pEntry->Signature;
+            pDir[i].Instance = pEntry->Instance;
+            pDir[i].Length = pEntry->Length;
+            pDir[i].Address = pEntry->Address;
+            pDir[i].Offset = qwOffs;
+
+            memcpy(&((char*)pImage)[qwOffs], pEntry->pTable, pEntry->Length);
+            memset(&((char*)pImage)[qwOffs + pEntry->Length], 0, pad);
+
+            qwOffs += pEntry->Length + pad;
+        }
+
+        //
+        // clear the gap between XSDT signatures and the first payload
+        //
+        qwOffs = sizeof(FWSNAPHDR) + pIdx->nEntries * sizeof(FWSNAPDIRENTRY) + pIdx->nXsdtEntries * sizeof(uint32_t);
+        memset(&((char*)pImage)[qwOffs], 0, (size_t)(ALIGN8(qwOffs) - qwOffs));
+
+    } while (0);
+
+    INSTR_LEAVE(GetFirmwareTableSnapshot, NULL != pImage && qwSize <= ImageSize ? qwSize : 0);
+
+    return qwSize;
+}
+
+/** CreateFirmwareTableSnapshot4UEFI()
+Synopsis
+    void* CreateFirmwareTableSnapshot4UEFI(uint32_t FirmwareTableProviderSignature, uint64_t* pImageSize);
+Description
+    Allocate a buffer and capture all firmware tables into it, see GetFirmwareTableSnapshot4UEFI()
+Paramters
+    uint32_t FirmwareTableProviderSignature :   'ACPI'
+    uint64_t* pImageSize                    :   receives the size of the image, may be NULL
+Returns
+    pointer to the image, to be released by free()
+    NULL, if no tables available or out of memory
+**/
+void* CreateFirmwareTableSnapshot4UEFI(uint32_t FirmwareTableProviderSignature, uint64_t* pImageSize)
+{
+    uint64_t qwSize;
+    void* pImage = NULL;
+    INSTR_ENTER();
+
+    qwSize = GetFirmwareTableSnapshot4UEFI(FirmwareTableProviderSignature, NULL, 0);
+
+    do {
+
+        if (0 == qwSize || qwSize != (size_t)qwSize)
+            break;
+
+        pImage = malloc((size_t)qwSize);
+
+        if (NULL == pImage)
+            break;
+
+        GetFirmwareTableSnapshot4UEFI(FirmwareTableProviderSignature, pImage, qwSize);
+
+        if (NULL != pImageSize)
+            *pImageSize = qwSize;
+
+    } while (0);
+
+    INSTR_LEAVE(CreateFirmwareTableSnapshot, NULL != pImage ? qwSize : 0);
+
+    return pImage;
+}
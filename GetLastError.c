@@ -0,0 +1,63 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetLastError.c
+
+Abstract:
+
+    Win32 API GetLastError()/SetLastError() for UEFI
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include "Win324UEFI.h"
+
+static uint32_t dwLastError = ERROR_SUCCESS;
+
+/** GetLastError()
+Synopsis
+    uint32_t GetLastError(void);
+    https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror#syntax
+Description
+    Retrieves the last-error code value set by a Win324UEFI function.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror#return-value
+**/
+uint32_t GetLastError4UEFI(void)
+{
+    uint32_t dwRet;
+    INSTR_ENTER();
+
+    dwRet = dwLastError;
+
+    INSTR_LEAVE(GetLastError, 0);
+
+    return dwRet;
+}
+
+/** SetLastError()
+Synopsis
+    void SetLastError(uint32_t dwErrCode);
+    https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-setlasterror#syntax
+Description
+    Sets the last-error code.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-setlasterror#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-setlasterror#return-value
+**/
+void SetLastError4UEFI(uint32_t dwErrCode)
+{
+    INSTR_ENTER();
+
+    dwLastError = dwErrCode;
+
+    INSTR_LEAVE(SetLastError, 0);
+}
@@ -0,0 +1,110 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetLogicalProcessorInformationEx.c
+
+Abstract:
+
+    Win32 API GetLogicalProcessorInformationEx() and GetCurrentProcessorNumberEx() for UEFI
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+/** GetLogicalProcessorInformationEx()
+Synopsis
+    int GetLogicalProcessorInformationEx4UEFI(uint32_t RelationshipType, LOGPROCINFOEX* Buffer, uint32_t* ReturnedLength);
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlogicalprocessorinformationex#syntax
+Description
+    Retrieves information about the relationships of logical processors and related hardware.
+
+    NOTE: LOGPROCREL_CACHE returns no records.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlogicalprocessorinformationex#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlogicalprocessorinformationex#return-value
+**/
+int GetLogicalProcessorInformationEx4UEFI(uint32_t RelationshipType, LOGPROCINFOEX* Buffer, uint32_t* ReturnedLength)
+{
+    TOPOIDX* pIdx;
+    uint32_t First, Size;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+
+        pIdx = __TopologyIdxGet();
+
+        if (NULL == pIdx)
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        if (NULL == ReturnedLength || (LOGPROCREL_ALL != RelationshipType && LOGPROCREL_GROUP < RelationshipType))
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        First = LOGPROCREL_ALL == RelationshipType ? 0 : pIdx->InfoFirst[RelationshipType];
+        Size = (LOGPROCREL_ALL == RelationshipType ? pIdx->cbInfo : pIdx->InfoFirst[RelationshipType + 1]) - First;
+
+        if (NULL == Buffer || *ReturnedLength < Size)
+        {
+            *ReturnedLength = Size;
+            SetLastError4UEFI(ERROR_INSUFFICIENT_BUFFER);
+            break;
+        }
+
+        memcpy(Buffer, &pIdx->pInfo[First], Size);
+        *ReturnedLength = Size;
+        nRet = 1;
+
+    } while (0);
+
+    INSTR_LEAVE(GetLogicalProcessorInformationEx, 0);
+
+    return nRet;
+}
+
+/** GetCurrentProcessorNumberEx()
+Synopsis
+    void GetCurrentProcessorNumberEx4UEFI(PROCNUMBER* ProcNumber);
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getcurrentprocessornumberex#syntax
+Description
+    Retrieves the processor group and number of the logical processor in which the calling thread is running.
+
+    NOTE: The processor is identified by its APIC ID, safe on APs once the topology index is built.
+          An APIC ID not listed in the MADT returns group 0, number 0.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getcurrentprocessornumberex#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-getcurrentprocessornumberex#return-value
+**/
+void GetCurrentProcessorNumberEx4UEFI(PROCNUMBER* ProcNumber)
+{
+    const TOPOCPU* pCpu = NULL;
+    INSTR_ENTER();
+
+    if (NULL != __TopologyIdxGet())
+        pCpu = __TopologyIdxFindApic(__ApicId());
+
+    memset(ProcNumber, 0, sizeof(PROCNUMBER));
+
+    if (NULL != pCpu)
+    {
+        ProcNumber->Group = pCpu->Group;
+        ProcNumber->Number = pCpu->Number;
+    }
+
+    INSTR_LEAVE(GetCurrentProcessorNumberEx, 0);
+}
@@ -27,11 +27,9 @@ Abstract:
 #include <string.h>
 #include <Guid\Acpi.h>
 #include <Protocol\AcpiSystemDescriptionTable.h>
-
-#define CDETRACE(msg) printf(__FILE__"(%d) \\ " __FUNCTION__"(): ", __LINE__ ), printf msg
+#include "Win324UEFI.h"
 
 #define IsEqualGUID(rguid1, rguid2) (!memcmp(rguid1, rguid2, sizeof(GUID))) //guiddef.h
-//#define CDETRACE(msg) printf(__FILE__"(%d) \\ " __FUNCTION__"(): ", __LINE__ ), printf msg
 //
 //  warning C4273: 'GetSystemFirmwareTable': inconsistent dll linkage
 // 
@@ -51,6 +49,9 @@ Description
     Retrieves the specified firmware table from the firmware table provider.
     
     NOTE: This is an extended version that allows to pass the instance of SSDT as an additional parameter
+          GetSystemFirmwareTableInstance4UEFI() takes instance and address as typed parameters
+          GetSystemFirmwareTableView4UEFI() returns a pointer to the table instead of a copy
+          FirmwareTableCursorNext4UEFI() walks all instances and filters by OEM ID, OEM Table ID and revision
 
 Paramters
     https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemfirmwaretable#parameters
@@ -67,41 +68,28 @@ uint32_t EFIAPI GetSystemFirmwareTable4UEFI(
         //      2. UINT32 Instance
 )
 {
-    static EFI_GUID EfiAcpi20TableGuid = EFI_ACPI_20_TABLE_GUID;
-    EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER* pRSD = NULL;
-    EFI_CONFIGURATION_TABLE* pCfg = pEfiSystemTable->ConfigurationTable;
     uint32_t nRet = 0;
-    int ssdtinstance = 0,i;
+    int ssdtinstance = 0;
     va_list ap;
     va_start(ap, BufferSize);
-    void* pTbl;
-    uint32_t sizeTbl;
-    bool foundTbl = false;
-    //
-    // NOTE: DSDT is _not_ located in the RSDT, but in the FACP == FADT
-    //       Therefore patch FirmwareTableID to FACP == FADT and get DSDT from there
-    //
-    bool fDSDT = 'TDSD' == FirmwareTableID;
     uint64_t *pAddress = NULL;
+    INSTR_ENTER();
 
-    //CDETRACE(("--> \nFirmwareTableProviderSignature: %c%c%c%c, \nFirmwareTableID: %c%c%c%c\n", 
-    //    0xFF & (FirmwareTableProviderSignature >> 24),
-    //    0xFF & (FirmwareTableProviderSignature >> 16),
-    //    0xFF & (FirmwareTableProviderSignature >> 8),
-    //    0xFF & (FirmwareTableProviderSignature >> 0),
-    //    0xFF & (FirmwareTableID >> 24),
-    //    0xFF & (FirmwareTableID >> 16),
-    //    0xFF & (FirmwareTableID >> 8),
-    //    0xFF & (FirmwareTableID >> 0)
-    //    ));
+    TRACE(GetSystemFirmwareTable, FirmwareTableProviderSignature, FirmwareTableID, pFirmwareTableBuffer, BufferSize);
     
     do {
 
-        if ('ACPI' != FirmwareTableProviderSignature)
-            break;                                                          // currently only support 'ACPI'
+        if ('RSMB' == FirmwareTableProviderSignature)
+        {
+            //
+            // NOTE: no variadic arg parameters for 'RSMB', same as Windows
+            //
+            nRet = GetSystemFirmwareTableInstance4UEFI(FirmwareTableProviderSignature, 0, 0, pFirmwareTableBuffer, BufferSize, NULL);
+            break;
+        }
 
-        if (fDSDT)
-            FirmwareTableID = 'PCAF';                                       // patch FirmwareTableID to FACP == FADT
+        if ('ACPI' != FirmwareTableProviderSignature)
+            break;                                                          // currently only support 'ACPI' and 'RSMB'
 
         //
         // get variadic arg parameters
@@ -109,93 +97,25 @@ uint32_t EFIAPI GetSystemFirmwareTable4UEFI(
         pAddress = va_arg(ap, void*);
         ssdtinstance = va_arg(ap, int);
 
-        if ('TDSS' != FirmwareTableID){
-            ssdtinstance = 0;
+        if ('TDSS' != FirmwareTableID)
+            ssdtinstance = 0;                                               // multiple instances only for SSDT
 
-            //printf("SSDT instance %d\n", ssdtinstance);
-        }
-        else {
-            //printf("%.4s\n", true == fDSDT ? "DSDT" : (char*)(&FirmwareTableID));
-        }
+        if (ssdtinstance < 0)
+            break;                                                          // negative instance never matches
 
-        //CDETRACE(("--> pEfiSystemTable->NumberOfTableEntries %zd\n", pEfiSystemTable->NumberOfTableEntries));
+        //
+        // NOTE: DSDT and FACS are _not_ located in the XSDT, but in the FACP == FADT.
+        //       GetSystemFirmwareTableView4UEFI() resolves them as 'TDSD' and 'SCAF'
+        //
+        nRet = GetSystemFirmwareTableInstance4UEFI(FirmwareTableProviderSignature, FirmwareTableID, (uint32_t)ssdtinstance, pFirmwareTableBuffer, BufferSize, pAddress);
 
-        for (i = 0; i < pEfiSystemTable->NumberOfTableEntries; i++)
-        {
-            int64_t qwSig;
-            char* pStr8 = NULL;
-
-            if (IsEqualGUID(&EfiAcpi20TableGuid, &pEfiSystemTable->ConfigurationTable[i].VendorGuid))
-            {
-                pRSD = pCfg[i].VendorTable;
-                qwSig = pRSD->Signature;
-                break;
-            }
-        }
+        TRACE(GetSystemFirmwareTableAcpi, nRet, ssdtinstance, NULL == pAddress ? 0 : *pAddress, 0);
 
-        //CDETRACE(("--> pRSD %p\n", pRSD));
+    } while (0);
 
-        if (NULL != pRSD) do
-        {
-            EFI_ACPI_SDT_HEADER* pXSDT = (void*)pRSD->XsdtAddress;
-            EFI_ACPI_2_0_COMMON_HEADER* pTBLEnd = (void*)&(((char*)pXSDT)[pXSDT->Length]);
-            EFI_ACPI_2_0_COMMON_HEADER** ppTBL = (void*)&(((char*)pXSDT)[sizeof(EFI_ACPI_SDT_HEADER)]);
-            ptrdiff_t numTbl = pTBLEnd - (EFI_ACPI_2_0_COMMON_HEADER*)ppTBL, idxTbl;
-
-            if ('TDSX' == FirmwareTableID) {
-                pTbl = pXSDT;
-                sizeTbl = pXSDT->Length;
-                foundTbl = true;                                        // mark found flag and...
-                break;
-            }
-
-            for (idxTbl = 0; idxTbl < numTbl; idxTbl++, ppTBL++)        // walk through all tables in the XSDT
-            {                                                           //
-                if (FirmwareTableID == (*ppTBL)->Signature)             // if signatur match...
-                {                                                       //
-                    if ('TDSS' == FirmwareTableID)                      // if SSDT also consider ...
-                    {                                                   //
-                        if (0 != ssdtinstance) {                        // ... multiple table instances
-                            if (ssdtinstance >= 0)                      // if positive...
-                                ssdtinstance--;                         //  ... decrement instance counter
-                            continue;                                   //
-                        }                                               //
-                    }                                                   //
-                                                                        //
-                    if (false == fDSDT)                                 // check DSDT request
-                    {                                                   // 
-                        pTbl = *ppTBL;                                  // ... save table address
-                        sizeTbl = (*ppTBL)->Length;                     // save table length
-                        foundTbl = true;                                // mark found flag and...
-                        break;// for()                                  // ...break for()
-                    }                                                   //
-                    else                                                //
-                    {                                                   // DSDT request
-                        EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* pFADT//
-                            = (void*) * ppTBL;                          //
-                        uint64_t tmp64 = pFADT->Dsdt;                   // typecast 32 -> 64 1/2
-                        EFI_ACPI_2_0_COMMON_HEADER* pDSDT=(void*)tmp64; // typecast 32 -> 64 2/2
-                        pTbl = pDSDT;                                   //
-                        sizeTbl = pDSDT->Length;                        // save table length
-                        foundTbl = true;                                // mark found flag and...
-                        break;// for()                                  // ...break for()
-                    }                                                   //
-                }                                                       // 
-            }
-
-        } while (0);
-
-        if (true == foundTbl)
-        {
-            nRet = sizeTbl;
-            if (sizeTbl <= BufferSize)
-                if (NULL != pFirmwareTableBuffer) {
-                    memcpy(pFirmwareTableBuffer, pTbl, (size_t)sizeTbl);
-                    *pAddress = (uint64_t)pTbl;
-                }
-        }
+    va_end(ap);
 
-    } while (0);
+    INSTR_LEAVE(GetSystemFirmwareTable, NULL != pFirmwareTableBuffer && nRet <= BufferSize ? nRet : 0);
 
     return nRet ;
-}
\ No newline at end of file
+}
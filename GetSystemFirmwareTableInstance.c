@@ -0,0 +1,72 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetSystemFirmwareTableInstance.c
+
+Abstract:
+
+    Typed companion of Win32 API GetSystemFirmwareTable() for UEFI, that takes
+    the table instance and address as regular parameters instead of the variadic tail
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+/** GetSystemFirmwareTableInstance()
+Synopsis
+    uint32_t GetSystemFirmwareTableInstance4UEFI(uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID, uint32_t Instance, void* pFirmwareTableBuffer, uint32_t BufferSize, uint64_t* pAddress);
+Description
+    Retrieves a copy of the specified instance of a firmware table.
+
+    NOTE:   Other than GetSystemFirmwareTable() the Instance parameter is considered for
+            all table signatures, not only for SSDT.
+            If BufferSize is too small or pFirmwareTableBuffer is NULL, the buffer is not
+            touched and only the required size is returned
+Paramters
+    uint32_t FirmwareTableProviderSignature :   'ACPI' or 'RSMB'
+    uint32_t FirmwareTableID                :   table signature, e.g. 'TDSS' for SSDT
+    uint32_t Instance                       :   instance of the table, 0 for the first one
+    void* pFirmwareTableBuffer              :   buffer that receives the table
+    uint32_t BufferSize                     :   size of the buffer
+    uint64_t* pAddress                      :   receives physical address of the table, may be NULL
+Returns
+    size of the table in bytes
+    0, if the table was not found
+**/
+uint32_t EFIAPI GetSystemFirmwareTableInstance4UEFI(
+    uint32_t FirmwareTableProviderSignature,
+    uint32_t FirmwareTableID,
+    uint32_t Instance,
+    void* pFirmwareTableBuffer,
+    uint32_t BufferSize,
+    uint64_t* pAddress
+)
+{
+    const void* pTbl = NULL;
+    uint64_t qwAddress = 0;
+    uint32_t nRet = 0;
+    INSTR_ENTER();
+
+    nRet = GetSystemFirmwareTableView4UEFI(FirmwareTableProviderSignature, FirmwareTableID, Instance, &pTbl, &qwAddress);
+
+    if (0 != nRet && nRet <= BufferSize)
+        if (NULL != pFirmwareTableBuffer) {
+            memcpy(pFirmwareTableBuffer, pTbl, (size_t)nRet);
+            if (NULL != pAddress)
+                *pAddress = qwAddress;
+        }
+
+    INSTR_LEAVE(GetSystemFirmwareTableInstance, NULL != pFirmwareTableBuffer && nRet <= BufferSize ? nRet : 0);
+
+    return nRet;
+}
@@ -0,0 +1,108 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetSystemFirmwareTableView.c
+
+Abstract:
+
+    Zero-copy companion of Win32 API GetSystemFirmwareTable() for UEFI
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Win324UEFI.h"
+
+/** GetSystemFirmwareTableView()
+Synopsis
+    uint32_t GetSystemFirmwareTableView4UEFI(uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID, uint32_t Instance, const void** ppFirmwareTable, uint64_t* pAddress);
+Description
+    Retrieves a read-only pointer to the specified firmware table, instead of a copy.
+
+    NOTE:   In UEFI all firmware tables are mapped and readable. The table must not be
+            modified through the returned pointer.
+            While a snapshot image is loaded, the pointer refers into the image and
+            *pAddress is the physical address on the captured machine.
+            For 'RSMB' the Windows RawSMBIOSData layout is returned, *pAddress receives
+            the address of the SMBIOS structure table.
+            Other than GetSystemFirmwareTable() the Instance parameter is considered for
+            all table signatures, not only for SSDT.
+Paramters
+    uint32_t FirmwareTableProviderSignature :   'ACPI' or 'RSMB'
+    uint32_t FirmwareTableID                :   table signature, e.g. 'PCAF' for FACP,
+                                                'TDSD' for the DSDT, 'SCAF' for the FACS, 'TDSX' for the XSDT
+                                                ignored for 'RSMB'
+    uint32_t Instance                       :   instance of the table, 0 for the first one
+    const void** ppFirmwareTable            :   receives pointer to the table, may be NULL
+    uint64_t* pAddress                      :   receives physical address of the table, may be NULL
+Returns
+    size of the table in bytes
+    0, if the table was not found, or is corrupt in validation mode. GetLastError4UEFI() returns ERROR_CRC then.
+**/
+uint32_t EFIAPI GetSystemFirmwareTableView4UEFI(
+    uint32_t FirmwareTableProviderSignature,
+    uint32_t FirmwareTableID,
+    uint32_t Instance,
+    const void** ppFirmwareTable,
+    uint64_t* pAddress
+)
+{
+    const ACPITBLIDXENTRY* pEntry = NULL;
+    SMBIOSIDX* pSmbios = NULL;
+    uint32_t nRet = 0;
+    INSTR_ENTER();
+
+    do {
+
+        if ('RSMB' == FirmwareTableProviderSignature)
+        {
+            //
+            // NOTE: FirmwareTableID and Instance are ignored, there is only one SMBIOS table
+            //
+            pSmbios = __SmbiosIdxGet();
+
+            if (NULL == pSmbios)
+                break;
+
+            if (NULL != ppFirmwareTable)
+                *ppFirmwareTable = pSmbios->pRaw;
+
+            if (NULL != pAddress)
+                *pAddress = pSmbios->TableAddress;
+
+            nRet = pSmbios->RawSize;
+            break;
+        }
+
+        if ('ACPI' != FirmwareTableProviderSignature)
+            break;                                                          // currently only support 'ACPI' and 'RSMB'
+
+        pEntry = __AcpiTblIdxFind(FirmwareTableID, Instance);
+
+        if (NULL == pEntry)
+            break;
+
+        if (false == __AcpiTblIdxValid(pEntry))
+            break;                                                          // corrupt, ERROR_CRC
+
+        if (NULL != ppFirmwareTable)
+            *ppFirmwareTable = pEntry->pTable;
+
+        if (NULL != pAddress)
+            *pAddress = pEntry->Address;
+
+        nRet = pEntry->Length;
+
+    } while (0);
+
+    INSTR_LEAVE(GetSystemFirmwareTableView, 0);
+
+    return nRet;
+}
@@ -0,0 +1,128 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetSystemTime.c
+
+Abstract:
+
+    Win32 API GetSystemTime(), GetLocalTime() and FileTimeToSystemTime() for UEFI
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Win324UEFI.h"
+
+#define DAYS_1601_TO_1600_03_01 306     // days from March 1, 1600 to January 1, 1601
+
+/** systime()
+
+    Convert 100ns units since January 1, 1601 to a date and time of the gregorian calendar
+
+    @param[in]  qwFt    time in 100ns units since January 1, 1601
+    @param[out] pTime   receives the date and time
+
+    @retval VOID
+
+**/
+static void systime(uint64_t qwFt, SYSTIME* pTime)
+{
+    uint64_t qwSec = qwFt / SYSTIME_PER_SEC;
+    uint32_t Days = (uint32_t)(qwSec / 86400), Sec = (uint32_t)(qwSec % 86400);
+    uint32_t z = Days + DAYS_1601_TO_1600_03_01, doe, yoe, doy, mp;
+
+    doe = z % 146097;                                               // years start on March 1, in 400 year eras
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+
+    pTime->wMonth = (uint16_t)(mp < 10 ? mp + 3 : mp - 9);
+    pTime->wYear = (uint16_t)(1600 + z / 146097 * 400 + yoe + (pTime->wMonth <= 2));
+    pTime->wDay = (uint16_t)(doy - (153 * mp + 2) / 5 + 1);
+    pTime->wDayOfWeek = (uint16_t)((Days + 1) % 7);                 // January 1, 1601 was a Monday
+    pTime->wHour = (uint16_t)(Sec / 3600);
+    pTime->wMinute = (uint16_t)(Sec / 60 % 60);
+    pTime->wSecond = (uint16_t)(Sec % 60);
+    pTime->wMilliseconds = (uint16_t)(qwFt % SYSTIME_PER_SEC / 10000);
+}
+
+/** GetSystemTime()
+Synopsis
+    void GetSystemTime4UEFI(SYSTIME* lpSystemTime);
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtime#syntax
+Description
+    Retrieves the current system date and time in Coordinated Universal Time (UTC) format.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtime#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtime#return-value
+**/
+void GetSystemTime4UEFI(SYSTIME* lpSystemTime)
+{
+    INSTR_ENTER();
+
+    systime(__SystemTimeNow(), lpSystemTime);
+
+    INSTR_LEAVE(GetSystemTime, 0);
+}
+
+/** GetLocalTime()
+Synopsis
+    void GetLocalTime4UEFI(SYSTIME* lpSystemTime);
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlocaltime#syntax
+Description
+    Retrieves the current local date and time.
+
+    NOTE: The local time is UTC plus the EFI_TIME TimeZone and Daylight reported by the RTC.
+          For an RTC with EFI_UNSPECIFIED_TIMEZONE local time and UTC are the same.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlocaltime#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlocaltime#return-value
+**/
+void GetLocalTime4UEFI(SYSTIME* lpSystemTime)
+{
+    uint64_t qwFt;
+    INSTR_ENTER();
+
+    qwFt = __SystemTimeNow();
+    systime(qwFt + (int64_t)__SystemTimeBias() * 60 * (int64_t)SYSTIME_PER_SEC, lpSystemTime);
+
+    INSTR_LEAVE(GetLocalTime, 0);
+}
+
+/** FileTimeToSystemTime()
+Synopsis
+    int FileTimeToSystemTime4UEFI(const uint64_t* lpFileTime, SYSTIME* lpSystemTime);
+    https://docs.microsoft.com/en-us/windows/win32/api/timezoneapi/nf-timezoneapi-filetimetosystemtime#syntax
+Description
+    Converts a file time to system time format. System time is based on Coordinated Universal Time (UTC).
+
+    NOTE: The FILETIME is passed as uint64_t, same layout.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/timezoneapi/nf-timezoneapi-filetimetosystemtime#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/timezoneapi/nf-timezoneapi-filetimetosystemtime#return-value
+**/
+int FileTimeToSystemTime4UEFI(const uint64_t* lpFileTime, SYSTIME* lpSystemTime)
+{
+    int nRet = 0;
+    INSTR_ENTER();
+
+    if (0x8000000000000000ULL <= *lpFileTime)
+        SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+    else
+    {
+        systime(*lpFileTime, lpSystemTime);
+        nRet = 1;
+    }
+
+    INSTR_LEAVE(FileTimeToSystemTime, 0);
+
+    return nRet;
+}
@@ -0,0 +1,66 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetSystemTimeAsFileTime.c
+
+Abstract:
+
+    Win32 API GetSystemTimeAsFileTime() and GetSystemTimePreciseAsFileTime() for UEFI
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include "Win324UEFI.h"
+
+/** GetSystemTimeAsFileTime()
+Synopsis
+    void GetSystemTimeAsFileTime4UEFI(uint64_t* lpSystemTimeAsFileTime);
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtimeasfiletime#syntax
+Description
+    Retrieves the current system date and time. The information is in Coordinated Universal Time (UTC) format.
+
+    NOTE: The FILETIME is returned as uint64_t, same layout.
+    NOTE: The time is extrapolated from the TSC, same as GetSystemTimePreciseAsFileTime().
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtimeasfiletime#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtimeasfiletime#return-value
+**/
+void GetSystemTimeAsFileTime4UEFI(uint64_t* lpSystemTimeAsFileTime)
+{
+    INSTR_ENTER();
+
+    *lpSystemTimeAsFileTime = __SystemTimeNow();
+
+    INSTR_LEAVE(GetSystemTimeAsFileTime, 0);
+}
+
+/** GetSystemTimePreciseAsFileTime()
+Synopsis
+    void GetSystemTimePreciseAsFileTime4UEFI(uint64_t* lpSystemTimeAsFileTime);
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtimepreciseasfiletime#syntax
+Description
+    Retrieves the current system date and time with the highest possible level of precision (<1us).
+    The retrieved information is in Coordinated Universal Time (UTC) format.
+
+    NOTE: The FILETIME is returned as uint64_t, same layout.
+    NOTE: The RTC is read once on the BSP and anchored to the TSC, see __SystemTimeNow().
+          The first call on the BSP polls the RTC for the edge of its second, that takes up to one second.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtimepreciseasfiletime#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsystemtimepreciseasfiletime#return-value
+**/
+void GetSystemTimePreciseAsFileTime4UEFI(uint64_t* lpSystemTimeAsFileTime)
+{
+    INSTR_ENTER();
+
+    *lpSystemTimeAsFileTime = __SystemTimeNow();
+
+    INSTR_LEAVE(GetSystemTimePreciseAsFileTime, 0);
+}
@@ -0,0 +1,44 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    GetTickCount.c
+
+Abstract:
+
+    Win32 API GetTickCount() for UEFI
+
+    Retrieves the number of milliseconds that have elapsed since the system was started, up to 49.7 days.
+
+--*/
+#include <Uefi.h>
+#include <stdint.h>
+#include "Win324UEFI.h"
+
+/** GetTickCount()
+Synopsis
+    DWORD GetTickCount();
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-gettickcount#syntax
+Description
+    Retrieves the number of milliseconds that have elapsed since the system was started, up to 49.7 days.
+
+Paramters
+    
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-gettickcount#return-value
+**/
+uint32_t EFIAPI GetTickCount4UEFI(void)
+{
+    uint32_t dwRet;
+    INSTR_ENTER();
+
+    dwRet = (uint32_t)GetTickCount644UEFI();
+
+    INSTR_LEAVE(GetTickCount, 0);
+
+    return dwRet;
+}
@@ -17,7 +17,30 @@ Abstract:
 --*/
 #include <Uefi.h>
 #include <stdint.h>
-#include <time.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+static INITONCE ScaleOnce = INITONCE_STATIC_INIT;
+static TSCSCALE MsScale;
+
+/** scaleinit()
+
+    InitOnceExecuteOnce() callback, set up the TSC to millisecond conversion
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    not used
+    @param[in] Context      not used
+
+    @retval 1
+
+**/
+static int scaleinit(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    __TscScaleInit(&MsScale, 1000);
+
+    return 1;
+}
+
 /** GetTickCount64()
 Synopsis
     ULONGLONG GetTickCount64();
@@ -25,7 +48,8 @@ Synopsis
 Description
     Retrieves the number of milliseconds that have elapsed since the system was started.
     
-    NOTE:   Actually the number of millioseconds since the process was started.
+    NOTE:   The TSC is reset to 0 at platform reset and counts at a constant rate.
+            The TSC is converted to milliseconds by a precomputed multiplier, see __TscScaleInit()
 
 Paramters
     
@@ -34,5 +58,14 @@ Returns
 **/
 uint64_t EFIAPI GetTickCount644UEFI(void)
 {
-    return (uint64_t)clock();
+    uint64_t qwRet;
+    INSTR_ENTER();
+
+    InitOnceExecuteOnce4UEFI(&ScaleOnce, scaleinit, NULL, NULL);
+
+    qwRet = __TscScale(&MsScale, __rdtsc());
+
+    INSTR_LEAVE(GetTickCount64, 0);
+
+    return qwRet;
 }
@@ -0,0 +1,1015 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    HeapAlloc.c
+
+Abstract:
+
+    Win32 API Heap*() and GetProcessHeap() for UEFI
+
+    A heap reserves 1MiB arenas by AllocatePages() and carves them into 64KiB slabs,
+    each holding objects of a single size class. Slabs are aligned to their size, so
+    that the slab header of an object is found by masking its address.
+
+    Each processor has its own slot with the current slab per size class. Objects are
+    taken from the owner's free list, then from the never used rest of the slab, then
+    from the remote free list. All frees are pushed lock-free to the remote free list
+    of the slab. A full slab is retired by its owner, the first free to a retired slab
+    puts it on the partial list of the heap, from where it is picked up again.
+
+    Blocks larger than HEAP_MAX_SMALL get their own pages, also aligned to 64KiB.
+
+    HeapDestroy() releases all arenas and large blocks at once, without visiting objects.
+    Heaps, that are not destroyed by the application, are destroyed at exit.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_BitScanReverse64, _InterlockedExchange, _InterlockedCompareExchange, _InterlockedCompareExchangePointer, _InterlockedExchangePointer)
+
+#define HEAP_SIGNATURE      'PAEH'      // "HEAP"
+#define SLAB_SIGNATURE      'BALS'      // "SLAB"
+#define LARGE_SIGNATURE     'GRAL'      // "LARG"
+#define SLAB_HDR_SIZE       64          // objects start behind the header, 16 byte aligned
+#define LARGE_MAX_SIZE      (SIZE_MAX - SLAB_HDR_SIZE - VMEM_PAGE_SIZE) // page count of larger blocks wraps
+
+typedef struct _SLAB {
+    uint32_t Signature;                 // SLAB_SIGNATURE
+    uint16_t Class;                     // size class
+    uint16_t Size;                      // object size
+    struct _HEAPOBJ* pHeap;             // owning heap
+    void* pFree;                        // objects freed to the owner, owner only
+    uint8_t* pBump;                     // first never used object
+    void* volatile pRemote;             // objects freed lock-free, taken at once by the owner
+    volatile long fListed;              // owned by a slot or on the partial list
+    struct _SLAB* pNext;                // partial list
+    struct _SLAB* pNextArena;           // list of arenas, in the first slab of an arena only
+}SLAB;
+
+typedef struct _LARGEBLK {
+    uint32_t Signature;                 // LARGE_SIGNATURE
+    uint32_t Reserved;
+    struct _HEAPOBJ* pHeap;             // owning heap
+    struct _LARGEBLK* pNext;
+    struct _LARGEBLK* pPrev;
+    size_t nPages;                      // number of 4KiB pages, including the header
+    size_t Size;                        // requested size
+}LARGEBLK;
+
+typedef struct _HEAPSLOT {
+    volatile long Lock;                 // spin lock, taken for the shared slot only
+    int64_t cbAllocated;                // bytes allocated minus bytes freed on this slot
+    SLAB* pCur[HEAP_CLASSES];           // current slab per size class
+    uint8_t Pad[48];                    // one slot per 5 cache lines
+}HEAPSLOT;
+
+typedef struct _HEAPOBJ {
+    HEAPSLOT Slot[HEAP_SLOTS];          // first, cache line aligned by the page allocation
+    uint32_t Signature;                 // HEAP_SIGNATURE
+    uint32_t flOptions;                 // HeapCreate() flOptions
+    volatile long Lock;                 // arenas, partial lists and large blocks
+    size_t nPages;                      // number of pages of the HEAPOBJ
+    size_t cbMaxReserve;                // 0 if growable
+    size_t cbReserved;                  // arenas and large blocks
+    size_t cbCommitted;                 // slabs carved and large blocks
+    SLAB* pArena;                       // list of arenas, in the order reserved
+    SLAB* pArenaTail;
+    SLAB* pArenaCur;                    // arena slabs are carved from
+    uint8_t* pArenaNext;                // next slab to carve
+    uint8_t* pArenaEnd;
+    SLAB* pPartial[HEAP_CLASSES];       // retired slabs with free objects
+    LARGEBLK* pLarge;                   // list of large blocks
+    struct _HEAPOBJ* pNextHeap;         // list of all heaps
+}HEAPOBJ;
+
+static const uint16_t ClassSize[HEAP_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192
+};
+
+static HEAPOBJ* pHeapList;
+static bool fAtExit = false;
+static HEAPOBJ* pProcessHeap;
+static INITONCE ProcessHeapOnce = INITONCE_STATIC_INIT;
+
+/** sizeclass()
+
+    Get the size class of a small block: 16..128 in steps of 16, then 4 classes per power of 2
+
+    @param[in] n        requested size, HEAP_MAX_SMALL at most
+
+    @retval size class
+
+**/
+static uint32_t sizeclass(size_t n)
+{
+    unsigned long b;
+
+    if (n <= 128)
+        return n <= 16 ? 0 : (uint32_t)((n - 1) >> 4);
+
+    _BitScanReverse64(&b, n - 1);
+
+    return 8 + (b - 7) * 4 + (uint32_t)((n - 1) >> (b - 2)) - 4;
+}
+
+/** slotenter()
+
+    Get the slot of the calling processor. Slots are used by a single processor, only
+    the last one is shared by the processors beyond HEAP_SLOTS - 1 and needs the lock.
+
+    @param[in] pHeap    heap
+
+    @retval slot
+
+**/
+static HEAPSLOT* slotenter(HEAPOBJ* pHeap)
+{
+    int32_t Slot = __ThreadPoolSelf() + 1;
+    HEAPSLOT* pSlot = &pHeap->Slot[Slot < HEAP_SLOTS - 1 ? Slot : HEAP_SLOTS - 1];
+
+    if (&pHeap->Slot[HEAP_SLOTS - 1] == pSlot)
+        __SpinLock(&pSlot->Lock);
+
+    return pSlot;
+}
+
+/** slotleave()
+
+    Release the slot of the calling processor
+
+    @param[in] pHeap    heap
+    @param[in] pSlot    slot from slotenter()
+
+    @retval VOID
+
+**/
+static void slotleave(HEAPOBJ* pHeap, HEAPSLOT* pSlot)
+{
+    if (&pHeap->Slot[HEAP_SLOTS - 1] == pSlot)
+        __SpinUnlock(&pSlot->Lock);
+}
+
+/** reserve()
+
+    Reserve another arena and append it to the list of arenas
+
+    @param[in] pHeap    heap
+
+    @retval true    success
+    @retval false   out of memory, maximum size reached or called on an AP
+
+**/
+static bool reserve(HEAPOBJ* pHeap)
+{
+    SLAB* pArena = NULL;
+
+    if (0 == pHeap->cbMaxReserve || pHeap->cbReserved + HEAP_ARENA_SIZE <= pHeap->cbMaxReserve)
+        pArena = __PagesAlloc(HEAP_ARENA_SIZE / VMEM_PAGE_SIZE, HEAP_SLAB_SIZE / VMEM_PAGE_SIZE);
+
+    if (NULL != pArena)
+    {
+        pArena->pNextArena = NULL;
+
+        if (NULL != pHeap->pArenaTail)
+            pHeap->pArenaTail->pNextArena = pArena;
+        else
+            pHeap->pArena = pArena;
+
+        pHeap->pArenaTail = pArena;
+        pHeap->cbReserved += HEAP_ARENA_SIZE;
+    }
+
+    return NULL != pArena;
+}
+
+/** nextarena()
+
+    Continue carving slabs from the next arena, reserve one if all are used up.
+    The heap lock is held.
+
+    @param[in] pHeap    heap
+
+    @retval true    success
+    @retval false   out of memory, maximum size reached or called on an AP
+
+**/
+static bool nextarena(HEAPOBJ* pHeap)
+{
+    SLAB* pArena = NULL != pHeap->pArenaCur ? pHeap->pArenaCur->pNextArena : pHeap->pArena;
+
+    if (NULL == pArena && reserve(pHeap))
+        pArena = pHeap->pArenaTail;
+
+    if (NULL != pArena)
+    {
+        pHeap->pArenaCur = pArena;
+        pHeap->pArenaNext = (uint8_t*)pArena;
+        pHeap->pArenaEnd = (uint8_t*)pArena + HEAP_ARENA_SIZE;
+    }
+
+    return NULL != pArena;
+}
+
+/** newslab()
+
+    Get a slab for a size class, from the partial list or carved from an arena
+
+    @param[in] pHeap    heap
+    @param[in] Class    size class
+
+    @retval slab, owned by the caller
+    @retval NULL, if out of memory
+
+**/
+static SLAB* newslab(HEAPOBJ* pHeap, uint32_t Class)
+{
+    SLAB* pSlab;
+
+    __SpinLock(&pHeap->Lock);
+
+    do {
+        if (NULL != (pSlab = pHeap->pPartial[Class]))
+        {
+            pHeap->pPartial[Class] = pSlab->pNext;
+            break;
+        }
+
+        if (pHeap->pArenaNext == pHeap->pArenaEnd && false == nextarena(pHeap))
+            break;
+
+        pSlab = (SLAB*)pHeap->pArenaNext;
+        pHeap->pArenaNext += HEAP_SLAB_SIZE;
+        pHeap->cbCommitted += HEAP_SLAB_SIZE;
+
+        pSlab->Signature = SLAB_SIGNATURE;
+        pSlab->Class = (uint16_t)Class;
+        pSlab->Size = ClassSize[Class];
+        pSlab->pHeap = pHeap;
+        pSlab->pFree = NULL;
+        pSlab->pBump = (uint8_t*)pSlab + SLAB_HDR_SIZE;
+        pSlab->pRemote = NULL;
+
+    } while (0);
+
+    __SpinUnlock(&pHeap->Lock);
+
+    if (NULL != pSlab)
+        pSlab->fListed = 1;
+
+    return pSlab;
+}
+
+/** slaballoc()
+
+    Take an object from a slab owned by the caller
+
+    @param[in] pSlab    slab
+
+    @retval object
+    @retval NULL, if the slab is full
+
+**/
+static void* slaballoc(SLAB* pSlab)
+{
+    void* pRet = pSlab->pFree;
+
+    if (NULL == pRet && pSlab->pBump + pSlab->Size <= (uint8_t*)pSlab + HEAP_SLAB_SIZE)
+    {
+        pRet = pSlab->pBump;
+        pSlab->pBump += pSlab->Size;
+        return pRet;
+    }
+
+    if (NULL == pRet)
+        pRet = _InterlockedExchangePointer(&pSlab->pRemote, NULL);
+
+    if (NULL != pRet)
+        pSlab->pFree = *(void**)pRet;
+
+    return pRet;
+}
+
+/** retire()
+
+    Give up the ownership of a full slab. If objects were freed meanwhile, the
+    ownership is kept.
+
+    @param[in] pSlab    slab
+
+    @retval true    slab retired, the next free puts it on the partial list
+    @retval false   slab kept, objects available
+
+**/
+static bool retire(SLAB* pSlab)
+{
+    _InterlockedExchange(&pSlab->fListed, 0);                       // full fence, the store must not pass the load of pRemote
+
+    return NULL == pSlab->pRemote || 0 != _InterlockedCompareExchange(&pSlab->fListed, 1, 0);
+}
+
+/** smallalloc()
+
+    Allocate an object of a size class on the slot of the calling processor
+
+    @param[in] pHeap    heap
+    @param[in] Class    size class
+
+    @retval object
+    @retval NULL, if out of memory
+
+**/
+static void* smallalloc(HEAPOBJ* pHeap, uint32_t Class)
+{
+    HEAPSLOT* pSlot = slotenter(pHeap);
+    SLAB* pSlab;
+    void* pRet = NULL;
+
+    while (NULL != (pSlab = pSlot->pCur[Class]) && NULL == (pRet = slaballoc(pSlab)))
+        if (retire(pSlab))
+            pSlot->pCur[Class] = NULL;
+
+    if (NULL == pSlab && NULL != (pSlot->pCur[Class] = newslab(pHeap, Class)))
+        pRet = slaballoc(pSlot->pCur[Class]);
+
+    if (NULL != pRet)
+        pSlot->cbAllocated += ClassSize[Class];
+
+    slotleave(pHeap, pSlot);
+
+    return pRet;
+}
+
+/** smallfree()
+
+    Free an object to its slab, lock-free
+
+    @param[in] pHeap    heap
+    @param[in] pSlab    slab of the object
+    @param[in] pMem     object
+
+    @retval VOID
+
+**/
+static void smallfree(HEAPOBJ* pHeap, SLAB* pSlab, void* pMem)
+{
+    HEAPSLOT* pSlot = slotenter(pHeap);
+    void* pOld;
+
+    pSlot->cbAllocated -= pSlab->Size;
+    slotleave(pHeap, pSlot);
+
+    do {
+        pOld = pSlab->pRemote;
+        *(void**)pMem = pOld;
+    } while (pOld != _InterlockedCompareExchangePointer(&pSlab->pRemote, pMem, pOld));
+
+    if (0 == pSlab->fListed && 0 == _InterlockedCompareExchange(&pSlab->fListed, 1, 0))
+    {
+        __SpinLock(&pHeap->Lock);                                   // first free to a retired slab
+        pSlab->pNext = pHeap->pPartial[pSlab->Class];
+        pHeap->pPartial[pSlab->Class] = pSlab;
+        __SpinUnlock(&pHeap->Lock);
+    }
+}
+
+/** largealloc()
+
+    Allocate a block with its own pages, 64KiB aligned
+
+    @param[in] pHeap    heap
+    @param[in] dwBytes  requested size
+
+    @retval block
+    @retval NULL, if out of memory, larger than LARGE_MAX_SIZE or called on an AP
+
+**/
+static void* largealloc(HEAPOBJ* pHeap, size_t dwBytes)
+{
+    size_t nPages = (SLAB_HDR_SIZE + dwBytes + VMEM_PAGE_SIZE - 1) / VMEM_PAGE_SIZE;
+    LARGEBLK* pBlk = NULL;
+    HEAPSLOT* pSlot;
+
+    __SpinLock(&pHeap->Lock);
+
+    if (dwBytes > LARGE_MAX_SIZE)                                   // nPages has wrapped
+        pBlk = NULL;
+    else if (0 == pHeap->cbMaxReserve || pHeap->cbReserved + nPages * VMEM_PAGE_SIZE <= pHeap->cbMaxReserve)
+        pBlk = __PagesAlloc(nPages, HEAP_SLAB_SIZE / VMEM_PAGE_SIZE);
+
+    if (NULL != pBlk)
+    {
+        pBlk->Signature = LARGE_SIGNATURE;
+        pBlk->pHeap = pHeap;
+        pBlk->nPages = nPages;
+        pBlk->Size = dwBytes;
+        pBlk->pPrev = NULL;
+        pBlk->pNext = pHeap->pLarge;
+
+        if (NULL != pHeap->pLarge)
+            pHeap->pLarge->pPrev = pBlk;
+
+        pHeap->pLarge = pBlk;
+        pHeap->cbReserved += nPages * VMEM_PAGE_SIZE;
+        pHeap->cbCommitted += nPages * VMEM_PAGE_SIZE;
+    }
+
+    __SpinUnlock(&pHeap->Lock);
+
+    if (NULL != pBlk)
+    {
+        pSlot = slotenter(pHeap);
+        pSlot->cbAllocated += dwBytes;
+        slotleave(pHeap, pSlot);
+    }
+
+    return NULL != pBlk ? (uint8_t*)pBlk + SLAB_HDR_SIZE : NULL;
+}
+
+/** largefree()
+
+    Free a block with its own pages
+
+    @param[in] pHeap    heap
+    @param[in] pBlk     block header
+
+    @retval VOID
+
+**/
+static void largefree(HEAPOBJ* pHeap, LARGEBLK* pBlk)
+{
+    HEAPSLOT* pSlot = slotenter(pHeap);
+
+    pSlot->cbAllocated -= pBlk->Size;
+    slotleave(pHeap, pSlot);
+
+    __SpinLock(&pHeap->Lock);
+
+    if (NULL != pBlk->pPrev)
+        pBlk->pPrev->pNext = pBlk->pNext;
+    else
+        pHeap->pLarge = pBlk->pNext;
+
+    if (NULL != pBlk->pNext)
+        pBlk->pNext->pPrev = pBlk->pPrev;
+
+    pHeap->cbReserved -= pBlk->nPages * VMEM_PAGE_SIZE;
+    pHeap->cbCommitted -= pBlk->nPages * VMEM_PAGE_SIZE;
+
+    __SpinUnlock(&pHeap->Lock);
+
+    pBlk->Signature = 0;
+    __PagesFree(pBlk, pBlk->nPages);
+}
+
+/** block()
+
+    Get the header of a block and validate it
+
+    @param[in] pHeap    heap
+    @param[in] pMem     block
+
+    @retval SLAB_SIGNATURE or LARGE_SIGNATURE, ppHdr receives the header
+    @retval 0, if not a block of the heap
+
+**/
+static uint32_t block(HEAPOBJ* pHeap, const void* pMem, void** ppHdr)
+{
+    SLAB* pSlab = (SLAB*)((uintptr_t)pMem & ~(uintptr_t)(HEAP_SLAB_SIZE - 1));
+    uint32_t nRet = 0;
+
+    do {
+        if (NULL == pMem || (uint8_t*)pMem < (uint8_t*)pSlab + SLAB_HDR_SIZE)
+            break;
+
+        if (SLAB_SIGNATURE == pSlab->Signature && pHeap == pSlab->pHeap)
+        {
+            if (0 != ((uint8_t*)pMem - (uint8_t*)pSlab - SLAB_HDR_SIZE) % pSlab->Size)
+                break;                                              // not the start of an object
+
+            nRet = SLAB_SIGNATURE;
+        }
+        else if (LARGE_SIGNATURE == pSlab->Signature && pHeap == pSlab->pHeap && (uint8_t*)pMem == (uint8_t*)pSlab + SLAB_HDR_SIZE)
+            nRet = LARGE_SIGNATURE;
+
+        *ppHdr = pSlab;
+
+    } while (0);
+
+    return nRet;
+}
+
+/** destroy()
+
+    Release all arenas and large blocks and the heap object
+
+    @param[in] pHeap    heap
+
+    @retval VOID
+
+**/
+static void destroy(HEAPOBJ* pHeap)
+{
+    HEAPOBJ** ppHeap;
+    LARGEBLK* pBlk;
+    SLAB* pArena;
+    size_t i;
+
+    for (ppHeap = &pHeapList; NULL != *ppHeap; ppHeap = &(*ppHeap)->pNextHeap)
+        if (pHeap == *ppHeap)
+        {
+            *ppHeap = pHeap->pNextHeap;
+            break;
+        }
+
+    while (NULL != (pBlk = pHeap->pLarge))
+    {
+        pHeap->pLarge = pBlk->pNext;
+        pBlk->Signature = 0;
+        __PagesFree(pBlk, pBlk->nPages);
+    }
+
+    while (NULL != (pArena = pHeap->pArena))
+    {
+        pHeap->pArena = pArena->pNextArena;
+
+        for (i = 0; i < HEAP_ARENA_SIZE; i += HEAP_SLAB_SIZE)       // invalidate the slab signatures
+            ((SLAB*)((uint8_t*)pArena + i))->Signature = 0;
+
+        __PagesFree(pArena, HEAP_ARENA_SIZE / VMEM_PAGE_SIZE);
+    }
+
+    pHeap->Signature = 0;
+    __PagesFree(pHeap, pHeap->nPages);
+}
+
+/** destroyall()
+
+    atexit() handler, destroy all heaps not destroyed by the application
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void destroyall(void)
+{
+    while (NULL != pHeapList)
+        destroy(pHeapList);
+
+    pProcessHeap = NULL;
+    InitOnceInitialize4UEFI(&ProcessHeapOnce);
+}
+
+/** HeapCreate()
+Synopsis
+    void* HeapCreate4UEFI(uint32_t flOptions, size_t dwInitialSize, size_t dwMaximumSize);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapcreate#syntax
+Description
+    Creates a private heap object that can be used by the calling process.
+
+    NOTE: dwInitialSize is reserved in arenas at once, so that HeapAlloc() on APs,
+          that can't grow the heap, is served from them.
+    NOTE: flOptions are ignored, the heap is always serialized.
+    NOTE: Must not be called on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapcreate#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapcreate#return-value
+**/
+void* HeapCreate4UEFI(uint32_t flOptions, size_t dwInitialSize, size_t dwMaximumSize)
+{
+    size_t nPages = (sizeof(HEAPOBJ) + VMEM_PAGE_SIZE - 1) / VMEM_PAGE_SIZE;
+    HEAPOBJ* pHeap = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (0 != dwMaximumSize && dwInitialSize > dwMaximumSize)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        if (NULL == (pHeap = __PagesAlloc(nPages, 1)))
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        memset(pHeap, 0, sizeof(HEAPOBJ));
+        pHeap->Signature = HEAP_SIGNATURE;
+        pHeap->flOptions = flOptions;
+        pHeap->nPages = nPages;
+        pHeap->cbMaxReserve = 0 == dwMaximumSize ? 0 : (dwMaximumSize + HEAP_ARENA_SIZE - 1) / HEAP_ARENA_SIZE * HEAP_ARENA_SIZE;
+
+        pHeap->pNextHeap = pHeapList;
+        pHeapList = pHeap;
+
+        if (false == fAtExit)
+            fAtExit = 0 == atexit(destroyall);
+
+        while (pHeap->cbReserved < dwInitialSize)
+        {
+            if (false == reserve(pHeap))
+            {
+                destroy(pHeap);
+                pHeap = NULL;
+                SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+                break;
+            }
+        }
+
+    } while (0);
+
+    INSTR_LEAVE(HeapCreate, 0);
+
+    return pHeap;
+}
+
+/** HeapDestroy()
+Synopsis
+    int HeapDestroy4UEFI(void* hHeap);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapdestroy#syntax
+Description
+    Destroys the specified heap object. All arenas and large blocks are released at once.
+
+    NOTE: The process heap can't be destroyed.
+    NOTE: Must not be called on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapdestroy#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapdestroy#return-value
+**/
+int HeapDestroy4UEFI(void* hHeap)
+{
+    HEAPOBJ* pHeap = hHeap;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    if (NULL == pHeap || HEAP_SIGNATURE != pHeap->Signature || pProcessHeap == pHeap)
+        SetLastError4UEFI(ERROR_INVALID_HANDLE);
+    else if (0 <= __ThreadPoolSelf())
+        SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+    else
+    {
+        destroy(pHeap);
+        nRet = 1;
+    }
+
+    INSTR_LEAVE(HeapDestroy, 0);
+
+    return nRet;
+}
+
+/** HeapAlloc()
+Synopsis
+    void* HeapAlloc4UEFI(void* hHeap, uint32_t dwFlags, size_t dwBytes);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapalloc#syntax
+Description
+    Allocates a block of memory from a heap. The allocated memory is not movable.
+
+    NOTE: Blocks are 16 byte aligned. Blocks larger than HEAP_MAX_SMALL can't be
+          allocated on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapalloc#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapalloc#return-value
+**/
+void* HeapAlloc4UEFI(void* hHeap, uint32_t dwFlags, size_t dwBytes)
+{
+    HEAPOBJ* pHeap = hHeap;
+    void* pRet = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pHeap || HEAP_SIGNATURE != pHeap->Signature)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        if (dwBytes <= HEAP_MAX_SMALL)
+        {
+            uint32_t Class = sizeclass(dwBytes);
+
+            if (NULL != (pRet = smallalloc(pHeap, Class)) && (HEAP_ZERO_MEMORY & dwFlags))
+                memset(pRet, 0, ClassSize[Class]);
+        }
+        else if (NULL != (pRet = largealloc(pHeap, dwBytes)) && (HEAP_ZERO_MEMORY & dwFlags))
+            memset(pRet, 0, dwBytes);
+
+        if (NULL == pRet)
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+
+    } while (0);
+
+    INSTR_LEAVE(HeapAlloc, 0);
+
+    return pRet;
+}
+
+/** HeapFree()
+Synopsis
+    int HeapFree4UEFI(void* hHeap, uint32_t dwFlags, void* lpMem);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapfree#syntax
+Description
+    Frees a memory block allocated from a heap by HeapAlloc() or HeapReAlloc().
+
+    NOTE: Blocks larger than HEAP_MAX_SMALL can't be freed on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapfree#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapfree#return-value
+**/
+int HeapFree4UEFI(void* hHeap, uint32_t dwFlags, void* lpMem)
+{
+    HEAPOBJ* pHeap = hHeap;
+    void* pHdr = NULL;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pHeap || HEAP_SIGNATURE != pHeap->Signature)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        if (NULL == lpMem)                                          // same as Windows
+        {
+            nRet = 1;
+            break;
+        }
+
+        switch (block(pHeap, lpMem, &pHdr))
+        {
+        case SLAB_SIGNATURE:
+            smallfree(pHeap, pHdr, lpMem);
+            nRet = 1;
+            break;
+        case LARGE_SIGNATURE:
+            if (0 <= __ThreadPoolSelf())
+            {
+                SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+                break;
+            }
+            largefree(pHeap, pHdr);
+            nRet = 1;
+            break;
+        default:
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+    } while (0);
+
+    INSTR_LEAVE(HeapFree, 0);
+
+    return nRet;
+}
+
+/** HeapSize()
+Synopsis
+    size_t HeapSize4UEFI(void* hHeap, uint32_t dwFlags, const void* lpMem);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapsize#syntax
+Description
+    Retrieves the size of a memory block allocated from a heap by HeapAlloc() or HeapReAlloc().
+
+    NOTE: For blocks up to HEAP_MAX_SMALL the size of the size class is returned,
+          that is the requested size rounded up.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapsize#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapsize#return-value
+**/
+size_t HeapSize4UEFI(void* hHeap, uint32_t dwFlags, const void* lpMem)
+{
+    HEAPOBJ* pHeap = hHeap;
+    void* pHdr = NULL;
+    size_t nRet = (size_t)-1;
+    INSTR_ENTER();
+
+    if (NULL == pHeap || HEAP_SIGNATURE != pHeap->Signature)
+        SetLastError4UEFI(ERROR_INVALID_HANDLE);
+    else switch (block(pHeap, lpMem, &pHdr))
+    {
+    case SLAB_SIGNATURE:
+        nRet = ((SLAB*)pHdr)->Size;
+        break;
+    case LARGE_SIGNATURE:
+        nRet = ((LARGEBLK*)pHdr)->Size;
+        break;
+    default:
+        SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+        break;
+    }
+
+    INSTR_LEAVE(HeapSize, 0);
+
+    return nRet;
+}
+
+/** HeapReAlloc()
+Synopsis
+    void* HeapReAlloc4UEFI(void* hHeap, uint32_t dwFlags, void* lpMem, size_t dwBytes);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapreallocate#syntax
+Description
+    Reallocates a block of memory from a heap. The block stays in place, if the new
+    size fits into its size class or into its pages.
+
+    NOTE: On APs a block larger than HEAP_MAX_SMALL is never moved, it could not be
+          freed there. HeapReAlloc() fails with ERROR_NOT_SUPPORTED instead.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapreallocate#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapreallocate#return-value
+**/
+void* HeapReAlloc4UEFI(void* hHeap, uint32_t dwFlags, void* lpMem, size_t dwBytes)
+{
+    HEAPOBJ* pHeap = hHeap;
+    void* pHdr = NULL, *pRet = NULL;
+    size_t nOld = 0;
+    uint32_t Kind = 0;
+    bool fInPlace = false;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pHeap || HEAP_SIGNATURE != pHeap->Signature)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        if (dwBytes > LARGE_MAX_SIZE)                               // the in place check below would wrap
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        switch (Kind = block(pHeap, lpMem, &pHdr))
+        {
+        case SLAB_SIGNATURE:
+            nOld = ((SLAB*)pHdr)->Size;
+            fInPlace = dwBytes <= nOld;
+            break;
+        case LARGE_SIGNATURE:
+            nOld = ((LARGEBLK*)pHdr)->Size;
+            fInPlace = dwBytes > HEAP_MAX_SMALL && SLAB_HDR_SIZE + dwBytes <= ((LARGEBLK*)pHdr)->nPages * VMEM_PAGE_SIZE;
+            break;
+        default:
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        if (0 == nOld)
+            break;
+
+        if (fInPlace)
+        {
+            if (LARGE_SIGNATURE == Kind)
+            {
+                HEAPSLOT* pSlot = slotenter(pHeap);
+
+                pSlot->cbAllocated += (int64_t)dwBytes - (int64_t)nOld;
+                slotleave(pHeap, pSlot);
+
+                ((LARGEBLK*)pHdr)->Size = dwBytes;
+            }
+
+            if ((HEAP_ZERO_MEMORY & dwFlags) && dwBytes > nOld)
+                memset((uint8_t*)lpMem + nOld, 0, dwBytes - nOld);
+
+            pRet = lpMem;
+            break;
+        }
+
+        if (HEAP_REALLOC_IN_PLACE_ONLY & dwFlags)
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        if (LARGE_SIGNATURE == Kind && 0 <= __ThreadPoolSelf())     // HeapFree() of a large block is BSP only
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        if (NULL == (pRet = HeapAlloc4UEFI(hHeap, dwFlags, dwBytes)))
+            break;
+
+        memcpy(pRet, lpMem, dwBytes < nOld ? dwBytes : nOld);
+        HeapFree4UEFI(hHeap, 0, lpMem);
+
+    } while (0);
+
+    INSTR_LEAVE(HeapReAlloc, 0);
+
+    return pRet;
+}
+
+/** HeapSummary()
+Synopsis
+    int HeapSummary4UEFI(void* hHeap, uint32_t dwFlags, HEAPSUMMARY* lpSummary);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapsummary#syntax
+Description
+    Summarizes the allocated, committed and reserved bytes of a heap.
+    cbAllocated / cbCommitted is the utilization of the slabs in use.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapsummary#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-heapsummary#return-value
+**/
+int HeapSummary4UEFI(void* hHeap, uint32_t dwFlags, HEAPSUMMARY* lpSummary)
+{
+    HEAPOBJ* pHeap = hHeap;
+    int64_t cbAllocated = 0;
+    uint32_t i;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pHeap || HEAP_SIGNATURE != pHeap->Signature)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        if (NULL == lpSummary || sizeof(HEAPSUMMARY) != lpSummary->cb)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        for (i = 0; i < HEAP_SLOTS; i++)                            // frees may be counted on another slot than allocations
+            cbAllocated += pHeap->Slot[i].cbAllocated;
+
+        lpSummary->cbAllocated = (size_t)cbAllocated;
+        lpSummary->cbCommitted = pHeap->cbCommitted;
+        lpSummary->cbReserved = pHeap->cbReserved;
+        lpSummary->cbMaxReserve = pHeap->cbMaxReserve;
+        nRet = 1;
+
+    } while (0);
+
+    INSTR_LEAVE(HeapSummary, 0);
+
+    return nRet;
+}
+
+/** initprocessheap()
+
+    InitOnceExecuteOnce() callback, create the process heap
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    not used
+    @param[in] Context      not used
+
+    @retval 1   success
+    @retval 0   out of memory, retried on next use
+
+**/
+static int initprocessheap(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    pProcessHeap = HeapCreate4UEFI(0, 0, 0);
+
+    return NULL != pProcessHeap;
+}
+
+/** GetProcessHeap()
+Synopsis
+    void* GetProcessHeap4UEFI(void);
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-getprocessheap#syntax
+Description
+    Retrieves a handle to the default heap of the calling process.
+    The heap is created on first use.
+
+    NOTE: The first call must not be made on an AP.
+Paramters
+    none
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/heapapi/nf-heapapi-getprocessheap#return-value
+**/
+void* GetProcessHeap4UEFI(void)
+{
+    INSTR_ENTER();
+
+    InitOnceExecuteOnce4UEFI(&ProcessHeapOnce, initprocessheap, NULL, NULL);
+
+    INSTR_LEAVE(GetProcessHeap, 0);
+
+    return pProcessHeap;
+}
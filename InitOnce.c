@@ -0,0 +1,95 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    InitOnce.c
+
+Abstract:
+
+    Win32 API InitOnceInitialize() and InitOnceExecuteOnce() for UEFI
+
+    The first caller switches the state from INITONCE_UNINIT to INITONCE_BUSY and
+    runs the init function, concurrent callers spin until it is done. If the init
+    function fails, the state returns to INITONCE_UNINIT and the next caller retries.
+    Used by the lazy caches of the library, e.g. the ACPI table index and the TSC
+    calibration.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_InterlockedCompareExchange, _ReadWriteBarrier)
+
+/** InitOnceInitialize()
+Synopsis
+    void InitOnceInitialize4UEFI(INITONCE* InitOnce);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initonceinitialize#syntax
+Description
+    Initializes a one-time initialization structure.
+
+    NOTE: Same as INITONCE_STATIC_INIT. Also used to run the init function again.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initonceinitialize#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initonceinitialize#return-value
+**/
+void InitOnceInitialize4UEFI(INITONCE* InitOnce)
+{
+    InitOnce->Context = NULL;
+    _ReadWriteBarrier();
+    InitOnce->State = INITONCE_UNINIT;
+}
+
+/** InitOnceExecuteOnce()
+Synopsis
+    int InitOnceExecuteOnce4UEFI(INITONCE* InitOnce, int (*InitFn)(INITONCE* InitOnce, void* Parameter, void** Context), void* Parameter, void** Context);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initonceexecuteonce#syntax
+Description
+    Executes the specified function successfully one time. No other threads that specify
+    the same one-time initialization structure can execute the specified function while
+    it is being executed by the current thread.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initonceexecuteonce#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initonceexecuteonce#return-value
+**/
+int InitOnceExecuteOnce4UEFI(INITONCE* InitOnce, int (*InitFn)(INITONCE* InitOnce, void* Parameter, void** Context), void* Parameter, void** Context)
+{
+    uint32_t Backoff = 1;
+    void* pContext;
+    int nRet = 1;
+
+    while (INITONCE_DONE != InitOnce->State)
+    {
+        if (INITONCE_UNINIT != InitOnce->State
+            || INITONCE_UNINIT != _InterlockedCompareExchange(&InitOnce->State, INITONCE_BUSY, INITONCE_UNINIT))
+        {
+            __SpinBackoff(&Backoff);                                // another processor runs InitFn
+            continue;
+        }
+
+        pContext = NULL;
+        nRet = InitFn(InitOnce, Parameter, &pContext);
+
+        if (0 != nRet)
+            InitOnce->Context = pContext;
+
+        _ReadWriteBarrier();
+        InitOnce->State = 0 != nRet ? INITONCE_DONE : INITONCE_UNINIT;
+
+        if (0 == nRet)
+            break;
+    }
+
+    if (0 != nRet && NULL != Context)
+        *Context = InitOnce->Context;
+
+    return nRet;
+}
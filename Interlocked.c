@@ -0,0 +1,280 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    Interlocked.c
+
+Abstract:
+
+    Win32 API Interlocked*() for UEFI
+
+    The functions map to the LOCK prefixed compiler intrinsics, so they are safe
+    on all processors, including the APs of the thread pool.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_InterlockedIncrement, _InterlockedDecrement, _InterlockedExchange, _InterlockedExchangeAdd, _InterlockedCompareExchange)
+#pragma intrinsic (_InterlockedIncrement64, _InterlockedDecrement64, _InterlockedExchange64, _InterlockedExchangeAdd64, _InterlockedCompareExchange64)
+#pragma intrinsic (_InterlockedExchangePointer, _InterlockedCompareExchangePointer)
+#pragma intrinsic (_ReadWriteBarrier)
+
+/** InterlockedIncrement()
+Synopsis
+    long InterlockedIncrement4UEFI(volatile long* Addend);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedincrement#syntax
+Description
+    Increments the value of the specified 32-bit variable as an atomic operation.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedincrement#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedincrement#return-value
+**/
+long InterlockedIncrement4UEFI(volatile long* Addend)
+{
+    return _InterlockedIncrement(Addend);
+}
+
+/** InterlockedDecrement()
+Synopsis
+    long InterlockedDecrement4UEFI(volatile long* Addend);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockeddecrement#syntax
+Description
+    Decrements the value of the specified 32-bit variable as an atomic operation.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockeddecrement#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockeddecrement#return-value
+**/
+long InterlockedDecrement4UEFI(volatile long* Addend)
+{
+    return _InterlockedDecrement(Addend);
+}
+
+/** InterlockedExchange()
+Synopsis
+    long InterlockedExchange4UEFI(volatile long* Target, long Value);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchange#syntax
+Description
+    Sets a 32-bit variable to the specified value as an atomic operation.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchange#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchange#return-value
+**/
+long InterlockedExchange4UEFI(volatile long* Target, long Value)
+{
+    return _InterlockedExchange(Target, Value);
+}
+
+/** InterlockedExchangeAdd()
+Synopsis
+    long InterlockedExchangeAdd4UEFI(volatile long* Addend, long Value);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangeadd#syntax
+Description
+    Performs an atomic addition of two 32-bit values.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangeadd#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangeadd#return-value
+**/
+long InterlockedExchangeAdd4UEFI(volatile long* Addend, long Value)
+{
+    return _InterlockedExchangeAdd(Addend, Value);
+}
+
+/** InterlockedCompareExchange()
+Synopsis
+    long InterlockedCompareExchange4UEFI(volatile long* Destination, long Exchange, long Comparand);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchange#syntax
+Description
+    Performs an atomic compare-and-exchange operation on the specified 32-bit values.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchange#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchange#return-value
+**/
+long InterlockedCompareExchange4UEFI(volatile long* Destination, long Exchange, long Comparand)
+{
+    return _InterlockedCompareExchange(Destination, Exchange, Comparand);
+}
+
+/** InterlockedIncrement64()
+Synopsis
+    int64_t InterlockedIncrement644UEFI(volatile int64_t* Addend);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedincrement64#syntax
+Description
+    Increments the value of the specified 64-bit variable as an atomic operation.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedincrement64#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedincrement64#return-value
+**/
+int64_t InterlockedIncrement644UEFI(volatile int64_t* Addend)
+{
+    return _InterlockedIncrement64(Addend);
+}
+
+/** InterlockedDecrement64()
+Synopsis
+    int64_t InterlockedDecrement644UEFI(volatile int64_t* Addend);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockeddecrement64#syntax
+Description
+    Decrements the value of the specified 64-bit variable as an atomic operation.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockeddecrement64#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockeddecrement64#return-value
+**/
+int64_t InterlockedDecrement644UEFI(volatile int64_t* Addend)
+{
+    return _InterlockedDecrement64(Addend);
+}
+
+/** InterlockedExchange64()
+Synopsis
+    int64_t InterlockedExchange644UEFI(volatile int64_t* Target, int64_t Value);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchange64#syntax
+Description
+    Sets a 64-bit variable to the specified value as an atomic operation.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchange64#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchange64#return-value
+**/
+int64_t InterlockedExchange644UEFI(volatile int64_t* Target, int64_t Value)
+{
+    return _InterlockedExchange64(Target, Value);
+}
+
+/** InterlockedExchangeAdd64()
+Synopsis
+    int64_t InterlockedExchangeAdd644UEFI(volatile int64_t* Addend, int64_t Value);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangeadd64#syntax
+Description
+    Performs an atomic addition of two 64-bit values.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangeadd64#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangeadd64#return-value
+**/
+int64_t InterlockedExchangeAdd644UEFI(volatile int64_t* Addend, int64_t Value)
+{
+    return _InterlockedExchangeAdd64(Addend, Value);
+}
+
+/** InterlockedCompareExchange64()
+Synopsis
+    int64_t InterlockedCompareExchange644UEFI(volatile int64_t* Destination, int64_t Exchange, int64_t Comparand);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchange64#syntax
+Description
+    Performs an atomic compare-and-exchange operation on the specified 64-bit values.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchange64#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchange64#return-value
+**/
+int64_t InterlockedCompareExchange644UEFI(volatile int64_t* Destination, int64_t Exchange, int64_t Comparand)
+{
+    return _InterlockedCompareExchange64(Destination, Exchange, Comparand);
+}
+
+/** InterlockedExchangePointer()
+Synopsis
+    void* InterlockedExchangePointer4UEFI(void* volatile* Target, void* Value);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangepointer#syntax
+Description
+    Atomically exchanges a pair of addresses.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangepointer#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedexchangepointer#return-value
+**/
+void* InterlockedExchangePointer4UEFI(void* volatile* Target, void* Value)
+{
+    return _InterlockedExchangePointer(Target, Value);
+}
+
+/** InterlockedCompareExchangePointer()
+Synopsis
+    void* InterlockedCompareExchangePointer4UEFI(void* volatile* Destination, void* Exchange, void* Comparand);
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchangepointer#syntax
+Description
+    Performs an atomic compare-and-exchange operation on the specified pointer values.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchangepointer#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winnt/nf-winnt-interlockedcompareexchangepointer#return-value
+**/
+void* InterlockedCompareExchangePointer4UEFI(void* volatile* Destination, void* Exchange, void* Comparand)
+{
+    return _InterlockedCompareExchangePointer(Destination, Exchange, Comparand);
+}
+
+/** __SpinBackoff()
+Synopsis
+    void __SpinBackoff(uint32_t* pBackoff);
+Description
+    Spin *pBackoff PAUSE instructions, then double *pBackoff up to SPIN_BACKOFF_MAX.
+    Start with *pBackoff = 1 and reset it to 1 after progress was made.
+Paramters
+    uint32_t* pBackoff      :   backoff state of the caller
+Returns
+    none
+**/
+void __SpinBackoff(uint32_t* pBackoff)
+{
+    uint32_t i;
+
+    for (i = 0; i < *pBackoff; i++)
+        _mm_pause();
+
+    if (*pBackoff < SPIN_BACKOFF_MAX)
+        *pBackoff <<= 1;
+}
+
+/** __SpinLock()
+Synopsis
+    void __SpinLock(volatile long* pLock);
+Description
+    Acquire a spin lock, spin with PAUSE and exponential backoff, see __SpinBackoff().
+    The lock is a long initialized to 0, it is not recursive.
+Paramters
+    volatile long* pLock    :   lock
+Returns
+    none
+**/
+void __SpinLock(volatile long* pLock)
+{
+    uint32_t Backoff = 1;
+
+    while (0 != _InterlockedExchange(pLock, 1))
+    {
+        do {
+            __SpinBackoff(&Backoff);
+        } while (0 != *pLock);
+    }
+}
+
+/** __SpinUnlock()
+Synopsis
+    void __SpinUnlock(volatile long* pLock);
+Description
+    Release a spin lock acquired by __SpinLock()
+Paramters
+    volatile long* pLock    :   lock
+Returns
+    none
+**/
+void __SpinUnlock(volatile long* pLock)
+{
+    _ReadWriteBarrier();
+    *pLock = 0;                                                     // x64 stores are not reordered with older stores
+}
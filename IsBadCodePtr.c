@@ -0,0 +1,47 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    IsBadCodePtr.c
+
+Abstract:
+
+    Win32 API IsBadCodePtr() for UEFI
+
+    Determines whether the calling process has read access to the memory at the specified address.
+
+--*/
+#include <windows.h>
+#include "Win324UEFI.h"
+
+/** IsBadCodePtr()
+Synopsis
+    BOOL IsBadCodePtr(FARPROC lpfn)
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadcodeptr#syntax
+Description
+    Determines whether the calling process has read access to the memory at the specified address.
+    Additionally the memory must not be marked EFI_MEMORY_XP in the UEFI memory map or
+    the EFI memory attributes table, see __MemMapIdx.c, nor execute disabled in the live
+    page tables, see __PageWalk.c
+
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadcodeptr#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadcodeptr#return-value
+**/
+int IsBadCodePtr4UEFI(const void* lpfn)
+{
+    uint64_t qwAddress = (uint64_t)(uintptr_t)lpfn;
+    int nRet;
+    INSTR_ENTER();
+
+    nRet = false == (__MemMapIdxCheck(qwAddress, 1, MEMACC_READ | MEMACC_EXECUTE) && __PageWalkCheck(qwAddress, 1, MEMACC_READ | MEMACC_EXECUTE));
+
+    INSTR_LEAVE(IsBadCodePtr, 0);
+
+    return nRet;
+}
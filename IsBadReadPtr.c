@@ -16,13 +16,16 @@ Abstract:
 
 --*/
 #include <windows.h>
+#include "Win324UEFI.h"
 
-/** Sleep()
+/** IsBadReadPtr()
 Synopsis
     BOOL IsBadReadPtr(const VOID *lp,UINT_PTR   ucb)
     https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadreadptr#syntax
 Description
     Verifies that the calling process has read access to the specified range of memory.
+    The range is looked up in a snapshot of the UEFI memory map, see __MemMapIdx.c,
+    and in the live page tables, see __PageWalk.c
 
 Paramters
     https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadreadptr#parameters
@@ -31,5 +34,13 @@ Returns
 **/
 int IsBadReadPtr4UEFI(const void* lp, UINT_PTR   ucb)
 {
-    return 0;
+    uint64_t qwAddress = (uint64_t)(uintptr_t)lp;
+    int nRet;
+    INSTR_ENTER();
+
+    nRet = false == (__MemMapIdxCheck(qwAddress, (uint64_t)ucb, MEMACC_READ) && __PageWalkCheck(qwAddress, (uint64_t)ucb, MEMACC_READ));
+
+    INSTR_LEAVE(IsBadReadPtr, 0);
+
+    return nRet;
 }
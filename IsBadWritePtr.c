@@ -16,12 +16,17 @@ Abstract:
 
 --*/
 #include <windows.h>
+#include "Win324UEFI.h"
+
 /** IsBadWritePtr()
 Synopsis
     BOOL IsBadWritePtr(const VOID *lp,UINT_PTR   ucb)
     https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadwriteptr#syntax
 Description
     Verifies that the calling process has write access to the specified range of memory.
+    The range is looked up in a snapshot of the UEFI memory map, see __MemMapIdx.c,
+    and in the live page tables, see __PageWalk.c. Read-only pages are reported only
+    if CR0.WP is set, otherwise the processor ignores the R/W bit at CPL 0.
 
 Paramters
     https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-isbadwriteptr#parameters
@@ -30,5 +35,13 @@ Returns
 **/
 int IsBadWritePtr4UEFI(const void* lp, UINT_PTR  ucb)
 {
-    return 0;
+    uint64_t qwAddress = (uint64_t)(uintptr_t)lp;
+    int nRet;
+    INSTR_ENTER();
+
+    nRet = false == (__MemMapIdxCheck(qwAddress, (uint64_t)ucb, MEMACC_WRITE) && __PageWalkCheck(qwAddress, (uint64_t)ucb, MEMACC_WRITE));
+
+    INSTR_LEAVE(IsBadWritePtr, 0);
+
+    return nRet;
 }
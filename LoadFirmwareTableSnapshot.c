@@ -0,0 +1,162 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    LoadFirmwareTableSnapshot.c
+
+Abstract:
+
+    Replay a firmware table snapshot image
+
+    GetSystemFirmwareTable(), GetSystemFirmwareTableView4UEFI() and
+    EnumSystemFirmwareTables() are served from the image instead of the
+    tables of the running system, e.g. to analyze a captured machine offline.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+/** chkimage()
+
+    Check header and directory of a snapshot image
+
+    @param[in] pImage       image
+    @param[in] ImageSize    size of the buffer holding the image
+
+    @retval true    image is consistent
+    @retval false   image is damaged or of an unknown version
+
+**/
+static bool chkimage(const void* pImage, uint64_t ImageSize)
+{
+    const FWSNAPHDR* pHdr = pImage;
+    const FWSNAPDIRENTRY* pDir = (const void*)&pHdr[1];
+    uint64_t qwDirEnd;
+    uint32_t i;
+    bool fRet = false;
+
+    do {
+
+        if (ImageSize < sizeof(FWSNAPHDR) || 0 != (7 & (uintptr_t)pImage))
+            break;
+
+        if (FWSNAP_SIGNATURE != pHdr->Signature || FWSNAP_VERSION != pHdr->Version || sizeof(FWSNAPHDR) != pHdr->HdrSize)
+            break;
+
+        if (pHdr->ImageSize > ImageSize)
+            break;                                                          // truncated image
+
+        qwDirEnd = sizeof(FWSNAPHDR) + (uint64_t)pHdr->nEntries * sizeof(FWSNAPDIRENTRY) + (uint64_t)pHdr->nXsdtEntries * sizeof(uint32_t);
+
+        if (qwDirEnd > pHdr->ImageSize)
+            break;
+
+        for (i = 0; i < pHdr->nEntries; i++)
+        {
+            if (0 != (7 & pDir[i].Offset) || pDir[i].Offset < qwDirEnd)
+                break;
+            if (pDir[i].Offset > pHdr->ImageSize || pDir[i].Length > pHdr->ImageSize - pDir[i].Offset)
+                break;
+            if (0 != i && pDir[i - 1].Provider == pDir[i].Provider)         // binary search needs sorted directory
+                if (pDir[i - 1].Signature > pDir[i].Signature
+                    || (pDir[i - 1].Signature == pDir[i].Signature && pDir[i - 1].Instance >= pDir[i].Instance))
+                    break;
+        }
+
+        fRet = (i == pHdr->nEntries);
+
+    } while (0);
+
+    return fRet;
+}
+
+/** LoadFirmwareTableSnapshot4UEFI()
+Synopsis
+    int LoadFirmwareTableSnapshot4UEFI(const void* pImage, uint64_t ImageSize);
+Description
+    Serve all firmware table queries from a snapshot image, created by
+    GetFirmwareTableSnapshot4UEFI() on this or another machine.
+
+    NOTE:   The image is not copied and must remain valid until the next call of
+            LoadFirmwareTableSnapshot4UEFI() or AcpiTableIndexRebuild4UEFI().
+            LoadFirmwareTableSnapshot4UEFI(NULL, 0) returns to the tables of the running system.
+Paramters
+    const void* pImage  :   image, 8 byte aligned, or NULL
+    uint64_t ImageSize  :   size of the buffer holding the image
+Returns
+    number of tables served from the image, or from the running system if pImage is NULL
+    -1, if the image is damaged or out of memory. The current tables remain unchanged.
+**/
+int LoadFirmwareTableSnapshot4UEFI(const void* pImage, uint64_t ImageSize)
+{
+    const FWSNAPHDR* pHdr = pImage;
+    const FWSNAPDIRENTRY* pDir = (const void*)&pHdr[1];
+    ACPITBLIDX Idx;
+    uint32_t i, nAcpi = 0;
+    int nRet = -1;
+    INSTR_ENTER();
+
+    do {
+
+        if (NULL == pImage)
+        {
+            nRet = AcpiTableIndexRebuild4UEFI();
+            break;
+        }
+
+        if (false == chkimage(pImage, ImageSize))
+            break;
+
+        for (i = 0; i < pHdr->nEntries; i++)
+            nAcpi += ('ACPI' == pDir[i].Provider);
+
+        //
+        // NOTE: single allocation for entries and XSDT signatures, as for the live index
+        //
+        memset(&Idx, 0, sizeof(Idx));
+        Idx.pEntry = malloc(nAcpi * sizeof(ACPITBLIDXENTRY) + pHdr->nXsdtEntries * sizeof(uint32_t) + 1);
+
+        if (NULL == Idx.pEntry)
+            break;
+
+        Idx.pSig32 = (void*)&Idx.pEntry[nAcpi];
+        Idx.nXsdtEntries = pHdr->nXsdtEntries;
+        Idx.RsdpAddress = pHdr->RsdpAddress;
+
+        memcpy(Idx.pSig32, &pDir[pHdr->nEntries], pHdr->nXsdtEntries * sizeof(uint32_t));
+
+        for (i = 0; i < pHdr->nEntries; i++)                                // directory is sorted already
+        {
+            ACPITBLIDXENTRY* pEntry = &Idx.pEntry[Idx.nEntries];
+
+            if ('ACPI' != pDir[i].Provider)
+                continue;
+
+            pEntry->Signature = pDir[i].Signature;
+            pEntry->Instance = pDir[i].Instance;
+            pEntry->Address = pDir[i].Address;
+            pEntry->pTable = &((const char*)pImage)[pDir[i].Offset];
+            pEntry->Length = pDir[i].Length;
+            pEntry->Verdict = ACPITBLVERDICT_UNKNOWN;
+            Idx.nEntries++;
+        }
+
+        __AcpiTblIdxReplace(&Idx);
+
+        nRet = (int)Idx.nEntries;
+
+    } while (0);
+
+    INSTR_LEAVE(LoadFirmwareTableSnapshot, 0);
+
+    return nRet;
+}
@@ -0,0 +1,310 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    NumaNode.c
+
+Abstract:
+
+    Win32 API GetNumaHighestNodeNumber(), GetNumaNodeProcessorMaskEx(),
+    GetNumaProcessorNodeEx() and GetNumaAvailableMemoryNodeEx() for UEFI
+
+    NUMA node distance from the SLIT
+
+--*/
+#include <uefi.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+/** available()
+
+    Sum up the free memory of a node: EfiConventionalMemory descriptors of the
+    current memory map, clipped to the SRAT memory ranges of the node.
+    Without SRAT memory ranges all free memory belongs to node 0.
+
+    @param[in] pIdx     topology index
+    @param[in] Node     node number
+    @param[out] pqwSum  receives the number of bytes
+
+    @retval 0, success
+    @retval -1, memory map not available
+
+**/
+static int available(const TOPOIDX* pIdx, uint16_t Node, uint64_t* pqwSum)
+{
+    EFI_MEMORY_DESCRIPTOR* pMap = NULL, * pDesc;
+    EFI_STATUS Status = EFI_BUFFER_TOO_SMALL;
+    UINTN Size = 0, MapKey, DescSize = sizeof(EFI_MEMORY_DESCRIPTOR), i;
+    UINT32 DescVer;
+    uint64_t Start, End, s, e;
+    uint32_t m;
+    int nTry;
+
+    *pqwSum = 0;
+
+    for (nTry = 0; nTry < 4 && EFI_BUFFER_TOO_SMALL == Status; nTry++)
+    {
+        Status = pEfiSystemTable->BootServices->GetMemoryMap(&Size, pMap, &MapKey, &DescSize, &DescVer);
+
+        if (EFI_BUFFER_TOO_SMALL == Status)
+        {
+            Size += 8 * DescSize;                                   // the allocation below may split descriptors
+            free(pMap);
+
+            if (NULL == (pMap = malloc(Size)))
+                break;
+        }
+    }
+
+    for (i = 0; EFI_SUCCESS == Status && i < Size / DescSize; i++)
+    {
+        pDesc = (void*)((uint8_t*)pMap + i * DescSize);
+
+        if (EfiConventionalMemory != pDesc->Type)
+            continue;
+
+        Start = pDesc->PhysicalStart;
+        End = Start + pDesc->NumberOfPages * 4096;
+
+        if (0 == pIdx->nMem)
+        {
+            *pqwSum += 0 == Node ? End - Start : 0;
+            continue;
+        }
+
+        for (m = 0; m < pIdx->nMem && pIdx->pMem[m].Base < End; m++)
+        {
+            if (Node != pIdx->pMem[m].Node)
+                continue;
+
+            s = Start > pIdx->pMem[m].Base ? Start : pIdx->pMem[m].Base;
+            e = End < pIdx->pMem[m].Base + pIdx->pMem[m].Length ? End : pIdx->pMem[m].Base + pIdx->pMem[m].Length;
+
+            if (s < e)
+                *pqwSum += e - s;
+        }
+    }
+
+    free(pMap);
+
+    return EFI_SUCCESS == Status ? 0 : -1;
+}
+
+/** GetNumaHighestNodeNumber()
+Synopsis
+    int GetNumaHighestNodeNumber4UEFI(uint32_t* HighestNodeNumber);
+    https://docs.microsoft.com/en-us/windows/win32/api/systemtopologyapi/nf-systemtopologyapi-getnumahighestnodenumber#syntax
+Description
+    Retrieves the node that currently has the highest number.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/systemtopologyapi/nf-systemtopologyapi-getnumahighestnodenumber#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/systemtopologyapi/nf-systemtopologyapi-getnumahighestnodenumber#return-value
+**/
+int GetNumaHighestNodeNumber4UEFI(uint32_t* HighestNodeNumber)
+{
+    TOPOIDX* pIdx;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    pIdx = __TopologyIdxGet();
+
+    if (NULL == pIdx)
+        SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+    else
+    {
+        *HighestNodeNumber = pIdx->nNodes - 1;
+        nRet = 1;
+    }
+
+    INSTR_LEAVE(GetNumaHighestNodeNumber, 0);
+
+    return nRet;
+}
+
+/** GetNumaNodeProcessorMaskEx()
+Synopsis
+    int GetNumaNodeProcessorMaskEx4UEFI(uint16_t Node, GROUPAFFINITY* ProcessorMask);
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumanodeprocessormaskex#syntax
+Description
+    Retrieves the processor mask for a node regardless of the processor group the node belongs to.
+
+    NOTE: A node with more than 64 processors returns its first group. A node without
+          processors returns an empty mask of group 0.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumanodeprocessormaskex#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumanodeprocessormaskex#return-value
+**/
+int GetNumaNodeProcessorMaskEx4UEFI(uint16_t Node, GROUPAFFINITY* ProcessorMask)
+{
+    TOPOIDX* pIdx;
+    uint32_t i;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+
+        pIdx = __TopologyIdxGet();
+
+        if (NULL == pIdx || Node >= pIdx->nNodes)
+        {
+            SetLastError4UEFI(NULL == pIdx ? ERROR_NOT_ENOUGH_MEMORY : ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        memset(ProcessorMask, 0, sizeof(GROUPAFFINITY));
+
+        for (i = 0; i < pIdx->nCpus && Node != pIdx->pCpu[i].Node; i++)  // processors are sorted by node
+            ;
+
+        if (i < pIdx->nCpus)
+            ProcessorMask->Group = pIdx->pCpu[i].Group;
+
+        for (; i < pIdx->nCpus && Node == pIdx->pCpu[i].Node && ProcessorMask->Group == pIdx->pCpu[i].Group; i++)
+            ProcessorMask->Mask |= (uintptr_t)1 << pIdx->pCpu[i].Number;
+
+        nRet = 1;
+
+    } while (0);
+
+    INSTR_LEAVE(GetNumaNodeProcessorMaskEx, 0);
+
+    return nRet;
+}
+
+/** GetNumaProcessorNodeEx()
+Synopsis
+    int GetNumaProcessorNodeEx4UEFI(const PROCNUMBER* Processor, uint16_t* NodeNumber);
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumaprocessornodeex#syntax
+Description
+    Retrieves the node number as a USHORT value for the specified logical processor.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumaprocessornodeex#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumaprocessornodeex#return-value
+**/
+int GetNumaProcessorNodeEx4UEFI(const PROCNUMBER* Processor, uint16_t* NodeNumber)
+{
+    TOPOIDX* pIdx;
+    uint32_t lo = 0, hi, mid, Key = (uint32_t)Processor->Group << 8 | Processor->Number;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    *NodeNumber = 0xFFFF;
+    pIdx = __TopologyIdxGet();
+
+    for (hi = NULL == pIdx ? 0 : pIdx->nCpus; lo < hi;)             // binary search, group and number ascend
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (((uint32_t)pIdx->pCpu[mid].Group << 8 | pIdx->pCpu[mid].Number) < Key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (NULL != pIdx && lo < pIdx->nCpus && Key == ((uint32_t)pIdx->pCpu[lo].Group << 8 | pIdx->pCpu[lo].Number))
+    {
+        *NodeNumber = pIdx->pCpu[lo].Node;
+        nRet = 1;
+    }
+    else
+        SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+
+    INSTR_LEAVE(GetNumaProcessorNodeEx, 0);
+
+    return nRet;
+}
+
+/** GetNumaAvailableMemoryNodeEx()
+Synopsis
+    int GetNumaAvailableMemoryNodeEx4UEFI(uint16_t Node, uint64_t* AvailableBytes);
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumaavailablememorynodeex#syntax
+Description
+    Retrieves the amount of memory that is available in a node specified as a USHORT value.
+
+    NOTE: Available memory is EfiConventionalMemory of the current memory map.
+    NOTE: BSP only, on APs ERROR_NOT_SUPPORTED is set, GetMemoryMap() is a boot service
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumaavailablememorynodeex#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getnumaavailablememorynodeex#return-value
+**/
+int GetNumaAvailableMemoryNodeEx4UEFI(uint16_t Node, uint64_t* AvailableBytes)
+{
+    TOPOIDX* pIdx;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+
+        if (0 <= __ThreadPoolSelf())
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        pIdx = __TopologyIdxGet();
+
+        if (NULL == pIdx || Node >= pIdx->nNodes)
+        {
+            SetLastError4UEFI(NULL == pIdx ? ERROR_NOT_ENOUGH_MEMORY : ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        if (0 != available(pIdx, Node, AvailableBytes))
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        nRet = 1;
+
+    } while (0);
+
+    INSTR_LEAVE(GetNumaAvailableMemoryNodeEx, 0);
+
+    return nRet;
+}
+
+/** GetNumaNodeDistance4UEFI()
+Synopsis
+    uint8_t GetNumaNodeDistance4UEFI(uint16_t Node1, uint16_t Node2);
+Description
+    Get the relative memory latency between two nodes from the SLIT,
+    NUMA_LOCAL_DISTANCE within a node
+Paramters
+    uint16_t Node1  :   node number of the processor
+    uint16_t Node2  :   node number of the memory
+Returns
+    distance
+    0xFF, if a node number is invalid
+**/
+uint8_t GetNumaNodeDistance4UEFI(uint16_t Node1, uint16_t Node2)
+{
+    TOPOIDX* pIdx;
+    uint8_t bRet = 0xFF;
+    INSTR_ENTER();
+
+    pIdx = __TopologyIdxGet();
+
+    if (NULL != pIdx && Node1 < pIdx->nNodes && Node2 < pIdx->nNodes)
+        bRet = pIdx->pDistance[Node1 * pIdx->nNodes + Node2];
+
+    INSTR_LEAVE(GetNumaNodeDistance, 0);
+
+    return bRet;
+}
@@ -0,0 +1,322 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    PciConfig.c
+
+Abstract:
+
+    PCI configuration space access for UEFI
+
+    Functions decoded by an MCFG segment are accessed through their memory mapped
+    4KiB configuration space. Otherwise the first 256 bytes of segment 0 are accessed
+    through CF8/CFC. The index/data port pair is serialized by a critical section.
+
+    Block transfers use naturally aligned 32 bit accesses, 8 and 16 bit accesses
+    at unaligned edges only. A single aligned 8, 16 or 32 bit transfer is a single
+    access of that width.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+#define PCI_CF8_INDEX   0xCF8
+#define PCI_CF8_DATA    0xCFC
+#define PCI_CF8_ENABLE  0x80000000
+
+static CRITSECT Cf8Lock;                                            // zero initialized is initialized
+
+/** cfglimit()
+
+    Get the size of the accessible configuration space of a function
+
+    @param[in]  PciAddress  PCI_ADDRESS()
+    @param[out] pEcam       receives the ECAM address of the function, 0 for CF8/CFC
+
+    @retval PCI_CFG_SIZE, PCI_CFG_LEGACY_SIZE or 0
+
+**/
+static uint32_t cfglimit(uint32_t PciAddress, uint64_t* pEcam)
+{
+    *pEcam = __PciEcam(PciAddress, 0);
+
+    return 0 != *pEcam ? PCI_CFG_SIZE : (0 == PCI_SEGMENT(PciAddress) ? PCI_CFG_LEGACY_SIZE : 0);
+}
+
+/** cfgread()
+
+    Single naturally aligned access. For CF8/CFC the caller holds Cf8Lock.
+
+    @param[in] Ecam         ECAM address of the function, 0 for CF8/CFC
+    @param[in] PciAddress   PCI_ADDRESS()
+    @param[in] Offset       register offset
+    @param[in] Width        1, 2, 4
+
+    @retval register value
+
+**/
+static uint32_t cfgread(uint64_t Ecam, uint32_t PciAddress, uint32_t Offset, uint32_t Width)
+{
+    uint32_t dwRet;
+
+    if (0 != Ecam)
+        dwRet = 1 == Width ? *(volatile uint8_t*)(uintptr_t)(Ecam + Offset)
+        : (2 == Width ? *(volatile uint16_t*)(uintptr_t)(Ecam + Offset) : *(volatile uint32_t*)(uintptr_t)(Ecam + Offset));
+    else
+    {
+        outpd(PCI_CF8_INDEX, PCI_CF8_ENABLE | (PciAddress & 0xFFFF) << 8 | (Offset & 0xFC));
+        dwRet = 1 == Width ? (uint32_t)inp((unsigned short)(PCI_CF8_DATA + (Offset & 3)))
+            : (2 == Width ? (uint32_t)inpw((unsigned short)(PCI_CF8_DATA + (Offset & 2))) : (uint32_t)inpd(PCI_CF8_DATA));
+    }
+
+    return dwRet;
+}
+
+/** cfgwrite()
+
+    Single naturally aligned access. For CF8/CFC the caller holds Cf8Lock.
+
+    @param[in] Ecam         ECAM address of the function, 0 for CF8/CFC
+    @param[in] PciAddress   PCI_ADDRESS()
+    @param[in] Offset       register offset
+    @param[in] Width        1, 2, 4
+    @param[in] Value        register value
+
+    @retval none
+
+**/
+static void cfgwrite(uint64_t Ecam, uint32_t PciAddress, uint32_t Offset, uint32_t Width, uint32_t Value)
+{
+    if (0 != Ecam)
+    {
+        if (1 == Width)
+            *(volatile uint8_t*)(uintptr_t)(Ecam + Offset) = (uint8_t)Value;
+        else if (2 == Width)
+            *(volatile uint16_t*)(uintptr_t)(Ecam + Offset) = (uint16_t)Value;
+        else
+            *(volatile uint32_t*)(uintptr_t)(Ecam + Offset) = Value;
+    }
+    else
+    {
+        outpd(PCI_CF8_INDEX, PCI_CF8_ENABLE | (PciAddress & 0xFFFF) << 8 | (Offset & 0xFC));
+
+        if (1 == Width)
+            outp((unsigned short)(PCI_CF8_DATA + (Offset & 3)), (int)(uint8_t)Value);
+        else if (2 == Width)
+            outpw((unsigned short)(PCI_CF8_DATA + (Offset & 2)), (unsigned short)Value);
+        else
+            outpd(PCI_CF8_DATA, Value);
+    }
+}
+
+/** cfgxfer()
+
+    Transfer a block from or to the configuration space
+
+    @param[in] PciAddress   PCI_ADDRESS()
+    @param[in] Offset       register offset
+    @param[in] pBuffer      buffer
+    @param[in] Size         number of bytes
+    @param[in] fWrite       true to write, false to read
+
+    @retval number of bytes transferred
+    @retval 0, if the range exceeds the accessible configuration space, last error is set
+
+**/
+static uint32_t cfgxfer(uint32_t PciAddress, uint32_t Offset, uint8_t* pBuffer, uint32_t Size, bool fWrite)
+{
+    uint64_t Ecam;
+    uint32_t Limit = cfglimit(PciAddress, &Ecam), Width, n, dw;
+
+    do {
+
+        if (Offset >= Limit || Size > Limit - Offset)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            Size = 0;
+            break;
+        }
+
+        if (0 == Ecam)
+            EnterCriticalSection4UEFI(&Cf8Lock);
+
+        for (n = 0; n < Size; n += Width, Offset += Width)
+        {
+            Width = (1 & Offset) || 1 == Size - n ? 1 : ((2 & Offset) || Size - n < 4 ? 2 : 4);
+
+            if (fWrite)
+            {
+                dw = 0;
+                memcpy(&dw, &pBuffer[n], Width);                    // little endian
+                cfgwrite(Ecam, PciAddress, Offset, Width, dw);
+            }
+            else
+            {
+                dw = cfgread(Ecam, PciAddress, Offset, Width);
+                memcpy(&pBuffer[n], &dw, Width);
+            }
+        }
+
+        if (0 == Ecam)
+            LeaveCriticalSection4UEFI(&Cf8Lock);
+
+    } while (0);
+
+    return Size;
+}
+
+/** __PciCfgRead()
+Synopsis
+    uint32_t __PciCfgRead(uint32_t PciAddress, uint32_t Offset, uint32_t Width);
+Description
+    Read a single naturally aligned configuration space register
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset, multiple of Width
+    uint32_t Width      :   1, 2, 4
+Returns
+    register value
+    all bits set, if misaligned or not accessible
+**/
+uint32_t __PciCfgRead(uint32_t PciAddress, uint32_t Offset, uint32_t Width)
+{
+    uint32_t dwRet = 0xFFFFFFFF >> (32 - 8 * Width);
+
+    if (0 == (Offset & (Width - 1)))
+        cfgxfer(PciAddress, Offset, (uint8_t*)&dwRet, Width, false);
+
+    return dwRet;
+}
+
+/** PciConfigRead4UEFI()
+Synopsis
+    uint32_t PciConfigRead4UEFI(uint32_t PciAddress, uint32_t Offset, void* pBuffer, uint32_t Size);
+Description
+    Read a block from the configuration space of a PCI function
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset
+    void* pBuffer       :   receives the register values
+    uint32_t Size       :   number of bytes, Offset + Size up to PCI_CFG_SIZE
+                            for ECAM or PCI_CFG_LEGACY_SIZE for CF8/CFC
+Returns
+    number of bytes read
+    0, if the range is not accessible, last error is set to ERROR_INVALID_PARAMETER
+**/
+uint32_t PciConfigRead4UEFI(uint32_t PciAddress, uint32_t Offset, void* pBuffer, uint32_t Size)
+{
+    uint32_t dwRet;
+    INSTR_ENTER();
+
+    dwRet = cfgxfer(PciAddress, Offset, pBuffer, Size, false);
+
+    INSTR_LEAVE(PciConfigRead, 0);
+
+    return dwRet;
+}
+
+/** PciConfigWrite4UEFI()
+Synopsis
+    uint32_t PciConfigWrite4UEFI(uint32_t PciAddress, uint32_t Offset, const void* pBuffer, uint32_t Size);
+Description
+    Write a block to the configuration space of a PCI function
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset
+    const void* pBuffer :   register values
+    uint32_t Size       :   number of bytes, Offset + Size up to PCI_CFG_SIZE
+                            for ECAM or PCI_CFG_LEGACY_SIZE for CF8/CFC
+Returns
+    number of bytes written
+    0, if the range is not accessible, last error is set to ERROR_INVALID_PARAMETER
+**/
+uint32_t PciConfigWrite4UEFI(uint32_t PciAddress, uint32_t Offset, const void* pBuffer, uint32_t Size)
+{
+    uint32_t dwRet;
+    INSTR_ENTER();
+
+    dwRet = cfgxfer(PciAddress, Offset, (uint8_t*)pBuffer, Size, true);
+
+    INSTR_LEAVE(PciConfigWrite, 0);
+
+    return dwRet;
+}
+
+/** PciConfigRead84UEFI()
+Synopsis
+    uint8_t PciConfigRead84UEFI(uint32_t PciAddress, uint32_t Offset);
+Description
+    Read an 8 bit configuration space register
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset
+Returns
+    register value
+    0xFF, if not accessible
+**/
+uint8_t PciConfigRead84UEFI(uint32_t PciAddress, uint32_t Offset)
+{
+    uint8_t bRet;
+    INSTR_ENTER();
+
+    bRet = (uint8_t)__PciCfgRead(PciAddress, Offset, 1);
+
+    INSTR_LEAVE(PciConfigRead8, 0);
+
+    return bRet;
+}
+
+/** PciConfigRead164UEFI()
+Synopsis
+    uint16_t PciConfigRead164UEFI(uint32_t PciAddress, uint32_t Offset);
+Description
+    Read a 16 bit configuration space register
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset, 2 byte aligned
+Returns
+    register value
+    0xFFFF, if misaligned or not accessible
+**/
+uint16_t PciConfigRead164UEFI(uint32_t PciAddress, uint32_t Offset)
+{
+    uint16_t wRet;
+    INSTR_ENTER();
+
+    wRet = (uint16_t)__PciCfgRead(PciAddress, Offset, 2);
+
+    INSTR_LEAVE(PciConfigRead16, 0);
+
+    return wRet;
+}
+
+/** PciConfigRead324UEFI()
+Synopsis
+    uint32_t PciConfigRead324UEFI(uint32_t PciAddress, uint32_t Offset);
+Description
+    Read a 32 bit configuration space register
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset, 4 byte aligned
+Returns
+    register value
+    0xFFFFFFFF, if misaligned or not accessible
+**/
+uint32_t PciConfigRead324UEFI(uint32_t PciAddress, uint32_t Offset)
+{
+    uint32_t dwRet;
+    INSTR_ENTER();
+
+    dwRet = __PciCfgRead(PciAddress, Offset, 4);
+
+    INSTR_LEAVE(PciConfigRead32, 0);
+
+    return dwRet;
+}
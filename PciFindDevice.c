@@ -0,0 +1,170 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    PciFindDevice.c
+
+Abstract:
+
+    PCI function lookup by class code and by vendor/device ID
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+/** classfirst()
+
+    Binary search in class order for the first function of a class, or for the
+    first function behind that class
+
+    @param[in] pIdx         PCI device index
+    @param[in] BaseClass    base class
+    @param[in] SubClass     sub class, PCI_SUBCLASS_ANY for all sub classes
+    @param[in] fBehind      false for the first function of the class,
+                            true for the first function behind the class
+
+    @retval position in pIdx->pClassOrder[]
+
+**/
+static uint32_t classfirst(const PCIIDX* pIdx, uint8_t BaseClass, uint8_t SubClass, bool fBehind)
+{
+    uint32_t lo = 0, hi = pIdx->nEntries, mid, Key, Cls;
+
+    if (PCI_SUBCLASS_ANY == SubClass)
+        Key = (uint32_t)BaseClass << 8 | (fBehind ? 0xFF : 0x00);
+    else
+        Key = (uint32_t)BaseClass << 8 | SubClass;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        Cls = (uint32_t)pIdx->pEntry[pIdx->pClassOrder[mid]].BaseClass << 8 | pIdx->pEntry[pIdx->pClassOrder[mid]].SubClass;
+
+        if (Cls < Key || (fBehind && Cls == Key))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/** PciFindByClass4UEFI()
+Synopsis
+    const PCIDEVENTRY* PciFindByClass4UEFI(uint8_t BaseClass, uint8_t SubClass, uint32_t Instance);
+Description
+    Get the n-th PCI function of a class, e.g. 0x01/0x08 "NVM Express controller".
+    Functions of the same class are counted in address order.
+Paramters
+    uint8_t BaseClass   :   base class
+    uint8_t SubClass    :   sub class, PCI_SUBCLASS_ANY for all sub classes
+    uint32_t Instance   :   instance, 0 for the first function of that class
+Returns
+    pointer to the index entry
+    NULL, if not found
+**/
+const PCIDEVENTRY* PciFindByClass4UEFI(uint8_t BaseClass, uint8_t SubClass, uint32_t Instance)
+{
+    PCIIDX* pIdx;
+    const PCIDEVENTRY* pRet = NULL;
+    uint32_t First;
+    INSTR_ENTER();
+
+    do {
+
+        pIdx = __PciIdxGet();
+
+        if (NULL == pIdx)
+            break;
+
+        First = classfirst(pIdx, BaseClass, SubClass, false);
+
+        if (Instance >= classfirst(pIdx, BaseClass, SubClass, true) - First)
+            break;
+
+        pRet = &pIdx->pEntry[pIdx->pClassOrder[First + Instance]];
+
+    } while (0);
+
+    INSTR_LEAVE(PciFindByClass, 0);
+
+    return pRet;
+}
+
+/** PciFindById4UEFI()
+Synopsis
+    const PCIDEVENTRY* PciFindById4UEFI(uint16_t VendorId, uint16_t DeviceId, uint32_t Instance);
+Description
+    Get the n-th PCI function with a vendor/device ID, in address order
+Paramters
+    uint16_t VendorId   :   vendor ID
+    uint16_t DeviceId   :   device ID, PCI_DEVICEID_ANY for all devices of the vendor
+    uint32_t Instance   :   instance, 0 for the first function with that ID
+Returns
+    pointer to the index entry
+    NULL, if not found
+**/
+const PCIDEVENTRY* PciFindById4UEFI(uint16_t VendorId, uint16_t DeviceId, uint32_t Instance)
+{
+    PCIIDX* pIdx;
+    const PCIDEVENTRY* pRet = NULL;
+    uint32_t i;
+    INSTR_ENTER();
+
+    pIdx = __PciIdxGet();
+
+    for (i = 0; NULL != pIdx && i < pIdx->nEntries; i++)
+    {
+        if (VendorId != pIdx->pEntry[i].VendorId)
+            continue;
+
+        if (PCI_DEVICEID_ANY != DeviceId && DeviceId != pIdx->pEntry[i].DeviceId)
+            continue;
+
+        if (0 == Instance--)
+        {
+            pRet = &pIdx->pEntry[i];
+            break;
+        }
+    }
+
+    INSTR_LEAVE(PciFindById, 0);
+
+    return pRet;
+}
+
+/** PciClassCount4UEFI()
+Synopsis
+    uint32_t PciClassCount4UEFI(uint8_t BaseClass, uint8_t SubClass);
+Description
+    Get the number of PCI functions of a class
+Paramters
+    uint8_t BaseClass   :   base class
+    uint8_t SubClass    :   sub class, PCI_SUBCLASS_ANY for all sub classes
+Returns
+    number of functions
+**/
+uint32_t PciClassCount4UEFI(uint8_t BaseClass, uint8_t SubClass)
+{
+    PCIIDX* pIdx;
+    uint32_t nRet = 0;
+    INSTR_ENTER();
+
+    pIdx = __PciIdxGet();
+
+    if (NULL != pIdx)
+        nRet = classfirst(pIdx, BaseClass, SubClass, true) - classfirst(pIdx, BaseClass, SubClass, false);
+
+    INSTR_LEAVE(PciClassCount, 0);
+
+    return nRet;
+}
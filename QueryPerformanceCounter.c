@@ -19,9 +19,13 @@ Abstract:
 
 #include <uefi.h>
 #include <stdint.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
 
 #define IsEqualGUID(rguid1, rguid2) (!memcmp(rguid1, rguid2, sizeof(GUID))) //guiddef.h
 
+static int QpcMode = QPCMODE_DEFAULT;
+
 /** QueryPerformanceCounter()
 Synopsis
     BOOL QueryPerformanceCounter(LARGE_INTEGER *lpPerformanceCount);
@@ -30,6 +34,11 @@ Description
     Retrieves the current value of the performance counter, which is a high resolution (<1us) time stamp that 
     can be used for time-interval measurements.
 
+    NOTE:   The performance counter is the raw TSC. QueryPerformanceFrequency() reports
+            the TSC counts per second.
+            With QPCMODE_SERIALIZED the TSC read is fenced by LFENCE, so that it is not
+            reordered with the code under measurement, see SetPerformanceCounterMode4UEFI()
+
 Paramters
     https://docs.microsoft.com/en-us/windows/win32/api/profileapi/nf-profileapi-queryperformancecounter#parameters
 Returns
@@ -37,7 +46,41 @@ Returns
 **/
 int32_t EFIAPI QueryPerformanceCounter4UEFI(int64_t* lpPerformanceCount)
 {
-    *lpPerformanceCount = __rdtsc() / 1000;
+    INSTR_ENTER();
+
+    if (QPCMODE_SERIALIZED == QpcMode)
+    {
+        _mm_lfence();                                       // wait for all previous instructions to complete
+        *lpPerformanceCount = (int64_t)__rdtsc();
+        _mm_lfence();                                       // hold back subsequent instructions
+    }
+    else
+        *lpPerformanceCount = (int64_t)__rdtsc();
+
+    INSTR_LEAVE(QueryPerformanceCounter, 0);
 
     return 1;
-}
\ No newline at end of file
+}
+
+/** SetPerformanceCounterMode4UEFI()
+Synopsis
+    int SetPerformanceCounterMode4UEFI(int Mode);
+Description
+    Select how QueryPerformanceCounter() reads the TSC
+Paramters
+    int Mode    :   QPCMODE_DEFAULT     plain RDTSC
+                    QPCMODE_SERIALIZED  LFENCE, RDTSC, LFENCE for precise microbenchmarks
+Returns
+    previous mode
+**/
+int SetPerformanceCounterMode4UEFI(int Mode)
+{
+    int nRet = QpcMode;
+    INSTR_ENTER();
+
+    QpcMode = Mode;
+
+    INSTR_LEAVE(SetPerformanceCounterMode, 0);
+
+    return nRet;
+}
@@ -0,0 +1,75 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    QueryUnbiasedInterruptTime.c
+
+Abstract:
+
+    Win32 API QueryUnbiasedInterruptTime() for UEFI
+
+    Gets the current unbiased interrupt-time count, in units of 100 nanoseconds.
+
+--*/
+#include <Uefi.h>
+#include <stdint.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+static INITONCE ScaleOnce = INITONCE_STATIC_INIT;
+static TSCSCALE HnsScale;
+
+/** scaleinit()
+
+    InitOnceExecuteOnce() callback, set up the TSC to 100ns conversion
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    not used
+    @param[in] Context      not used
+
+    @retval 1
+
+**/
+static int scaleinit(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    __TscScaleInit(&HnsScale, 10000000);
+
+    return 1;
+}
+
+/** QueryUnbiasedInterruptTime()
+Synopsis
+    BOOL QueryUnbiasedInterruptTime(PULONGLONG UnbiasedTime);
+    https://docs.microsoft.com/en-us/windows/win32/api/realtimeapiset/nf-realtimeapiset-queryunbiasedinterrupttime#syntax
+Description
+    Gets the current unbiased interrupt-time count, in units of 100 nanoseconds.
+
+    NOTE:   There is no sleep or hibernate state in UEFI, so the count is the
+            time since platform reset, taken from the TSC like GetTickCount64()
+
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/realtimeapiset/nf-realtimeapiset-queryunbiasedinterrupttime#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/realtimeapiset/nf-realtimeapiset-queryunbiasedinterrupttime#return-value
+**/
+int EFIAPI QueryUnbiasedInterruptTime4UEFI(uint64_t* UnbiasedTime)
+{
+    int nRet = 0;
+    INSTR_ENTER();
+
+    if (NULL != UnbiasedTime)
+    {
+        InitOnceExecuteOnce4UEFI(&ScaleOnce, scaleinit, NULL, NULL);
+
+        *UnbiasedTime = __TscScale(&HnsScale, __rdtsc());
+        nRet = 1;
+    }
+
+    INSTR_LEAVE(QueryUnbiasedInterruptTime, 0);
+
+    return nRet;
+}
@@ -0,0 +1,112 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    QueueUserWorkItem.c
+
+Abstract:
+
+    Win32 API QueueUserWorkItem() and TrySubmitThreadpoolCallback() for UEFI
+
+    Work items are thread objects without a handle, they return to the pool
+    as soon as the callback has returned.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Win324UEFI.h"
+
+/** QueueUserWorkItem()
+Synopsis
+    int QueueUserWorkItem4UEFI(uint32_t (*Function)(void* Context), void* Context, uint32_t Flags);
+    https://docs.microsoft.com/en-us/windows/win32/api/threadpoollegacyapiset/nf-threadpoollegacyapiset-queueuserworkitem#syntax
+Description
+    Queues a work item to a worker thread in the thread pool.
+
+    NOTE: Flags are ignored, all items run on the APs of the thread pool.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/threadpoollegacyapiset/nf-threadpoollegacyapiset-queueuserworkitem#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/threadpoollegacyapiset/nf-threadpoollegacyapiset-queueuserworkitem#return-value
+**/
+int QueueUserWorkItem4UEFI(uint32_t (*Function)(void* Context), void* Context, uint32_t Flags)
+{
+    THREADOBJ* pThread = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == Function)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        pThread = __ThreadAlloc();
+
+        if (NULL == pThread)
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        pThread->pfnStart = Function;
+        pThread->lpParameter = Context;
+
+        __ThreadSubmit(pThread);
+
+    } while (0);
+
+    INSTR_LEAVE(QueueUserWorkItem, 0);
+
+    return NULL != pThread;
+}
+
+/** TrySubmitThreadpoolCallback()
+Synopsis
+    int TrySubmitThreadpoolCallback4UEFI(void (*pfns)(void* Instance, void* Context), void* pv, void* pcbe);
+    https://docs.microsoft.com/en-us/windows/win32/api/threadpoolapiset/nf-threadpoolapiset-trysubmitthreadpoolcallback#syntax
+Description
+    Requests that a thread pool worker thread call the specified callback function.
+
+    NOTE: The callback environment pcbe is ignored, the Instance parameter of the callback is NULL.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/threadpoolapiset/nf-threadpoolapiset-trysubmitthreadpoolcallback#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/threadpoolapiset/nf-threadpoolapiset-trysubmitthreadpoolcallback#return-value
+**/
+int TrySubmitThreadpoolCallback4UEFI(void (*pfns)(void* Instance, void* Context), void* pv, void* pcbe)
+{
+    THREADOBJ* pThread = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pfns)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        pThread = __ThreadAlloc();
+
+        if (NULL == pThread)
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        pThread->pfnCallback = pfns;
+        pThread->lpParameter = pv;
+
+        __ThreadSubmit(pThread);
+
+    } while (0);
+
+    INSTR_LEAVE(TrySubmitThreadpoolCallback, 0);
+
+    return NULL != pThread;
+}
@@ -0,0 +1,163 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    SRWLock.c
+
+Abstract:
+
+    Win32 API *SRWLock*() for UEFI
+
+    RWLOCK.State holds the exclusive owner in bit 0 and the number of shared
+    owners above. A writer, that can't acquire the lock at once, announces itself
+    in RWLOCK.WritersWaiting. New shared owners are held back as long as writers
+    wait, so that a continuous stream of readers can't starve the writers.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_InterlockedCompareExchange, _InterlockedExchangeAdd, _InterlockedIncrement, _InterlockedDecrement, _ReadWriteBarrier)
+
+#define RWLOCK_EXCLUSIVE    1
+#define RWLOCK_SHARED       2
+
+/** InitializeSRWLock()
+Synopsis
+    void InitializeSRWLock4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializesrwlock#syntax
+Description
+    Initialize a slim reader/writer (SRW) lock.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializesrwlock#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-initializesrwlock#return-value
+**/
+void InitializeSRWLock4UEFI(RWLOCK* SRWLock)
+{
+    SRWLock->State = 0;
+    SRWLock->WritersWaiting = 0;
+}
+
+/** TryAcquireSRWLockShared()
+Synopsis
+    int TryAcquireSRWLockShared4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryacquiresrwlockshared#syntax
+Description
+    Attempts to acquire a slim reader/writer (SRW) lock in shared mode.
+
+    NOTE: Fails also, while writers wait for the lock.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryacquiresrwlockshared#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryacquiresrwlockshared#return-value
+**/
+int TryAcquireSRWLockShared4UEFI(RWLOCK* SRWLock)
+{
+    long State = SRWLock->State;
+
+    return 0 == (RWLOCK_EXCLUSIVE & State)
+        && 0 == SRWLock->WritersWaiting
+        && State == _InterlockedCompareExchange(&SRWLock->State, State + RWLOCK_SHARED, State);
+}
+
+/** TryAcquireSRWLockExclusive()
+Synopsis
+    int TryAcquireSRWLockExclusive4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryacquiresrwlockexclusive#syntax
+Description
+    Attempts to acquire a slim reader/writer (SRW) lock in exclusive mode.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryacquiresrwlockexclusive#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-tryacquiresrwlockexclusive#return-value
+**/
+int TryAcquireSRWLockExclusive4UEFI(RWLOCK* SRWLock)
+{
+    return 0 == SRWLock->State
+        && 0 == _InterlockedCompareExchange(&SRWLock->State, RWLOCK_EXCLUSIVE, 0);
+}
+
+/** AcquireSRWLockShared()
+Synopsis
+    void AcquireSRWLockShared4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-acquiresrwlockshared#syntax
+Description
+    Acquires a slim reader/writer (SRW) lock in shared mode.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-acquiresrwlockshared#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-acquiresrwlockshared#return-value
+**/
+void AcquireSRWLockShared4UEFI(RWLOCK* SRWLock)
+{
+    uint32_t Backoff = 1;
+
+    while (0 == TryAcquireSRWLockShared4UEFI(SRWLock))
+        __SpinBackoff(&Backoff);
+}
+
+/** AcquireSRWLockExclusive()
+Synopsis
+    void AcquireSRWLockExclusive4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-acquiresrwlockexclusive#syntax
+Description
+    Acquires a slim reader/writer (SRW) lock in exclusive mode.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-acquiresrwlockexclusive#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-acquiresrwlockexclusive#return-value
+**/
+void AcquireSRWLockExclusive4UEFI(RWLOCK* SRWLock)
+{
+    uint32_t Backoff = 1;
+
+    if (0 == TryAcquireSRWLockExclusive4UEFI(SRWLock))
+    {
+        _InterlockedIncrement(&SRWLock->WritersWaiting);            // hold back new readers
+
+        while (0 == TryAcquireSRWLockExclusive4UEFI(SRWLock))
+            __SpinBackoff(&Backoff);
+
+        _InterlockedDecrement(&SRWLock->WritersWaiting);
+    }
+}
+
+/** ReleaseSRWLockShared()
+Synopsis
+    void ReleaseSRWLockShared4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-releasesrwlockshared#syntax
+Description
+    Releases a slim reader/writer (SRW) lock that was acquired in shared mode.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-releasesrwlockshared#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-releasesrwlockshared#return-value
+**/
+void ReleaseSRWLockShared4UEFI(RWLOCK* SRWLock)
+{
+    _InterlockedExchangeAdd(&SRWLock->State, -RWLOCK_SHARED);
+}
+
+/** ReleaseSRWLockExclusive()
+Synopsis
+    void ReleaseSRWLockExclusive4UEFI(RWLOCK* SRWLock);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-releasesrwlockexclusive#syntax
+Description
+    Releases a slim reader/writer (SRW) lock that was acquired in exclusive mode.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-releasesrwlockexclusive#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-releasesrwlockexclusive#return-value
+**/
+void ReleaseSRWLockExclusive4UEFI(RWLOCK* SRWLock)
+{
+    _ReadWriteBarrier();
+    SRWLock->State = 0;                                             // x64 stores are not reordered with older stores
+}
@@ -10,13 +10,118 @@ Module Name:
 
 Abstract:
 
-    Win32 API GetTickCount64() for UEFI
+    Win32 API Sleep() for UEFI
 
-    Retrieves the number of milliseconds that have elapsed since the system was started.
+    Suspends the execution of the current thread until the time-out interval elapses.
+
+    The deadline is kept in TSC counts. Depending on the remaining time the wait is done
+        1. by a UEFI timer event and WaitForEvent(), that allows the CPU to halt
+        2. by gBS->Stall()
+        3. by spinning on the TSC with PAUSE
+    Each tier hands over to the next, more precise one before the deadline.
+
+    Thread pool items on APs must not call boot services, they spin on the TSC only.
 
 --*/
+#include <uefi.h>
 #include <stdint.h>
-#include <time.h>
+#include <stdbool.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+#define SLEEP_TIMER_MIN_US      20000   // wait for timer event if >= 20ms remain...
+#define SLEEP_TIMER_SLACK_US    10000   // ... and wake up 10ms early, that is one timer tick at most
+#define SLEEP_STALL_MIN_US      1000    // Stall() if >= 1ms remain...
+#define SLEEP_STALL_SLACK_US    100     // ... and return 100us early
+                                        // spin on the TSC for the rest
+
+/** waittimer()
+
+    Wait for a one-shot UEFI timer event
+
+    @param[in] qwMicroseconds time to wait
+
+    @retval true    success
+    @retval false   timer event not available, e.g. TPL above TPL_APPLICATION
+
+**/
+static bool waittimer(uint64_t qwMicroseconds)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    EFI_EVENT Event = NULL;
+    EFI_STATUS Status;
+    UINTN Index;
+
+    Status = pBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Event);
+
+    if (EFI_SUCCESS == Status)
+    {
+        Status = pBS->SetTimer(Event, TimerRelative, qwMicroseconds * 10);  // 100ns units
+
+        if (EFI_SUCCESS == Status)
+            Status = pBS->WaitForEvent(1, &Event, &Index);
+
+        pBS->CloseEvent(Event);
+    }
+
+    return EFI_SUCCESS == Status;
+}
+
+/** sleeptsc()
+
+    Sleep for the given number of TSC counts, on APs by spinning only
+
+    @param[in] qwTscDelta TSC counts to sleep
+
+    @retval VOID
+
+**/
+static void sleeptsc(uint64_t qwTscDelta)
+{
+    uint64_t qwTscPerUs = __TscPerSec() / 1000000;
+    uint64_t qwDeadline = __rdtsc() + qwTscDelta;
+    int64_t remain;
+    bool fAP = 0 <= __ThreadPoolSelf();
+    bool fTimer = false == fAP;
+
+    if (0 == qwTscPerUs)
+        qwTscPerUs = 1;
+
+    while (0 < (remain = (int64_t)(qwDeadline - __rdtsc())))
+    {
+        uint64_t qwUs = (uint64_t)remain / qwTscPerUs;
+
+        if (true == fTimer && qwUs >= SLEEP_TIMER_MIN_US)
+            fTimer = waittimer(qwUs - SLEEP_TIMER_SLACK_US);            // on failure fall back to Stall()
+        else if (false == fAP && qwUs >= SLEEP_STALL_MIN_US)
+            pEfiSystemTable->BootServices->Stall((UINTN)(qwUs - SLEEP_STALL_SLACK_US));
+        else
+            _mm_pause();
+    }
+}
+
+/** timetotsc()
+
+    Convert milli-, micro- or nanoseconds to TSC counts
+
+    @param[in] qwTime   time
+    @param[in] qwUnits  units per second of qwTime, 1000, 1000000 or 1000000000
+
+    @retval TSC counts
+
+**/
+static uint64_t timetotsc(uint64_t qwTime, uint64_t qwUnits)
+{
+    uint64_t qwTscPerSec = __TscPerSec();
+
+    return (qwTime / qwUnits) * qwTscPerSec + (qwTime % qwUnits) * qwTscPerSec / qwUnits;
+}
+
 /** Sleep()
 Synopsis
     void Sleep(uint32_t dwMilliseconds);
@@ -31,7 +136,52 @@ Returns
 **/
 void Sleep4UEFI(uint32_t dwMilliseconds)
 {
-    clock_t end = (clock_t)dwMilliseconds + clock();
-    while (end > clock())
-        ;
+    INSTR_ENTER();
+
+    if (0 != dwMilliseconds)
+        sleeptsc(timetotsc(dwMilliseconds, 1000));
+
+    INSTR_LEAVE(Sleep, 0);
+}
+
+/** SleepMicroseconds4UEFI()
+Synopsis
+    void SleepMicroseconds4UEFI(uint64_t qwMicroseconds);
+Description
+    Sleep() with microsecond resolution
+Paramters
+    uint64_t qwMicroseconds :   time to sleep in microseconds
+Returns
+    none
+**/
+void SleepMicroseconds4UEFI(uint64_t qwMicroseconds)
+{
+    INSTR_ENTER();
+
+    if (0 != qwMicroseconds)
+        sleeptsc(timetotsc(qwMicroseconds, 1000000));
+
+    INSTR_LEAVE(SleepMicroseconds, 0);
+}
+
+/** SleepNanoseconds4UEFI()
+Synopsis
+    void SleepNanoseconds4UEFI(uint64_t qwNanoseconds);
+Description
+    Sleep() with nanosecond resolution
+
+    NOTE:   Very short times are dominated by the call overhead of some 10ns
+Paramters
+    uint64_t qwNanoseconds  :   time to sleep in nanoseconds
+Returns
+    none
+**/
+void SleepNanoseconds4UEFI(uint64_t qwNanoseconds)
+{
+    INSTR_ENTER();
+
+    if (0 != qwNanoseconds)
+        sleeptsc(timetotsc(qwNanoseconds, 1000000000));
+
+    INSTR_LEAVE(SleepNanoseconds, 0);
 }
@@ -0,0 +1,141 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    SmbiosFindStructure.c
+
+Abstract:
+
+    SMBIOS structure lookup by type and by handle
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+/** SmbiosFindByType4UEFI()
+Synopsis
+    const void* SmbiosFindByType4UEFI(uint8_t Type, uint32_t Instance, uint32_t* pSize);
+Description
+    Get the n-th SMBIOS structure of a type, e.g. type 17 "Memory Device"
+
+    NOTE:   The pointer refers to the RawSMBIOSData copy, that is returned
+            by GetSystemFirmwareTable('RSMB'), not to the firmware table
+Paramters
+    uint8_t Type        :   structure type
+    uint32_t Instance   :   instance, 0 for the first structure of that type
+    uint32_t* pSize     :   receives the size including the string-set, may be NULL
+Returns
+    pointer to the structure
+    NULL, if not found
+**/
+const void* SmbiosFindByType4UEFI(uint8_t Type, uint32_t Instance, uint32_t* pSize)
+{
+    SMBIOSIDX* pIdx;
+    const SMBIOSIDXENTRY* pEntry;
+    const void* pRet = NULL;
+    INSTR_ENTER();
+
+    pIdx = __SmbiosIdxGet();
+
+    if (NULL != pIdx && Instance < pIdx->TypeFirst[Type + 1] - pIdx->TypeFirst[Type])
+    {
+        pEntry = &pIdx->pEntry[pIdx->TypeFirst[Type] + Instance];
+
+        if (NULL != pSize)
+            *pSize = pEntry->Size;
+
+        pRet = &pIdx->pRaw->SMBIOSTableData[pEntry->Offset];
+    }
+
+    INSTR_LEAVE(SmbiosFindByType, 0);
+
+    return pRet;
+}
+
+/** SmbiosFindByHandle4UEFI()
+Synopsis
+    const void* SmbiosFindByHandle4UEFI(uint16_t Handle, uint32_t* pSize);
+Description
+    Get the SMBIOS structure with the given handle, e.g. to follow the
+    "Memory Array Handle" of a type 17 structure
+Paramters
+    uint16_t Handle     :   structure handle
+    uint32_t* pSize     :   receives the size including the string-set, may be NULL
+Returns
+    pointer to the structure
+    NULL, if not found
+**/
+const void* SmbiosFindByHandle4UEFI(uint16_t Handle, uint32_t* pSize)
+{
+    SMBIOSIDX* pIdx;
+    const SMBIOSIDXENTRY* pEntry;
+    const void* pRet = NULL;
+    uint32_t lo = 0, hi, mid;
+    INSTR_ENTER();
+
+    do {
+
+        pIdx = __SmbiosIdxGet();
+
+        if (NULL == pIdx)
+            break;
+
+        for (hi = pIdx->nEntries; lo < hi;)                         // binary search in handle order
+        {
+            mid = lo + (hi - lo) / 2;
+
+            if (pIdx->pEntry[pIdx->pHandleOrder[mid]].Handle < Handle)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == pIdx->nEntries || pIdx->pEntry[pIdx->pHandleOrder[lo]].Handle != Handle)
+            break;
+
+        pEntry = &pIdx->pEntry[pIdx->pHandleOrder[lo]];
+
+        if (NULL != pSize)
+            *pSize = pEntry->Size;
+
+        pRet = &pIdx->pRaw->SMBIOSTableData[pEntry->Offset];
+
+    } while (0);
+
+    INSTR_LEAVE(SmbiosFindByHandle, 0);
+
+    return pRet;
+}
+
+/** SmbiosTypeCount4UEFI()
+Synopsis
+    uint32_t SmbiosTypeCount4UEFI(uint8_t Type);
+Description
+    Get the number of SMBIOS structures of a type
+Paramters
+    uint8_t Type        :   structure type
+Returns
+    number of structures
+**/
+uint32_t SmbiosTypeCount4UEFI(uint8_t Type)
+{
+    SMBIOSIDX* pIdx;
+    uint32_t nRet;
+    INSTR_ENTER();
+
+    pIdx = __SmbiosIdxGet();
+    nRet = NULL == pIdx ? 0 : pIdx->TypeFirst[Type + 1] - pIdx->TypeFirst[Type];
+
+    INSTR_LEAVE(SmbiosTypeCount, 0);
+
+    return nRet;
+}
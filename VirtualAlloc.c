@@ -0,0 +1,356 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    VirtualAlloc.c
+
+Abstract:
+
+    Win32 API VirtualAlloc() and VirtualFree() for UEFI
+
+    UEFI identity maps all memory, there is no address space to reserve apart from
+    the memory itself. So each region is reserved and committed at once by AllocatePages()
+    and tracked in an array sorted by address. Committing pages of a reserved region
+    returns them as they are, decommitting zeroes them.
+
+    Regions, that are not released by the application, are released at exit.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Win324UEFI.h"
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+typedef struct _VREGION {
+    uint64_t Base;                      // address of the first page
+    uint64_t nPages;                    // number of 4KiB pages
+}VREGION;
+
+static VREGION* pRegion;                                            // sorted by Base
+static size_t nRegions, nRegionsMax;
+static bool fAtExit = false;
+
+/** find()
+
+    Binary search the region, that contains an address
+
+    @param[in] qwAddress    address
+
+    @retval index of the region
+    @retval -1, if not within a region
+
+**/
+static intptr_t find(uint64_t qwAddress)
+{
+    size_t lo = 0, hi = nRegions, mid;
+
+    while (lo < hi)                                                 // first region above qwAddress
+    {
+        mid = (lo + hi) / 2;
+
+        if (pRegion[mid].Base <= qwAddress)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return 0 != lo && qwAddress < pRegion[lo - 1].Base + pRegion[lo - 1].nPages * VMEM_PAGE_SIZE ? (intptr_t)lo - 1 : -1;
+}
+
+/** insert()
+
+    Insert a region into the sorted array
+
+    @param[in] qwBase   address of the first page
+    @param[in] nPages   number of pages
+
+    @retval true    success
+    @retval false   out of memory
+
+**/
+static bool insert(uint64_t qwBase, uint64_t nPages)
+{
+    VREGION* pNew;
+    size_t i;
+    bool fRet = false;
+
+    do {
+        if (nRegions == nRegionsMax)
+        {
+            pNew = realloc(pRegion, (nRegionsMax ? 2 * nRegionsMax : 16) * sizeof(VREGION));
+
+            if (NULL == pNew)
+                break;
+
+            pRegion = pNew;
+            nRegionsMax = nRegionsMax ? 2 * nRegionsMax : 16;
+        }
+
+        for (i = nRegions; i > 0 && pRegion[i - 1].Base > qwBase; i--)
+            pRegion[i] = pRegion[i - 1];
+
+        pRegion[i].Base = qwBase;
+        pRegion[i].nPages = nPages;
+        nRegions++;
+        fRet = true;
+
+    } while (0);
+
+    return fRet;
+}
+
+/** releaseall()
+
+    atexit() handler, release all regions not released by the application
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void releaseall(void)
+{
+    while (0 != nRegions)
+    {
+        nRegions--;
+        __PagesFree((void*)(uintptr_t)pRegion[nRegions].Base, (size_t)pRegion[nRegions].nPages);
+    }
+
+    free(pRegion);
+    pRegion = NULL;
+    nRegionsMax = 0;
+}
+
+/** __PagesAlloc()
+Synopsis
+    void* __PagesAlloc(size_t nPages, size_t nAlignPages);
+Description
+    Allocate pages by AllocatePages(), aligned to a power of 2 number of pages.
+    The pages below and above the aligned range are freed at once.
+
+    NOTE: Boot services must not be called on APs, NULL is returned there.
+Paramters
+    size_t nPages           :   number of 4KiB pages
+    size_t nAlignPages      :   alignment in pages, a power of 2
+Returns
+    address of the first page
+    NULL, if out of memory or called on an AP
+**/
+void* __PagesAlloc(size_t nPages, size_t nAlignPages)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    EFI_PHYSICAL_ADDRESS qwBase, qwAligned;
+    size_t nTotal = nPages + nAlignPages - 1, nHead;
+    void* pRet = NULL;
+
+    do {
+        if (0 == nPages || 0 <= __ThreadPoolSelf())
+            break;
+
+        if (EFI_SUCCESS != pBS->AllocatePages(AllocateAnyPages, EfiLoaderData, nTotal, &qwBase))
+            break;
+
+        qwAligned = (qwBase + nAlignPages * VMEM_PAGE_SIZE - 1) & ~(nAlignPages * VMEM_PAGE_SIZE - 1);
+        nHead = (size_t)((qwAligned - qwBase) / VMEM_PAGE_SIZE);
+
+        if (0 != nHead)
+            pBS->FreePages(qwBase, nHead);
+
+        if (0 != nTotal - nHead - nPages)
+            pBS->FreePages(qwAligned + nPages * VMEM_PAGE_SIZE, nTotal - nHead - nPages);
+
+        pRet = (void*)(uintptr_t)qwAligned;
+
+    } while (0);
+
+    return pRet;
+}
+
+/** __PagesFree()
+Synopsis
+    void __PagesFree(void* pBase, size_t nPages);
+Description
+    Free pages allocated by __PagesAlloc()
+Paramters
+    void* pBase             :   address of the first page
+    size_t nPages           :   number of 4KiB pages
+Returns
+    none
+**/
+void __PagesFree(void* pBase, size_t nPages)
+{
+    pEfiSystemTable->BootServices->FreePages((EFI_PHYSICAL_ADDRESS)(uintptr_t)pBase, nPages);
+}
+
+/** VirtualAlloc()
+Synopsis
+    void* VirtualAlloc4UEFI(void* lpAddress, size_t dwSize, uint32_t flAllocationType, uint32_t flProtect);
+    https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualalloc#syntax
+Description
+    Reserves, commits, or changes the state of a region of pages.
+
+    NOTE: Reserved pages are committed at once, the region is backed by memory.
+    NOTE: Regions are 4KiB granular, 2MiB granular and aligned for MEM_LARGE_PAGES
+          or dwSize of 2MiB and above.
+    NOTE: flProtect is ignored, pages are readable, writable and executable.
+    NOTE: Must not be called on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualalloc#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualalloc#return-value
+**/
+void* VirtualAlloc4UEFI(void* lpAddress, size_t dwSize, uint32_t flAllocationType, uint32_t flProtect)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    EFI_PHYSICAL_ADDRESS qwBase = (uintptr_t)lpAddress & ~(uintptr_t)(VMEM_PAGE_SIZE - 1);
+    uint64_t qwEnd = ((uintptr_t)lpAddress + dwSize + VMEM_PAGE_SIZE - 1) & ~(uint64_t)(VMEM_PAGE_SIZE - 1);
+    size_t nPages = (size_t)((qwEnd - qwBase) / VMEM_PAGE_SIZE), nAlign = 1;
+    intptr_t Idx;
+    void* pRet = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (0 == dwSize || 0 == ((MEM_COMMIT | MEM_RESERVE) & flAllocationType) || 0 != (~(MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES) & flAllocationType))
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        if (NULL != lpAddress && 0 <= (Idx = find(qwBase)))         // commit pages of a region
+        {
+            if (0 == (MEM_COMMIT & flAllocationType) || qwEnd > pRegion[Idx].Base + pRegion[Idx].nPages * VMEM_PAGE_SIZE)
+                SetLastError4UEFI(ERROR_INVALID_ADDRESS);
+            else
+                pRet = (void*)(uintptr_t)qwBase;                    // committed on reservation
+
+            break;
+        }
+
+        if (NULL != lpAddress)                                      // reserve at the given address
+        {
+            if (0 == (MEM_RESERVE & flAllocationType) || 0 <= __ThreadPoolSelf()
+                || EFI_SUCCESS != pBS->AllocatePages(AllocateAddress, EfiLoaderData, nPages, &qwBase))
+            {
+                SetLastError4UEFI(ERROR_INVALID_ADDRESS);
+                break;
+            }
+        }
+        else
+        {
+            if ((MEM_LARGE_PAGES & flAllocationType) || dwSize >= VMEM_LARGE_SIZE)
+            {
+                nAlign = VMEM_LARGE_SIZE / VMEM_PAGE_SIZE;
+                nPages = (dwSize + VMEM_LARGE_SIZE - 1) / VMEM_LARGE_SIZE * nAlign;
+            }
+            else
+                nPages = (dwSize + VMEM_PAGE_SIZE - 1) / VMEM_PAGE_SIZE;
+
+            qwBase = (uintptr_t)__PagesAlloc(nPages, nAlign);
+
+            if (0 == qwBase)
+            {
+                SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+                break;
+            }
+        }
+
+        if (false == insert(qwBase, nPages))
+        {
+            pBS->FreePages(qwBase, nPages);
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        if (false == fAtExit)
+            fAtExit = 0 == atexit(releaseall);
+
+        pRet = memset((void*)(uintptr_t)qwBase, 0, nPages * VMEM_PAGE_SIZE);
+
+    } while (0);
+
+    INSTR_LEAVE(VirtualAlloc, 0);
+
+    return pRet;
+}
+
+/** VirtualFree()
+Synopsis
+    int VirtualFree4UEFI(void* lpAddress, size_t dwSize, uint32_t dwFreeType);
+    https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualfree#syntax
+Description
+    Releases, decommits, or releases and decommits a region of pages.
+
+    NOTE: MEM_DECOMMIT zeroes the pages, they remain backed by memory until MEM_RELEASE.
+    NOTE: Must not be called on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualfree#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualfree#return-value
+**/
+int VirtualFree4UEFI(void* lpAddress, size_t dwSize, uint32_t dwFreeType)
+{
+    uint64_t qwBase = (uintptr_t)lpAddress & ~(uintptr_t)(VMEM_PAGE_SIZE - 1), qwEnd;
+    intptr_t Idx = find(qwBase);
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+        if (0 > Idx)
+        {
+            SetLastError4UEFI(ERROR_INVALID_ADDRESS);
+            break;
+        }
+
+        qwEnd = pRegion[Idx].Base + pRegion[Idx].nPages * VMEM_PAGE_SIZE;
+
+        if (MEM_RELEASE == dwFreeType)
+        {
+            if (0 != dwSize || qwBase != pRegion[Idx].Base || 0 <= __ThreadPoolSelf())
+            {
+                SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+                break;
+            }
+
+            __PagesFree((void*)(uintptr_t)qwBase, (size_t)pRegion[Idx].nPages);
+
+            memmove(&pRegion[Idx], &pRegion[Idx + 1], (nRegions - Idx - 1) * sizeof(VREGION));
+            nRegions--;
+            nRet = 1;
+            break;
+        }
+
+        if (MEM_DECOMMIT == dwFreeType)
+        {
+            if (0 != dwSize)
+                qwEnd = ((uintptr_t)lpAddress + dwSize + VMEM_PAGE_SIZE - 1) & ~(uint64_t)(VMEM_PAGE_SIZE - 1);
+
+            if (qwEnd > pRegion[Idx].Base + pRegion[Idx].nPages * VMEM_PAGE_SIZE)
+            {
+                SetLastError4UEFI(ERROR_INVALID_ADDRESS);
+                break;
+            }
+
+            memset((void*)(uintptr_t)qwBase, 0, (size_t)(qwEnd - qwBase));
+            nRet = 1;
+            break;
+        }
+
+        SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+
+    } while (0);
+
+    INSTR_LEAVE(VirtualFree, 0);
+
+    return nRet;
+}
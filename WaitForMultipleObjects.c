@@ -0,0 +1,243 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    WaitForMultipleObjects.c
+
+Abstract:
+
+    Win32 API WaitForSingleObject() and WaitForMultipleObjects() for UEFI
+
+    Each pass advances the timer wheel and expires the awaited timers from the TSC.
+    Until the nearest deadline, either of the awaited timers or of the time-out, the
+    wait is done
+        1. by WaitForEvent() on the periodic timer event of the timer wheel, that allows the CPU to halt
+        2. by gBS->Stall()
+        3. by spinning on the TSC with PAUSE
+    so that the wake-up jitter is bound by the TSC, not by the UEFI timer tick.
+
+    Threads signal their handle from an AP, without a UEFI event. While threads are
+    awaited, the BSP runs queued thread pool items instead, or spins with PAUSE.
+
+    Thread pool items on APs may wait for thread handles only. The timer wheel and
+    its UEFI event belong to the BSP, timer handles fail with ERROR_NOT_SUPPORTED.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+#define WAIT_EVENT_MIN_US       12000   // WaitForEvent() if >= 12ms remain, one timer tick may be 10ms
+#define WAIT_STALL_MIN_US       1000    // Stall() if >= 1ms remain...
+#define WAIT_STALL_SLACK_US     100     // ... and return 100us early
+                                        // spin on the TSC for the rest
+
+/** signaled()
+
+    Expire the awaited timers and check the wait condition. If satisfied, the
+    signaled state of auto-reset objects is consumed.
+
+    @param[in] nCount       number of handles
+    @param[in] pObjArg      awaited objects
+    @param[in] bWaitAll     wait for all objects
+    @param[in] qwTscNow     current TSC
+
+    @retval index of the signaled object, 0 if bWaitAll
+    @retval -1, if the wait condition is not satisfied
+
+**/
+static int signaled(uint32_t nCount, WAITOBJ* const* pObjArg, int bWaitAll, uint64_t qwTscNow)
+{
+    volatile WAITOBJ* const* pObj = (volatile WAITOBJ* const*)pObjArg;     // threads are signaled by APs
+    uint32_t i;
+    int nRet = -1;
+
+    for (i = 0; i < nCount; i++)
+        if (WAITOBJ_TIMER == pObj[i]->Signature)
+            __TimerWheelExpire((TIMEROBJ*)pObjArg[i], qwTscNow);
+
+    do {
+        if (bWaitAll)
+        {
+            for (i = 0; i < nCount; i++)
+                if (false == pObj[i]->fSignaled)
+                    break;
+
+            if (i < nCount)
+                break;
+
+            for (i = 0; i < nCount; i++)
+                if (false == pObj[i]->fManualReset)
+                    pObj[i]->fSignaled = false;
+
+            nRet = 0;
+        }
+        else
+        {
+            for (i = 0; i < nCount; i++)
+                if (pObj[i]->fSignaled)
+                    break;
+
+            if (i == nCount)
+                break;
+
+            if (false == pObj[i]->fManualReset)
+                pObj[i]->fSignaled = false;
+
+            nRet = (int)i;
+        }
+
+    } while (0);
+
+    return nRet;
+}
+
+/** WaitForMultipleObjects()
+Synopsis
+    uint32_t WaitForMultipleObjects4UEFI(uint32_t nCount, void* const* lpHandles, int bWaitAll, uint32_t dwMilliseconds);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-waitformultipleobjects#syntax
+Description
+    Waits until one or all of the specified objects are in the signaled state or the time-out interval elapses.
+
+    NOTE: On APs only thread handles can be awaited.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-waitformultipleobjects#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-waitformultipleobjects#return-value
+**/
+uint32_t WaitForMultipleObjects4UEFI(uint32_t nCount, void* const* lpHandles, int bWaitAll, uint32_t dwMilliseconds)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    WAITOBJ* const* pObj = (WAITOBJ* const*)lpHandles;
+    uint64_t qwTscPerSec = __TscPerSec(), qwTscPerUs = qwTscPerSec / 1000000;
+    uint64_t qwNow = __rdtsc(), qwDeadline = UINT64_MAX;
+    uint32_t i, dwRet = WAIT_FAILED;
+    EFI_EVENT Event = NULL;
+    UINTN Index;
+    int nSignaled;
+    bool fThread, fAP = 0 <= __ThreadPoolSelf();
+    INSTR_ENTER();
+
+    if (0 == qwTscPerUs)
+        qwTscPerUs = 1;
+
+    do {
+        if (0 == nCount || MAXIMUM_WAIT_OBJECTS < nCount || NULL == lpHandles)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        for (i = 0; i < nCount; i++)
+            if (NULL == pObj[i] || (WAITOBJ_TIMER != pObj[i]->Signature && WAITOBJ_THREAD != pObj[i]->Signature))
+                break;
+
+        if (i < nCount)
+        {
+            SetLastError4UEFI(ERROR_INVALID_HANDLE);
+            break;
+        }
+
+        for (i = 0; fAP && i < nCount; i++)
+            if (WAITOBJ_TIMER == pObj[i]->Signature)
+                break;
+
+        if (fAP && i < nCount)
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);                 // no boot services, the wheel belongs to the BSP
+            break;
+        }
+
+        if (INFINITE != dwMilliseconds)
+            qwDeadline = qwNow + (uint64_t)dwMilliseconds * qwTscPerSec / 1000;
+
+        if (false == fAP)
+            Event = __TimerWheelEvent();
+
+        while (1)
+        {
+            uint64_t qwNext = qwDeadline, qwUs;
+
+            qwNow = __rdtsc();
+
+            if (false == fAP)
+                __TimerWheelAdvance(qwNow);
+
+            nSignaled = signaled(nCount, pObj, bWaitAll, qwNow);
+
+            if (0 <= nSignaled)
+            {
+                dwRet = WAIT_OBJECT_0 + (uint32_t)nSignaled;
+                break;
+            }
+
+            if (qwNow >= qwDeadline)
+            {
+                dwRet = WAIT_TIMEOUT;
+                break;
+            }
+
+            for (i = 0, fThread = false; i < nCount; i++)           // nearest deadline of the awaited timers
+                if (WAITOBJ_THREAD == pObj[i]->Signature)
+                    fThread = true;
+                else if (((TIMEROBJ*)pObj[i])->fArmed && ((TIMEROBJ*)pObj[i])->DueTsc < qwNext)
+                    qwNext = ((TIMEROBJ*)pObj[i])->DueTsc;
+
+            qwUs = qwNext > qwNow ? (qwNext - qwNow) / qwTscPerUs : 0;
+
+            if (fThread)
+            {
+                if (false == __ThreadPoolHelp())
+                    _mm_pause();
+            }
+            else if (NULL != Event && qwUs >= WAIT_EVENT_MIN_US)
+            {
+                if (EFI_SUCCESS != pBS->WaitForEvent(1, &Event, &Index))
+                    Event = NULL;                                   // e.g. TPL above TPL_APPLICATION, fall back to Stall()
+            }
+            else if (qwUs >= WAIT_STALL_MIN_US)
+                pBS->Stall((UINTN)((qwUs > WAIT_EVENT_MIN_US ? WAIT_EVENT_MIN_US : qwUs) - WAIT_STALL_SLACK_US));
+            else
+                _mm_pause();
+        }
+
+    } while (0);
+
+    INSTR_LEAVE(WaitForMultipleObjects, 0);
+
+    return dwRet;
+}
+
+/** WaitForSingleObject()
+Synopsis
+    uint32_t WaitForSingleObject4UEFI(void* hHandle, uint32_t dwMilliseconds);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-waitforsingleobject#syntax
+Description
+    Waits until the specified object is in the signaled state or the time-out interval elapses.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-waitforsingleobject#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-waitforsingleobject#return-value
+**/
+uint32_t WaitForSingleObject4UEFI(void* hHandle, uint32_t dwMilliseconds)
+{
+    uint32_t dwRet;
+    INSTR_ENTER();
+
+    dwRet = WaitForMultipleObjects4UEFI(1, &hHandle, 0, dwMilliseconds);
+
+    INSTR_LEAVE(WaitForSingleObject, 0);
+
+    return dwRet;
+}
@@ -0,0 +1,188 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    WaitableTimer.c
+
+Abstract:
+
+    Win32 API CreateWaitableTimer(), SetWaitableTimer() and CancelWaitableTimer() for UEFI
+
+    The timer object is allocated once by CreateWaitableTimer(), arming and cancelling
+    only link and unlink it in the timer wheel.
+
+    The timer wheel is owned by the BSP and not locked, timer objects are allocated
+    from boot services memory. On APs all timer functions fail with ERROR_NOT_SUPPORTED.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+/** validtimer()
+
+    Validate a waitable timer handle
+
+    @param[in] hTimer   handle
+
+    @retval pointer to the timer object
+    @retval NULL, if hTimer is not a waitable timer or called on an AP, last error is set
+
+**/
+static TIMEROBJ* validtimer(void* hTimer)
+{
+    TIMEROBJ* pTimer = hTimer;
+
+    if (0 <= __ThreadPoolSelf())                                    // the timer wheel belongs to the BSP
+    {
+        SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+        pTimer = NULL;
+    }
+    else if (NULL == pTimer || WAITOBJ_TIMER != pTimer->Hdr.Signature)
+    {
+        SetLastError4UEFI(ERROR_INVALID_HANDLE);
+        pTimer = NULL;
+    }
+
+    return pTimer;
+}
+
+/** CreateWaitableTimer()
+Synopsis
+    void* CreateWaitableTimer4UEFI(void* lpTimerAttributes, int bManualReset, const char* lpTimerName);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-createwaitabletimera#syntax
+Description
+    Creates an unnamed waitable timer object, initially not signaled.
+
+    NOTE: Named timers are not supported. Timers can't be created on APs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-createwaitabletimera#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-createwaitabletimera#return-value
+**/
+void* CreateWaitableTimer4UEFI(void* lpTimerAttributes, int bManualReset, const char* lpTimerName)
+{
+    TIMEROBJ* pTimer = NULL;
+    INSTR_ENTER();
+
+    do {
+        if (NULL != lpTimerName || 0 <= __ThreadPoolSelf())
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        pTimer = calloc(1, sizeof(TIMEROBJ));
+
+        if (NULL == pTimer)
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        pTimer->Hdr.Signature = WAITOBJ_TIMER;
+        pTimer->Hdr.fManualReset = 0 != bManualReset;
+
+    } while (0);
+
+    INSTR_LEAVE(CreateWaitableTimer, 0);
+
+    return pTimer;
+}
+
+/** SetWaitableTimer()
+Synopsis
+    int SetWaitableTimer4UEFI(void* hTimer, const int64_t* lpDueTime, int32_t lPeriod, void* pfnCompletionRoutine, void* lpArgToCompletionRoutine, int fResume);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-setwaitabletimer#syntax
+Description
+    Activates the specified waitable timer. The timer is set to the not signaled state
+    and re-armed, if it was active.
+
+    NOTE: Absolute due times are converted to relative due times against the system time
+          at the call, see GetSystemTimePreciseAsFileTime(). Later RTC changes are not tracked.
+    NOTE: Completion routines are not supported, since there are no APCs.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-setwaitabletimer#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-setwaitabletimer#return-value
+**/
+int SetWaitableTimer4UEFI(void* hTimer, const int64_t* lpDueTime, int32_t lPeriod, void* pfnCompletionRoutine, void* lpArgToCompletionRoutine, int fResume)
+{
+    TIMEROBJ* pTimer = validtimer(hTimer);
+    uint64_t qwTscPerSec = __TscPerSec(), qwDue, qwNow;
+    int nRet = 0;
+    INSTR_ENTER();
+
+    do {
+        if (NULL == pTimer)
+            break;
+
+        if (NULL == lpDueTime || 0 > lPeriod)
+        {
+            SetLastError4UEFI(ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        if (NULL != pfnCompletionRoutine)                           // APC
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        if (0 < *lpDueTime)                                         // absolute FILETIME
+        {
+            qwNow = __SystemTimeNow();
+            qwDue = (uint64_t)*lpDueTime > qwNow ? (uint64_t)*lpDueTime - qwNow : 0;
+        }
+        else
+            qwDue = 0 - (uint64_t)*lpDueTime;                       // 100ns units
+
+        pTimer->Hdr.fSignaled = false;
+        pTimer->DueTsc = __rdtsc() + (qwDue / 10000000) * qwTscPerSec + (qwDue % 10000000) * qwTscPerSec / 10000000;
+        pTimer->PeriodTsc = (uint64_t)lPeriod * qwTscPerSec / 1000;
+
+        __TimerWheelArm(pTimer);
+
+        nRet = 1;
+
+    } while (0);
+
+    INSTR_LEAVE(SetWaitableTimer, 0);
+
+    return nRet;
+}
+
+/** CancelWaitableTimer()
+Synopsis
+    int CancelWaitableTimer4UEFI(void* hTimer);
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-cancelwaitabletimer#syntax
+Description
+    Sets the specified waitable timer to the inactive state. The signaled state is not changed.
+Paramters
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-cancelwaitabletimer#parameters
+Returns
+    https://docs.microsoft.com/en-us/windows/win32/api/synchapi/nf-synchapi-cancelwaitabletimer#return-value
+**/
+int CancelWaitableTimer4UEFI(void* hTimer)
+{
+    TIMEROBJ* pTimer = validtimer(hTimer);
+    int nRet = 0;
+    INSTR_ENTER();
+
+    if (NULL != pTimer)
+    {
+        __TimerWheelCancel(pTimer);
+        nRet = 1;
+    }
+
+    INSTR_LEAVE(CancelWaitableTimer, 0);
+
+    return nRet;
+}
@@ -0,0 +1,1047 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    Win324UEFI.h
+
+Abstract:
+
+    Win324UEFI library definitions and prototypes
+
+    NOTE: This header is kept free of UEFI and Windows types, so that it can be
+          included by modules that use <uefi.h> as well as by modules that
+          use <windows.h>.
+
+--*/
+#ifndef _WIN324UEFI_H_
+#define _WIN324UEFI_H_
+
+#include <Uefi.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//
+// Win32 API
+//
+extern uint32_t EFIAPI GetSystemFirmwareTable4UEFI(uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID, void* pFirmwareTableBuffer, uint32_t BufferSize, ...);
+extern uint32_t EnumSystemFirmwareTables4UEFI(uint32_t FirmwareTableProviderSignature, void* pFirmwareTableEnumBuffer, uint32_t BufferSize);
+extern int32_t EFIAPI QueryPerformanceCounter4UEFI(int64_t* lpPerformanceCount);
+extern int32_t EFIAPI QueryPerformanceFrequency4UEFI(int64_t* lpFrequency);
+extern int IsBadReadPtr4UEFI(const void* lp, uintptr_t ucb);
+extern int IsBadWritePtr4UEFI(const void* lp, uintptr_t ucb);
+extern uint32_t GetLastError4UEFI(void);
+extern void SetLastError4UEFI(uint32_t dwErrCode);
+
+//
+// Win32 error codes, same as winerror.h
+//
+#ifndef ERROR_SUCCESS
+#define ERROR_SUCCESS       0L
+#endif
+#ifndef ERROR_INVALID_HANDLE
+#define ERROR_INVALID_HANDLE 6L         // the handle is invalid
+#endif
+#ifndef ERROR_NOT_ENOUGH_MEMORY
+#define ERROR_NOT_ENOUGH_MEMORY 8L      // not enough memory resources are available to process this command
+#endif
+#ifndef ERROR_CRC
+#define ERROR_CRC           23L         // data error (cyclic redundancy check)
+#endif
+#ifndef ERROR_NOT_SUPPORTED
+#define ERROR_NOT_SUPPORTED 50L         // the request is not supported
+#endif
+#ifndef ERROR_INVALID_PARAMETER
+#define ERROR_INVALID_PARAMETER 87L     // the parameter is incorrect
+#endif
+#ifndef ERROR_INSUFFICIENT_BUFFER
+#define ERROR_INSUFFICIENT_BUFFER 122L  // the data area passed to a system call is too small
+#endif
+#ifndef ERROR_INVALID_ADDRESS
+#define ERROR_INVALID_ADDRESS 487L      // attempt to access invalid address
+#endif
+
+//
+// ACPI table index
+//
+//  The index is built once on first use and holds all tables referenced by the XSDT, plus
+//  the XSDT itself and the DSDT/FACS referenced by the FADT.
+//
+typedef struct _ACPITBLIDXENTRY {
+    uint32_t Signature;                 // table signature, e.g. 'PCAF' for "FACP"
+    uint32_t Instance;                  // n-th table with that signature, in XSDT order
+    uint64_t Address;                   // physical address of the table
+    const void* pTable;                 // pointer to the table, into the snapshot image when replaying
+    uint32_t Length;                    // table length taken from the table header
+    uint32_t Verdict;                   // ACPITBLVERDICT_..., checksum result cached on first validation
+}ACPITBLIDXENTRY;
+
+#define ACPITBLVERDICT_UNKNOWN  0       // not yet validated
+#define ACPITBLVERDICT_VALID    1       // checksum ok
+#define ACPITBLVERDICT_CORRUPT  2       // checksum or length error
+
+typedef struct _ACPITBLIDX {
+    uint64_t RsdpAddress;               // physical address of the RSDP
+    const void* pRsdp;                  // pointer to the RSDP, NULL when replaying a snapshot image
+    uint32_t RsdpVerdict;               // ACPITBLVERDICT_... of the RSDP
+    uint32_t nEntries;                  // number of entries in pEntry[]
+    uint32_t nXsdtEntries;              // number of signatures in pSig32[]
+    ACPITBLIDXENTRY* pEntry;            // sorted by Signature, Instance
+    uint32_t* pSig32;                   // XSDT signatures in XSDT order, for EnumSystemFirmwareTables()
+    uint32_t Generation;                // incremented each time the index is rebuilt or replaced
+}ACPITBLIDX;
+
+extern ACPITBLIDX* __AcpiTblIdxGet(void);
+extern const ACPITBLIDXENTRY* __AcpiTblIdxFind(uint32_t Signature, uint32_t Instance);
+extern void __AcpiTblIdxReplace(const ACPITBLIDX* pIdx);
+extern bool __AcpiTblIdxValid(const ACPITBLIDXENTRY* pEntry);
+extern int AcpiTableIndexRebuild4UEFI(void);
+
+//
+// ACPI checksum validation
+//
+#define FWTBLVAL_NONE       0           // tables are returned as they are
+#define FWTBLVAL_CHECKSUM   1           // RSDP and table checksums are validated, ERROR_CRC for corrupt tables
+
+#define ACPICSUM_AUTO       0           // fastest kernel available
+#define ACPICSUM_SCALAR     1
+#define ACPICSUM_SSE2       2
+#define ACPICSUM_AVX2       3
+
+extern int SetFirmwareTableValidation4UEFI(int Mode);
+extern uint8_t __AcpiChecksum(const void* p, size_t size);
+extern uint8_t __AcpiChecksumEx(int Kernel, const void* p, size_t size);
+
+extern uint32_t EFIAPI GetSystemFirmwareTableView4UEFI(uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID, uint32_t Instance, const void** ppFirmwareTable, uint64_t* pAddress);
+extern uint32_t EFIAPI GetSystemFirmwareTableInstance4UEFI(uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID, uint32_t Instance, void* pFirmwareTableBuffer, uint32_t BufferSize, uint64_t* pAddress);
+
+//
+// firmware table cursor
+//
+//  FWTBLCURSOR Cur;
+//  FirmwareTableCursorInit4UEFI(&Cur, 'ACPI', 'TDSS');
+//  FirmwareTableCursorFilter4UEFI(&Cur, FWTBLFLT_OEMTABLEID, NULL, "CpuSsdt", 0, 0);
+//  while (0 != (size = FirmwareTableCursorNext4UEFI(&Cur, &pTbl, &qwAddress)))
+//      ...
+//
+#define FWTBLFLT_OEMID          0x01    // OEM ID must match
+#define FWTBLFLT_OEMTABLEID     0x02    // OEM Table ID must match
+#define FWTBLFLT_REVISION       0x04    // table revision must be >= Revision
+#define FWTBLFLT_OEMREVISION    0x08    // OEM revision must be >= OemRevision
+
+typedef struct _FWTBLCURSOR {
+    uint32_t Provider;                  // 'ACPI'
+    uint32_t Signature;                 // table signature, 0 for all tables
+    uint32_t Flags;                     // FWTBLFLT_...
+    char OemId[6];                      // filter values, blank padded as in the table header
+    char OemTableId[8];                 //
+    uint8_t Revision;                   //
+    uint32_t OemRevision;               //
+    uint32_t TableID;                   // out: signature of the table returned last
+    uint32_t Instance;                  // out: instance of the table returned last
+    uint32_t Position;                  // internal: next index entry
+    uint32_t Generation;                // internal: index generation Position refers to
+}FWTBLCURSOR;
+
+extern void FirmwareTableCursorInit4UEFI(FWTBLCURSOR* pCursor, uint32_t FirmwareTableProviderSignature, uint32_t FirmwareTableID);
+extern void FirmwareTableCursorFilter4UEFI(FWTBLCURSOR* pCursor, uint32_t Flags, const char* strOemId, const char* strOemTableId, uint8_t Revision, uint32_t OemRevision);
+extern uint32_t FirmwareTableCursorNext4UEFI(FWTBLCURSOR* pCursor, const void** ppFirmwareTable, uint64_t* pAddress);
+
+//
+// SMBIOS index, 'RSMB' provider
+//
+//  The SMBIOS 3.x entry point takes precedence over the 2.x entry point.
+//  The structure table is copied once into the Windows RawSMBIOSData layout, that
+//  is returned by GetSystemFirmwareTable('RSMB').
+//
+typedef struct _RAWSMBIOSDATA {
+    uint8_t Used20CallingMethod;
+    uint8_t SMBIOSMajorVersion;
+    uint8_t SMBIOSMinorVersion;
+    uint8_t DmiRevision;
+    uint32_t Length;                    // size of SMBIOSTableData[]
+    uint8_t SMBIOSTableData[];
+}RAWSMBIOSDATA;
+
+typedef struct _SMBIOSIDXENTRY {
+    uint8_t Type;                       // structure type
+    uint8_t Length;                     // length of the formatted area
+    uint16_t Handle;                    // structure handle
+    uint32_t Instance;                  // n-th structure of that type, in table order
+    uint32_t Offset;                    // offset in SMBIOSTableData[]
+    uint32_t Size;                      // size including the string-set and its double NUL
+}SMBIOSIDXENTRY;
+
+typedef struct _SMBIOSIDX {
+    uint64_t EntryPointAddress;         // physical address of the entry point structure
+    uint64_t TableAddress;              // physical address of the structure table
+    uint32_t nEntries;                  // number of entries in pEntry[]
+    SMBIOSIDXENTRY* pEntry;             // sorted by Type, Instance
+    uint32_t* pHandleOrder;             // indices into pEntry[], sorted by Handle
+    uint32_t TypeFirst[257];            // pEntry[TypeFirst[t]] to pEntry[TypeFirst[t + 1] - 1] are of type t
+    RAWSMBIOSDATA* pRaw;                // RawSMBIOSData copy of the structure table
+    uint32_t RawSize;                   // size of *pRaw in bytes
+}SMBIOSIDX;
+
+extern SMBIOSIDX* __SmbiosIdxGet(void);
+extern int SmbiosIndexRebuild4UEFI(void);
+extern const void* SmbiosFindByType4UEFI(uint8_t Type, uint32_t Instance, uint32_t* pSize);
+extern const void* SmbiosFindByHandle4UEFI(uint16_t Handle, uint32_t* pSize);
+extern uint32_t SmbiosTypeCount4UEFI(uint8_t Type);
+
+//
+// memory map index
+//
+//  The UEFI memory map is captured on first use, sorted by address and adjacent descriptors
+//  with the same access rights are coalesced. IsBadReadPtr()/IsBadWritePtr()/IsBadCodePtr()
+//  look up ranges by binary search and refresh the index only on a miss, if the memory map
+//  key has changed since.
+//
+#define MEMACC_READ         1
+#define MEMACC_WRITE        2
+#define MEMACC_EXECUTE      4
+
+typedef struct _MEMMAPRANGE {
+    uint64_t Start;                     // physical address of the first byte
+    uint64_t End;                       // physical address of the first byte behind the range
+    uint32_t Deny;                      // MEMACC_xxx not granted
+}MEMMAPRANGE;
+
+typedef struct _MEMMAPIDX {
+    uint64_t MapKey;                    // memory map key of the snapshot
+    uint32_t nRanges;                   // number of entries in pRange[]
+    MEMMAPRANGE* pRange;                // memory map ranges, sorted, coalesced
+    uint32_t nAttrRanges;               // number of entries in pAttrRange[]
+    MEMMAPRANGE* pAttrRange;            // EFI memory attributes table ranges, sorted, coalesced
+    uint32_t Generation;                // incremented with each snapshot taken
+}MEMMAPIDX;
+
+extern MEMMAPIDX* __MemMapIdxGet(void);
+extern bool __MemMapIdxCheck(uint64_t qwAddress, uint64_t qwSize, uint32_t Access);
+extern int MemoryMapIndexRebuild4UEFI(void);
+extern int IsBadCodePtr4UEFI(const void* lpfn);
+
+//
+// page table walker
+//
+//  The access rights are taken from the live 4-level/5-level page tables, since the memory
+//  map does not reflect pages marked read-only or not present by the memory protection policy.
+//  A direct mapped software translation cache holds the walk result per 4KiB page.
+//
+typedef struct _PGWALKCTX {
+    uint64_t Cr3;                       // physical address of the PML4/PML5 table in bits 51:12, 0 if paging disabled
+    uint32_t Levels;                    // paging levels, 4 or 5 with CR4.LA57
+    bool fWp;                           // CR0.WP, supervisor writes to read-only pages fault
+    bool fNxe;                          // IA32_EFER.NXE, the XD bit is honored
+    intptr_t Bias;                      // added to physical table addresses to get a pointer, 0 with identity mapping
+}PGWALKCTX;
+
+#define PGTLB_SIZE          256         // number of software translation cache entries
+
+extern void PageWalkContextInit4UEFI(PGWALKCTX* pCtx);
+extern void PageWalkSetContext4UEFI(const PGWALKCTX* pCtx);
+extern void PageWalkFlush4UEFI(void);
+extern uint32_t __PageWalk(const PGWALKCTX* pCtx, uint64_t qwLinear, uint32_t* pPageShift);
+extern bool __PageWalkCheck(uint64_t qwAddress, uint64_t qwSize, uint32_t Access);
+
+//
+// firmware table snapshot image
+//
+//  +-----------------------+   offset 0
+//  | FWSNAPHDR             |
+//  +-----------------------+   HdrSize
+//  | FWSNAPDIRENTRY[]      |   nEntries, sorted by Provider, Signature, Instance
+//  +-----------------------+
+//  | uint32_t Sig32[]      |   nXsdtEntries, XSDT signatures in XSDT order
+//  +-----------------------+   8 byte aligned
+//  | payloads              |   each table 8 byte aligned, see FWSNAPDIRENTRY.Offset
+//  +-----------------------+   ImageSize
+//
+#define FWSNAP_SIGNATURE    'PANS'      // "SNAP"
+#define FWSNAP_VERSION      1
+
+typedef struct _FWSNAPHDR {
+    uint32_t Signature;                 // FWSNAP_SIGNATURE
+    uint16_t Version;                   // FWSNAP_VERSION
+    uint16_t HdrSize;                   // sizeof(FWSNAPHDR)
+    uint32_t nEntries;                  // number of directory entries
+    uint32_t nXsdtEntries;              // number of XSDT signatures following the directory
+    uint64_t ImageSize;                 // total size of the image in bytes
+    uint64_t RsdpAddress;               // physical address of the RSDP on the captured machine
+}FWSNAPHDR;
+
+typedef struct _FWSNAPDIRENTRY {
+    uint32_t Provider;                  // 'ACPI'
+    uint32_t Signature;                 // table signature
+    uint32_t Instance;                  // n-th table with that signature
+    uint32_t Length;                    // table length in bytes
+    uint64_t Address;                   // physical address of the table on the captured machine
+    uint64_t Offset;                    // offset of the payload from the start of the image
+}FWSNAPDIRENTRY;
+
+extern uint64_t GetFirmwareTableSnapshot4UEFI(uint32_t FirmwareTableProviderSignature, void* pImage, uint64_t ImageSize);
+extern void* CreateFirmwareTableSnapshot4UEFI(uint32_t FirmwareTableProviderSignature, uint64_t* pImageSize);
+extern int LoadFirmwareTableSnapshot4UEFI(const void* pImage, uint64_t ImageSize);
+
+//
+// AML namespace index
+//
+//  Single pass over the DSDT and all SSDTs, without evaluating methods.
+//  Definitions are indexed by their absolute path, e.g. \_SB_.PCI0.LPCB,
+//  devices additionally by their _HID.
+//
+#define AMLOP_NAME          0x0008
+#define AMLOP_METHOD        0x0014
+#define AMLOP_OPREGION      0x5B80
+#define AMLOP_DEVICE        0x5B82
+#define AMLOP_PROCESSOR     0x5B83
+#define AMLOP_POWERRES      0x5B84
+#define AMLOP_THERMALZONE   0x5B85
+
+#define AMLIDX_NIL          0xFFFFFFFF  // end of hash chain
+
+typedef struct _AMLIDXNODE {
+    const char* strPath;                // absolute path, 4 character segments, e.g. \_SB_.PCI0
+    const char* strHid;                 // _HID of a device, e.g. "PNP0A08", NULL if none
+    uint32_t Signature;                 // table signature, 'TDSD' or 'TDSS'
+    uint32_t Instance;                  // table instance
+    uint32_t Offset;                    // offset of the opcode from the start of the table
+    uint16_t Opcode;                    // AMLOP_...
+    uint16_t Reserved;
+    uint32_t NextPath;                  // next node in the path hash chain
+    uint32_t NextHid;                   // next node in the _HID hash chain
+}AMLIDXNODE;
+
+typedef struct _AMLIDX {
+    uint32_t nNodes;                    // number of nodes in pNode[]
+    uint32_t nBuckets;                  // number of hash buckets, power of 2
+    AMLIDXNODE* pNode;                  // nodes in table order
+    uint32_t* pPathBucket;              // path hash buckets
+    uint32_t* pHidBucket;               // _HID hash buckets
+    void* pArena;                       // chunks holding path and _HID strings
+}AMLIDX;
+
+extern AMLIDX* AmlIndexCreate4UEFI(void);
+extern void AmlIndexDestroy4UEFI(AMLIDX* pIdx);
+extern const AMLIDXNODE* AmlIndexFindPath4UEFI(const AMLIDX* pIdx, const char* strPath);
+extern const AMLIDXNODE* AmlIndexFindHid4UEFI(const AMLIDX* pIdx, const char* strHid, const AMLIDXNODE* pPrev);
+
+//
+// ACPI signature classification
+//
+#define ACPISIG_MULTI       0x01        // multiple instances allowed
+#define ACPISIG_EXTERNAL    0x02        // signature reserved by ACPI, table defined by an external specification
+
+typedef struct _ACPISIGINFO {
+    uint32_t Signature;                 // packed signature, e.g. 'PCAF' for "FACP"
+    uint8_t SpecRev;                    // ACPI spec revision, BCD, 0x62 for 6.2
+    uint8_t Flags;                      // ACPISIG_MULTI, ACPISIG_EXTERNAL
+    uint16_t MinLength;                 // minimum table length
+}ACPISIGINFO;
+
+extern int __ChkACPISignature(char Sig[4]);
+extern int __LookupACPISignature(uint32_t Sig32, const ACPISIGINFO** ppInfo);
+
+//
+// TSC calibration
+//
+typedef enum _TSCCALSRC {
+    TSCCALSRC_NONE = 0,                 // not yet calibrated
+    TSCCALSRC_CPUID15,                  // CPUID leaf 15h TSC/crystal ratio and crystal clock
+    TSCCALSRC_CPUID16,                  // CPUID leaf 16h processor base frequency
+    TSCCALSRC_PIT,                      // 8254 PIT timer 2, 50ms
+    TSCCALSRC_HPET,                     // HPET main counter, adaptive window
+    TSCCALSRC_PMTIMER,                  // ACPI PM timer, adaptive window
+}TSCCALSRC;
+
+typedef struct _TSCSCALE {
+    uint64_t Mul;                       // fixed point multiplier...
+    uint32_t Shift;                     // ... and shift, see __TscScaleInit()
+}TSCSCALE;
+
+extern uint64_t __TscPerSec(void);
+extern void __TscScaleInit(TSCSCALE* pScale, uint64_t qwUnitsPerSec);
+extern uint64_t __TscScale(const TSCSCALE* pScale, uint64_t qwTsc);
+extern TSCCALSRC GetTscCalibrationSource4UEFI(uint64_t* pTscPerSec);
+
+//
+// QueryPerformanceCounter() mode
+//
+#define QPCMODE_DEFAULT     0           // plain RDTSC
+#define QPCMODE_SERIALIZED  1           // LFENCE, RDTSC, LFENCE
+
+extern int SetPerformanceCounterMode4UEFI(int Mode);
+
+//
+// Sleep()
+//
+extern void Sleep4UEFI(uint32_t dwMilliseconds);
+extern void SleepMicroseconds4UEFI(uint64_t qwMicroseconds);
+extern void SleepNanoseconds4UEFI(uint64_t qwNanoseconds);
+
+//
+// tick counts
+//
+extern uint64_t EFIAPI GetTickCount644UEFI(void);
+extern uint32_t EFIAPI GetTickCount4UEFI(void);
+extern int EFIAPI QueryUnbiasedInterruptTime4UEFI(uint64_t* UnbiasedTime);
+
+//
+// system time
+//
+//  The RTC is read by GetTime() on the BSP and anchored to the TSC at the edge of its
+//  second. System time is extrapolated from the TSC in 100ns FILETIME units since
+//  January 1, 1601 UTC. The anchor is checked against the RTC every SYSTIME_RESYNC_SEC
+//  seconds and re-anchored, if it is off by more than the RTC resolution. The time
+//  returned never goes backwards across a re-anchor.
+//
+#define SYSTIME_RESYNC_SEC  64          // seconds between RTC checks
+#define SYSTIME_PER_SEC     10000000ULL // FILETIME units per second
+
+typedef struct _SYSTIME {               // same layout as SYSTEMTIME
+    uint16_t wYear;
+    uint16_t wMonth;                    // 1 = January
+    uint16_t wDayOfWeek;                // 0 = Sunday
+    uint16_t wDay;
+    uint16_t wHour;
+    uint16_t wMinute;
+    uint16_t wSecond;
+    uint16_t wMilliseconds;
+}SYSTIME;
+
+extern uint64_t __SystemTimeNow(void);
+extern int32_t __SystemTimeBias(void);
+extern uint32_t __SystemTimeDays(uint32_t Year, uint32_t Month, uint32_t Day);
+extern void GetSystemTimeAsFileTime4UEFI(uint64_t* lpSystemTimeAsFileTime);
+extern void GetSystemTimePreciseAsFileTime4UEFI(uint64_t* lpSystemTimeAsFileTime);
+extern void GetSystemTime4UEFI(SYSTIME* lpSystemTime);
+extern void GetLocalTime4UEFI(SYSTIME* lpSystemTime);
+extern int FileTimeToSystemTime4UEFI(const uint64_t* lpFileTime, SYSTIME* lpSystemTime);
+
+//
+// waitable objects, same values as synchapi.h/winbase.h
+//
+#ifndef INFINITE
+#define INFINITE            0xFFFFFFFF
+#endif
+#ifndef WAIT_OBJECT_0
+#define WAIT_OBJECT_0       0x00000000L
+#endif
+#ifndef WAIT_TIMEOUT
+#define WAIT_TIMEOUT        258L
+#endif
+#ifndef WAIT_FAILED
+#define WAIT_FAILED         0xFFFFFFFF
+#endif
+#ifndef MAXIMUM_WAIT_OBJECTS
+#define MAXIMUM_WAIT_OBJECTS 64
+#endif
+
+//
+// waitable timer
+//
+//  Armed timers are kept in a hierarchical timer wheel of WHEEL_LEVELS x WHEEL_SLOTS lists
+//  with a tick of 1ms. Arming and cancelling link and unlink the timer object, nothing is
+//  allocated. The wheel is advanced from the TSC by the waiting functions, which block in
+//  WaitForEvent() on a single periodic EVT_TIMER event.
+//
+#define WHEEL_BITS          6
+#define WHEEL_SLOTS         (1 << WHEEL_BITS)
+#define WHEEL_LEVELS        4           // 2^24 ticks, longer times are cascaded repeatedly
+
+#define WAITOBJ_TIMER       'RMIT'      // "TIMR", signature of a waitable timer handle
+
+typedef struct _WAITOBJ {
+    uint32_t Signature;                 // WAITOBJ_xxx, to validate handles
+    bool fSignaled;                     // signaled state
+    bool fManualReset;                  // stays signaled when a wait is satisfied
+}WAITOBJ;
+
+typedef struct _TIMEROBJ {
+    WAITOBJ Hdr;                        // Hdr.Signature == WAITOBJ_TIMER
+    bool fArmed;                        // linked into the timer wheel
+    uint16_t Slot;                      // Level * WHEEL_SLOTS + slot index, if armed
+    struct _TIMEROBJ* pNext;            // timer wheel slot list
+    struct _TIMEROBJ* pPrev;
+    uint64_t DueTsc;                    // expiry time in TSC counts
+    uint64_t PeriodTsc;                 // period in TSC counts, 0 for a one-shot timer
+}TIMEROBJ;
+
+extern void __TimerWheelArm(TIMEROBJ* pTimer);
+extern void __TimerWheelCancel(TIMEROBJ* pTimer);
+extern void __TimerWheelExpire(TIMEROBJ* pTimer, uint64_t qwTscNow);
+extern void __TimerWheelAdvance(uint64_t qwTscNow);
+extern void* __TimerWheelEvent(void);
+
+extern void* CreateWaitableTimer4UEFI(void* lpTimerAttributes, int bManualReset, const char* lpTimerName);
+extern int SetWaitableTimer4UEFI(void* hTimer, const int64_t* lpDueTime, int32_t lPeriod, void* pfnCompletionRoutine, void* lpArgToCompletionRoutine, int fResume);
+extern int CancelWaitableTimer4UEFI(void* hTimer);
+extern uint32_t WaitForSingleObject4UEFI(void* hHandle, uint32_t dwMilliseconds);
+extern uint32_t WaitForMultipleObjects4UEFI(uint32_t nCount, void* const* lpHandles, int bWaitAll, uint32_t dwMilliseconds);
+extern int CloseHandle4UEFI(void* hObject);
+
+//
+// threads and thread pool
+//
+//  Threads and work items run on the APs. Each AP is started once by
+//  EFI_MP_SERVICES_PROTOCOL.StartupThisAP() in non-blocking mode and runs a worker loop on
+//  its own work-stealing deque: the owner pops at the bottom, idle workers steal at the top.
+//  Items submitted by the BSP are spread round-robin over the deques, items submitted by
+//  a worker go to its own deque. Without APs, items run on the BSP at submission.
+//
+//  Thread objects are taken from a preallocated pool, since APs must not call boot services.
+//
+#define WAITOBJ_THREAD      'DRHT'      // "THRD", signature of a thread handle
+
+#ifndef STILL_ACTIVE
+#define STILL_ACTIVE        259L        // GetExitCodeThread(): the thread is still running
+#endif
+#ifndef CREATE_SUSPENDED
+#define CREATE_SUSPENDED    0x00000004  // not supported
+#endif
+
+#define THREADPOOL_ITEMS    4096        // thread objects, running or queued or with an open handle
+#define THREADPOOL_DEQUE    1024        // deque size per AP, power of 2
+
+typedef struct _THREADOBJ {
+    WAITOBJ Hdr;                        // Hdr.Signature == WAITOBJ_THREAD, while a handle is open
+    uint32_t (*pfnStart)(void* lpParameter);
+    void (*pfnCallback)(void* Instance, void* Context);     // TrySubmitThreadpoolCallback(), pfnStart unused
+    void* lpParameter;
+    volatile uint32_t ExitCode;         // STILL_ACTIVE until the thread has returned
+    volatile long nRef;                 // open handle plus pending execution
+    uint32_t ThreadId;                  // index in the thread object pool + 1
+    struct _THREADOBJ* pNextFree;       // thread object pool free list
+}THREADOBJ;
+
+extern void* CreateThread4UEFI(void* lpThreadAttributes, size_t dwStackSize, uint32_t (*lpStartAddress)(void* lpParameter), void* lpParameter, uint32_t dwCreationFlags, uint32_t* lpThreadId);
+extern int GetExitCodeThread4UEFI(void* hThread, uint32_t* lpExitCode);
+extern int QueueUserWorkItem4UEFI(uint32_t (*Function)(void* Context), void* Context, uint32_t Flags);
+extern int TrySubmitThreadpoolCallback4UEFI(void (*pfns)(void* Instance, void* Context), void* pv, void* pcbe);
+extern uint32_t ThreadPoolWorkerCount4UEFI(void);
+extern void ThreadPoolShutdown4UEFI(void);
+
+extern uint32_t GetCurrentThreadId4UEFI(void);
+
+extern THREADOBJ* __ThreadAlloc(void);
+extern void __ThreadSubmit(THREADOBJ* pThread);
+extern void __ThreadRelease(THREADOBJ* pThread);
+extern bool __ThreadPoolHelp(void);
+extern uint32_t __ThreadSelfId(void);
+
+#define THREADID_MAIN       1           // GetCurrentThreadId() of the application, pool threads count from 2
+
+//
+// synchronization, safe across the APs of the thread pool
+//
+//  All waits spin with PAUSE and exponential backoff, there is no blocking wait on APs.
+//  NOTE: The primitives are not instrumented, the counters would dominate their cost.
+//
+#define SPIN_BACKOFF_MAX    1024        // PAUSE instructions per backoff round at most
+
+typedef struct _CRITSECT {
+    volatile long Lock;                 // 0 free, 1 owned
+    volatile uint32_t OwningThread;     // GetCurrentThreadId() of the owner, 0 if free
+    uint32_t RecursionCount;            // number of EnterCriticalSection() of the owner
+    uint32_t SpinCount;                 // PAUSE rounds before the exponential backoff starts
+}CRITSECT;
+
+typedef struct _RWLOCK {
+    volatile long State;                // bit 0: owned exclusive, bits 31:1 number of shared owners
+    volatile long WritersWaiting;       // new shared owners are held back, while writers wait
+}RWLOCK;
+
+#define RWLOCK_INIT         { 0, 0 }    // SRWLOCK_INIT
+
+typedef struct _INITONCE {
+    volatile long State;                // INITONCE_UNINIT, INITONCE_BUSY, INITONCE_DONE
+    void* Context;                      // context returned by the init function
+}INITONCE;
+
+#define INITONCE_UNINIT     0
+#define INITONCE_BUSY       1
+#define INITONCE_DONE       2
+#define INITONCE_STATIC_INIT { INITONCE_UNINIT, NULL }
+
+extern long InterlockedIncrement4UEFI(volatile long* Addend);
+extern long InterlockedDecrement4UEFI(volatile long* Addend);
+extern long InterlockedExchange4UEFI(volatile long* Target, long Value);
+extern long InterlockedExchangeAdd4UEFI(volatile long* Addend, long Value);
+extern long InterlockedCompareExchange4UEFI(volatile long* Destination, long Exchange, long Comparand);
+extern int64_t InterlockedIncrement644UEFI(volatile int64_t* Addend);
+extern int64_t InterlockedDecrement644UEFI(volatile int64_t* Addend);
+extern int64_t InterlockedExchange644UEFI(volatile int64_t* Target, int64_t Value);
+extern int64_t InterlockedExchangeAdd644UEFI(volatile int64_t* Addend, int64_t Value);
+extern int64_t InterlockedCompareExchange644UEFI(volatile int64_t* Destination, int64_t Exchange, int64_t Comparand);
+extern void* InterlockedExchangePointer4UEFI(void* volatile* Target, void* Value);
+extern void* InterlockedCompareExchangePointer4UEFI(void* volatile* Destination, void* Exchange, void* Comparand);
+
+extern void InitializeCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+extern int InitializeCriticalSectionAndSpinCount4UEFI(CRITSECT* lpCriticalSection, uint32_t dwSpinCount);
+extern void EnterCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+extern int TryEnterCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+extern void LeaveCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+extern void DeleteCriticalSection4UEFI(CRITSECT* lpCriticalSection);
+
+extern void InitializeSRWLock4UEFI(RWLOCK* SRWLock);
+extern void AcquireSRWLockShared4UEFI(RWLOCK* SRWLock);
+extern void AcquireSRWLockExclusive4UEFI(RWLOCK* SRWLock);
+extern int TryAcquireSRWLockShared4UEFI(RWLOCK* SRWLock);
+extern int TryAcquireSRWLockExclusive4UEFI(RWLOCK* SRWLock);
+extern void ReleaseSRWLockShared4UEFI(RWLOCK* SRWLock);
+extern void ReleaseSRWLockExclusive4UEFI(RWLOCK* SRWLock);
+
+extern void InitOnceInitialize4UEFI(INITONCE* InitOnce);
+extern int InitOnceExecuteOnce4UEFI(INITONCE* InitOnce, int (*InitFn)(INITONCE* InitOnce, void* Parameter, void** Context), void* Parameter, void** Context);
+
+extern void __SpinBackoff(uint32_t* pBackoff);
+extern void __SpinLock(volatile long* pLock);
+extern void __SpinUnlock(volatile long* pLock);
+extern int32_t __ThreadPoolSelf(void);
+
+//
+// virtual memory and heaps
+//
+//  UEFI identity maps all memory, so VirtualAlloc() reserves and commits at once by AllocatePages(),
+//  in 4KiB granules, or 2MiB aligned granules for MEM_LARGE_PAGES and sizes of 2MiB and above.
+//
+//  Private heaps carve 64KiB slabs of a single size class from 1MiB arenas. Each processor
+//  allocates from its own current slab per size class, frees are pushed lock-free to the slab.
+//  Larger blocks get their own pages. HeapDestroy() releases all arenas at once.
+//
+//  NOTE: Arenas and large blocks come from AllocatePages(), that must not be called on APs.
+//        On APs HeapAlloc() is served from the arenas already reserved, see dwInitialSize.
+//
+#ifndef MEM_COMMIT
+#define MEM_COMMIT          0x00001000
+#define MEM_RESERVE         0x00002000
+#define MEM_DECOMMIT        0x00004000
+#define MEM_RELEASE         0x00008000
+#define MEM_LARGE_PAGES     0x20000000
+#endif
+#ifndef PAGE_NOACCESS
+#define PAGE_NOACCESS       0x01
+#define PAGE_READONLY       0x02
+#define PAGE_READWRITE      0x04
+#define PAGE_EXECUTE        0x10
+#define PAGE_EXECUTE_READ   0x20
+#define PAGE_EXECUTE_READWRITE 0x40
+#endif
+#ifndef HEAP_NO_SERIALIZE
+#define HEAP_NO_SERIALIZE   0x00000001
+#define HEAP_GENERATE_EXCEPTIONS 0x00000004
+#define HEAP_ZERO_MEMORY    0x00000008
+#define HEAP_REALLOC_IN_PLACE_ONLY 0x00000010
+#endif
+
+#define VMEM_PAGE_SIZE      0x1000      // VirtualAlloc() granule
+#define VMEM_LARGE_SIZE     0x200000    // VirtualAlloc() granule for MEM_LARGE_PAGES and sizes of 2MiB and above
+#define HEAP_SLAB_SIZE      0x10000     // slab of a single size class, aligned to its size
+#define HEAP_ARENA_SIZE     0x100000    // arena of slabs
+#define HEAP_MAX_SMALL      8192        // largest size class, larger blocks get their own pages
+#define HEAP_CLASSES        32          // 16..128 in steps of 16, then 4 classes per power of 2
+#define HEAP_SLOTS          64          // per processor slab caches, the last one is shared by all other processors
+
+typedef struct _HEAPSUMMARY {
+    uint32_t cb;                        // sizeof(HEAPSUMMARY)
+    size_t cbAllocated;                 // bytes allocated by HeapAlloc(), including size class rounding
+    size_t cbCommitted;                 // bytes of slabs in use and large blocks
+    size_t cbReserved;                  // bytes of arenas and large blocks
+    size_t cbMaxReserve;                // dwMaximumSize of HeapCreate(), 0 if growable
+}HEAPSUMMARY;
+
+extern void* VirtualAlloc4UEFI(void* lpAddress, size_t dwSize, uint32_t flAllocationType, uint32_t flProtect);
+extern int VirtualFree4UEFI(void* lpAddress, size_t dwSize, uint32_t dwFreeType);
+extern void* HeapCreate4UEFI(uint32_t flOptions, size_t dwInitialSize, size_t dwMaximumSize);
+extern int HeapDestroy4UEFI(void* hHeap);
+extern void* HeapAlloc4UEFI(void* hHeap, uint32_t dwFlags, size_t dwBytes);
+extern void* HeapReAlloc4UEFI(void* hHeap, uint32_t dwFlags, void* lpMem, size_t dwBytes);
+extern int HeapFree4UEFI(void* hHeap, uint32_t dwFlags, void* lpMem);
+extern size_t HeapSize4UEFI(void* hHeap, uint32_t dwFlags, const void* lpMem);
+extern int HeapSummary4UEFI(void* hHeap, uint32_t dwFlags, HEAPSUMMARY* lpSummary);
+extern void* GetProcessHeap4UEFI(void);
+
+extern void* __PagesAlloc(size_t nPages, size_t nAlignPages);
+extern void __PagesFree(void* pBase, size_t nPages);
+
+//
+// PCI configuration space
+//
+//  The MCFG table is parsed once into the ECAM segment list. Each function is reached through its
+//  memory mapped 4KiB configuration space. Without MCFG, or while a snapshot is replayed, the
+//  first 256 bytes of segment 0 are accessed through CF8/CFC.
+//
+//  The device index is built by a single pass over all buses on first query and holds the IDs,
+//  class code and BARs of each function, sorted by address and by class code.
+//
+#define PCI_ADDRESS(Segment, Bus, Device, Function) ((uint32_t)(Segment) << 16 | (uint32_t)(Bus) << 8 | (uint32_t)(Device) << 3 | (uint32_t)(Function))
+#define PCI_SEGMENT(PciAddress)     ((uint16_t)((PciAddress) >> 16))
+#define PCI_BUS(PciAddress)         ((uint8_t)((PciAddress) >> 8))
+#define PCI_DEVICE(PciAddress)      ((uint8_t)(((PciAddress) >> 3) & 0x1F))
+#define PCI_FUNCTION(PciAddress)    ((uint8_t)((PciAddress) & 7))
+
+#define PCI_CFG_SIZE        4096        // extended configuration space through ECAM
+#define PCI_CFG_LEGACY_SIZE 256         // configuration space through CF8/CFC
+#define PCI_SUBCLASS_ANY    0xFF        // PciFindByClass4UEFI(), PciClassCount4UEFI() wildcard
+#define PCI_DEVICEID_ANY    0xFFFF      // PciFindById4UEFI() wildcard
+
+typedef struct _PCIECAMSEG {
+    uint64_t BaseAddress;               // ECAM base address, bus 0 of the segment
+    uint16_t Segment;                   // PCI segment group number
+    uint8_t StartBus;                   // first bus decoded
+    uint8_t EndBus;                     // last bus decoded
+    uint32_t Reserved;
+}PCIECAMSEG;
+
+typedef struct _PCIDEVENTRY {
+    uint32_t PciAddress;                // PCI_ADDRESS()
+    uint16_t VendorId;
+    uint16_t DeviceId;
+    uint8_t RevisionId;
+    uint8_t ProgIf;                     // class code
+    uint8_t SubClass;
+    uint8_t BaseClass;
+    uint8_t HeaderType;                 // without the multi-function bit
+    uint8_t nBars;                      // 6 for type 0, 2 for type 1 headers
+    uint16_t Reserved;
+    uint32_t Bar[6];                    // BAR registers as read, BARs are not sized
+    uint64_t EcamAddress;               // address of the configuration space, 0 for CF8/CFC
+}PCIDEVENTRY;
+
+typedef struct _PCIIDX {
+    uint32_t nSegments;                 // number of entries in pSegment[], 0 for CF8/CFC
+    PCIECAMSEG* pSegment;               // MCFG allocation structures
+    uint32_t nEntries;                  // number of entries in pEntry[]
+    PCIDEVENTRY* pEntry;                // sorted by PciAddress
+    uint32_t* pClassOrder;              // indices into pEntry[], sorted by BaseClass, SubClass, PciAddress
+}PCIIDX;
+
+extern PCIIDX* __PciIdxGet(void);
+extern uint64_t __PciEcam(uint32_t PciAddress, uint32_t Offset);
+extern uint32_t __PciCfgRead(uint32_t PciAddress, uint32_t Offset, uint32_t Width);
+extern int PciIndexRebuild4UEFI(void);
+extern uint32_t PciConfigRead4UEFI(uint32_t PciAddress, uint32_t Offset, void* pBuffer, uint32_t Size);
+extern uint32_t PciConfigWrite4UEFI(uint32_t PciAddress, uint32_t Offset, const void* pBuffer, uint32_t Size);
+extern uint8_t PciConfigRead84UEFI(uint32_t PciAddress, uint32_t Offset);
+extern uint16_t PciConfigRead164UEFI(uint32_t PciAddress, uint32_t Offset);
+extern uint32_t PciConfigRead324UEFI(uint32_t PciAddress, uint32_t Offset);
+extern const PCIDEVENTRY* PciFindByClass4UEFI(uint8_t BaseClass, uint8_t SubClass, uint32_t Instance);
+extern const PCIDEVENTRY* PciFindById4UEFI(uint16_t VendorId, uint16_t DeviceId, uint32_t Instance);
+extern uint32_t PciClassCount4UEFI(uint8_t BaseClass, uint8_t SubClass);
+
+//
+// processor and NUMA topology
+//
+//  MADT, SRAT and SLIT are parsed once into the topology index. Logical processors are numbered
+//  by NUMA node and APIC ID and packed into groups of 64, a node is not split across groups
+//  unless it has more than 64 processors. Core and package IDs are derived from the APIC ID
+//  with the shifts of CPUID leaf 0Bh. The GetLogicalProcessorInformationEx() records are
+//  generated once, sorted by relationship.
+//
+//  Without SRAT there is a single node 0, without SLIT the distance is 10 within a node and 20
+//  between nodes. Cache relationships are not reported.
+//
+#ifndef LTP_PC_SMT
+#define LTP_PC_SMT          0x1         // PROCREL.Flags, core with more than one logical processor
+#endif
+#define MAXIMUM_PROC_PER_GROUP 64
+#define NUMA_LOCAL_DISTANCE 10          // SLIT distance within a node
+#define NUMA_REMOTE_DISTANCE 20         // distance between nodes without SLIT
+
+typedef enum _LOGPROCREL {              // same values as LOGICAL_PROCESSOR_RELATIONSHIP
+    LOGPROCREL_CORE = 0,
+    LOGPROCREL_NUMANODE = 1,
+    LOGPROCREL_CACHE = 2,
+    LOGPROCREL_PACKAGE = 3,
+    LOGPROCREL_GROUP = 4,
+    LOGPROCREL_ALL = 0xFFFF
+}LOGPROCREL;
+
+typedef struct _GROUPAFFINITY {         // same layout as GROUP_AFFINITY
+    uintptr_t Mask;
+    uint16_t Group;
+    uint16_t Reserved[3];
+}GROUPAFFINITY;
+
+typedef struct _PROCNUMBER {            // same layout as PROCESSOR_NUMBER
+    uint16_t Group;
+    uint8_t Number;
+    uint8_t Reserved;
+}PROCNUMBER;
+
+typedef struct _PROCREL {               // same layout as PROCESSOR_RELATIONSHIP
+    uint8_t Flags;
+    uint8_t EfficiencyClass;
+    uint8_t Reserved[20];
+    uint16_t GroupCount;
+    GROUPAFFINITY GroupMask[1];
+}PROCREL;
+
+typedef struct _NUMANODEREL {           // same layout as NUMA_NODE_RELATIONSHIP
+    uint32_t NodeNumber;
+    uint8_t Reserved[18];
+    uint16_t GroupCount;
+    GROUPAFFINITY GroupMask[1];
+}NUMANODEREL;
+
+typedef struct _PROCGROUPINFO {         // same layout as PROCESSOR_GROUP_INFO
+    uint8_t MaximumProcessorCount;
+    uint8_t ActiveProcessorCount;
+    uint8_t Reserved[38];
+    uintptr_t ActiveProcessorMask;
+}PROCGROUPINFO;
+
+typedef struct _GROUPREL {              // same layout as GROUP_RELATIONSHIP
+    uint16_t MaximumGroupCount;
+    uint16_t ActiveGroupCount;
+    uint8_t Reserved[20];
+    PROCGROUPINFO GroupInfo[1];
+}GROUPREL;
+
+typedef struct _LOGPROCINFOEX {         // same layout as SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX
+    uint32_t Relationship;              // LOGPROCREL_xxx
+    uint32_t Size;                      // size of the record in bytes
+    union {
+        PROCREL Processor;
+        NUMANODEREL NumaNode;
+        GROUPREL Group;
+    };
+}LOGPROCINFOEX;
+
+typedef struct _TOPOCPU {
+    uint32_t ApicId;                    // x2APIC ID or local APIC ID
+    uint32_t AcpiUid;                   // ACPI processor UID
+    uint32_t ProximityDomain;           // SRAT proximity domain
+    uint32_t CoreId;                    // ApicId >> SMT shift
+    uint32_t PackageId;                 // ApicId >> package shift
+    uint16_t Node;                      // NUMA node number
+    uint16_t Group;                     // processor group
+    uint8_t Number;                     // processor number in the group
+    uint8_t Reserved[3];
+}TOPOCPU;
+
+typedef struct _TOPOMEM {
+    uint64_t Base;                      // SRAT memory affinity range
+    uint64_t Length;
+    uint32_t ProximityDomain;           // SRAT proximity domain
+    uint32_t Flags;                     // SRAT memory affinity flags
+    uint16_t Node;                      // NUMA node number
+    uint16_t Reserved[3];
+}TOPOMEM;
+
+typedef struct _TOPOIDX {
+    uint32_t nCpus;                     // number of entries in pCpu[]
+    TOPOCPU* pCpu;                      // enabled processors, index is the logical processor number
+    uint32_t* pApicOrder;               // indices into pCpu[], sorted by ApicId
+    uint32_t nNodes;                    // number of NUMA nodes
+    uint32_t* pNodeDomain;              // proximity domain of each node, ascending
+    uint8_t* pDistance;                 // nNodes x nNodes distance matrix
+    uint32_t nMem;                      // number of entries in pMem[]
+    TOPOMEM* pMem;                      // memory ranges, sorted by Base
+    uint16_t nGroups;                   // number of processor groups
+    uint8_t SmtShift;                   // APIC ID bits of the logical processor in the core
+    uint8_t PkgShift;                   // APIC ID bits of the logical processor in the package
+    uint32_t cbInfo;                    // size of pInfo in bytes
+    uint8_t* pInfo;                     // LOGPROCINFOEX records, sorted by Relationship
+    uint32_t InfoFirst[LOGPROCREL_GROUP + 2];   // offset of the first record of each relationship in pInfo
+}TOPOIDX;
+
+extern TOPOIDX* __TopologyIdxGet(void);
+extern uint32_t __ApicId(void);
+extern const TOPOCPU* __TopologyIdxFindApic(uint32_t ApicId);
+extern int TopologyIndexRebuild4UEFI(void);
+extern int GetLogicalProcessorInformationEx4UEFI(uint32_t RelationshipType, LOGPROCINFOEX* Buffer, uint32_t* ReturnedLength);
+extern void GetCurrentProcessorNumberEx4UEFI(PROCNUMBER* ProcNumber);
+extern int GetNumaHighestNodeNumber4UEFI(uint32_t* HighestNodeNumber);
+extern int GetNumaNodeProcessorMaskEx4UEFI(uint16_t Node, GROUPAFFINITY* ProcessorMask);
+extern int GetNumaProcessorNodeEx4UEFI(const PROCNUMBER* Processor, uint16_t* NodeNumber);
+extern int GetNumaAvailableMemoryNodeEx4UEFI(uint16_t Node, uint64_t* AvailableBytes);
+extern uint8_t GetNumaNodeDistance4UEFI(uint16_t Node1, uint16_t Node2);
+
+//
+// instrumentation
+//
+//  With WIN324UEFI_INSTRUMENT defined at compile time, each *4UEFI function records its
+//  call count, the number of bytes copied and its TSC latency into a log2 histogram.
+//  Without it INSTR_ENTER()/INSTR_LEAVE() expand to nothing.
+//
+typedef enum _INSTRID {
+    INSTRID_GetSystemFirmwareTable,
+    INSTRID_GetSystemFirmwareTableInstance,
+    INSTRID_GetSystemFirmwareTableView,
+    INSTRID_EnumSystemFirmwareTables,
+    INSTRID_FirmwareTableCursorInit,
+    INSTRID_FirmwareTableCursorFilter,
+    INSTRID_FirmwareTableCursorNext,
+    INSTRID_GetFirmwareTableSnapshot,
+    INSTRID_CreateFirmwareTableSnapshot,
+    INSTRID_LoadFirmwareTableSnapshot,
+    INSTRID_SetFirmwareTableValidation,
+    INSTRID_AcpiTableIndexRebuild,
+    INSTRID_AmlIndexCreate,
+    INSTRID_AmlIndexDestroy,
+    INSTRID_AmlIndexFindPath,
+    INSTRID_AmlIndexFindHid,
+    INSTRID_SmbiosIndexRebuild,
+    INSTRID_SmbiosFindByType,
+    INSTRID_SmbiosFindByHandle,
+    INSTRID_SmbiosTypeCount,
+    INSTRID_IsBadReadPtr,
+    INSTRID_IsBadWritePtr,
+    INSTRID_IsBadCodePtr,
+    INSTRID_MemoryMapIndexRebuild,
+    INSTRID_PageWalkContextInit,
+    INSTRID_PageWalkSetContext,
+    INSTRID_PageWalkFlush,
+    INSTRID_QueryPerformanceCounter,
+    INSTRID_QueryPerformanceFrequency,
+    INSTRID_SetPerformanceCounterMode,
+    INSTRID_GetTscCalibrationSource,
+    INSTRID_Sleep,
+    INSTRID_SleepMicroseconds,
+    INSTRID_SleepNanoseconds,
+    INSTRID_GetTickCount64,
+    INSTRID_GetTickCount,
+    INSTRID_QueryUnbiasedInterruptTime,
+    INSTRID_GetLastError,
+    INSTRID_SetLastError,
+    INSTRID_CreateWaitableTimer,
+    INSTRID_SetWaitableTimer,
+    INSTRID_CancelWaitableTimer,
+    INSTRID_WaitForSingleObject,
+    INSTRID_WaitForMultipleObjects,
+    INSTRID_CloseHandle,
+    INSTRID_CreateThread,
+    INSTRID_GetExitCodeThread,
+    INSTRID_QueueUserWorkItem,
+    INSTRID_TrySubmitThreadpoolCallback,
+    INSTRID_ThreadPoolWorkerCount,
+    INSTRID_ThreadPoolShutdown,
+    INSTRID_GetCurrentThreadId,
+    INSTRID_VirtualAlloc,
+    INSTRID_VirtualFree,
+    INSTRID_HeapCreate,
+    INSTRID_HeapDestroy,
+    INSTRID_HeapAlloc,
+    INSTRID_HeapReAlloc,
+    INSTRID_HeapFree,
+    INSTRID_HeapSize,
+    INSTRID_HeapSummary,
+    INSTRID_GetProcessHeap,
+    INSTRID_PciIndexRebuild,
+    INSTRID_PciConfigRead,
+    INSTRID_PciConfigWrite,
+    INSTRID_PciConfigRead8,
+    INSTRID_PciConfigRead16,
+    INSTRID_PciConfigRead32,
+    INSTRID_PciFindByClass,
+    INSTRID_PciFindById,
+    INSTRID_PciClassCount,
+    INSTRID_TopologyIndexRebuild,
+    INSTRID_GetLogicalProcessorInformationEx,
+    INSTRID_GetCurrentProcessorNumberEx,
+    INSTRID_GetNumaHighestNodeNumber,
+    INSTRID_GetNumaNodeProcessorMaskEx,
+    INSTRID_GetNumaProcessorNodeEx,
+    INSTRID_GetNumaAvailableMemoryNodeEx,
+    INSTRID_GetNumaNodeDistance,
+    INSTRID_GetSystemTimeAsFileTime,
+    INSTRID_GetSystemTimePreciseAsFileTime,
+    INSTRID_GetSystemTime,
+    INSTRID_GetLocalTime,
+    INSTRID_FileTimeToSystemTime,
+    INSTRID_MAX
+}INSTRID;
+
+#define INSTR_BUCKETS       64          // Hist[i] counts latencies of 2^i to 2^(i+1)-1 TSC counts, Hist[0] also 0
+
+typedef struct _INSTRSTAT {
+    uint64_t nCalls;                    // number of calls
+    uint64_t nBytes;                    // number of bytes copied to the caller
+    uint64_t qwTscTotal;                // sum of the latencies in TSC counts
+    uint64_t qwTscMax;                  // maximum latency in TSC counts
+    uint64_t Hist[INSTR_BUCKETS];       // log2 latency histogram
+}INSTRSTAT;
+
+typedef struct _INSTRDUMPHDR {
+    uint32_t Signature;                 // INSTRDUMP_SIGNATURE
+    uint32_t HdrSize;                   // sizeof(INSTRDUMPHDR)
+    uint32_t nEntries;                  // number of INSTRSTAT following the header, indexed by INSTRID
+    uint32_t EntrySize;                 // sizeof(INSTRSTAT)
+    uint64_t TscPerSec;                 // TSC counts per second, to convert latencies
+}INSTRDUMPHDR;
+
+#define INSTRDUMP_SIGNATURE 'TSNI'      // "INST"
+
+extern uint64_t __InstrEnter(void);
+extern void __InstrLeave(INSTRID Id, uint64_t qwTscStart, uint64_t nBytes);
+extern const char* InstrumentationName4UEFI(INSTRID Id);
+extern uint64_t InstrumentationQuery4UEFI(INSTRID Id, INSTRSTAT* pStat);
+extern void InstrumentationReset4UEFI(void);
+extern uint32_t InstrumentationDump4UEFI(void* pBuffer, uint32_t BufferSize);
+extern void InstrumentationPrint4UEFI(void);
+
+#ifdef WIN324UEFI_INSTRUMENT
+#define INSTR_ENTER()               uint64_t __qwInstrTsc = __InstrEnter()
+#define INSTR_LEAVE(Id, nBytes)     __InstrLeave(INSTRID_##Id, __qwInstrTsc, (uint64_t)(nBytes))
+#else
+#define INSTR_ENTER()
+#define INSTR_LEAVE(Id, nBytes)
+#endif
+
+//
+// event trace
+//
+//  TraceEvent4UEFI() records a fixed size binary event into the ring of the executing
+//  processor: TSC, APIC ID, event ID and four arguments. Nothing is formatted at the trace
+//  site, the slot is reserved by a single interlocked increment of the ring head.
+//  The rings are allocated on the BSP by TraceStart4UEFI(), one per processor of the
+//  topology index, and overwrite their oldest events. TraceDump4UEFI() and TracePrint4UEFI()
+//  merge the rings in TSC order afterwards, the latter decodes the events to text.
+//
+//  The TRACE() sites of the library are always compiled in and record events between
+//  TraceStart4UEFI() and TraceStop4UEFI(). Otherwise a site costs a call and the test
+//  of the enable flag, a few ns.
+//
+typedef enum _TRACEID {
+    TRACEID_NONE,
+    TRACEID_GetSystemFirmwareTable,     // Provider, TableID, pFirmwareTableBuffer, BufferSize
+    TRACEID_GetSystemFirmwareTableAcpi, // nRet, Instance, table address
+    TRACEID_MAX,
+    TRACEID_USER = 0x8000               // first ID for application events
+}TRACEID;
+
+typedef struct _TRACEEVENT {
+    uint64_t Tsc;                       // TSC at the trace site
+    uint64_t Seq;                       // position in the ring + 1, 0 while the event is written
+    uint64_t Caller;                    // return address into the trace site
+    uint32_t ApicId;                    // APIC ID of the executing processor
+    uint16_t Cpu;                       // ring, processor index of the topology index
+    uint16_t Id;                        // TRACEID_...
+    uint64_t Arg[4];                    // arguments
+}TRACEEVENT;
+
+typedef struct _TRACEDUMPHDR {
+    uint32_t Signature;                 // TRACEDUMP_SIGNATURE
+    uint32_t HdrSize;                   // sizeof(TRACEDUMPHDR)
+    uint32_t nEvents;                   // number of TRACEEVENT following the header, in TSC order
+    uint32_t EventSize;                 // sizeof(TRACEEVENT)
+    uint64_t TscPerSec;                 // TSC counts per second, to convert timestamps
+    uint64_t nLost;                     // number of events overwritten
+}TRACEDUMPHDR;
+
+#define TRACEDUMP_SIGNATURE 'ECRT'      // "TRCE"
+
+extern int TraceStart4UEFI(uint32_t nEventsPerCpu);
+extern void TraceStop4UEFI(void);
+extern void TraceEvent4UEFI(uint32_t Id, uint64_t Arg0, uint64_t Arg1, uint64_t Arg2, uint64_t Arg3);
+extern uint32_t TraceDump4UEFI(void* pBuffer, uint32_t BufferSize);
+extern uint32_t TracePrint4UEFI(const char* strFileName);
+
+#define TRACE(Id, a0, a1, a2, a3)   TraceEvent4UEFI(TRACEID_##Id, (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2), (uint64_t)(a3))
+
+#endif//_WIN324UEFI_H_
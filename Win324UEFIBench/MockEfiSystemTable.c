@@ -0,0 +1,757 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    MockEfiSystemTable.c
+
+Abstract:
+
+    Mock EFI system table with a synthetic ACPI tree
+
+    A copy of the EFI system table is installed as pEfiSystemTable. Its
+    configuration table holds a configurable number of dummy entries and
+    an ACPI 2.0 entry, that points to a generated RSDP/XSDT/FADT/FACS/DSDT
+    plus N SSDTs of configurable size.
+
+    DSDT and SSDTs hold generated AML: Device(\_SB_.PCI0) in the DSDT,
+    Device(\_SB_.PCI0.Tnnn) in SSDT nnn, each filled with devices Dnnn
+    that carry _ADR, _HID, _STA, an OperationRegion and a Field.
+
+    An SMBIOS 3.0 entry point replaces the real SMBIOS entries. Its structure
+    table holds type 0, 1, 2x type 4, type 16, N type 17 memory devices and type 127.
+
+    An MCFG table describes segment 0, bus 0..N-1 of a synthetic ECAM image.
+    Each bus holds a multi-function device 0 and devices 1..7 of rotating classes.
+
+    MADT lists N processors with APIC ID 0..N-1, x2APIC structures from APIC ID 255.
+    SRAT spreads them evenly over M proximity domains with 1GiB of memory each,
+    SLIT holds distance 10 within and 20 + |i - j| between domains.
+
+    While a measurement runs, AllocatePool()/FreePool() of the boot services
+    table are wrapped to count the pool allocations done underneath malloc(),
+    those of the library and those of the caller pattern alike.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <Guid\Acpi.h>
+#include <Guid\SmBios.h>
+#include <IndustryStandard/SmBios.h>
+#include <IndustryStandard/Acpi62.h>
+#include <IndustryStandard/MemoryMappedConfigurationSpaceAccessTable.h>
+#include "Win324UEFI.h"
+#include "Win324UEFIBench.h"
+
+#define ALIGN(x,a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+static EFI_SYSTEM_TABLE* pRealSystemTable = NULL;
+static EFI_SYSTEM_TABLE MockSystemTable;
+static EFI_CONFIGURATION_TABLE* pMockCfg = NULL;
+static void* pMockAcpi = NULL;
+static void* pMockSmbios = NULL;
+static void* pMockEcam = NULL;
+static EFI_ALLOCATE_POOL pfnAllocatePool = NULL;
+static EFI_FREE_POOL pfnFreePool = NULL;
+static unsigned long nPoolAlloc, nPoolFree;
+
+static EFI_STATUS EFIAPI allocatepool(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID** Buffer)
+{
+    nPoolAlloc++;
+
+    return pfnAllocatePool(PoolType, Size, Buffer);
+}
+
+static EFI_STATUS EFIAPI freepool(VOID* Buffer)
+{
+    nPoolFree++;
+
+    return pfnFreePool(Buffer);
+}
+
+static uint8_t checksum(void* p, size_t size)
+{
+    uint8_t* pb = p, sum = 0;
+
+    while (size--)
+        sum += *pb++;
+
+    return (uint8_t)(0 - sum);
+}
+
+static void fillhdr(void* pTbl, uint32_t Signature, uint32_t Length, uint8_t Revision, const char* strOemTableId)
+{
+    EFI_ACPI_DESCRIPTION_HEADER* pHdr = pTbl;
+    char OemTableId[9];
+
+    snprintf(OemTableId, sizeof(OemTableId), "%-8s", strOemTableId);
+
+    pHdr->Signature = Signature;
+    pHdr->Length = Length;
+    pHdr->Revision = Revision;
+    pHdr->Checksum = 0;
+    memcpy(pHdr->OemId, "W324UE", sizeof(pHdr->OemId));
+    memcpy(&pHdr->OemTableId, OemTableId, sizeof(pHdr->OemTableId));
+    pHdr->OemRevision = 1;
+    pHdr->CreatorId = 'NTNI';
+    pHdr->CreatorRevision = 0x20220101;
+}
+
+/** amldevice()
+
+    Write Device(Dnnn) { Name(_ADR, nnn) Name(_HID, "W32400nn") Method(_STA) { Return(0x0F) }
+                         OperationRegion(OPR0, SystemMemory, ...) Field(OPR0, ...) { F000, 32 } }
+
+    @retval 71, size of the device in bytes
+
+**/
+static uint32_t amldevice(uint8_t* p, uint32_t n)
+{
+    static const uint8_t Template[71] = {
+        0x5B, 0x82, 0x45, 0x04, 'D', '0', '0', '0',                                     // Device, PkgLength 69
+        0x08, '_', 'A', 'D', 'R', 0x0C, 0, 0, 0, 0,                                     // Name(_ADR, DWordConst)
+        0x08, '_', 'H', 'I', 'D', 0x0D, 'W', '3', '2', '4', '0', '0', '0', '0', 0,      // Name(_HID, String)
+        0x14, 0x09, '_', 'S', 'T', 'A', 0x00, 0xA4, 0x0A, 0x0F,                         // Method(_STA, 0) { Return(0x0F) }
+        0x5B, 0x80, 'O', 'P', 'R', '0', 0x00, 0x0C, 0, 0, 0xD0, 0xFE, 0x0B, 0, 4,       // OperationRegion(OPR0, SystemMemory, DWordConst, WordConst)
+        0x5B, 0x81, 0x0B, 'O', 'P', 'R', '0', 0x01, 'F', '0', '0', '0', 0x20,           // Field(OPR0, DWordAcc) { F000, 32 }
+    };
+    static const char hex[] = "0123456789ABCDEF";
+
+    memcpy(p, Template, sizeof(Template));
+
+    p[5] = hex[(n >> 8) & 0xF];
+    p[6] = hex[(n >> 4) & 0xF];
+    p[7] = hex[n & 0xF];
+    memcpy(&p[14], &n, sizeof(uint32_t));
+    p[30] = hex[(n >> 4) & 0xF];
+    p[31] = hex[n & 0xF];
+    memcpy(&p[51], &n, sizeof(uint16_t));
+
+    return sizeof(Template);
+}
+
+/** amlbody()
+
+    Fill a definition block with Device(strName) { [Name(_HID, EISAID)] Device(D000) ... }
+    and pad the rest with Name(PAD_, Buffer() {})
+
+    @param[in] p            start of the definition block body
+    @param[in] size         size of the body
+    @param[in] pName        NameString of the outer device
+    @param[in] sizeName     its size
+    @param[in] dwEisaId     _HID of the outer device, 0 for none
+
+    @retval VOID
+
+**/
+static void amlbody(uint8_t* p, uint32_t size, const uint8_t* pName, uint32_t sizeName, uint32_t dwEisaId)
+{
+    uint32_t len, n, pos = 0;
+
+    //
+    // Device, 4 byte PkgLength, NameString, _HID, devices
+    //
+    len = 4 + sizeName + (0 != dwEisaId ? 10 : 0);
+
+    if (2 + len + 16 > size)
+        return;
+
+    for (n = 0; n < 4096 && 2 + len + 71 + 16 <= size; n++)
+        len += amldevice(&p[2 + len], n);
+
+    p[pos++] = 0x5B;
+    p[pos++] = 0x82;
+    p[pos++] = (uint8_t)(0xC0 | (len & 0x0F));
+    p[pos++] = (uint8_t)(len >> 4);
+    p[pos++] = (uint8_t)(len >> 12);
+    p[pos++] = (uint8_t)(len >> 20);
+    memcpy(&p[pos], pName, sizeName);
+    pos += sizeName;
+
+    if (0 != dwEisaId)
+    {
+        memcpy(&p[pos], "\x08_HID\x0C", 6);
+        p[pos + 6] = (uint8_t)(dwEisaId >> 24);                                     // EISA ID is stored big endian
+        p[pos + 7] = (uint8_t)(dwEisaId >> 16);
+        p[pos + 8] = (uint8_t)(dwEisaId >> 8);
+        p[pos + 9] = (uint8_t)(dwEisaId >> 0);
+    }
+
+    //
+    // Name(PAD_, Buffer(n) {}) for the rest
+    //
+    pos = 2 + len;
+    len = size - pos - 6;                                                           // Buffer PkgLength
+
+    memcpy(&p[pos], "\x08PAD_\x11", 6);
+    p[pos + 6] = (uint8_t)(0xC0 | (len & 0x0F));
+    p[pos + 7] = (uint8_t)(len >> 4);
+    p[pos + 8] = (uint8_t)(len >> 12);
+    p[pos + 9] = (uint8_t)(len >> 20);
+    p[pos + 10] = 0x0C;                                                             // BufferSize, DWordConst
+    n = len - 9;
+    memcpy(&p[pos + 11], &n, sizeof(uint32_t));
+}
+
+/** smbiosstruct()
+
+    Write an SMBIOS structure with zeroed formatted area and its string-set
+
+    @param[in] p            destination, may be NULL to get the size only
+    @param[in] Type         structure type
+    @param[in] Length       length of the formatted area
+    @param[in] Handle       handle
+    @param[in] strStrings   strings, separated by '|', NULL for none
+
+    @retval size of the structure including the string-set
+
+**/
+static uint32_t smbiosstruct(uint8_t* p, uint8_t Type, uint8_t Length, uint16_t Handle, const char* strStrings)
+{
+    uint32_t len = NULL == strStrings ? 0 : (uint32_t)strlen(strStrings), i;
+
+    if (NULL != p)
+    {
+        memset(p, 0, Length);
+        p[0] = Type;
+        p[1] = Length;
+        memcpy(&p[2], &Handle, sizeof(Handle));
+
+        for (i = 0; i < len; i++)
+            p[Length + i] = '|' == strStrings[i] ? '\0' : strStrings[i];
+
+        p[Length + len] = '\0';                                                     // double NUL
+        p[Length + len + 1] = '\0';
+    }
+
+    return Length + len + 2;
+}
+
+/** smbiostable()
+
+    Generate the SMBIOS structure table
+
+    @param[in] p        destination, may be NULL to get the size only
+    @param[in] nMemDev  number of type 17 structures
+
+    @retval size of the structure table
+
+**/
+static uint32_t smbiostable(uint8_t* p, uint32_t nMemDev)
+{
+    uint32_t size = 0, i;
+    uint16_t Handle = 0, hMemArray;
+    char strDimm[64];
+
+#define ADD(Type, Length, strStrings) size += smbiosstruct(NULL == p ? NULL : &p[size], Type, Length, Handle++, strStrings)
+
+    ADD(0, 0x18, "W324UEFI|1.00|01/01/2022");
+    ADD(1, 0x1B, "W324UEFI|Mock|1.0|0000");
+    ADD(4, 0x30, "CPU0|GenuineMock|Mock CPU");
+    ADD(4, 0x30, "CPU1|GenuineMock|Mock CPU");
+    hMemArray = Handle;
+    ADD(16, 0x17, NULL);
+
+    for (i = 0; i < nMemDev; i++)
+    {
+        uint32_t offs = size;
+
+        snprintf(strDimm, sizeof(strDimm), "DIMM_%u|BANK %u|Mock|%08X", i, i / 2, i);
+        ADD(17, 0x28, strDimm);
+
+        if (NULL != p)
+            memcpy(&p[offs + 4], &hMemArray, sizeof(hMemArray));                  // Physical Memory Array Handle
+    }
+
+    ADD(127, 4, NULL);
+
+#undef ADD
+
+    return size;
+}
+
+/** pcifunc()
+
+    Fill the configuration header of a function in the ECAM image
+
+    @param[in] pEcam        ECAM image, bus 0
+    @param[in] PciAddress   function address
+    @param[in] dwClass      base class, sub class, prog-if
+    @param[in] HeaderType   header type register
+
+    @retval VOID
+
+**/
+static void pcifunc(uint8_t* pEcam, uint32_t PciAddress, uint32_t dwClass, uint8_t HeaderType)
+{
+    uint32_t* pCfg = (void*)&pEcam[(size_t)(PciAddress & 0xFFFF) << 12];
+    uint32_t i;
+
+    memset(pCfg, 0, 4096);
+    pCfg[0] = 0x8086 | (0x1000 | (dwClass >> 8)) << 16;             // vendor ID, device ID from class code
+    pCfg[2] = dwClass << 8 | 1;                                     // class code, revision ID
+    pCfg[3] = (uint32_t)HeaderType << 16;
+
+    for (i = 0; i < (0 == (HeaderType & 0x7F) ? 6u : 2u); i++)
+        pCfg[4 + i] = 0x80000000 | (PciAddress & 0xFFFF) << 12 | i << 4;
+
+    if (1 == (HeaderType & 0x7F))                                   // bridge: primary, secondary, subordinate bus
+        pCfg[6] = PCI_BUS(PciAddress) | (PCI_BUS(PciAddress) + 1u) << 8 | (PCI_BUS(PciAddress) + 1u) << 16;
+}
+
+/** pciecam()
+
+    Generate the ECAM image. Absent functions read all bits set.
+
+    @param[in] pEcam    ECAM image
+    @param[in] nBus     number of buses
+
+    @retval VOID
+
+**/
+static void pciecam(uint8_t* pEcam, uint32_t nBus)
+{
+    static const uint32_t Class[] = { 0x060400, 0x030000, 0x040300, 0x088000 };
+    uint32_t Bus, Dev, dwClass;
+
+    memset(pEcam, 0xFF, (size_t)nBus << 20);
+
+    for (Bus = 0; Bus < nBus; Bus++)
+    {
+        pcifunc(pEcam, PCI_ADDRESS(0, Bus, 0, 0), 0x010802, 0x80);  // NVMe, multi-function
+        pcifunc(pEcam, PCI_ADDRESS(0, Bus, 0, 1), 0x0C0330, 0x00);  // xHCI
+        pcifunc(pEcam, PCI_ADDRESS(0, Bus, 0, 2), 0x020000, 0x00);  // Ethernet
+
+        for (Dev = 1; Dev < 8; Dev++)
+        {
+            dwClass = Class[(Bus + Dev) % (sizeof(Class) / sizeof(Class[0]))];
+            pcifunc(pEcam, PCI_ADDRESS(0, Bus, Dev, 0), dwClass, 0x060400 == dwClass ? 1 : 0);
+        }
+    }
+}
+
+/** topology()
+
+    Generate MADT, SRAT and SLIT
+
+    @param[out] pMADT       receives the MADT, may be NULL to get the sizes only
+    @param[out] pSRAT       receives the SRAT
+    @param[out] pSLIT       receives the SLIT
+    @param[in] nCpus        number of processors
+    @param[in] nNodes       number of proximity domains
+    @param[out] pSize       receives the sizes of MADT, SRAT, SLIT
+
+    @retval VOID
+
+**/
+static void topology(uint8_t* pMADT, uint8_t* pSRAT, uint8_t* pSLIT, uint32_t nCpus, uint32_t nNodes, size_t* pSize)
+{
+    size_t offsMADT = sizeof(EFI_ACPI_6_2_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER);
+    size_t offsSRAT = sizeof(EFI_ACPI_6_2_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER);
+    uint32_t i, j, Node;
+
+    for (i = 0; i < nCpus; i++)
+    {
+        Node = (uint32_t)((uint64_t)i * nNodes / nCpus);
+
+        if (i < 0xFF)
+        {
+            if (NULL != pMADT)
+            {
+                EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_STRUCTURE* pApic = (void*)&pMADT[offsMADT];
+                EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_AFFINITY_STRUCTURE* pAff = (void*)&pSRAT[offsSRAT];
+
+                pApic->Type = EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC;
+                pApic->Length = sizeof(*pApic);
+                pApic->AcpiProcessorUid = (uint8_t)i;
+                pApic->ApicId = (uint8_t)i;
+                pApic->Flags = EFI_ACPI_6_2_LOCAL_APIC_ENABLED;
+
+                pAff->Type = EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_AFFINITY;
+                pAff->Length = sizeof(*pAff);
+                pAff->ProximityDomain7To0 = (uint8_t)Node;
+                pAff->ApicId = (uint8_t)i;
+                pAff->Flags = EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_ENABLED;
+            }
+
+            offsMADT += sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_STRUCTURE);
+            offsSRAT += sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_AFFINITY_STRUCTURE);
+        }
+        else
+        {
+            if (NULL != pMADT)
+            {
+                EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_STRUCTURE* pX2Apic = (void*)&pMADT[offsMADT];
+                EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_AFFINITY_STRUCTURE* pAff = (void*)&pSRAT[offsSRAT];
+
+                pX2Apic->Type = EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC;
+                pX2Apic->Length = sizeof(*pX2Apic);
+                pX2Apic->X2ApicId = i;
+                pX2Apic->Flags = EFI_ACPI_6_2_LOCAL_APIC_ENABLED;
+                pX2Apic->AcpiProcessorUid = i;
+
+                pAff->Type = EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_AFFINITY;
+                pAff->Length = sizeof(*pAff);
+                pAff->ProximityDomain = Node;
+                pAff->X2ApicId = i;
+                pAff->Flags = EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_ENABLED;
+            }
+
+            offsMADT += sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_STRUCTURE);
+            offsSRAT += sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_AFFINITY_STRUCTURE);
+        }
+    }
+
+    for (Node = 0; Node < nNodes; Node++)
+    {
+        if (NULL != pMADT)
+        {
+            EFI_ACPI_6_2_MEMORY_AFFINITY_STRUCTURE* pMem = (void*)&pSRAT[offsSRAT];
+
+            pMem->Type = EFI_ACPI_6_2_MEMORY_AFFINITY;
+            pMem->Length = sizeof(*pMem);
+            pMem->ProximityDomain = Node;
+            pMem->AddressBaseLow = (Node & 3) << 30;
+            pMem->AddressBaseHigh = Node >> 2;
+            pMem->LengthLow = 1 << 30;
+            pMem->Flags = EFI_ACPI_6_2_MEMORY_ENABLED;
+        }
+
+        offsSRAT += sizeof(EFI_ACPI_6_2_MEMORY_AFFINITY_STRUCTURE);
+    }
+
+    pSize[0] = offsMADT;
+    pSize[1] = offsSRAT;
+    pSize[2] = sizeof(EFI_ACPI_6_2_SYSTEM_LOCALITY_DISTANCE_INFORMATION_TABLE_HEADER) + nNodes * nNodes;
+
+    if (NULL != pMADT)
+    {
+        fillhdr(pMADT, 'CIPA', (uint32_t)pSize[0], 4, "APIC");
+        fillhdr(pSRAT, 'TARS', (uint32_t)pSize[1], 3, "SRAT");
+        fillhdr(pSLIT, 'TILS', (uint32_t)pSize[2], 1, "SLIT");
+        ((EFI_ACPI_6_2_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER*)pSRAT)->Reserved1 = 1;
+        ((EFI_ACPI_6_2_SYSTEM_LOCALITY_DISTANCE_INFORMATION_TABLE_HEADER*)pSLIT)->NumberOfSystemLocalities = nNodes;
+
+        for (i = 0; i < nNodes; i++)
+            for (j = 0; j < nNodes; j++)
+                pSLIT[pSize[2] - nNodes * nNodes + i * nNodes + j] = (uint8_t)(i == j ? 10 : 20 + (i > j ? i - j : j - i));
+
+        pMADT[9] = checksum(pMADT, pSize[0]);
+        pSRAT[9] = checksum(pSRAT, pSize[1]);
+        pSLIT[9] = checksum(pSLIT, pSize[2]);
+    }
+}
+
+/** MockEfiSystemTableInstall()
+Synopsis
+    int MockEfiSystemTableInstall(const MOCKCFG* pCfg);
+Description
+    Generate the synthetic ACPI tree and install the mock EFI system table
+Paramters
+    const MOCKCFG* pCfg :   configuration
+Returns
+    0   :   success
+    -1  :   out of memory or table size below header size
+**/
+int MockEfiSystemTableInstall(const MOCKCFG* pCfg)
+{
+    static EFI_GUID EfiAcpi20TableGuid = EFI_ACPI_20_TABLE_GUID;
+    static EFI_GUID SmbiosTableGuid = SMBIOS_TABLE_GUID;
+    static EFI_GUID Smbios3TableGuid = SMBIOS3_TABLE_GUID;
+    EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER* pRSD;
+    EFI_ACPI_DESCRIPTION_HEADER* pXSDT;
+    EFI_ACPI_6_2_FIXED_ACPI_DESCRIPTION_TABLE* pFADT;
+    EFI_ACPI_6_2_FIRMWARE_ACPI_CONTROL_STRUCTURE* pFACS;
+    EFI_ACPI_DESCRIPTION_HEADER* pDSDT;
+    uint64_t* pXsdtEntry;
+    size_t offsXSDT, offsFADT, offsFACS, offsDSDT, offsSSDT, offsMCFG, offsMADT, sizeXSDT, sizeSSDT, sizeMCFG, sizeTopo[3], size;
+    uint32_t i;
+    char* pBase;
+
+    MockEfiSystemTableRemove();
+
+    if (pCfg->DsdtSize < sizeof(EFI_ACPI_DESCRIPTION_HEADER) || pCfg->SsdtSize < sizeof(EFI_ACPI_DESCRIPTION_HEADER) || 256 < pCfg->nPciBus)
+        return -1;
+
+    //
+    // layout: RSDP, XSDT, FADT, FACS, DSDT, SSDT[0..n-1], MCFG, MADT, SRAT, SLIT
+    //
+    topology(NULL, NULL, NULL, pCfg->nCpus, pCfg->nNumaNodes, sizeTopo);
+    sizeXSDT = sizeof(EFI_ACPI_DESCRIPTION_HEADER) + (1 + pCfg->nSsdt + (0 != pCfg->nPciBus) + (0 != pCfg->nCpus) * (1 + 2 * (0 != pCfg->nNumaNodes))) * sizeof(uint64_t);
+    sizeMCFG = sizeof(EFI_ACPI_MEMORY_MAPPED_CONFIGURATION_BASE_ADDRESS_TABLE_HEADER)
+        + sizeof(EFI_ACPI_MEMORY_MAPPED_ENHANCED_CONFIGURATION_SPACE_BASE_ADDRESS_ALLOCATION_STRUCTURE);
+    sizeSSDT = ALIGN(pCfg->SsdtSize, 8);
+    offsXSDT = ALIGN(sizeof(EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER), 16);
+    offsFADT = ALIGN(offsXSDT + sizeXSDT, 16);
+    offsFACS = ALIGN(offsFADT + sizeof(EFI_ACPI_6_2_FIXED_ACPI_DESCRIPTION_TABLE), 64);
+    offsDSDT = ALIGN(offsFACS + sizeof(EFI_ACPI_6_2_FIRMWARE_ACPI_CONTROL_STRUCTURE), 16);
+    offsSSDT = ALIGN(offsDSDT + pCfg->DsdtSize, 16);
+    offsMCFG = offsSSDT + pCfg->nSsdt * sizeSSDT;
+    offsMADT = ALIGN(offsMCFG + sizeMCFG, 16);
+    size = offsMADT + ALIGN(sizeTopo[0], 16) + ALIGN(sizeTopo[1], 16) + sizeTopo[2];
+
+    pMockAcpi = calloc(1, size + 64);
+    pMockSmbios = calloc(1, sizeof(SMBIOS_TABLE_3_0_ENTRY_POINT) + 16 + smbiostable(NULL, pCfg->nMemDev));
+    pMockCfg = calloc(1, (pCfg->nCfgDummy + pEfiSystemTable->NumberOfTableEntries + 2) * sizeof(EFI_CONFIGURATION_TABLE));
+    pMockEcam = 0 == pCfg->nPciBus ? NULL : malloc((size_t)pCfg->nPciBus << 20);
+
+    if (NULL == pMockAcpi || NULL == pMockCfg || NULL == pMockSmbios || (0 != pCfg->nPciBus && NULL == pMockEcam))
+    {
+        free(pMockAcpi);
+        free(pMockCfg);
+        free(pMockSmbios);
+        free(pMockEcam);
+        pMockAcpi = pMockCfg = pMockSmbios = pMockEcam = NULL;
+        return -1;
+    }
+
+    pBase = (char*)ALIGN((size_t)pMockAcpi, 64);
+    pRSD = (void*)pBase;
+    pXSDT = (void*)&pBase[offsXSDT];
+    pFADT = (void*)&pBase[offsFADT];
+    pFACS = (void*)&pBase[offsFACS];
+    pDSDT = (void*)&pBase[offsDSDT];
+    pXsdtEntry = (void*)&pBase[offsXSDT + sizeof(EFI_ACPI_DESCRIPTION_HEADER)];
+
+    //
+    // FACS, DSDT
+    //
+    pFACS->Signature = 'SCAF';
+    pFACS->Length = sizeof(EFI_ACPI_6_2_FIRMWARE_ACPI_CONTROL_STRUCTURE);
+    pFACS->Version = 2;
+
+    fillhdr(pDSDT, 'TDSD', pCfg->DsdtSize, 2, "DSDT");
+    amlbody((uint8_t*)&pDSDT[1], pCfg->DsdtSize - sizeof(EFI_ACPI_DESCRIPTION_HEADER), (const uint8_t*)"\\\x2E_SB_PCI0", 10, 0x41D00A08);   // PNP0A08
+    pDSDT->Checksum = checksum(pDSDT, pCfg->DsdtSize);
+
+    //
+    // FADT
+    //
+    fillhdr(pFADT, 'PCAF', sizeof(EFI_ACPI_6_2_FIXED_ACPI_DESCRIPTION_TABLE), 6, "FACP");
+    pFADT->FirmwareCtrl = 0;
+    pFADT->Dsdt = 0;
+    pFADT->XFirmwareCtrl = (uint64_t)pFACS;
+    pFADT->XDsdt = (uint64_t)pDSDT;
+    pFADT->MinorVersion = 2;
+    pFADT->Header.Checksum = checksum(pFADT, pFADT->Header.Length);
+    *pXsdtEntry++ = (uint64_t)pFADT;
+
+    //
+    // SSDTs
+    //
+    for (i = 0; i < pCfg->nSsdt; i++)
+    {
+        EFI_ACPI_DESCRIPTION_HEADER* pSSDT = (void*)&pBase[offsSSDT + i * sizeSSDT];
+        char strOemTableId[16];
+        uint8_t Name[16] = { '\\', 0x2F, 3, '_', 'S', 'B', '_', 'P', 'C', 'I', '0', 'T' };
+
+        snprintf(strOemTableId, sizeof(strOemTableId), "SSDT%04X", i & 0xFFFF);
+        snprintf((char*)&Name[12], 4, "%03X", i & 0xFFF);
+        fillhdr(pSSDT, 'TDSS', pCfg->SsdtSize, 2, strOemTableId);
+        amlbody((uint8_t*)&pSSDT[1], pCfg->SsdtSize - sizeof(EFI_ACPI_DESCRIPTION_HEADER), Name, 15, 0);
+        pSSDT->Checksum = checksum(pSSDT, pCfg->SsdtSize);
+        *pXsdtEntry++ = (uint64_t)pSSDT;
+    }
+
+    //
+    // MCFG, segment 0, bus 0..n-1
+    //
+    if (0 != pCfg->nPciBus)
+    {
+        EFI_ACPI_MEMORY_MAPPED_CONFIGURATION_BASE_ADDRESS_TABLE_HEADER* pMCFG = (void*)&pBase[offsMCFG];
+        EFI_ACPI_MEMORY_MAPPED_ENHANCED_CONFIGURATION_SPACE_BASE_ADDRESS_ALLOCATION_STRUCTURE* pAlloc = (void*)&pMCFG[1];
+
+        pciecam(pMockEcam, pCfg->nPciBus);
+        fillhdr(pMCFG, 'GFCM', (uint32_t)sizeMCFG, 1, "MCFG");
+        pAlloc->BaseAddress = (uint64_t)pMockEcam;
+        pAlloc->PciSegmentGroupNumber = 0;
+        pAlloc->StartBusNumber = 0;
+        pAlloc->EndBusNumber = (uint8_t)(pCfg->nPciBus - 1);
+        pMCFG->Header.Checksum = checksum(pMCFG, sizeMCFG);
+        *pXsdtEntry++ = (uint64_t)pMCFG;
+    }
+
+    //
+    // MADT, SRAT, SLIT
+    //
+    if (0 != pCfg->nCpus)
+    {
+        uint8_t* pMADT = (void*)&pBase[offsMADT];
+        uint8_t* pSRAT = pMADT + ALIGN(sizeTopo[0], 16);
+        uint8_t* pSLIT = pSRAT + ALIGN(sizeTopo[1], 16);
+
+        topology(pMADT, pSRAT, pSLIT, pCfg->nCpus, pCfg->nNumaNodes, sizeTopo);
+        *pXsdtEntry++ = (uint64_t)pMADT;
+
+        if (0 != pCfg->nNumaNodes)
+        {
+            *pXsdtEntry++ = (uint64_t)pSRAT;
+            *pXsdtEntry++ = (uint64_t)pSLIT;
+        }
+    }
+
+    //
+    // XSDT, RSDP
+    //
+    fillhdr(pXSDT, 'TDSX', (uint32_t)sizeXSDT, 1, "XSDT");
+    pXSDT->Checksum = checksum(pXSDT, sizeXSDT);
+
+    pRSD->Signature = 0x2052545020445352ULL;                // "RSD PTR "
+    memcpy(pRSD->OemId, "W324UE", sizeof(pRSD->OemId));
+    pRSD->Revision = 2;
+    pRSD->Length = sizeof(EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER);
+    pRSD->XsdtAddress = (uint64_t)pXSDT;
+    pRSD->Checksum = checksum(pRSD, 20);
+    pRSD->ExtendedChecksum = checksum(pRSD, pRSD->Length);
+
+    //
+    // SMBIOS 3.0 entry point, structure table behind it
+    //
+    do {
+        SMBIOS_TABLE_3_0_ENTRY_POINT* pEP3 = pMockSmbios;
+        uint8_t* pTbl = (uint8_t*)pMockSmbios + ALIGN(sizeof(SMBIOS_TABLE_3_0_ENTRY_POINT), 16);
+
+        memcpy(pEP3->AnchorString, "_SM3_", 5);
+        pEP3->EntryPointLength = sizeof(SMBIOS_TABLE_3_0_ENTRY_POINT);
+        pEP3->MajorVersion = 3;
+        pEP3->MinorVersion = 2;
+        pEP3->EntryPointRevision = 1;
+        pEP3->TableMaximumSize = smbiostable(pTbl, pCfg->nMemDev);
+        pEP3->TableAddress = (uint64_t)pTbl;
+        pEP3->EntryPointStructureChecksum = checksum(pEP3, sizeof(SMBIOS_TABLE_3_0_ENTRY_POINT));
+
+    } while (0);
+
+    //
+    // configuration table: dummy entries, real entries except ACPI 2.0 and SMBIOS, mock ACPI 2.0 and SMBIOS 3.0
+    //
+    pRealSystemTable = pEfiSystemTable;
+    MockSystemTable = *pRealSystemTable;
+    MockSystemTable.NumberOfTableEntries = 0;
+    MockSystemTable.ConfigurationTable = pMockCfg;
+
+    for (i = 0; i < pCfg->nCfgDummy; i++)
+    {
+        EFI_GUID DummyGuid = { 0x57334955, 0x4546, (uint16_t)i, {'W','3','2','4','U','E','F','I'} };
+
+        pMockCfg[MockSystemTable.NumberOfTableEntries].VendorGuid = DummyGuid;
+        pMockCfg[MockSystemTable.NumberOfTableEntries++].VendorTable = NULL;
+    }
+
+    for (i = 0; i < pRealSystemTable->NumberOfTableEntries; i++)
+        if (memcmp(&EfiAcpi20TableGuid, &pRealSystemTable->ConfigurationTable[i].VendorGuid, sizeof(EFI_GUID))
+            && memcmp(&SmbiosTableGuid, &pRealSystemTable->ConfigurationTable[i].VendorGuid, sizeof(EFI_GUID))
+            && memcmp(&Smbios3TableGuid, &pRealSystemTable->ConfigurationTable[i].VendorGuid, sizeof(EFI_GUID)))
+            pMockCfg[MockSystemTable.NumberOfTableEntries++] = pRealSystemTable->ConfigurationTable[i];
+
+    pMockCfg[MockSystemTable.NumberOfTableEntries].VendorGuid = EfiAcpi20TableGuid;
+    pMockCfg[MockSystemTable.NumberOfTableEntries++].VendorTable = pRSD;
+    pMockCfg[MockSystemTable.NumberOfTableEntries].VendorGuid = Smbios3TableGuid;
+    pMockCfg[MockSystemTable.NumberOfTableEntries++].VendorTable = pMockSmbios;
+
+    pEfiSystemTable = &MockSystemTable;
+
+    AcpiTableIndexRebuild4UEFI();
+    SmbiosIndexRebuild4UEFI();
+    PciIndexRebuild4UEFI();
+    TopologyIndexRebuild4UEFI();
+
+    return 0;
+}
+
+/** MockEfiPoolCountStart()
+Synopsis
+    void MockEfiPoolCountStart(void);
+Description
+    Wrap AllocatePool()/FreePool() of the boot services table and zero the counts.
+    BSP only, APs do not call boot services.
+Paramters
+    none
+Returns
+    none
+**/
+void MockEfiPoolCountStart(void)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+
+    if (NULL == pfnAllocatePool)
+    {
+        pfnAllocatePool = pBS->AllocatePool;
+        pfnFreePool = pBS->FreePool;
+        pBS->AllocatePool = allocatepool;
+        pBS->FreePool = freepool;
+    }
+
+    nPoolAlloc = nPoolFree = 0;
+}
+
+/** MockEfiPoolCountStop()
+Synopsis
+    unsigned long MockEfiPoolCountStop(unsigned long* pnFree);
+Description
+    Restore AllocatePool()/FreePool() of the boot services table
+Paramters
+    unsigned long* pnFree   :   receives the number of FreePool() calls, may be NULL
+Returns
+    number of AllocatePool() calls since MockEfiPoolCountStart()
+**/
+unsigned long MockEfiPoolCountStop(unsigned long* pnFree)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+
+    if (NULL != pfnAllocatePool)
+    {
+        pBS->AllocatePool = pfnAllocatePool;
+        pBS->FreePool = pfnFreePool;
+        pfnAllocatePool = NULL;
+        pfnFreePool = NULL;
+    }
+
+    if (NULL != pnFree)
+        *pnFree = nPoolFree;
+
+    return nPoolAlloc;
+}
+
+/** MockEfiSystemTableRemove()
+Synopsis
+    void MockEfiSystemTableRemove(void);
+Description
+    Restore the real EFI system table and free the synthetic ACPI tree
+Paramters
+    none
+Returns
+    none
+**/
+void MockEfiSystemTableRemove(void)
+{
+    MockEfiPoolCountStop(NULL);
+
+    if (NULL != pRealSystemTable)
+    {
+        pEfiSystemTable = pRealSystemTable;
+        pRealSystemTable = NULL;
+
+        AcpiTableIndexRebuild4UEFI();
+        SmbiosIndexRebuild4UEFI();
+        PciIndexRebuild4UEFI();
+        TopologyIndexRebuild4UEFI();
+    }
+
+    free(pMockAcpi);
+    free(pMockCfg);
+    free(pMockSmbios);
+    free(pMockEcam);
+    pMockAcpi = pMockCfg = pMockSmbios = pMockEcam = NULL;
+}
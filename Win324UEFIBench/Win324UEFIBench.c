@@ -0,0 +1,1577 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    Win324UEFIBench.c
+
+Abstract:
+
+    Microbenchmark for the Win324UEFI library
+
+    The firmware table functions are measured against a mock EFI system table
+    with a synthetic ACPI tree. The number of SSDTs is scaled, so that
+    O(n^2) behavior becomes visible in the ns/call column.
+
+    The bench is a UEFI Shell application, there is no native build. Only the
+    configuration tables are mocked: boot services, the PIT port I/O of the TSC
+    calibration and the APs of EFI_MP_SERVICES_PROTOCOL are the platform's own.
+
+    The allocs/call column counts the AllocatePool() calls of a measurement,
+    made by the library and by the caller pattern, e.g. the malloc() of
+    size probe + copy.
+
+    Win324UEFIBench [-n maxssdt] [-s ssdtsize] [-d dsdtsize] [-c cfgdummies] [-m memdevices] [-i iterations]
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+#include "Win324UEFIBench.h"
+
+#define NUMELEM(x) (sizeof(x) / sizeof(x[0]))
+
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+static int64_t qwQPF;                   // QueryPerformanceFrequency()
+
+static int64_t now(void)
+{
+    int64_t qwQPC;
+
+    QueryPerformanceCounter4UEFI(&qwQPC);
+
+    return qwQPC;
+}
+
+static int64_t start(void)
+{
+    MockEfiPoolCountStart();
+
+    return now();
+}
+
+static double nspercall(int64_t qwTicks, uint64_t nCalls)
+{
+    return (double)qwTicks * 1.0E9 / (double)qwQPF / (double)(0 == nCalls ? 1 : nCalls);
+}
+
+static void report(const char* strName, uint32_t nTbl, int64_t qwTicks, uint64_t nCalls)
+{
+    unsigned long nAlloc = MockEfiPoolCountStop(NULL);              // pool allocations since start()
+
+    printf("%-40s %5u %12.1f %10.2f\n", strName, nTbl, nspercall(qwTicks, nCalls), (double)nAlloc / (double)(0 == nCalls ? 1 : nCalls));
+}
+
+/** benchacpi()
+
+    Run the firmware table benchmarks for the currently installed ACPI tree
+
+    @param[in] nSsdt        number of SSDTs
+    @param[in] nIterations  number of iterations
+
+    @retval VOID
+
+**/
+static void benchacpi(uint32_t nSsdt, uint32_t nIterations)
+{
+    uint32_t i, n, cbAml, Sig32[1024 + 16];
+    int64_t qwStart;
+    uint64_t qwAddress;
+    const void* pTbl;
+    volatile uint8_t bSink = 0;
+
+    //
+    // Win32 pattern: size probe, malloc, copy - for all SSDT instances
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        for (i = 0; i < nSsdt; i++)
+        {
+            uint32_t size = GetSystemFirmwareTable4UEFI('ACPI', 'TDSS', NULL, 0, &qwAddress, i);
+            void* pBuf = malloc(size);
+
+            GetSystemFirmwareTable4UEFI('ACPI', 'TDSS', pBuf, size, &qwAddress, i);
+            bSink ^= ((uint8_t*)pBuf)[0];
+            free(pBuf);
+        }
+    report("GetSystemFirmwareTable SSDT probe+copy", nSsdt, now() - qwStart, (uint64_t)nIterations * nSsdt);
+
+    //
+    // zero-copy view - for all SSDT instances
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        for (i = 0; i < nSsdt; i++)
+        {
+            GetSystemFirmwareTableView4UEFI('ACPI', 'TDSS', i, &pTbl, &qwAddress);
+            bSink ^= ((const uint8_t*)pTbl)[0];
+        }
+    report("GetSystemFirmwareTableView SSDT", nSsdt, now() - qwStart, (uint64_t)nIterations * nSsdt);
+
+    //
+    // cursor - all SSDT instances, and the last SSDT found by its OEM Table ID
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        FWTBLCURSOR Cur;
+
+        FirmwareTableCursorInit4UEFI(&Cur, 'ACPI', 'TDSS');
+        while (0 != FirmwareTableCursorNext4UEFI(&Cur, &pTbl, &qwAddress))
+            bSink ^= ((const uint8_t*)pTbl)[0];
+    }
+    report("FirmwareTableCursor SSDT", nSsdt, now() - qwStart, (uint64_t)nIterations * nSsdt);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        FWTBLCURSOR Cur;
+        char strOemTableId[16];
+
+        snprintf(strOemTableId, sizeof(strOemTableId), "SSDT%04X", (nSsdt - 1) & 0xFFFF);
+        FirmwareTableCursorInit4UEFI(&Cur, 'ACPI', 'TDSS');
+        FirmwareTableCursorFilter4UEFI(&Cur, FWTBLFLT_OEMTABLEID, NULL, strOemTableId, 0, 0);
+        if (0 != FirmwareTableCursorNext4UEFI(&Cur, &pTbl, &qwAddress))
+            bSink ^= ((const uint8_t*)pTbl)[0];
+    }
+    report("FirmwareTableCursor SSDT by OemTableId", nSsdt, now() - qwStart, nIterations);
+
+    //
+    // DSDT resolved from the FADT
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        GetSystemFirmwareTableView4UEFI('ACPI', 'TDSD', 0, &pTbl, &qwAddress);
+        bSink ^= ((const uint8_t*)pTbl)[0];
+    }
+    report("GetSystemFirmwareTableView DSDT", nSsdt, now() - qwStart, nIterations);
+
+    //
+    // checksum kernels over the DSDT, and zero-copy view with cached checksum verdicts
+    //
+    do {
+        static struct {
+            char* strName;
+            int Kernel;
+        }Csum[] = {
+            {"__AcpiChecksumEx DSDT scalar", ACPICSUM_SCALAR},
+            {"__AcpiChecksumEx DSDT SSE2", ACPICSUM_SSE2},
+            {"__AcpiChecksumEx DSDT AVX2", ACPICSUM_AVX2},
+        };
+        uint32_t k, size = GetSystemFirmwareTableView4UEFI('ACPI', 'TDSD', 0, &pTbl, &qwAddress);
+
+        if (0 == size)
+            break;
+
+        for (k = 0; k < NUMELEM(Csum); k++)
+        {
+            qwStart = start();
+            for (n = 0; n < nIterations; n++)
+                bSink ^= __AcpiChecksumEx(Csum[k].Kernel, pTbl, size);
+            report(Csum[k].strName, nSsdt, now() - qwStart, nIterations);
+        }
+
+    } while (0);
+
+    SetFirmwareTableValidation4UEFI(FWTBLVAL_CHECKSUM);
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        for (i = 0; i < nSsdt; i++)
+        {
+            GetSystemFirmwareTableView4UEFI('ACPI', 'TDSS', i, &pTbl, &qwAddress);
+            bSink ^= ((const uint8_t*)pTbl)[0];
+        }
+    SetFirmwareTableValidation4UEFI(FWTBLVAL_NONE);
+    report("GetSystemFirmwareTableView SSDT validated", nSsdt, now() - qwStart, (uint64_t)nIterations * nSsdt);
+
+    //
+    // EnumSystemFirmwareTables(): size probe and enumeration
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        uint32_t size = EnumSystemFirmwareTables4UEFI('ACPI', NULL, 0);
+
+        if (size <= sizeof(Sig32))
+            EnumSystemFirmwareTables4UEFI('ACPI', Sig32, size);
+    }
+    report("EnumSystemFirmwareTables probe+enum", nSsdt, now() - qwStart, nIterations);
+
+    //
+    // snapshot of all tables into one image, then replay from the image
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        void* pImage = CreateFirmwareTableSnapshot4UEFI('ACPI', NULL);
+
+        free(pImage);
+    }
+    report("CreateFirmwareTableSnapshot", nSsdt, now() - qwStart, nIterations);
+
+    do {
+        uint64_t qwImageSize;
+        void* pImage = CreateFirmwareTableSnapshot4UEFI('ACPI', &qwImageSize);
+
+        if (NULL == pImage)
+            break;
+
+        if (0 < LoadFirmwareTableSnapshot4UEFI(pImage, qwImageSize))
+        {
+            qwStart = start();
+            for (n = 0; n < nIterations; n++)
+                for (i = 0; i < nSsdt; i++)
+                {
+                    GetSystemFirmwareTableView4UEFI('ACPI', 'TDSS', i, &pTbl, &qwAddress);
+                    bSink ^= ((const uint8_t*)pTbl)[0];
+                }
+            report("GetSystemFirmwareTableView SSDT replay", nSsdt, now() - qwStart, (uint64_t)nIterations * nSsdt);
+
+            LoadFirmwareTableSnapshot4UEFI(NULL, 0);
+        }
+
+        free(pImage);
+
+    } while (0);
+
+    //
+    // AML namespace index: build, lookup by path and by _HID
+    //
+    for (cbAml = GetSystemFirmwareTableView4UEFI('ACPI', 'TDSD', 0, NULL, NULL), i = 0; i < nSsdt; i++)
+        cbAml += GetSystemFirmwareTableView4UEFI('ACPI', 'TDSS', i, NULL, NULL);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        AmlIndexDestroy4UEFI(AmlIndexCreate4UEFI());
+    qwStart = now() - qwStart;
+    report("AmlIndexCreate", nSsdt, qwStart, nIterations);
+    printf("%-40s %12u %12.1f MB/s\n", "AmlIndexCreate, AML bytes", cbAml, (double)cbAml * 1.0E3 / nspercall(qwStart, nIterations));
+
+    do {
+        AMLIDX* pAml = AmlIndexCreate4UEFI();
+        const AMLIDXNODE* pNode;
+        uint32_t nFound = 0;
+
+        if (NULL == pAml)
+            break;
+
+        qwStart = start();
+        for (n = 0; n < nIterations; n++)
+            for (i = 0; i < nSsdt; i++)
+                nFound += (NULL != AmlIndexFindPath4UEFI(pAml, "\\_SB.PCI0.D001._STA"));
+        report("AmlIndexFindPath", pAml->nNodes, now() - qwStart, (uint64_t)nIterations * nSsdt);
+
+        qwStart = start();
+        for (n = 0; n < nIterations; n++)
+            for (pNode = AmlIndexFindHid4UEFI(pAml, "PNP0A08", NULL); NULL != pNode; pNode = AmlIndexFindHid4UEFI(pAml, "PNP0A08", pNode))
+                nFound++;
+        report("AmlIndexFindHid", pAml->nNodes, now() - qwStart, nIterations);
+
+        AmlIndexDestroy4UEFI(pAml);
+
+    } while (0);
+
+    //
+    // SMBIOS: RawSMBIOSData probe+copy, all type 17 memory devices, lookup by handle
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        uint32_t size = GetSystemFirmwareTable4UEFI('RSMB', 0, NULL, 0);
+        void* pBuf = malloc(size);
+
+        GetSystemFirmwareTable4UEFI('RSMB', 0, pBuf, size);
+        bSink ^= ((uint8_t*)pBuf)[0];
+        free(pBuf);
+    }
+    report("GetSystemFirmwareTable RSMB probe+copy", nSsdt, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        const uint8_t* pStruct;
+
+        for (i = 0; NULL != (pStruct = SmbiosFindByType4UEFI(17, i, NULL)); i++)
+            bSink ^= pStruct[0];
+    }
+    report("SmbiosFindByType 17 all", SmbiosTypeCount4UEFI(17), now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        const uint8_t* pStruct = SmbiosFindByHandle4UEFI((uint16_t)(n & 0x1F), NULL);
+
+        if (NULL != pStruct)
+            bSink ^= pStruct[0];
+    }
+    report("SmbiosFindByHandle", SmbiosTypeCount4UEFI(17), now() - qwStart, nIterations);
+
+    //
+    // index rebuild
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        AcpiTableIndexRebuild4UEFI();
+    report("AcpiTableIndexRebuild", nSsdt, now() - qwStart, nIterations);
+}
+
+/** benchsig()
+
+    Classify all signatures of the currently installed ACPI tree plus unknown signatures
+
+**/
+static void benchsig(uint32_t nIterations)
+{
+    static char* strSig[] = { "FACP", "SSDT", "DSDT", "APIC", "HPET", "MCFG", "XENV", "iBFT", "OEM1", "XXXX", "ABCD", "WSMT" };
+    uint32_t i, n, nFound = 0;
+    int64_t qwStart;
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        for (i = 0; i < NUMELEM(strSig); i++)
+            nFound += __ChkACPISignature(strSig[i]);
+    report("__ChkACPISignature", 0, now() - qwStart, (uint64_t)nIterations * NUMELEM(strSig));
+}
+
+/** benchmem()
+
+    Pointer validation against the memory map snapshot of the real system table
+
+**/
+static void benchmem(uint32_t nIterations)
+{
+    static uint8_t bStatic[4096];
+    uint8_t* pHeap = malloc(64 * 1024);
+    uint32_t n, nBad = 0;
+    int64_t qwStart;
+
+    MemoryMapIndexRebuild4UEFI();
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        nBad += IsBadReadPtr4UEFI(&bStatic[n % 4096], 1);
+    report("IsBadReadPtr static", __MemMapIdxGet() ? __MemMapIdxGet()->nRanges : 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        nBad += IsBadWritePtr4UEFI(pHeap, 64 * 1024);
+    report("IsBadWritePtr heap 64KiB", __MemMapIdxGet() ? __MemMapIdxGet()->nRanges : 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        nBad += IsBadReadPtr4UEFI((void*)(uintptr_t)0xFFFFFFFFFFFF0000ULL, 16);
+    report("IsBadReadPtr miss", __MemMapIdxGet() ? __MemMapIdxGet()->nRanges : 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        MemoryMapIndexRebuild4UEFI();
+    report("MemoryMapIndexRebuild", __MemMapIdxGet() ? __MemMapIdxGet()->nRanges : 0, now() - qwStart, nIterations);
+
+    free(pHeap);
+}
+
+/** mockpgtbl()
+
+    Build a synthetic page table image at physical addresses 1000h..5FFFh
+
+        0000_0000h  4KiB pages: RW, RO, not present, XD, RW...
+        0020_0000h  2MiB page RO
+        0040_0000h  2MiB page XD
+        0060_0000h  4KiB pages below a RO page directory entry
+        4000_0000h  1GiB page RW, 8000_0000h 1GiB page RO, C000_0000h 1GiB page XD
+
+    @param[out] pCtx        receives the page walk context
+    @param[in] Levels       4 or 5
+    @param[in] pImage       image buffer, 6 * 4KiB, 4KiB aligned
+
+    @retval VOID
+
+**/
+static void mockpgtbl(PGWALKCTX* pCtx, uint32_t Levels, uint64_t* pImage)
+{
+    uint64_t* pPml5 = &pImage[1 * 512], * pPml4 = &pImage[2 * 512], * pPdpt = &pImage[3 * 512], * pPd = &pImage[4 * 512], * pPt = &pImage[5 * 512];
+    uint32_t i;
+
+    memset(pImage, 0, 6 * 4096);
+
+    pPml5[0] = 0x2000 | 3;
+    pPml4[0] = 0x3000 | 3;
+    pPdpt[0] = 0x4000 | 3;
+    pPdpt[1] = 0x40000000 | 0x83;
+    pPdpt[2] = 0x80000000 | 0x81;
+    pPdpt[3] = 0xC0000000 | 0x83 | (1ULL << 63);
+    pPd[0] = 0x5000 | 3;
+    pPd[1] = 0x200000 | 0x81;
+    pPd[2] = 0x400000 | 0x83 | (1ULL << 63);
+    pPd[3] = 0x5000 | 1;
+
+    for (i = 0; i < 512; i++)
+        pPt[i] = ((uint64_t)i << 12) | 3;
+
+    pPt[1] &= ~2ULL;
+    pPt[2] = 0;
+    pPt[3] |= 1ULL << 63;
+
+    pCtx->Cr3 = 5 == Levels ? 0x1000 : 0x2000;
+    pCtx->Levels = Levels;
+    pCtx->fWp = true;
+    pCtx->fNxe = true;
+    pCtx->Bias = (intptr_t)pImage;
+}
+
+/** benchpgwalk()
+
+    Page table walker and software translation cache against a synthetic page table image.
+    The image is walked through PGWALKCTX.Bias, the checks do not depend on the paging
+    set up by the firmware the bench runs on. Each probe is checked uncached and cached.
+
+**/
+static void benchpgwalk(uint32_t nIterations)
+{
+    static struct {
+        uint64_t qwAddress;
+        uint64_t qwSize;
+        uint32_t Access;
+        bool fExpected;
+    }Probe[] = {
+        {0x00000000, 0x1000, MEMACC_READ | MEMACC_WRITE | MEMACC_EXECUTE, true},
+        {0x00001000, 0x0008, MEMACC_READ, true},
+        {0x00001000, 0x0008, MEMACC_WRITE, false},
+        {0x00000FF8, 0x0010, MEMACC_WRITE, false},
+        {0x00002000, 0x0001, MEMACC_READ, false},
+        {0x00000000, 0x2000, MEMACC_READ, true},
+        {0x00001000, 0x2000, MEMACC_READ, false},
+        {0x00003000, 0x0001, MEMACC_EXECUTE, false},
+        {0x00200000, 0x200000, MEMACC_READ | MEMACC_EXECUTE, true},
+        {0x00200000, 0x0001, MEMACC_WRITE, false},
+        {0x00400000, 0x200000, MEMACC_READ | MEMACC_WRITE, true},
+        {0x00400000, 0x0001, MEMACC_EXECUTE, false},
+        {0x00600000, 0x0001, MEMACC_WRITE, false},
+        {0x00004000, 0x1FC000, MEMACC_READ | MEMACC_WRITE, true},
+        {0x40000000, 0x40000000, MEMACC_WRITE | MEMACC_EXECUTE, true},
+        {0x80000000, 0x0001, MEMACC_WRITE, false},
+        {0xC0000000, 0x0001, MEMACC_EXECUTE, false},
+        {0x100000000, 0x0001, MEMACC_READ, false},
+        {0x0000800000000000ULL, 0x0001, MEMACC_READ, false},
+        {0xFFFF800000000000ULL, 0x0001, MEMACC_READ, false},
+    };
+    uint64_t* pAlloc = malloc(7 * 4096), * pImage = (uint64_t*)(((uintptr_t)pAlloc + 4095) & ~(uintptr_t)4095);
+    PGWALKCTX PgCtx;
+    uint32_t i, n, Levels, nFail;
+    int64_t qwStart;
+    volatile uint32_t dwSink = 0;
+
+    for (Levels = 4; NULL != pAlloc && Levels <= 5; Levels++)
+    {
+        mockpgtbl(&PgCtx, Levels, pImage);
+        PageWalkSetContext4UEFI(&PgCtx);
+        nFail = 0;
+
+        for (n = 0; n < 2; n++)                                     // uncached and cached
+            for (i = 0; i < NUMELEM(Probe); i++)
+                if (Probe[i].fExpected != __PageWalkCheck(Probe[i].qwAddress, Probe[i].qwSize, Probe[i].Access))
+                {
+                    printf("page walk %u-level probe %u, %llXh: unexpected result\n", Levels, i, (unsigned long long)Probe[i].qwAddress);
+                    nFail++;
+                }
+
+        PgCtx.fWp = false;
+        PageWalkSetContext4UEFI(&PgCtx);
+        if (true != __PageWalkCheck(0x80000000, 1, MEMACC_WRITE))
+        {
+            printf("page walk %u-level CR0.WP clear: unexpected result\n", Levels);
+            nFail++;
+        }
+        PgCtx.fWp = true;
+        PageWalkSetContext4UEFI(&PgCtx);
+
+        printf("%-40s %5u %12u of %u failed\n", "page walk probes", Levels, nFail, 2 * (uint32_t)NUMELEM(Probe) + 1);
+
+        qwStart = start();
+        for (n = 0; n < nIterations; n++)
+            dwSink += __PageWalk(&PgCtx, (n % 512) << 12, NULL);
+        report("__PageWalk 4KiB", Levels, now() - qwStart, nIterations);
+
+        qwStart = start();
+        for (n = 0; n < nIterations; n++)
+            dwSink += __PageWalkCheck((n % 64) << 12, 8, MEMACC_READ);
+        report("__PageWalkCheck 4KiB cached", Levels, now() - qwStart, nIterations);
+
+        qwStart = start();
+        for (n = 0; n < nIterations; n++)
+            dwSink += __PageWalkCheck(0x40000000, 0x40000000, MEMACC_WRITE);
+        report("__PageWalkCheck 1GiB range", Levels, now() - qwStart, nIterations);
+
+        qwStart = start();
+        for (n = 0; n < nIterations; n++)
+            PageWalkFlush4UEFI(), dwSink += __PageWalkCheck(0x4000, 0x1FC000, MEMACC_WRITE);
+        report("__PageWalkCheck 508 x 4KiB uncached", Levels, now() - qwStart, nIterations);
+    }
+
+    PageWalkSetContext4UEFI(NULL);
+
+    free(pAlloc);
+}
+
+/** benchsystime()
+
+    System time: RT->GetTime() per call against the TSC extrapolation, monotony
+    and agreement of both
+
+**/
+static void benchsystime(uint32_t nIterations)
+{
+    EFI_TIME Time;
+    SYSTIME St;
+    volatile uint64_t qwSink = 0;
+    uint64_t qwFt, qwPrev, nBack = 0;
+    int64_t qwStart;
+    uint32_t n;
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        pEfiSystemTable->RuntimeServices->GetTime(&Time, NULL), qwSink += Time.Second;
+    report("RT->GetTime", 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    GetSystemTimePreciseAsFileTime4UEFI(&qwPrev);                   // RTC edge
+    report("GetSystemTimePreciseAsFileTime first", 1, now() - qwStart, 1);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        GetSystemTimePreciseAsFileTime4UEFI(&qwFt);
+        nBack += qwFt < qwPrev;
+        qwPrev = qwFt;
+    }
+    report("GetSystemTimePreciseAsFileTime", 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        GetLocalTime4UEFI(&St), qwSink += St.wMilliseconds;
+    report("GetLocalTime", 0, now() - qwStart, nIterations);
+
+    if (0 != nBack)
+        printf("GetSystemTimePreciseAsFileTime() went backwards %llu times\n", (unsigned long long)nBack);
+
+    pEfiSystemTable->RuntimeServices->GetTime(&Time, NULL);
+    GetSystemTime4UEFI(&St);
+    printf("RT->GetTime %04u-%02u-%02u %02u:%02u:%02u, GetSystemTime %04u-%02u-%02u %02u:%02u:%02u.%03u, day %u\n",
+        Time.Year, Time.Month, Time.Day, Time.Hour, Time.Minute, Time.Second,
+        St.wYear, St.wMonth, St.wDay, St.wHour, St.wMinute, St.wSecond, St.wMilliseconds, St.wDayOfWeek);
+}
+
+/** benchtime()
+
+    Timing functions: ns/call and Sleep() accuracy
+
+**/
+static void benchtime(uint32_t nIterations)
+{
+    static struct {
+        char* strName;
+        void (*pfnSleep)(uint64_t);
+        uint64_t qwTime;
+        uint64_t qwUnitsPerSec;
+    }SleepTest[] = {
+        {"SleepNanoseconds(500)", SleepNanoseconds4UEFI, 500, 1000000000},
+        {"SleepMicroseconds(10)", SleepMicroseconds4UEFI, 10, 1000000},
+        {"SleepMicroseconds(500)", SleepMicroseconds4UEFI, 500, 1000000},
+        {"SleepMicroseconds(5000)", SleepMicroseconds4UEFI, 5000, 1000000},
+        {"SleepMicroseconds(50000)", SleepMicroseconds4UEFI, 50000, 1000000},
+        {"SleepMicroseconds(250000)", SleepMicroseconds4UEFI, 250000, 1000000},
+    };
+    volatile uint64_t qwSink = 0;
+    int64_t qwStart, qwTmp;
+    uint32_t i, n;
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        QueryPerformanceCounter4UEFI(&qwTmp), qwSink += qwTmp;
+    report("QueryPerformanceCounter", 0, now() - qwStart, nIterations);
+
+    SetPerformanceCounterMode4UEFI(QPCMODE_SERIALIZED);
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        QueryPerformanceCounter4UEFI(&qwTmp), qwSink += qwTmp;
+    SetPerformanceCounterMode4UEFI(QPCMODE_DEFAULT);
+    report("QueryPerformanceCounter serialized", 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        QueryPerformanceFrequency4UEFI(&qwTmp), qwSink += qwTmp;
+    report("QueryPerformanceFrequency", 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        qwSink += GetTickCount644UEFI();
+    report("GetTickCount64", 0, now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        QueryUnbiasedInterruptTime4UEFI((uint64_t*)&qwTmp), qwSink += qwTmp;
+    report("QueryUnbiasedInterruptTime", 0, now() - qwStart, nIterations);
+
+    benchsystime(nIterations);
+
+    printf("\n%-40s %12s %12s %8s\n", "Sleep", "requested ns", "measured ns", "over %");
+    for (i = 0; i < NUMELEM(SleepTest); i++)
+    {
+        double ns, nsreq = (double)SleepTest[i].qwTime * 1.0E9 / (double)SleepTest[i].qwUnitsPerSec;
+
+        qwStart = now();
+        SleepTest[i].pfnSleep(SleepTest[i].qwTime);
+        ns = nspercall(now() - qwStart, 1);
+
+        printf("%-40s %12.0f %12.0f %8.2f\n", SleepTest[i].strName, nsreq, ns, 100.0 * (ns - nsreq) / nsreq);
+    }
+}
+
+#define POOL_WORK_LOOPS     2000    // LCG steps per work item, about 1..2us
+#define POOL_CHILDREN       4       // items queued by each parent item from the AP
+
+static volatile long nPoolPending;
+
+static uint32_t poolwork(void* lpParameter)
+{
+    uint64_t x = (uintptr_t)lpParameter;
+    uint32_t i;
+
+    for (i = 0; i < POOL_WORK_LOOPS; i++)
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    _InterlockedDecrement(&nPoolPending);
+
+    return (uint32_t)(x >> 32) | 1;                                 // never 0, checked by GetExitCodeThread()
+}
+
+static uint32_t poolparent(void* lpParameter)
+{
+    uint32_t i;
+
+    for (i = 0; i < POOL_CHILDREN; i++)
+        QueueUserWorkItem4UEFI(poolwork, (void*)((uintptr_t)lpParameter + i), 0);
+
+    return poolwork(lpParameter);
+}
+
+/** benchpoolrun()
+
+    Run one thread pool round: flat work items, nested work items queued by APs
+    and threads joined by WaitForMultipleObjects()
+
+    @retval ns per work item of the flat round
+
+**/
+static double benchpoolrun(uint32_t nIterations)
+{
+    void* hThread[MAXIMUM_WAIT_OBJECTS];
+    uint32_t i, nWorkers = ThreadPoolWorkerCount4UEFI(), ExitCode;
+    int64_t qwStart;
+    double nsFlat;
+
+    nPoolPending = (long)nIterations;
+    qwStart = now();
+    for (i = 0; i < nIterations; i++)
+        QueueUserWorkItem4UEFI(poolwork, (void*)(uintptr_t)i, 0);
+    while (0 != nPoolPending)
+        _mm_pause();
+    nsFlat = nspercall(now() - qwStart, nIterations);
+    printf("%-40s %5u %12.1f\n", "QueueUserWorkItem", nWorkers, nsFlat);
+
+    nPoolPending = (long)(nIterations / (POOL_CHILDREN + 1) * (POOL_CHILDREN + 1));
+    qwStart = now();
+    for (i = 0; i < nIterations / (POOL_CHILDREN + 1); i++)
+        QueueUserWorkItem4UEFI(poolparent, (void*)(uintptr_t)i, 0);
+    while (0 != nPoolPending)
+        _mm_pause();
+    printf("%-40s %5u %12.1f\n", "QueueUserWorkItem nested", nWorkers, nspercall(now() - qwStart, nIterations / (POOL_CHILDREN + 1) * (POOL_CHILDREN + 1)));
+
+    nPoolPending = MAXIMUM_WAIT_OBJECTS;
+    qwStart = now();
+    for (i = 0; i < MAXIMUM_WAIT_OBJECTS; i++)
+        hThread[i] = CreateThread4UEFI(NULL, 0, poolwork, (void*)(uintptr_t)i, 0, NULL);
+    if (WAIT_OBJECT_0 != WaitForMultipleObjects4UEFI(MAXIMUM_WAIT_OBJECTS, hThread, 1, INFINITE))
+        printf("WaitForMultipleObjects() failed for threads\n");
+    printf("%-40s %5u %12.1f\n", "CreateThread/WaitForMultipleObjects", nWorkers, nspercall(now() - qwStart, MAXIMUM_WAIT_OBJECTS));
+
+    for (i = 0; i < MAXIMUM_WAIT_OBJECTS; i++)
+    {
+        if (0 == GetExitCodeThread4UEFI(hThread[i], &ExitCode) || STILL_ACTIVE == ExitCode || 0 == ExitCode)
+            printf("thread %u: exit code %u\n", i, ExitCode);
+
+        CloseHandle4UEFI(hThread[i]);
+    }
+
+    return nsFlat;
+}
+
+/** benchpool()
+
+    Thread pool throughput on the APs the platform provides
+
+**/
+static void benchpool(uint32_t nIterations)
+{
+    printf("\n%-40s %5s %12s\n", "thread pool", "APs", "ns/item");
+
+    benchpoolrun(nIterations);
+    ThreadPoolShutdown4UEFI();
+}
+
+#define SYNC_WRITER_EVERY   16      // every 16th SRW lock operation is exclusive in the shared round
+
+typedef enum _SYNCOP {
+    SYNCOP_INTERLOCKED,
+    SYNCOP_CRITSECT,
+    SYNCOP_SRWEXCLUSIVE,
+    SYNCOP_SRWSHARED,
+    SYNCOP_INITONCE,
+    SYNCOP_MAX
+}SYNCOP;
+
+static const char* strSyncOp[SYNCOP_MAX] = {
+    "InterlockedIncrement",
+    "Enter/LeaveCriticalSection",
+    "Acquire/ReleaseSRWLockExclusive",
+    "SRWLock shared, 1/16 exclusive",
+    "InitOnceExecuteOnce",
+};
+
+static SYNCOP SyncOp;
+static uint32_t nSyncLoops;
+static volatile long nSyncCount;
+static volatile long nSyncErrors;
+static CRITSECT SyncCs;
+static RWLOCK SyncRw = RWLOCK_INIT;
+static INITONCE SyncOnce = INITONCE_STATIC_INIT;
+
+static int syncinit(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    nSyncCount++;
+    *Context = Parameter;
+
+    return 1;
+}
+
+static uint32_t syncwork(void* lpParameter)
+{
+    uint32_t i;
+    long n;
+    void* pContext;
+
+    if (THREADID_MAIN == GetCurrentThreadId4UEFI())
+        _InterlockedIncrement(&nSyncErrors);
+
+    for (i = 0; i < nSyncLoops; i++)
+    {
+        switch (SyncOp)
+        {
+        case SYNCOP_INTERLOCKED:
+            InterlockedIncrement4UEFI(&nSyncCount);
+            break;
+        case SYNCOP_CRITSECT:
+            EnterCriticalSection4UEFI(&SyncCs);
+            nSyncCount++;
+            LeaveCriticalSection4UEFI(&SyncCs);
+            break;
+        case SYNCOP_SRWEXCLUSIVE:
+            AcquireSRWLockExclusive4UEFI(&SyncRw);
+            nSyncCount++;
+            ReleaseSRWLockExclusive4UEFI(&SyncRw);
+            break;
+        case SYNCOP_SRWSHARED:
+            if (0 == i % SYNC_WRITER_EVERY)
+            {
+                AcquireSRWLockExclusive4UEFI(&SyncRw);
+                nSyncCount++;
+                ReleaseSRWLockExclusive4UEFI(&SyncRw);
+            }
+            else
+            {
+                AcquireSRWLockShared4UEFI(&SyncRw);
+                n = nSyncCount;
+                if (n != nSyncCount)                                // no writer inside
+                    _InterlockedIncrement(&nSyncErrors);
+                ReleaseSRWLockShared4UEFI(&SyncRw);
+            }
+            break;
+        case SYNCOP_INITONCE:
+            if (0 == InitOnceExecuteOnce4UEFI(&SyncOnce, syncinit, &SyncOnce, &pContext) || &SyncOnce != pContext)
+                _InterlockedIncrement(&nSyncErrors);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/** benchsyncrun()
+
+    Run each synchronization primitive on nThreads threads and verify the shared counter
+
+**/
+static void benchsyncrun(uint32_t nThreads, uint32_t nIterations)
+{
+    void* hThread[MAXIMUM_WAIT_OBJECTS];
+    uint32_t Op, i;
+    long nExpected;
+    int64_t qwStart;
+
+    for (Op = 0; Op < SYNCOP_MAX; Op++)
+    {
+        SyncOp = (SYNCOP)Op;
+        nSyncLoops = nIterations;
+        nSyncCount = 0;
+        nSyncErrors = 0;
+        InitializeCriticalSectionAndSpinCount4UEFI(&SyncCs, 64);
+        InitializeSRWLock4UEFI(&SyncRw);
+        InitOnceInitialize4UEFI(&SyncOnce);
+
+        switch (SyncOp)
+        {
+        case SYNCOP_SRWSHARED:
+            nExpected = (long)(nThreads * ((nIterations + SYNC_WRITER_EVERY - 1) / SYNC_WRITER_EVERY));
+            break;
+        case SYNCOP_INITONCE:
+            nExpected = 1;
+            break;
+        default:
+            nExpected = (long)(nThreads * nIterations);
+            break;
+        }
+
+        qwStart = now();
+        for (i = 0; i < nThreads; i++)
+            hThread[i] = CreateThread4UEFI(NULL, 0, syncwork, NULL, 0, NULL);
+        if (WAIT_OBJECT_0 != WaitForMultipleObjects4UEFI(nThreads, hThread, 1, INFINITE))
+            printf("WaitForMultipleObjects() failed for threads\n");
+        printf("%-40s %5u %12.1f\n", strSyncOp[Op], nThreads, nspercall(now() - qwStart, (uint64_t)nThreads * nIterations));
+
+        for (i = 0; i < nThreads; i++)
+            CloseHandle4UEFI(hThread[i]);
+
+        if (nExpected != nSyncCount || 0 != nSyncErrors)
+            printf("%s: count %ld, expected %ld, %ld errors\n", strSyncOp[Op], (long)nSyncCount, nExpected, (long)nSyncErrors);
+
+        DeleteCriticalSection4UEFI(&SyncCs);
+    }
+}
+
+/** benchsync()
+
+    Synchronization primitives under contention: on a single thread, then on
+    one thread per processor the platform provides, the BSP included.
+
+**/
+static void benchsync(uint32_t nIterations)
+{
+    CRITSECT Cs;
+    uint32_t nThreads;
+
+    InitializeCriticalSection4UEFI(&Cs);                            // recursion of the owner
+    EnterCriticalSection4UEFI(&Cs);
+    EnterCriticalSection4UEFI(&Cs);
+    if (2 != Cs.RecursionCount || THREADID_MAIN != Cs.OwningThread || 0 == TryEnterCriticalSection4UEFI(&Cs))
+        printf("EnterCriticalSection() recursion failed\n");
+    LeaveCriticalSection4UEFI(&Cs);
+    LeaveCriticalSection4UEFI(&Cs);
+    LeaveCriticalSection4UEFI(&Cs);
+    if (0 != Cs.Lock)
+        printf("LeaveCriticalSection() failed\n");
+
+    printf("\n%-40s %5s %12s\n", "synchronization", "thr", "ns/op");
+
+    nThreads = ThreadPoolWorkerCount4UEFI() + 1;
+    nThreads = nThreads < MAXIMUM_WAIT_OBJECTS ? nThreads : MAXIMUM_WAIT_OBJECTS;
+
+    benchsyncrun(1, nIterations);
+    if (1 < nThreads)
+        benchsyncrun(nThreads, nIterations);
+    ThreadPoolShutdown4UEFI();
+}
+
+#define HEAP_LIVE           1024    // live blocks of the random replacement pattern
+#define HEAP_MAX_BENCH      1024    // largest block of the random replacement pattern
+#define HEAP_THREADS_MAX    8
+
+static void* HeapLive[HEAP_THREADS_MAX][HEAP_LIVE];
+static void* hBenchHeap;
+static uint32_t nHeapLoops;
+
+static uint32_t lcg(uint32_t* pSeed)
+{
+    *pSeed = *pSeed * 1103515245 + 12345;
+
+    return *pSeed >> 8;
+}
+
+/** heapwork()
+
+    Random replacement of HEAP_LIVE blocks of 16..HEAP_MAX_BENCH bytes on the bench heap.
+    With lpParameter == NULL malloc()/free() instead, on slot 0.
+
+**/
+static uint32_t heapwork(void* lpParameter)
+{
+    uint32_t Slot = (uint32_t)(uintptr_t)lpParameter & 0xFFFF, Seed = Slot + 1, i, j;
+    bool fMalloc = 0 != ((uintptr_t)lpParameter & 0x10000);
+    void** ppLive = HeapLive[Slot];
+
+    for (i = 0; i < nHeapLoops; i++)
+    {
+        j = lcg(&Seed) % HEAP_LIVE;
+
+        if (fMalloc)
+        {
+            free(ppLive[j]);
+            ppLive[j] = malloc(16 + lcg(&Seed) % (HEAP_MAX_BENCH - 15));
+        }
+        else
+        {
+            HeapFree4UEFI(hBenchHeap, 0, ppLive[j]);
+            ppLive[j] = HeapAlloc4UEFI(hBenchHeap, 0, 16 + lcg(&Seed) % (HEAP_MAX_BENCH - 15));
+        }
+    }
+
+    return 0;
+}
+
+/** heapsummary()
+
+    Print the utilization of the bench heap
+
+**/
+static void heapsummary(const char* strName)
+{
+    HEAPSUMMARY Sum = { sizeof(HEAPSUMMARY) };
+
+    HeapSummary4UEFI(hBenchHeap, 0, &Sum);
+    printf("%-40s %12llu %12llu %12llu %7.1f%%\n", strName,
+        (unsigned long long)Sum.cbAllocated, (unsigned long long)Sum.cbCommitted, (unsigned long long)Sum.cbReserved,
+        0 == Sum.cbCommitted ? 0.0 : 100.0 * (double)Sum.cbAllocated / (double)Sum.cbCommitted);
+}
+
+/** benchheaprun()
+
+    Random replacement on nThreads threads, the live blocks are freed by the BSP afterwards
+
+**/
+static void benchheaprun(uint32_t nThreads, uint32_t nIterations)
+{
+    void* hThread[HEAP_THREADS_MAX];
+    uint32_t i;
+    int64_t qwStart;
+
+    nHeapLoops = nIterations * 64;
+    qwStart = now();
+    for (i = 0; i < nThreads; i++)
+        hThread[i] = CreateThread4UEFI(NULL, 0, heapwork, (void*)(uintptr_t)i, 0, NULL);
+    WaitForMultipleObjects4UEFI(nThreads, hThread, 1, INFINITE);
+    printf("%-40s %5u %12.1f\n", "HeapAlloc/HeapFree threads", nThreads, nspercall(now() - qwStart, (uint64_t)nThreads * nHeapLoops));
+
+    for (i = 0; i < nThreads; i++)
+        CloseHandle4UEFI(hThread[i]);
+}
+
+/** benchheap()
+
+    VirtualAlloc() and heap throughput, heap utilization after random replacement and bulk HeapDestroy()
+
+**/
+static void benchheap(uint32_t nIterations)
+{
+    HEAPSUMMARY Sum = { sizeof(HEAPSUMMARY) };
+    void* p[256];
+    uint32_t i, j, n, nThreads;
+    int64_t qwStart;
+
+    printf("\n%-40s %5s %12s\n", "virtual memory and heaps", "n", "ns/call");
+
+    n = nIterations < NUMELEM(p) ? nIterations : NUMELEM(p);
+    qwStart = now();
+    for (i = 0; i < n; i++)
+        p[i] = VirtualAlloc4UEFI(NULL, VMEM_PAGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    for (i = 0; i < n; i++)
+        VirtualFree4UEFI(p[i], 0, MEM_RELEASE);
+    printf("%-40s %5u %12.1f\n", "VirtualAlloc/VirtualFree 4KiB", n, nspercall(now() - qwStart, n));
+
+    qwStart = now();
+    for (i = 0; i < 16; i++)
+    {
+        p[i] = VirtualAlloc4UEFI(NULL, VMEM_LARGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (NULL == p[i] || 0 != (uintptr_t)p[i] % VMEM_LARGE_SIZE)
+            printf("VirtualAlloc() 2MiB failed or not aligned: %p\n", p[i]);
+    }
+    for (i = 0; i < 16; i++)
+        VirtualFree4UEFI(p[i], 0, MEM_RELEASE);
+    printf("%-40s %5u %12.1f\n", "VirtualAlloc/VirtualFree 2MiB", 16, nspercall(now() - qwStart, 16));
+
+    //
+    // single thread random replacement, malloc() vs. heap
+    //
+    hBenchHeap = HeapCreate4UEFI(0, 0, 0);
+    nHeapLoops = nIterations * 64;
+
+    memset(HeapLive, 0, sizeof(HeapLive));
+    qwStart = now();
+    heapwork((void*)(uintptr_t)0x10000);
+    printf("%-40s %5u %12.1f\n", "malloc/free random 16..1024", HEAP_LIVE, nspercall(now() - qwStart, nHeapLoops));
+    for (j = 0; j < HEAP_LIVE; j++)
+        free(HeapLive[0][j]);
+
+    memset(HeapLive, 0, sizeof(HeapLive));
+    qwStart = now();
+    heapwork(NULL);
+    printf("%-40s %5u %12.1f\n", "HeapAlloc/HeapFree random 16..1024", HEAP_LIVE, nspercall(now() - qwStart, nHeapLoops));
+
+    printf("\n%-40s %12s %12s %12s %8s\n", "heap utilization", "allocated", "committed", "reserved", "util");
+    heapsummary("after random replacement");
+
+    for (j = 0; j < HEAP_LIVE; j += 2)                              // free every other block
+    {
+        HeapFree4UEFI(hBenchHeap, 0, HeapLive[0][j]);
+        HeapLive[0][j] = NULL;
+    }
+    heapsummary("every other block freed");
+
+    for (j = 0; j < HEAP_LIVE; j += 2)                              // refill, other sizes
+        HeapLive[0][j] = HeapAlloc4UEFI(hBenchHeap, 0, 16 + (j * 37) % (HEAP_MAX_BENCH - 15));
+    heapsummary("refilled");
+
+    qwStart = now();
+    HeapDestroy4UEFI(hBenchHeap);
+    printf("%-40s %5u %12.1f\n", "HeapDestroy, ns per live block", HEAP_LIVE, nspercall(now() - qwStart, HEAP_LIVE));
+
+    //
+    // threads on a shared heap, reserved in advance for the APs
+    //
+    printf("\n%-40s %5s %12s\n", "heap threads", "thr", "ns/op");
+
+    nThreads = ThreadPoolWorkerCount4UEFI() + 1;
+    nThreads = nThreads < HEAP_THREADS_MAX ? nThreads : HEAP_THREADS_MAX;
+
+    hBenchHeap = HeapCreate4UEFI(0, 16 * HEAP_ARENA_SIZE * nThreads, 0);
+    memset(HeapLive, 0, sizeof(HeapLive));
+
+    benchheaprun(nThreads, nIterations);
+
+    for (n = 0; n < nThreads; n++)                                  // remote frees on the BSP
+        for (j = 0; j < HEAP_LIVE; j++)
+            HeapFree4UEFI(hBenchHeap, 0, HeapLive[n][j]);
+
+    if (0 == HeapSummary4UEFI(hBenchHeap, 0, &Sum) || 0 != Sum.cbAllocated)
+        printf("HeapSummary(): %llu bytes allocated after all blocks were freed\n", (unsigned long long)Sum.cbAllocated);
+
+    HeapDestroy4UEFI(hBenchHeap);
+    ThreadPoolShutdown4UEFI();
+}
+
+/** pcirescan()
+
+    Find all functions of a class by probing the configuration space of all buses,
+    the pattern the PCI device index replaces
+
+**/
+static uint32_t pcirescan(uint8_t BaseClass, uint8_t SubClass, uint32_t nBus)
+{
+    uint32_t Bus, Dev, Func, nFunc, dwClass, nRet = 0;
+
+    for (Bus = 0; Bus < nBus; Bus++)
+        for (Dev = 0; Dev < 32; Dev++)
+            for (Func = 0, nFunc = 1; Func < nFunc; Func++)
+            {
+                if (0xFFFF == PciConfigRead164UEFI(PCI_ADDRESS(0, Bus, Dev, Func), 0x00))
+                    continue;
+
+                if (0 == Func && (0x80 & PciConfigRead84UEFI(PCI_ADDRESS(0, Bus, Dev, Func), 0x0E)))
+                    nFunc = 8;
+
+                dwClass = PciConfigRead324UEFI(PCI_ADDRESS(0, Bus, Dev, Func), 0x08);
+
+                if (BaseClass == (uint8_t)(dwClass >> 24) && SubClass == (uint8_t)(dwClass >> 16))
+                    nRet++;
+            }
+
+    return nRet;
+}
+
+/** benchpci()
+
+    PCI device enumeration, class lookup through the index vs. rescanning all buses,
+    single register and block reads of the configuration space
+
+**/
+static void benchpci(MOCKCFG* pCfg, uint32_t nIterations)
+{
+    static uint32_t Block[PCI_CFG_SIZE / 4], Regs[PCI_CFG_SIZE / 4];
+    const PCIDEVENTRY* pEntry;
+    uint32_t i, n, nFound = 0, nEntries = 0;
+    int64_t qwStart;
+
+    printf("\n%-40s %5s %12s\n", "PCI configuration space", "n", "ns/call");
+
+    pCfg->nSsdt = 8;
+    if (0 != MockEfiSystemTableInstall(pCfg))
+    {
+        printf("MockEfiSystemTableInstall() failed for %u PCI buses\n", pCfg->nPciBus);
+        return;
+    }
+
+    qwStart = now();
+    for (n = 0; n < 16; n++)
+        nEntries = (uint32_t)PciIndexRebuild4UEFI();
+    printf("%-40s %5u %12.1f\n", "PciIndexRebuild, all buses", nEntries, nspercall(now() - qwStart, 16));
+
+    if (10 * pCfg->nPciBus != nEntries || pCfg->nPciBus != PciClassCount4UEFI(0x01, 0x08))
+        printf("PciIndexRebuild(): %u functions, %u NVMe, expected %u, %u\n", nEntries, PciClassCount4UEFI(0x01, 0x08), 10 * pCfg->nPciBus, pCfg->nPciBus);
+
+    //
+    // all NVMe controllers, index vs. rescan
+    //
+    qwStart = now();
+    for (n = 0; n < nIterations; n++)
+        for (i = 0; NULL != (pEntry = PciFindByClass4UEFI(0x01, 0x08, i)); i++)
+            nFound++;
+    printf("%-40s %5u %12.1f\n", "PciFindByClass NVMe, all instances", pCfg->nPciBus, nspercall(now() - qwStart, nIterations));
+
+    if (nFound != nIterations * pCfg->nPciBus)
+        printf("PciFindByClass(): %u found, expected %u\n", nFound, nIterations * pCfg->nPciBus);
+
+    n = nIterations / 64 + 1;
+    qwStart = now();
+    for (i = 0, nFound = 0; i < n; i++)
+        nFound += pcirescan(0x01, 0x08, pCfg->nPciBus);
+    printf("%-40s %5u %12.1f\n", "rescan all buses for NVMe", pCfg->nPciBus, nspercall(now() - qwStart, n));
+
+    if (nFound != n * pCfg->nPciBus)
+        printf("rescan: %u found, expected %u\n", nFound, n * pCfg->nPciBus);
+
+    qwStart = now();
+    for (n = 0; n < nIterations; n++)
+        nFound = NULL != PciFindById4UEFI(0x8086, 0x1000 | 0x0C03, pCfg->nPciBus - 1);
+    printf("%-40s %5u %12.1f\n", "PciFindById xHCI, last instance", nEntries, nspercall(now() - qwStart, nIterations));
+
+    //
+    // configuration space reads, single register and 4KiB block
+    //
+    pEntry = PciFindByClass4UEFI(0x01, 0x08, 0);
+
+    qwStart = now();
+    for (n = 0; n < nIterations; n++)
+        for (i = 0; i < PCI_CFG_SIZE / 4; i++)
+            Regs[i] = PciConfigRead324UEFI(pEntry->PciAddress, 4 * i);
+    printf("%-40s %5u %12.1f\n", "PciConfigRead32 x 1024", PCI_CFG_SIZE, nspercall(now() - qwStart, nIterations));
+
+    qwStart = now();
+    for (n = 0; n < nIterations; n++)
+        PciConfigRead4UEFI(pEntry->PciAddress, 0, Block, PCI_CFG_SIZE);
+    printf("%-40s %5u %12.1f\n", "PciConfigRead 4KiB block", PCI_CFG_SIZE, nspercall(now() - qwStart, nIterations));
+
+    if (0 != memcmp(Block, Regs, sizeof(Block)) || 0x8086 != (uint16_t)Block[0])
+        printf("PciConfigRead(): block differs from register reads\n");
+
+    if (0 != PciConfigRead4UEFI(pEntry->PciAddress, PCI_CFG_SIZE - 2, Block, 4) || 0xFFFF != PciConfigRead164UEFI(pEntry->PciAddress, 0x01))
+        printf("PciConfigRead(): access beyond the configuration space or misaligned access not rejected\n");
+
+    MockEfiSystemTableRemove();
+}
+
+static uint32_t popcount(uintptr_t Mask)
+{
+    uint32_t n = 0;
+
+    for (; 0 != Mask; Mask &= Mask - 1)
+        n++;
+
+    return n;
+}
+
+/** benchtopo()
+
+    Topology index build, GetLogicalProcessorInformationEx() probe+copy and the NUMA queries,
+    checked against the synthetic MADT/SRAT/SLIT
+
+**/
+static void benchtopo(MOCKCFG* pCfg, uint32_t nIterations)
+{
+    uint32_t Count[LOGPROCREL_GROUP + 1] = { 0 };
+    LOGPROCINFOEX* pInfo;
+    GROUPAFFINITY Ga;
+    PROCNUMBER Pn = { 0 };
+    uint32_t i, n, Len = 0, Offs, nLogical = 0, nMasked = 0, nExpected = 0, Highest = 0, nErrors = 0;
+    uint16_t Node, g;
+    uint8_t* pBuf;
+    int64_t qwStart;
+
+    printf("\n%-40s %5s %12s %10s\n", "processor and NUMA topology", "n", "ns/call", "allocs/call");
+
+    pCfg->nSsdt = 8;
+    if (0 != MockEfiSystemTableInstall(pCfg))
+    {
+        printf("MockEfiSystemTableInstall() failed for %u processors\n", pCfg->nCpus);
+        return;
+    }
+
+    qwStart = start();
+    for (n = 0; n < 16; n++)
+        TopologyIndexRebuild4UEFI();
+    report("TopologyIndexRebuild", pCfg->nCpus, now() - qwStart, 16);
+
+    //
+    // Win32 pattern: size probe, malloc, copy
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        Len = 0;
+        GetLogicalProcessorInformationEx4UEFI(LOGPROCREL_ALL, NULL, &Len);
+        pBuf = malloc(Len);
+        GetLogicalProcessorInformationEx4UEFI(LOGPROCREL_ALL, (void*)pBuf, &Len);
+        free(pBuf);
+    }
+    report("GetLogicalProcessorInformationEx all", pCfg->nCpus, now() - qwStart, nIterations);
+
+    pBuf = malloc(Len);
+    GetLogicalProcessorInformationEx4UEFI(LOGPROCREL_ALL, (void*)pBuf, &Len);
+
+    for (Offs = 0; Offs < Len; Offs += pInfo->Size)
+    {
+        pInfo = (void*)&pBuf[Offs];
+        Count[pInfo->Relationship]++;
+
+        if (LOGPROCREL_CORE == pInfo->Relationship)
+            for (g = 0; g < pInfo->Processor.GroupCount; g++)
+                nLogical += popcount(pInfo->Processor.GroupMask[g].Mask);
+
+        if (LOGPROCREL_GROUP == pInfo->Relationship)
+            Count[LOGPROCREL_GROUP] = pInfo->Group.ActiveGroupCount;
+    }
+    free(pBuf);
+
+    printf("%-40s %u logical, %u cores, %u packages, %u nodes, %u groups\n", "topology", nLogical,
+        Count[LOGPROCREL_CORE], Count[LOGPROCREL_PACKAGE], Count[LOGPROCREL_NUMANODE], Count[LOGPROCREL_GROUP]);
+
+    GetNumaHighestNodeNumber4UEFI(&Highest);
+
+    if (pCfg->nCpus != nLogical || pCfg->nNumaNodes != Count[LOGPROCREL_NUMANODE] || pCfg->nNumaNodes != Highest + 1)
+        printf("GetLogicalProcessorInformationEx(): %u logical, %u nodes, expected %u, %u\n", nLogical, Count[LOGPROCREL_NUMANODE], pCfg->nCpus, pCfg->nNumaNodes);
+
+    //
+    // node masks, node of each processor, distances
+    //
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        for (Node = 0; Node <= Highest; Node++)
+            GetNumaNodeProcessorMaskEx4UEFI(Node, &Ga);
+    report("GetNumaNodeProcessorMaskEx", Highest + 1, now() - qwStart, (uint64_t)nIterations * (Highest + 1));
+
+    qwStart = start();
+    for (Node = 0; Node <= Highest; Node++)
+    {
+        GetNumaNodeProcessorMaskEx4UEFI(Node, &Ga);
+        nMasked += popcount(Ga.Mask);
+
+        for (Pn.Group = Ga.Group, i = 0; i < MAXIMUM_PROC_PER_GROUP; i++)
+        {
+            uint16_t NodeOf;
+
+            if (0 == (Ga.Mask & (uintptr_t)1 << i))
+                continue;
+
+            Pn.Number = (uint8_t)i;
+            nErrors += 0 == GetNumaProcessorNodeEx4UEFI(&Pn, &NodeOf) || Node != NodeOf;
+        }
+    }
+    report("GetNumaProcessorNodeEx", nMasked, now() - qwStart, nMasked);
+
+    for (Node = 0; Node < pCfg->nNumaNodes; Node++)                 // the first group of a node only
+    {
+        for (i = 0, n = 0; i < pCfg->nCpus; i++)
+            n += Node == (uint64_t)i * pCfg->nNumaNodes / pCfg->nCpus;
+
+        nExpected += n < MAXIMUM_PROC_PER_GROUP ? n : MAXIMUM_PROC_PER_GROUP;
+    }
+
+    if (nExpected != nMasked || 0 != nErrors)
+        printf("GetNumaNodeProcessorMaskEx(): %u processors, %u wrong nodes, expected %u, 0\n", nMasked, nErrors, nExpected);
+
+    if (NUMA_LOCAL_DISTANCE != GetNumaNodeDistance4UEFI(0, 0) || (0 != Highest && 20 + Highest != GetNumaNodeDistance4UEFI(0, (uint16_t)Highest)))
+        printf("GetNumaNodeDistance(): %u, %u not taken from SLIT\n", GetNumaNodeDistance4UEFI(0, 0), GetNumaNodeDistance4UEFI(0, (uint16_t)Highest));
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        GetCurrentProcessorNumberEx4UEFI(&Pn);
+    report("GetCurrentProcessorNumberEx", 1, now() - qwStart, nIterations);
+
+    MockEfiSystemTableRemove();
+}
+
+/** benchtimer()
+
+    Waitable timers: arm/cancel ns/call with many armed timers and wake-up jitter
+
+**/
+static void benchtimer(uint32_t nIterations)
+{
+    static const uint32_t msWait[] = { 1, 5, 20, 50 };
+    void* hTimer[512];
+    int64_t qwStart, qwDue;
+    double ns, nsMax = 0.0;
+    char strName[40];
+    uint32_t i, n;
+
+    for (i = 0; i < NUMELEM(hTimer); i++)
+        hTimer[i] = CreateWaitableTimer4UEFI(NULL, 0, NULL);
+
+    for (i = 0; i < NUMELEM(hTimer); i++)                           // background load, 1ms .. 60s
+        qwDue = -10000LL * (1 + (int64_t)i * 117), SetWaitableTimer4UEFI(hTimer[i], &qwDue, 0, NULL, NULL, 0);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+    {
+        qwDue = -10000LL * (1 + n % 100000);
+        SetWaitableTimer4UEFI(hTimer[n % NUMELEM(hTimer)], &qwDue, 0, NULL, NULL, 0);
+    }
+    printf("\n");
+    report("SetWaitableTimer", NUMELEM(hTimer), now() - qwStart, nIterations);
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        CancelWaitableTimer4UEFI(hTimer[n % NUMELEM(hTimer)]);
+    report("CancelWaitableTimer", NUMELEM(hTimer), now() - qwStart, nIterations);
+
+    printf("\n%-40s %12s %12s %12s\n", "Waitable timer", "requested ns", "measured ns", "jitter ns");
+    for (i = 0; i < NUMELEM(msWait); i++)
+    {
+        qwDue = -10000LL * msWait[i];
+        qwStart = now();
+        SetWaitableTimer4UEFI(hTimer[i], &qwDue, 0, NULL, NULL, 0);
+        WaitForSingleObject4UEFI(hTimer[i], INFINITE);
+        ns = nspercall(now() - qwStart, 1);
+
+        snprintf(strName, sizeof(strName), "WaitForSingleObject %ums", msWait[i]);
+        printf("%-40s %12.0f %12.0f %12.0f\n", strName, 1.0E6 * msWait[i], ns, ns - 1.0E6 * msWait[i]);
+    }
+
+    //
+    // 64 timers 1ms apart, WaitForMultipleObjects() must return them in order
+    //
+    qwStart = now();
+    for (i = 0; i < MAXIMUM_WAIT_OBJECTS; i++)
+        qwDue = -10000LL * (1 + (int64_t)i), SetWaitableTimer4UEFI(hTimer[i], &qwDue, 0, NULL, NULL, 0);
+
+    for (i = 0; i < MAXIMUM_WAIT_OBJECTS; i++)
+    {
+        uint32_t dwRet = WaitForMultipleObjects4UEFI(MAXIMUM_WAIT_OBJECTS, hTimer, 0, 1000);
+
+        ns = nspercall(now() - qwStart, 1) - 1.0E6 * (1 + i);
+        nsMax = ns > nsMax ? ns : nsMax;
+
+        if (WAIT_OBJECT_0 + i != dwRet)
+            printf("WaitForMultipleObjects() returned %u, expected %u\n", dwRet, (uint32_t)(WAIT_OBJECT_0 + i));
+    }
+    printf("%-40s %12s %12s %12.0f\n", "WaitForMultipleObjects 64 x 1ms", "", "", nsMax);
+
+    GetSystemTimePreciseAsFileTime4UEFI((uint64_t*)&qwDue);
+    qwDue += 10000LL * 5;                                           // absolute, 5ms from now
+    qwStart = now();
+    SetWaitableTimer4UEFI(hTimer[0], &qwDue, 0, NULL, NULL, 0);
+    WaitForSingleObject4UEFI(hTimer[0], INFINITE);
+    ns = nspercall(now() - qwStart, 1);
+    printf("%-40s %12.0f %12.0f %12.0f\n", "WaitForSingleObject 5ms absolute", 5.0E6, ns, ns - 5.0E6);
+
+    for (i = 0; i < NUMELEM(hTimer); i++)
+        CloseHandle4UEFI(hTimer[i]);
+}
+
+static uint32_t traceitem(void* lpParameter)
+{
+    uint32_t i;
+
+    for (i = 0; i < 1000; i++)
+        TraceEvent4UEFI(TRACEID_USER + 1, (uintptr_t)lpParameter, i, 0, 0);
+
+    _InterlockedDecrement(&nPoolPending);
+
+    return 1;
+}
+
+/** benchtrace()
+
+    Event trace: ns/event disabled and enabled, events from the thread pool,
+    dump and decode
+
+**/
+static void benchtrace(uint32_t nIterations)
+{
+    TRACEDUMPHDR* pHdr;
+    uint32_t n, Size, nWorkers, nItems;
+    int64_t qwStart;
+    char Buffer[64];
+
+    nWorkers = ThreadPoolWorkerCount4UEFI();
+    nItems = 8 * (0 == nWorkers ? 1 : nWorkers);
+
+    printf("\n");
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        TraceEvent4UEFI(TRACEID_USER, n, 0, 0, 0);
+    report("TraceEvent disabled", 0, now() - qwStart, nIterations);
+
+    if (0 == TraceStart4UEFI(nIterations + nItems * 1000))
+    {
+        printf("TraceStart() failed\n");
+        return;
+    }
+
+    qwStart = start();
+    for (n = 0; n < nIterations; n++)
+        TraceEvent4UEFI(TRACEID_USER, n, 0, 0, 0);
+    report("TraceEvent", 1, now() - qwStart, nIterations);
+
+    nPoolPending = (long)nItems;
+    qwStart = start();
+    for (n = 0; n < nItems; n++)
+        QueueUserWorkItem4UEFI(traceitem, (void*)(uintptr_t)n, 0);
+    while (0 != nPoolPending)
+        _mm_pause();
+    report("TraceEvent thread pool", nWorkers, now() - qwStart, nItems * 1000);
+
+    GetSystemFirmwareTable4UEFI('ACPI', 'TDSS', Buffer, sizeof(Buffer), NULL, 0);
+    TraceStop4UEFI();
+
+    ThreadPoolShutdown4UEFI();
+
+    qwStart = start();
+    Size = TraceDump4UEFI(NULL, 0);
+    pHdr = malloc(Size);
+    if (NULL != pHdr && Size == TraceDump4UEFI(pHdr, Size))
+    {
+        report("TraceDump", pHdr->nEvents, now() - qwStart, 1);
+
+        for (n = 1; n < pHdr->nEvents && ((TRACEEVENT*)&pHdr[1])[n - 1].Tsc <= ((TRACEEVENT*)&pHdr[1])[n].Tsc; n++)
+            ;
+
+        if (pHdr->nEvents < nIterations + nItems * 1000 || n < pHdr->nEvents || 0 != pHdr->nLost)
+            printf("TraceDump(): %u events, %llu lost, TSC order broken at %u\n", pHdr->nEvents, (unsigned long long)pHdr->nLost, n);
+    }
+    free(pHdr);
+
+    qwStart = start();
+    n = TracePrint4UEFI("Win324UEFIBench.trc");
+    report("TracePrint file", n, now() - qwStart, 1);
+
+    //
+    // decoded sample
+    //
+    TraceStart4UEFI(4);
+    TraceEvent4UEFI(TRACEID_USER, 1, 2, 3, 4);
+    GetSystemFirmwareTable4UEFI('ACPI', 'PCAF', Buffer, sizeof(Buffer), NULL, 0);
+    TraceStop4UEFI();
+    TracePrint4UEFI(NULL);
+}
+
+int main(int argc, char** argv)
+{
+    MOCKCFG Cfg = { 16, 0, 4096, 256 * 1024, 32, 0, 0, 0 };
+    uint32_t nPciBus = 16, nCpus = 160, nNumaNodes = 4;
+    uint32_t nMaxSsdt = 512, nIterations = 1000, nSsdt;
+    TSCCALSRC Src;
+    uint64_t qwTscPerSec;
+    int i;
+
+    for (i = 1; i < argc - 1; i++)
+    {
+        if (0 == strcmp("-n", argv[i]))
+            nMaxSsdt = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-s", argv[i]))
+            Cfg.SsdtSize = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-d", argv[i]))
+            Cfg.DsdtSize = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-c", argv[i]))
+            Cfg.nCfgDummy = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-m", argv[i]))
+            Cfg.nMemDev = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-i", argv[i]))
+            nIterations = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-p", argv[i]))
+            nPciBus = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-t", argv[i]))
+            nCpus = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (0 == strcmp("-u", argv[i]))
+            nNumaNodes = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+
+    if (nMaxSsdt > 1024)
+        nMaxSsdt = 1024;
+
+    if (0 == nPciBus || nPciBus > 256)
+        nPciBus = 16;
+
+    if (0 == nCpus || 0 == nNumaNodes || nNumaNodes > nCpus)
+        nCpus = 160, nNumaNodes = 4;
+
+    //
+    // NOTE: calibrate the TSC with the real system table, before the mock is installed
+    //
+    QueryPerformanceFrequency4UEFI(&qwQPF);
+    Src = GetTscCalibrationSource4UEFI(&qwTscPerSec);
+
+    printf("Win324UEFIBench: TSC %llu Hz, calibration source %d\n\n", (unsigned long long)qwTscPerSec, (int)Src);
+    printf("%-40s %5s %12s %10s\n", "function", "n", "ns/call", "allocs/call");
+
+    for (nSsdt = 8; nSsdt <= nMaxSsdt; nSsdt *= 4)
+    {
+        Cfg.nSsdt = nSsdt;
+
+        if (0 != MockEfiSystemTableInstall(&Cfg))
+        {
+            printf("MockEfiSystemTableInstall() failed for %u SSDTs\n", nSsdt);
+            break;
+        }
+
+        benchacpi(nSsdt, nIterations / nSsdt + 1);
+
+        MockEfiSystemTableRemove();
+    }
+
+    benchsig(nIterations);
+    benchmem(nIterations);
+    benchpgwalk(nIterations);
+    benchtime(nIterations);
+    benchtimer(nIterations);
+    benchpool(nIterations);
+    benchsync(nIterations);
+    benchheap(nIterations);
+
+    Cfg.nPciBus = nPciBus;
+    benchpci(&Cfg, nIterations);
+
+    Cfg.nPciBus = 0;
+    Cfg.nCpus = nCpus;
+    Cfg.nNumaNodes = nNumaNodes;
+    benchtopo(&Cfg, nIterations);
+
+    benchtrace(nIterations);
+
+#ifdef WIN324UEFI_INSTRUMENT
+    printf("\n");
+    InstrumentationPrint4UEFI();
+#endif
+
+    return 0;
+}
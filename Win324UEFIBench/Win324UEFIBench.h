@@ -0,0 +1,40 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    Win324UEFIBench.h
+
+Abstract:
+
+    Win324UEFI microbenchmark definitions and prototypes
+
+--*/
+#ifndef _WIN324UEFIBENCH_H_
+#define _WIN324UEFIBENCH_H_
+
+#include <stdint.h>
+
+//
+// mock EFI system table configuration
+//
+typedef struct _MOCKCFG {
+    uint32_t nCfgDummy;                 // number of dummy configuration table entries in front of the ACPI 2.0 entry
+    uint32_t nSsdt;                     // number of SSDTs
+    uint32_t SsdtSize;                  // size of each SSDT in bytes
+    uint32_t DsdtSize;                  // size of the DSDT in bytes
+    uint32_t nMemDev;                   // number of SMBIOS type 17 memory devices
+    uint32_t nPciBus;                   // number of PCI buses decoded by the MCFG segment, 0 for no MCFG
+    uint32_t nCpus;                     // number of MADT processors, 0 for no MADT
+    uint32_t nNumaNodes;                // number of SRAT proximity domains, 0 for no SRAT and SLIT
+}MOCKCFG;
+
+extern int MockEfiSystemTableInstall(const MOCKCFG* pCfg);
+extern void MockEfiSystemTableRemove(void);
+extern void MockEfiPoolCountStart(void);
+extern unsigned long MockEfiPoolCountStop(unsigned long* pnFree);
+
+#endif//_WIN324UEFIBENCH_H_
@@ -0,0 +1,172 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __AcpiChecksum.c
+
+Abstract:
+
+    ACPI byte sum checksum
+
+    The bytes are added modulo 256 in SIMD registers, 16 bytes per
+    instruction with SSE2 and 32 bytes with AVX2. AVX2 is used, if
+    reported by CPUID and enabled in XCR0.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+static int fAvx2 = -1;                      // AVX2 available, -1 not yet checked
+
+/** sumscalar()
+
+    Byte sum, one byte at a time
+
+**/
+static uint8_t sumscalar(const uint8_t* pb, size_t size)
+{
+    uint8_t sum = 0;
+
+    while (size--)
+        sum += *pb++;
+
+    return sum;
+}
+
+/** sumsse2()
+
+    Byte sum, 64 bytes per iteration in four SSE2 accumulators
+
+**/
+static uint8_t sumsse2(const uint8_t* pb, size_t size)
+{
+    __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+    __m128i acc2 = _mm_setzero_si128(), acc3 = _mm_setzero_si128();
+    uint64_t lanes[2];
+
+    for (; size >= 64; size -= 64, pb += 64)
+    {
+        acc0 = _mm_add_epi8(acc0, _mm_loadu_si128((const __m128i*) & pb[0]));
+        acc1 = _mm_add_epi8(acc1, _mm_loadu_si128((const __m128i*) & pb[16]));
+        acc2 = _mm_add_epi8(acc2, _mm_loadu_si128((const __m128i*) & pb[32]));
+        acc3 = _mm_add_epi8(acc3, _mm_loadu_si128((const __m128i*) & pb[48]));
+    }
+
+    for (; size >= 16; size -= 16, pb += 16)
+        acc0 = _mm_add_epi8(acc0, _mm_loadu_si128((const __m128i*)pb));
+
+    acc0 = _mm_add_epi8(_mm_add_epi8(acc0, acc1), _mm_add_epi8(acc2, acc3));
+    acc0 = _mm_sad_epu8(acc0, _mm_setzero_si128());                 // horizontal sum of 8 bytes into each 64 bit lane
+    _mm_storeu_si128((__m128i*)lanes, acc0);
+
+    return (uint8_t)(lanes[0] + lanes[1] + sumscalar(pb, size));
+}
+
+/** sumavx2()
+
+    Byte sum, 128 bytes per iteration in four AVX2 accumulators
+
+**/
+static uint8_t sumavx2(const uint8_t* pb, size_t size)
+{
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+    uint64_t lanes[4];
+
+    for (; size >= 128; size -= 128, pb += 128)
+    {
+        acc0 = _mm256_add_epi8(acc0, _mm256_loadu_si256((const __m256i*) & pb[0]));
+        acc1 = _mm256_add_epi8(acc1, _mm256_loadu_si256((const __m256i*) & pb[32]));
+        acc2 = _mm256_add_epi8(acc2, _mm256_loadu_si256((const __m256i*) & pb[64]));
+        acc3 = _mm256_add_epi8(acc3, _mm256_loadu_si256((const __m256i*) & pb[96]));
+    }
+
+    for (; size >= 32; size -= 32, pb += 32)
+        acc0 = _mm256_add_epi8(acc0, _mm256_loadu_si256((const __m256i*)pb));
+
+    acc0 = _mm256_add_epi8(_mm256_add_epi8(acc0, acc1), _mm256_add_epi8(acc2, acc3));
+    acc0 = _mm256_sad_epu8(acc0, _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i*)lanes, acc0);
+
+    return (uint8_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumsse2(pb, size));
+}
+
+/** hasavx2()
+
+    Check CPUID for AVX2 and XCR0 for the YMM state being enabled by the firmware.
+    The result is cached.
+
+**/
+static bool hasavx2(void)
+{
+    int regs[4];    // EAX, EBX, ECX, EDX
+
+    if (-1 == fAvx2) do {
+
+        fAvx2 = 0;
+
+        __cpuid(regs, 0);
+        if ((unsigned)regs[0] < 7)
+            break;
+
+        __cpuid(regs, 1);
+        if (0 == (regs[2] & (1 << 27)) || 0 == (regs[2] & (1 << 28)))  // OSXSAVE, AVX
+            break;
+
+        if (6 != (_xgetbv(0) & 6))                                      // XMM and YMM state enabled
+            break;
+
+        __cpuidex(regs, 7, 0);
+        fAvx2 = 0 != (regs[1] & (1 << 5));                              // AVX2
+
+    } while (0);
+
+    return 1 == fAvx2;
+}
+
+/** __AcpiChecksumEx()
+Synopsis
+    uint8_t __AcpiChecksumEx(int Kernel, const void* p, size_t size);
+Description
+    Byte sum modulo 256 of a memory range, computed by the given kernel
+Paramters
+    int Kernel      :   ACPICSUM_AUTO, ACPICSUM_SCALAR, ACPICSUM_SSE2, ACPICSUM_AVX2
+                        ACPICSUM_AVX2 falls back to SSE2, if AVX2 is not available
+    const void* p   :   memory range
+    size_t size     :   size in bytes
+Returns
+    byte sum, 0 for a valid ACPI table
+**/
+uint8_t __AcpiChecksumEx(int Kernel, const void* p, size_t size)
+{
+    switch (Kernel)
+    {
+    case ACPICSUM_AUTO:                                                 // fall through
+    case ACPICSUM_AVX2:     return hasavx2() ? sumavx2(p, size) : sumsse2(p, size);
+    case ACPICSUM_SSE2:     return sumsse2(p, size);
+    default:                return sumscalar(p, size);
+    }
+}
+
+/** __AcpiChecksum()
+Synopsis
+    uint8_t __AcpiChecksum(const void* p, size_t size);
+Description
+    Byte sum modulo 256 of a memory range, computed by the fastest kernel available
+Paramters
+    const void* p   :   memory range
+    size_t size     :   size in bytes
+Returns
+    byte sum, 0 for a valid ACPI table
+**/
+uint8_t __AcpiChecksum(const void* p, size_t size)
+{
+    return __AcpiChecksumEx(ACPICSUM_AUTO, p, size);
+}
@@ -0,0 +1,401 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __AcpiTblIdx.c
+
+Abstract:
+
+    One-time index of all ACPI tables, used by GetSystemFirmwareTable() and
+    EnumSystemFirmwareTables() instead of rescanning configuration table and XSDT
+    on each call.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <Guid\Acpi.h>
+#include <IndustryStandard/Acpi62.h>
+#include <Protocol\AcpiSystemDescriptionTable.h>
+#include "Win324UEFI.h"
+
+#define IsEqualGUID(rguid1, rguid2) (!memcmp(rguid1, rguid2, sizeof(GUID))) //guiddef.h
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+static ACPITBLIDX AcpiTblIdx;
+static ACPITBLIDX* pAcpiTblIdx = NULL;
+static INITONCE AcpiTblIdxOnce = INITONCE_STATIC_INIT;
+static uint32_t Generation = 0;
+static int ValidationMode = FWTBLVAL_NONE;
+
+static int cmpentry(const void* p1, const void* p2)
+{
+    const ACPITBLIDXENTRY* pE1 = p1, * pE2 = p2;
+
+    if (pE1->Signature != pE2->Signature)
+        return pE1->Signature < pE2->Signature ? -1 : 1;
+
+    if (pE1->Instance != pE2->Instance)
+        return pE1->Instance < pE2->Instance ? -1 : 1;
+
+    return 0;
+}
+
+static void addentry(ACPITBLIDX* pIdx, uint32_t Signature, uint64_t Address, uint32_t Length)
+{
+    pIdx->pEntry[pIdx->nEntries].Signature = Signature;
+    pIdx->pEntry[pIdx->nEntries].Instance = pIdx->nEntries;     // NOTE: preliminary, XSDT order, see buildidx()
+    pIdx->pEntry[pIdx->nEntries].Address = Address;
+    pIdx->pEntry[pIdx->nEntries].pTable = (const void*)Address;  // identity mapped in UEFI
+    pIdx->pEntry[pIdx->nEntries].Length = Length;
+    pIdx->pEntry[pIdx->nEntries].Verdict = ACPITBLVERDICT_UNKNOWN;
+    pIdx->nEntries++;
+}
+
+/** buildidx()
+
+    Walk configuration table, XSDT and FADT once and fill the index
+
+    @param[in] pIdx index to fill
+
+    @retval 0 success
+    @retval -1 no ACPI 2.0 RSDP or out of memory
+
+**/
+static int buildidx(ACPITBLIDX* pIdx)
+{
+    static EFI_GUID EfiAcpi20TableGuid = EFI_ACPI_20_TABLE_GUID;
+    EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER* pRSD = NULL;
+    EFI_CONFIGURATION_TABLE* pCfg = pEfiSystemTable->ConfigurationTable;
+    EFI_ACPI_SDT_HEADER* pXSDT;
+    uint64_t* pTbl64;
+    int i, nRet = -1;
+    uint32_t numTbl, idxTbl;
+
+    memset(pIdx, 0, sizeof(ACPITBLIDX));
+
+    do {
+
+        for (i = 0; i < (int)pEfiSystemTable->NumberOfTableEntries; i++)
+        {
+            if (IsEqualGUID(&EfiAcpi20TableGuid, &pCfg[i].VendorGuid))
+            {
+                pRSD = pCfg[i].VendorTable;
+                break;
+            }
+        }
+
+        if (NULL == pRSD || 0 == pRSD->XsdtAddress)
+            break;
+
+        pXSDT = (void*)pRSD->XsdtAddress;
+        pTbl64 = (void*)&(((char*)pXSDT)[sizeof(EFI_ACPI_SDT_HEADER)]);
+        numTbl = (uint32_t)((pXSDT->Length - sizeof(EFI_ACPI_SDT_HEADER)) / sizeof(uint64_t));
+
+        //
+        // allocate entries for all XSDT tables + XSDT + DSDT + FACS and the XSDT signature array
+        //
+        pIdx->pEntry = malloc((numTbl + 3) * sizeof(ACPITBLIDXENTRY) + numTbl * sizeof(uint32_t));
+
+        if (NULL == pIdx->pEntry)
+            break;
+
+        pIdx->pSig32 = (void*)&pIdx->pEntry[numTbl + 3];
+        pIdx->RsdpAddress = (uint64_t)pRSD;
+        pIdx->pRsdp = pRSD;
+
+        addentry(pIdx, 'TDSX', (uint64_t)pXSDT, pXSDT->Length);
+
+        for (idxTbl = 0; idxTbl < numTbl; idxTbl++)             // walk through all tables in the XSDT
+        {
+            EFI_ACPI_2_0_COMMON_HEADER* pTbl = (void*)pTbl64[idxTbl];
+
+            if (NULL == pTbl)
+                continue;
+
+            pIdx->pSig32[pIdx->nXsdtEntries++] = pTbl->Signature;
+            addentry(pIdx, pTbl->Signature, (uint64_t)pTbl, pTbl->Length);
+
+            if ('PCAF' == pTbl->Signature)                      // resolve DSDT and FACS from the FADT
+            {
+                EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* pFADT = (void*)pTbl;
+                uint64_t DsdtAddr = pFADT->Dsdt, FacsAddr = pFADT->FirmwareCtrl;
+
+                //
+                // NOTE: the 64 bit X_DSDT/X_FIRMWARE_CTRL fields take precedence, if present
+                //
+                if (pFADT->Header.Length >= offsetof(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, XDsdt) + sizeof(uint64_t))
+                {
+                    if (0 != pFADT->XDsdt)
+                        DsdtAddr = pFADT->XDsdt;
+                    if (0 != pFADT->XFirmwareCtrl)
+                        FacsAddr = pFADT->XFirmwareCtrl;
+                }
+
+                if (0 != DsdtAddr)
+                    addentry(pIdx, 'TDSD', DsdtAddr, ((EFI_ACPI_2_0_COMMON_HEADER*)DsdtAddr)->Length);
+                if (0 != FacsAddr)
+                    addentry(pIdx, 'SCAF', FacsAddr, ((EFI_ACPI_2_0_COMMON_HEADER*)FacsAddr)->Length);
+            }
+        }
+
+        //
+        // sort by Signature and XSDT order, then renumber the instances per signature
+        //
+        qsort(pIdx->pEntry, pIdx->nEntries, sizeof(ACPITBLIDXENTRY), cmpentry);
+
+        for (idxTbl = 0; idxTbl < pIdx->nEntries; idxTbl++)
+        {
+            if (0 != idxTbl && pIdx->pEntry[idxTbl - 1].Signature == pIdx->pEntry[idxTbl].Signature)
+                pIdx->pEntry[idxTbl].Instance = pIdx->pEntry[idxTbl - 1].Instance + 1;
+            else
+                pIdx->pEntry[idxTbl].Instance = 0;
+        }
+
+        nRet = 0;
+
+    } while (0);
+
+    return nRet;
+}
+
+/** initidx()
+
+    InitOnceExecuteOnce() callback, build the index, unless one was installed
+    by __AcpiTblIdxReplace() before
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    not used
+    @param[in] Context      not used
+
+    @retval 1   index available
+    @retval 0   no ACPI tables available, retried on next use
+
+**/
+static int initidx(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    int nRet = 1;
+
+    if (NULL == pAcpiTblIdx)
+    {
+        if (0 == buildidx(&AcpiTblIdx)) {
+            AcpiTblIdx.Generation = ++Generation;
+            pAcpiTblIdx = &AcpiTblIdx;
+        }
+        else
+            nRet = 0;
+    }
+
+    return nRet;
+}
+
+/** __AcpiTblIdxGet()
+Synopsis
+    ACPITBLIDX* __AcpiTblIdxGet(void);
+Description
+    Get the ACPI table index. The index is built once on first use, also if
+    called concurrently on multiple processors.
+Paramters
+    none
+Returns
+    pointer to the index
+    NULL, if no ACPI tables available
+**/
+ACPITBLIDX* __AcpiTblIdxGet(void)
+{
+    InitOnceExecuteOnce4UEFI(&AcpiTblIdxOnce, initidx, NULL, NULL);
+
+    return pAcpiTblIdx;
+}
+
+/** __AcpiTblIdxFind()
+Synopsis
+    const ACPITBLIDXENTRY* __AcpiTblIdxFind(uint32_t Signature, uint32_t Instance);
+Description
+    Binary search a table in the ACPI table index
+Paramters
+    uint32_t Signature  : table signature, 'TDSX' for XSDT, 'TDSD' for DSDT, 'SCAF' for FACS
+    uint32_t Instance   : instance of the table, 0 for the first one
+Returns
+    pointer to the index entry
+    NULL, if not found
+**/
+const ACPITBLIDXENTRY* __AcpiTblIdxFind(uint32_t Signature, uint32_t Instance)
+{
+    ACPITBLIDX* pIdx = __AcpiTblIdxGet();
+    ACPITBLIDXENTRY key = { Signature, Instance };
+
+    if (NULL == pIdx)
+        return NULL;
+
+    return bsearch(&key, pIdx->pEntry, pIdx->nEntries, sizeof(ACPITBLIDXENTRY), cmpentry);
+}
+
+/** __AcpiTblIdxReplace()
+Synopsis
+    void __AcpiTblIdxReplace(const ACPITBLIDX* pIdx);
+Description
+    Discard the current ACPI table index and install the given one instead,
+    e.g. an index that refers to the tables of a snapshot image.
+
+    NOTE:   pIdx->pEntry must be a single malloc() allocation, that also holds pSig32[].
+            The index takes the ownership.
+Paramters
+    const ACPITBLIDX* pIdx  :   index to install
+Returns
+    none
+**/
+void __AcpiTblIdxReplace(const ACPITBLIDX* pIdx)
+{
+    if (NULL != pAcpiTblIdx)
+        free(pAcpiTblIdx->pEntry);
+
+    AcpiTblIdx = *pIdx;
+    AcpiTblIdx.Generation = ++Generation;
+    pAcpiTblIdx = &AcpiTblIdx;
+}
+
+/** rsdpverdict()
+
+    Validate checksum and extended checksum of the RSDP
+
+    @param[in] pRSD RSDP
+
+    @retval ACPITBLVERDICT_VALID
+    @retval ACPITBLVERDICT_CORRUPT
+
+**/
+static uint32_t rsdpverdict(const EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER* pRSD)
+{
+    uint32_t nRet = ACPITBLVERDICT_CORRUPT;
+
+    do {
+
+        if (0 != __AcpiChecksum(pRSD, 20))                                  // ACPI 1.0 part
+            break;
+
+        if (pRSD->Revision >= 2)
+            if (pRSD->Length < sizeof(EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER) || 0 != __AcpiChecksum(pRSD, pRSD->Length))
+                break;
+
+        nRet = ACPITBLVERDICT_VALID;
+
+    } while (0);
+
+    return nRet;
+}
+
+/** __AcpiTblIdxValid()
+Synopsis
+    bool __AcpiTblIdxValid(const ACPITBLIDXENTRY* pEntry);
+Description
+    Validate RSDP and table checksum, if enabled by SetFirmwareTableValidation4UEFI().
+    The verdict is computed once per index entry and cached.
+
+    NOTE:   The FACS has no checksum and is always valid.
+            A snapshot image holds no RSDP. Only the tables are validated.
+Paramters
+    const ACPITBLIDXENTRY* pEntry   :   index entry, NULL to validate the RSDP only
+Returns
+    true    :   valid or validation disabled
+    false   :   corrupt, last error is set to ERROR_CRC
+**/
+bool __AcpiTblIdxValid(const ACPITBLIDXENTRY* pEntry)
+{
+    ACPITBLIDXENTRY* pEntryRW = (ACPITBLIDXENTRY*)pEntry;                   // verdict is owned by the index
+    bool fRet = true;
+
+    do {
+
+        if (FWTBLVAL_NONE == ValidationMode || NULL == pAcpiTblIdx)
+            break;
+
+        if (ACPITBLVERDICT_UNKNOWN == pAcpiTblIdx->RsdpVerdict)
+            pAcpiTblIdx->RsdpVerdict = NULL == pAcpiTblIdx->pRsdp ? ACPITBLVERDICT_VALID : rsdpverdict(pAcpiTblIdx->pRsdp);
+
+        if (NULL != pEntry && ACPITBLVERDICT_UNKNOWN == pEntry->Verdict)
+        {
+            if ('SCAF' == pEntry->Signature)
+                pEntryRW->Verdict = ACPITBLVERDICT_VALID;
+            else if (pEntry->Length < sizeof(EFI_ACPI_DESCRIPTION_HEADER))
+                pEntryRW->Verdict = ACPITBLVERDICT_CORRUPT;
+            else
+                pEntryRW->Verdict = 0 == __AcpiChecksum(pEntry->pTable, pEntry->Length) ? ACPITBLVERDICT_VALID : ACPITBLVERDICT_CORRUPT;
+        }
+
+        fRet = ACPITBLVERDICT_VALID == pAcpiTblIdx->RsdpVerdict && (NULL == pEntry || ACPITBLVERDICT_VALID == pEntry->Verdict);
+
+        if (false == fRet)
+            SetLastError4UEFI(ERROR_CRC);
+
+    } while (0);
+
+    return fRet;
+}
+
+/** SetFirmwareTableValidation4UEFI()
+Synopsis
+    int SetFirmwareTableValidation4UEFI(int Mode);
+Description
+    Enable or disable checksum validation for GetSystemFirmwareTable(),
+    GetSystemFirmwareTableView4UEFI(), FirmwareTableCursorNext4UEFI() and
+    EnumSystemFirmwareTables().
+    Corrupt tables are not returned and the last error is set to ERROR_CRC.
+Paramters
+    int Mode    :   FWTBLVAL_NONE, FWTBLVAL_CHECKSUM
+Returns
+    previous mode
+**/
+int SetFirmwareTableValidation4UEFI(int Mode)
+{
+    int nRet = ValidationMode;
+    INSTR_ENTER();
+
+    ValidationMode = FWTBLVAL_CHECKSUM == Mode ? FWTBLVAL_CHECKSUM : FWTBLVAL_NONE;
+
+    INSTR_LEAVE(SetFirmwareTableValidation, 0);
+
+    return nRet;
+}
+
+/** AcpiTableIndexRebuild4UEFI()
+Synopsis
+    int AcpiTableIndexRebuild4UEFI(void);
+Description
+    Discard and rebuild the ACPI table index, e.g. after ACPI tables were installed or
+    uninstalled by EFI_ACPI_TABLE_PROTOCOL.
+    A snapshot image loaded by LoadFirmwareTableSnapshot4UEFI() is released.
+Paramters
+    none
+Returns
+    number of tables in the index
+    0, if no ACPI tables available
+**/
+int AcpiTableIndexRebuild4UEFI(void)
+{
+    int nRet;
+    INSTR_ENTER();
+
+    if (NULL != pAcpiTblIdx)
+        free(pAcpiTblIdx->pEntry);
+
+    pAcpiTblIdx = NULL;
+    InitOnceInitialize4UEFI(&AcpiTblIdxOnce);
+
+    nRet = NULL == __AcpiTblIdxGet() ? 0 : (int)pAcpiTblIdx->nEntries;
+
+    INSTR_LEAVE(AcpiTableIndexRebuild, 0);
+
+    return nRet;
+}
@@ -12,81 +12,125 @@ Abstract:
 
     Check if 4 Byte signature belongs to ACPI 6.2 table signatures
 
+    The signatures are held as packed 32 bit values, sorted by value, and
+    classified by binary search.
+
 --*/
 #include <stdio.h>
 #include <string.h>
+#include "Win324UEFI.h"
+
+#define SIG32(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
 
-typedef struct _TABLEACPISIGNATURE {
-    char Signature[4];
-}TABLEACPISIGNATURE;
-
-static TABLEACPISIGNATURE ACPISigs[] = {
-    {'A', 'P', 'I', 'C'},
-    {'B', 'E', 'R', 'T'},
-    {'B', 'G', 'R', 'T'},
-    {'C', 'P', 'E', 'P'},
-    {'D', 'S', 'D', 'T'},
-    {'E', 'C', 'D', 'T'},
-    {'E', 'I', 'N', 'J'},
-    {'E', 'R', 'S', 'T'},
-    {'F', 'A', 'C', 'P'},
-    {'F', 'A', 'C', 'S'},
-    {'F', 'P', 'D', 'T'},
-    {'G', 'T', 'D', 'T'},
-    {'H', 'E', 'S', 'T'},
-    {'H', 'M', 'A', 'T'},
-    {'M', 'P', 'S', 'T'},
-    {'M', 'S', 'C', 'T'},
-    {'N', 'F', 'I', 'T'},
-    {'P', 'D', 'T', 'T'},
-    {'P', 'M', 'T', 'T'},
-    {'P', 'P', 'T', 'T'},
-    {'P', 'S', 'D', 'T'},
-    {'R', 'A', 'S', 'F'},
-    {'R', 'S', 'D', 'T'},
-    {'S', 'B', 'S', 'T'},
-    {'S', 'D', 'E', 'V'},
-    {'S', 'L', 'I', 'T'},
-    {'S', 'R', 'A', 'T'},
-    {'S', 'S', 'D', 'T'},
-    {'X', 'S', 'D', 'T'},
-    {'B', 'O', 'O', 'T'},
-    {'C', 'S', 'R', 'T'},
-    {'D', 'B', 'G', '2'},
-    {'D', 'B', 'G', 'P'},
-    {'D', 'M', 'A', 'R'},
-    {'D', 'P', 'P', 'T'},
-    {'D', 'R', 'T', 'M'},
-    {'E', 'T', 'D', 'T'},
-    {'H', 'P', 'E', 'T'},
-    {'i', 'B', 'F', 'T'},
-    {'I', 'O', 'R', 'T'},
-    {'I', 'V', 'R', 'S'},
-    {'L', 'P', 'I', 'T'},
-    {'M', 'C', 'F', 'G'},
-    {'M', 'C', 'H', 'I'},
-    {'M', 'S', 'D', 'M'},
-    {'S', 'D', 'E', 'I'},
-    {'S', 'L', 'I', 'C'},
-    {'S', 'P', 'C', 'R'},
-    {'S', 'P', 'M', 'I'},
-    {'S', 'T', 'A', 'O'},
-    {'T', 'C', 'P', 'A'},
-    {'T', 'P', 'M', '2'},
-    {'U', 'E', 'F', 'I'},
-    {'W', 'A', 'E', 'T'},
-    {'W', 'D', 'A', 'T'},
-    {'W', 'D', 'R', 'T'},
-    {'W', 'P', 'B', 'T'},
-    {'W', 'S', 'M', 'T'},
-    {'X', 'E', 'N', 'V'},
+//
+// NOTE: ACPISigs[] must be kept sorted by the packed signature value, that is by the 4th,
+//       3rd, 2nd and 1st character. SpecRev is the ACPI specification revision that
+//       defines or reserves the signature. MinLength is the length of the fixed part
+//       of the table.
+//
+static const ACPISIGINFO ACPISigs[] = {
+    {SIG32('D', 'B', 'G', '2'), 0x50, ACPISIG_EXTERNAL,  44},    // DBG2
+    {SIG32('T', 'P', 'M', '2'), 0x50, ACPISIG_EXTERNAL,  52},    // TPM2
+    {SIG32('T', 'C', 'P', 'A'), 0x20, ACPISIG_EXTERNAL,  38},    // TCPA
+    {SIG32('S', 'L', 'I', 'C'), 0x30, ACPISIG_EXTERNAL,  36},    // SLIC
+    {SIG32('A', 'P', 'I', 'C'), 0x10, 0,                 44},    // APIC
+    {SIG32('R', 'A', 'S', 'F'), 0x50, 0,                 48},    // RASF
+    {SIG32('M', 'C', 'F', 'G'), 0x30, ACPISIG_EXTERNAL,  44},    // MCFG
+    {SIG32('S', 'D', 'E', 'I'), 0x62, ACPISIG_EXTERNAL,  36},    // SDEI
+    {SIG32('U', 'E', 'F', 'I'), 0x40, ACPISIG_EXTERNAL,  54},    // UEFI
+    {SIG32('M', 'C', 'H', 'I'), 0x40, ACPISIG_EXTERNAL,  69},    // MCHI
+    {SIG32('S', 'P', 'M', 'I'), 0x20, ACPISIG_EXTERNAL,  65},    // SPMI
+    {SIG32('E', 'I', 'N', 'J'), 0x40, 0,                 48},    // EINJ
+    {SIG32('M', 'S', 'D', 'M'), 0x50, ACPISIG_EXTERNAL,  36},    // MSDM
+    {SIG32('D', 'R', 'T', 'M'), 0x50, ACPISIG_EXTERNAL,  36},    // DRTM
+    {SIG32('S', 'T', 'A', 'O'), 0x60, ACPISIG_EXTERNAL,  37},    // STAO
+    {SIG32('F', 'A', 'C', 'P'), 0x10, 0,                116},    // FACP
+    {SIG32('C', 'P', 'E', 'P'), 0x30, 0,                 44},    // CPEP
+    {SIG32('D', 'B', 'G', 'P'), 0x20, ACPISIG_EXTERNAL,  52},    // DBGP
+    {SIG32('D', 'M', 'A', 'R'), 0x30, ACPISIG_EXTERNAL,  48},    // DMAR
+    {SIG32('S', 'P', 'C', 'R'), 0x20, ACPISIG_EXTERNAL,  80},    // SPCR
+    {SIG32('F', 'A', 'C', 'S'), 0x10, 0,                 64},    // FACS
+    {SIG32('I', 'V', 'R', 'S'), 0x40, ACPISIG_EXTERNAL,  48},    // IVRS
+    {SIG32('W', 'D', 'A', 'T'), 0x30, ACPISIG_EXTERNAL,  60},    // WDAT
+    {SIG32('H', 'M', 'A', 'T'), 0x62, 0,                 40},    // HMAT
+    {SIG32('S', 'R', 'A', 'T'), 0x30, 0,                 48},    // SRAT
+    {SIG32('W', 'P', 'B', 'T'), 0x50, ACPISIG_EXTERNAL,  52},    // WPBT
+    {SIG32('M', 'S', 'C', 'T'), 0x40, 0,                 56},    // MSCT
+    {SIG32('E', 'C', 'D', 'T'), 0x10, 0,                 65},    // ECDT
+    {SIG32('F', 'P', 'D', 'T'), 0x50, 0,                 36},    // FPDT
+    {SIG32('D', 'S', 'D', 'T'), 0x10, 0,                 36},    // DSDT
+    {SIG32('P', 'S', 'D', 'T'), 0x10, ACPISIG_MULTI,     36},    // PSDT
+    {SIG32('R', 'S', 'D', 'T'), 0x10, 0,                 36},    // RSDT
+    {SIG32('S', 'S', 'D', 'T'), 0x10, ACPISIG_MULTI,     36},    // SSDT
+    {SIG32('X', 'S', 'D', 'T'), 0x20, 0,                 36},    // XSDT
+    {SIG32('E', 'T', 'D', 'T'), 0x30, ACPISIG_EXTERNAL,  36},    // ETDT
+    {SIG32('G', 'T', 'D', 'T'), 0x50, 0,                 80},    // GTDT
+    {SIG32('W', 'A', 'E', 'T'), 0x40, ACPISIG_EXTERNAL,  40},    // WAET
+    {SIG32('H', 'P', 'E', 'T'), 0x30, ACPISIG_EXTERNAL,  56},    // HPET
+    {SIG32('i', 'B', 'F', 'T'), 0x40, ACPISIG_EXTERNAL,  48},    // iBFT
+    {SIG32('N', 'F', 'I', 'T'), 0x60, 0,                 40},    // NFIT
+    {SIG32('S', 'L', 'I', 'T'), 0x20, 0,                 44},    // SLIT
+    {SIG32('L', 'P', 'I', 'T'), 0x50, ACPISIG_EXTERNAL,  36},    // LPIT
+    {SIG32('W', 'S', 'M', 'T'), 0x61, ACPISIG_EXTERNAL,  40},    // WSMT
+    {SIG32('B', 'O', 'O', 'T'), 0x20, ACPISIG_EXTERNAL,  40},    // BOOT
+    {SIG32('D', 'P', 'P', 'T'), 0x50, ACPISIG_EXTERNAL,  36},    // DPPT
+    {SIG32('W', 'D', 'R', 'T'), 0x30, ACPISIG_EXTERNAL,  71},    // WDRT
+    {SIG32('B', 'E', 'R', 'T'), 0x40, 0,                 48},    // BERT
+    {SIG32('B', 'G', 'R', 'T'), 0x50, 0,                 56},    // BGRT
+    {SIG32('I', 'O', 'R', 'T'), 0x60, ACPISIG_EXTERNAL,  48},    // IORT
+    {SIG32('C', 'S', 'R', 'T'), 0x50, ACPISIG_EXTERNAL,  36},    // CSRT
+    {SIG32('S', 'B', 'S', 'T'), 0x10, 0,                 48},    // SBST
+    {SIG32('H', 'E', 'S', 'T'), 0x40, 0,                 40},    // HEST
+    {SIG32('M', 'P', 'S', 'T'), 0x50, 0,                 40},    // MPST
+    {SIG32('E', 'R', 'S', 'T'), 0x40, 0,                 48},    // ERST
+    {SIG32('P', 'D', 'T', 'T'), 0x62, 0,                 44},    // PDTT
+    {SIG32('P', 'M', 'T', 'T'), 0x50, 0,                 40},    // PMTT
+    {SIG32('P', 'P', 'T', 'T'), 0x62, 0,                 36},    // PPTT
+    {SIG32('S', 'D', 'E', 'V'), 0x62, 0,                 36},    // SDEV
+    {SIG32('X', 'E', 'N', 'V'), 0x60, ACPISIG_EXTERNAL,  36},    // XENV
 };
 
+/** __LookupACPISignature()
+Synopsis
+    int __LookupACPISignature(uint32_t Sig32, const ACPISIGINFO** ppInfo);
+Description
+    Classify a packed 4 Byte signature by binary search in the sorted signature table.
+Paramters
+    uint32_t Sig32          :   packed signature, e.g. 'PCAF' for "FACP"
+    const ACPISIGINFO** ppInfo: receives pointer to signature information, may be NULL
+Returns
+    signature ID, that is index into the signature table
+    -1  :   not found
+**/
+int __LookupACPISignature(uint32_t Sig32, const ACPISIGINFO** ppInfo)
+{
+    size_t lo = 0, hi = sizeof(ACPISigs) / sizeof(ACPISigs[0]);
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+
+        if (ACPISigs[mid].Signature < Sig32)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < sizeof(ACPISigs) / sizeof(ACPISigs[0]) && Sig32 == ACPISigs[lo].Signature)
+    {
+        if (NULL != ppInfo)
+            *ppInfo = &ACPISigs[lo];
+        return (int)lo;
+    }
+
+    return -1;
+}
+
 /** __ChkACPISignature()
 Synopsis
     int __ChkACPISignature(char Sig[4]);
 Description
-    Retrieves the specified firmware table from the firmware table provider.
+    Check if 4 Byte signature belongs to ACPI 6.2 table signatures
 Paramters
     char Sig[4] :   pointer to signatur
 Returns
@@ -96,16 +140,9 @@ Returns
 
 int __ChkACPISignature(char Sig[4])
 {
-    size_t i = 0;
-    int found = 0;
+    uint32_t Sig32;
 
-    for (i = 0; i < sizeof(ACPISigs) / sizeof(ACPISigs[0]); i++)
-    {
-        if (0 == strncmp(Sig, ACPISigs[i].Signature, 4))
-        {
-            found = 1;
-            break;
-        }
-    }
-    return found;
-}
\ No newline at end of file
+    memcpy(&Sig32, Sig, sizeof(Sig32));
+
+    return -1 != __LookupACPISignature(Sig32, NULL);
+}
@@ -0,0 +1,306 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __Instrument.c
+
+Abstract:
+
+    Per function call counters and TSC latency histograms
+
+    The counters are updated by INSTR_ENTER()/INSTR_LEAVE() in each *4UEFI function,
+    if the library is compiled with WIN324UEFI_INSTRUMENT. Updates are lock-free
+    interlocked additions, so that functions may be called on multiple processors.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (__rdtsc, _BitScanReverse64, _InterlockedIncrement64, _InterlockedExchangeAdd64, _InterlockedCompareExchange64)
+
+static INSTRSTAT InstrStat[INSTRID_MAX];
+
+static const char* strInstrName[INSTRID_MAX] = {
+    [INSTRID_GetSystemFirmwareTable] = "GetSystemFirmwareTable",
+    [INSTRID_GetSystemFirmwareTableInstance] = "GetSystemFirmwareTableInstance",
+    [INSTRID_GetSystemFirmwareTableView] = "GetSystemFirmwareTableView",
+    [INSTRID_EnumSystemFirmwareTables] = "EnumSystemFirmwareTables",
+    [INSTRID_FirmwareTableCursorInit] = "FirmwareTableCursorInit",
+    [INSTRID_FirmwareTableCursorFilter] = "FirmwareTableCursorFilter",
+    [INSTRID_FirmwareTableCursorNext] = "FirmwareTableCursorNext",
+    [INSTRID_GetFirmwareTableSnapshot] = "GetFirmwareTableSnapshot",
+    [INSTRID_CreateFirmwareTableSnapshot] = "CreateFirmwareTableSnapshot",
+    [INSTRID_LoadFirmwareTableSnapshot] = "LoadFirmwareTableSnapshot",
+    [INSTRID_SetFirmwareTableValidation] = "SetFirmwareTableValidation",
+    [INSTRID_AcpiTableIndexRebuild] = "AcpiTableIndexRebuild",
+    [INSTRID_AmlIndexCreate] = "AmlIndexCreate",
+    [INSTRID_AmlIndexDestroy] = "AmlIndexDestroy",
+    [INSTRID_AmlIndexFindPath] = "AmlIndexFindPath",
+    [INSTRID_AmlIndexFindHid] = "AmlIndexFindHid",
+    [INSTRID_SmbiosIndexRebuild] = "SmbiosIndexRebuild",
+    [INSTRID_SmbiosFindByType] = "SmbiosFindByType",
+    [INSTRID_SmbiosFindByHandle] = "SmbiosFindByHandle",
+    [INSTRID_SmbiosTypeCount] = "SmbiosTypeCount",
+    [INSTRID_IsBadReadPtr] = "IsBadReadPtr",
+    [INSTRID_IsBadWritePtr] = "IsBadWritePtr",
+    [INSTRID_IsBadCodePtr] = "IsBadCodePtr",
+    [INSTRID_MemoryMapIndexRebuild] = "MemoryMapIndexRebuild",
+    [INSTRID_PageWalkContextInit] = "PageWalkContextInit",
+    [INSTRID_PageWalkSetContext] = "PageWalkSetContext",
+    [INSTRID_PageWalkFlush] = "PageWalkFlush",
+    [INSTRID_QueryPerformanceCounter] = "QueryPerformanceCounter",
+    [INSTRID_QueryPerformanceFrequency] = "QueryPerformanceFrequency",
+    [INSTRID_SetPerformanceCounterMode] = "SetPerformanceCounterMode",
+    [INSTRID_GetTscCalibrationSource] = "GetTscCalibrationSource",
+    [INSTRID_Sleep] = "Sleep",
+    [INSTRID_SleepMicroseconds] = "SleepMicroseconds",
+    [INSTRID_SleepNanoseconds] = "SleepNanoseconds",
+    [INSTRID_GetTickCount64] = "GetTickCount64",
+    [INSTRID_GetTickCount] = "GetTickCount",
+    [INSTRID_QueryUnbiasedInterruptTime] = "QueryUnbiasedInterruptTime",
+    [INSTRID_GetLastError] = "GetLastError",
+    [INSTRID_SetLastError] = "SetLastError",
+    [INSTRID_CreateWaitableTimer] = "CreateWaitableTimer",
+    [INSTRID_SetWaitableTimer] = "SetWaitableTimer",
+    [INSTRID_CancelWaitableTimer] = "CancelWaitableTimer",
+    [INSTRID_WaitForSingleObject] = "WaitForSingleObject",
+    [INSTRID_WaitForMultipleObjects] = "WaitForMultipleObjects",
+    [INSTRID_CloseHandle] = "CloseHandle",
+    [INSTRID_CreateThread] = "CreateThread",
+    [INSTRID_GetExitCodeThread] = "GetExitCodeThread",
+    [INSTRID_QueueUserWorkItem] = "QueueUserWorkItem",
+    [INSTRID_TrySubmitThreadpoolCallback] = "TrySubmitThreadpoolCallback",
+    [INSTRID_ThreadPoolWorkerCount] = "ThreadPoolWorkerCount",
+    [INSTRID_ThreadPoolShutdown] = "ThreadPoolShutdown",
+    [INSTRID_GetCurrentThreadId] = "GetCurrentThreadId",
+    [INSTRID_VirtualAlloc] = "VirtualAlloc",
+    [INSTRID_VirtualFree] = "VirtualFree",
+    [INSTRID_HeapCreate] = "HeapCreate",
+    [INSTRID_HeapDestroy] = "HeapDestroy",
+    [INSTRID_HeapAlloc] = "HeapAlloc",
+    [INSTRID_HeapReAlloc] = "HeapReAlloc",
+    [INSTRID_HeapFree] = "HeapFree",
+    [INSTRID_HeapSize] = "HeapSize",
+    [INSTRID_HeapSummary] = "HeapSummary",
+    [INSTRID_GetProcessHeap] = "GetProcessHeap",
+    [INSTRID_PciIndexRebuild] = "PciIndexRebuild",
+    [INSTRID_PciConfigRead] = "PciConfigRead",
+    [INSTRID_PciConfigWrite] = "PciConfigWrite",
+    [INSTRID_PciConfigRead8] = "PciConfigRead8",
+    [INSTRID_PciConfigRead16] = "PciConfigRead16",
+    [INSTRID_PciConfigRead32] = "PciConfigRead32",
+    [INSTRID_PciFindByClass] = "PciFindByClass",
+    [INSTRID_PciFindById] = "PciFindById",
+    [INSTRID_PciClassCount] = "PciClassCount",
+    [INSTRID_TopologyIndexRebuild] = "TopologyIndexRebuild",
+    [INSTRID_GetLogicalProcessorInformationEx] = "GetLogicalProcessorInformationEx",
+    [INSTRID_GetCurrentProcessorNumberEx] = "GetCurrentProcessorNumberEx",
+    [INSTRID_GetNumaHighestNodeNumber] = "GetNumaHighestNodeNumber",
+    [INSTRID_GetNumaNodeProcessorMaskEx] = "GetNumaNodeProcessorMaskEx",
+    [INSTRID_GetNumaProcessorNodeEx] = "GetNumaProcessorNodeEx",
+    [INSTRID_GetNumaAvailableMemoryNodeEx] = "GetNumaAvailableMemoryNodeEx",
+    [INSTRID_GetNumaNodeDistance] = "GetNumaNodeDistance",
+    [INSTRID_GetSystemTimeAsFileTime] = "GetSystemTimeAsFileTime",
+    [INSTRID_GetSystemTimePreciseAsFileTime] = "GetSystemTimePreciseAsFileTime",
+    [INSTRID_GetSystemTime] = "GetSystemTime",
+    [INSTRID_GetLocalTime] = "GetLocalTime",
+    [INSTRID_FileTimeToSystemTime] = "FileTimeToSystemTime",
+};
+
+/** __InstrEnter()
+Synopsis
+    uint64_t __InstrEnter(void);
+Description
+    Get the TSC at function entry, used by INSTR_ENTER()
+Paramters
+    none
+Returns
+    TSC
+**/
+uint64_t __InstrEnter(void)
+{
+    return __rdtsc();
+}
+
+/** __InstrLeave()
+Synopsis
+    void __InstrLeave(INSTRID Id, uint64_t qwTscStart, uint64_t nBytes);
+Description
+    Record a call at function exit, used by INSTR_LEAVE()
+Paramters
+    INSTRID Id              :   function
+    uint64_t qwTscStart     :   TSC at function entry
+    uint64_t nBytes         :   number of bytes copied to the caller
+Returns
+    none
+**/
+void __InstrLeave(INSTRID Id, uint64_t qwTscStart, uint64_t nBytes)
+{
+    INSTRSTAT* pStat = &InstrStat[Id];
+    uint64_t qwTsc = __rdtsc() - qwTscStart, qwMax;
+    unsigned long Bucket = 0;
+
+    _BitScanReverse64(&Bucket, qwTsc);                              // Bucket unchanged for 0
+
+    _InterlockedIncrement64((volatile int64_t*)&pStat->nCalls);
+    _InterlockedIncrement64((volatile int64_t*)&pStat->Hist[Bucket]);
+    _InterlockedExchangeAdd64((volatile int64_t*)&pStat->qwTscTotal, (int64_t)qwTsc);
+
+    if (0 != nBytes)
+        _InterlockedExchangeAdd64((volatile int64_t*)&pStat->nBytes, (int64_t)nBytes);
+
+    for (qwMax = pStat->qwTscMax; qwTsc > qwMax; qwMax = pStat->qwTscMax)
+        if (qwMax == (uint64_t)_InterlockedCompareExchange64((volatile int64_t*)&pStat->qwTscMax, (int64_t)qwTsc, (int64_t)qwMax))
+            break;
+}
+
+/** InstrumentationName4UEFI()
+Synopsis
+    const char* InstrumentationName4UEFI(INSTRID Id);
+Description
+    Get the name of an instrumented function
+Paramters
+    INSTRID Id              :   function
+Returns
+    function name without the 4UEFI suffix
+    NULL, if Id is invalid
+**/
+const char* InstrumentationName4UEFI(INSTRID Id)
+{
+    return (unsigned)Id < INSTRID_MAX ? strInstrName[Id] : NULL;
+}
+
+/** InstrumentationQuery4UEFI()
+Synopsis
+    uint64_t InstrumentationQuery4UEFI(INSTRID Id, INSTRSTAT* pStat);
+Description
+    Get the counters and the latency histogram of an instrumented function.
+
+    NOTE: Without WIN324UEFI_INSTRUMENT all counters remain 0
+Paramters
+    INSTRID Id              :   function
+    INSTRSTAT* pStat        :   receives a copy of the counters, may be NULL
+Returns
+    number of calls
+**/
+uint64_t InstrumentationQuery4UEFI(INSTRID Id, INSTRSTAT* pStat)
+{
+    uint64_t nRet = 0;
+
+    if ((unsigned)Id < INSTRID_MAX)
+    {
+        nRet = InstrStat[Id].nCalls;
+
+        if (NULL != pStat)
+            *pStat = InstrStat[Id];
+    }
+
+    return nRet;
+}
+
+/** InstrumentationReset4UEFI()
+Synopsis
+    void InstrumentationReset4UEFI(void);
+Description
+    Clear all counters and histograms
+Paramters
+    none
+Returns
+    none
+**/
+void InstrumentationReset4UEFI(void)
+{
+    memset(InstrStat, 0, sizeof(InstrStat));
+}
+
+/** InstrumentationDump4UEFI()
+Synopsis
+    uint32_t InstrumentationDump4UEFI(void* pBuffer, uint32_t BufferSize);
+Description
+    Write all counters as a binary blob:
+
+        INSTRDUMPHDR, followed by INSTRSTAT[INSTRID_MAX] indexed by INSTRID
+
+    Same as with GetSystemFirmwareTable(), the required size is returned, if the
+    buffer is too small.
+Paramters
+    void* pBuffer           :   receives the blob, may be NULL
+    uint32_t BufferSize     :   size of pBuffer in bytes
+Returns
+    number of bytes written to the buffer, or required buffer size
+**/
+uint32_t InstrumentationDump4UEFI(void* pBuffer, uint32_t BufferSize)
+{
+    uint32_t nRet = sizeof(INSTRDUMPHDR) + sizeof(InstrStat);
+    INSTRDUMPHDR* pHdr = pBuffer;
+
+    if (NULL != pBuffer && BufferSize >= nRet)
+    {
+        pHdr->Signature = INSTRDUMP_SIGNATURE;
+        pHdr->HdrSize = sizeof(INSTRDUMPHDR);
+        pHdr->nEntries = INSTRID_MAX;
+        pHdr->EntrySize = sizeof(INSTRSTAT);
+        pHdr->TscPerSec = __TscPerSec();
+
+        memcpy(&pHdr[1], InstrStat, sizeof(InstrStat));
+    }
+
+    return nRet;
+}
+
+/** InstrumentationPrint4UEFI()
+Synopsis
+    void InstrumentationPrint4UEFI(void);
+Description
+    Print a summary table of all functions called at least once: calls, bytes copied,
+    average and maximum latency in ns and the latency percentiles taken from the histogram
+Paramters
+    none
+Returns
+    none
+**/
+void InstrumentationPrint4UEFI(void)
+{
+    double nsPerTsc = 1.0E9 / (double)__TscPerSec();
+    uint32_t i, b;
+
+    printf("%-32s %10s %12s %10s %10s %10s %10s\n", "function", "calls", "bytes", "avg ns", "max ns", "p50 ns<", "p99 ns<");
+
+    for (i = 0; i < INSTRID_MAX; i++)
+    {
+        INSTRSTAT Stat = InstrStat[i];
+        uint64_t nSum = 0, p50 = 0, p99 = 0;
+
+        if (0 == Stat.nCalls)
+            continue;
+
+        for (b = 0; b < INSTR_BUCKETS; b++)                         // upper bound of the percentile bucket
+        {
+            nSum += Stat.Hist[b];
+
+            if (0 == p50 && nSum * 2 >= Stat.nCalls)
+                p50 = 2ULL << b;
+
+            if (0 == p99 && nSum * 100 >= Stat.nCalls * 99)
+                p99 = 2ULL << b;
+        }
+
+        printf("%-32s %10llu %12llu %10.1f %10.1f %10.1f %10.1f\n",
+            strInstrName[i],
+            (unsigned long long)Stat.nCalls,
+            (unsigned long long)Stat.nBytes,
+            (double)Stat.qwTscTotal * nsPerTsc / (double)Stat.nCalls,
+            (double)Stat.qwTscMax * nsPerTsc,
+            (double)p50 * nsPerTsc,
+            (double)p99 * nsPerTsc
+        );
+    }
+}
@@ -0,0 +1,483 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __MemMapIdx.c
+
+Abstract:
+
+    Snapshot of the UEFI memory map, used by IsBadReadPtr()/IsBadWritePtr()/IsBadCodePtr()
+
+    The memory map is sorted by address and adjacent descriptors with the same access
+    rights are coalesced into a range array, that is looked up by binary search.
+    Protections from the EFI memory attributes table are kept in a second range array.
+
+    The snapshot is refreshed only on a miss and only if the memory map has changed
+    since, so a check of valid memory does not call into the firmware. A change is
+    reported by the EFI_EVENT_GROUP_MEMORY_MAP_CHANGE event group, a miss without
+    a change does not call GetMemoryMap() either. Without that event group every
+    miss compares the map key of a new GetMemoryMap().
+
+    Addresses not described by the memory map, e.g. MMIO of devices not reported as
+    EfiMemoryMappedIO, are treated as not accessible. Addresses not described by the
+    memory attributes table are not restricted by it.
+
+    Boot services are called on the BSP only. On APs the snapshot is used as is,
+    without a snapshot taken on the BSP before, all access is granted.
+    A snapshot is built into a second index and published by an interlocked pointer
+    exchange, so that readers on APs never see ranges being rewritten.
+
+--*/
+#include <uefi.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <intrin.h>
+#include <Guid\MemoryAttributesTable.h>
+#include <Guid\EventGroup.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_InterlockedExchangePointer)
+
+#define IsEqualGUID(rguid1, rguid2) (!memcmp(rguid1, rguid2, sizeof(GUID))) //guiddef.h
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+static MEMMAPIDX MemMapIdx[2];                                      // published and next index
+static MEMMAPIDX* volatile pMemMapIdx = NULL;                       // published index
+static uint32_t nRangeMax[2];                                       // capacity of MemMapIdx[].pRange[]
+static uint32_t nAttrRangeMax[2];                                   // capacity of MemMapIdx[].pAttrRange[]
+static EFI_MEMORY_DESCRIPTOR* pMapBuf = NULL;                       // GetMemoryMap() buffer, kept across snapshots
+static UINTN MapBufSize = 0;                                        // size of pMapBuf in bytes
+static const void* pMatPrev = NULL;                                 // memory attributes table of the snapshot
+static EFI_EVENT MapEvent = NULL;                                   // member of EFI_EVENT_GROUP_MEMORY_MAP_CHANGE
+static volatile long fMapChanged = 1;                               // memory map changed since the snapshot
+static bool fAtExit = false;
+
+static int cmprange(const void* p1, const void* p2)
+{
+    const MEMMAPRANGE* pR1 = p1, * pR2 = p2;
+
+    return pR1->Start == pR2->Start ? 0 : (pR1->Start < pR2->Start ? -1 : 1);
+}
+
+/** mapchanged()
+
+    EFI_EVENT_GROUP_MEMORY_MAP_CHANGE notification, the next miss takes a new snapshot
+
+    @param[in] Event    event
+    @param[in] Context  not used
+
+    @retval VOID
+
+**/
+static void EFIAPI mapchanged(EFI_EVENT Event, void* Context)
+{
+    fMapChanged = 1;
+}
+
+/** closeevent()
+
+    atexit() handler, close the memory map change event, before its notification
+    function is unloaded with the image
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void closeevent(void)
+{
+    if (NULL != MapEvent)
+        pEfiSystemTable->BootServices->CloseEvent(MapEvent);
+
+    MapEvent = NULL;
+    fMapChanged = 1;
+}
+
+/** denyof()
+
+    Translate memory type and attributes into the access rights not granted
+
+    NOTE: EFI_MEMORY_WP is ignored, firmware commonly reports it as a cacheability capability
+
+    @param[in] Type         EFI_MEMORY_TYPE
+    @param[in] Attribute    EFI_MEMORY_xxx attributes
+
+    @retval MEMACC_xxx not granted
+
+**/
+static uint32_t denyof(uint32_t Type, uint64_t Attribute)
+{
+    uint32_t Deny = 0;
+
+    if (EfiUnusableMemory == Type || (EFI_MEMORY_RP & Attribute))
+        Deny |= MEMACC_READ | MEMACC_WRITE | MEMACC_EXECUTE;
+
+    if (EFI_MEMORY_RO & Attribute)
+        Deny |= MEMACC_WRITE;
+
+    if (EFI_MEMORY_XP & Attribute)
+        Deny |= MEMACC_EXECUTE;
+
+    return Deny;
+}
+
+/** torange()
+
+    Convert memory descriptors into a sorted range array and coalesce adjacent ranges
+    with the same access rights. Overlapping descriptors are clipped, the lower one wins.
+
+    @param[in] pDesc        memory descriptors
+    @param[in] nDesc        number of memory descriptors
+    @param[in] DescSize     size of a memory descriptor, as reported by the firmware
+    @param[out] pRange      range array, capacity of at least nDesc entries
+
+    @retval number of ranges
+
+**/
+static uint32_t torange(const void* pDesc, UINTN nDesc, UINTN DescSize, MEMMAPRANGE* pRange)
+{
+    uint32_t i, n = 0, nConv;
+
+    for (i = 0; i < nDesc; i++)
+    {
+        const EFI_MEMORY_DESCRIPTOR* p = (const void*)((const uint8_t*)pDesc + i * DescSize);
+        uint64_t qwEnd = p->PhysicalStart + (p->NumberOfPages << EFI_PAGE_SHIFT);
+
+        if (qwEnd <= p->PhysicalStart)                              // empty or wrapping descriptor
+            continue;
+
+        pRange[n].Start = p->PhysicalStart;
+        pRange[n].End = qwEnd;
+        pRange[n].Deny = denyof(p->Type, p->Attribute);
+        n++;
+    }
+
+    qsort(pRange, n, sizeof(MEMMAPRANGE), cmprange);
+
+    for (nConv = n, n = 0, i = 0; i < nConv; i++)
+    {
+        MEMMAPRANGE R = pRange[i];
+
+        if (n > 0 && pRange[n - 1].End > R.Start)                   // overlap
+        {
+            if (pRange[n - 1].End >= R.End)
+                continue;
+            R.Start = pRange[n - 1].End;
+        }
+
+        if (n > 0 && pRange[n - 1].End == R.Start && pRange[n - 1].Deny == R.Deny)
+            pRange[n - 1].End = R.End;
+        else
+            pRange[n++] = R;
+    }
+
+    return n;
+}
+
+/** reserve()
+
+    Grow a range array of an unpublished index
+
+    @param[in out] ppRange  range array
+    @param[in out] pnMax    capacity of the range array
+    @param[in] n            number of ranges required
+
+    @retval true, success
+    @retval false, out of memory
+
+**/
+static bool reserve(MEMMAPRANGE** ppRange, uint32_t* pnMax, UINTN n)
+{
+    MEMMAPRANGE* pNew;
+    bool fRet = true;
+
+    if (n > *pnMax)
+    {
+        if (NULL == (pNew = realloc(*ppRange, n * sizeof(MEMMAPRANGE))))
+            fRet = false;
+        else
+        {
+            *ppRange = pNew;
+            *pnMax = (uint32_t)n;
+        }
+    }
+
+    return fRet;
+}
+
+/** snapshot()
+
+    Take a snapshot of the memory map and the memory attributes table.
+    The range arrays are rebuilt only if the memory map key or the memory attributes
+    table has changed since the previous snapshot, or if forced.
+
+    The new ranges are built into the index not published, then the index is published
+    by an interlocked exchange. Readers on APs keep using the former index meanwhile,
+    it is reused not before the next snapshot.
+
+    NOTE: All allocations are done before GetMemoryMap(), so that the map key
+          of the snapshot remains valid.
+
+    @param[in] fForce       rebuild even if unchanged
+
+    @retval 0, success
+    @retval -1, memory map not available
+
+**/
+static int snapshot(bool fForce)
+{
+    static EFI_GUID MemoryAttributesTableGuid = EFI_MEMORY_ATTRIBUTES_TABLE_GUID;
+    EFI_CONFIGURATION_TABLE* pCfg = pEfiSystemTable->ConfigurationTable;
+    EFI_MEMORY_ATTRIBUTES_TABLE* pMat = NULL;
+    EFI_STATUS Status = EFI_BUFFER_TOO_SMALL;
+    MEMMAPIDX* pCur = pMemMapIdx, * pNew = pCur == &MemMapIdx[0] ? &MemMapIdx[1] : &MemMapIdx[0];
+    uint32_t New = (uint32_t)(pNew - MemMapIdx);
+    UINTN Size, MapKey = 0, DescSize = sizeof(EFI_MEMORY_DESCRIPTOR), i;
+    UINT32 DescVer;
+    int nTry, nRet = -1;
+
+    do {
+        for (i = 0; i < pEfiSystemTable->NumberOfTableEntries; i++)
+            if (IsEqualGUID(&pCfg[i].VendorGuid, &MemoryAttributesTableGuid))
+            {
+                pMat = pCfg[i].VendorTable;
+                break;
+            }
+
+        if (NULL != pMat && false == reserve(&pNew->pAttrRange, &nAttrRangeMax[New], pMat->NumberOfEntries))
+            break;
+
+        if (false == reserve(&pNew->pRange, &nRangeMax[New], MapBufSize / sizeof(EFI_MEMORY_DESCRIPTOR)))
+            break;
+
+        //
+        // get the memory map into the buffer kept from the previous snapshot, grow on demand
+        //
+        for (nTry = 0; nTry < 4 && EFI_BUFFER_TOO_SMALL == Status; nTry++)
+        {
+            EFI_MEMORY_DESCRIPTOR* pNewBuf;
+
+            fMapChanged = NULL == MapEvent;                         // changes from here on are signaled
+            Size = MapBufSize;
+            Status = pEfiSystemTable->BootServices->GetMemoryMap(&Size, pMapBuf, &MapKey, &DescSize, &DescVer);
+
+            if (EFI_BUFFER_TOO_SMALL != Status)
+                break;
+
+            Size += 8 * DescSize;                                   // the allocations below may split descriptors
+
+            if (NULL == (pNewBuf = malloc(Size)))
+                break;
+
+            if (false == reserve(&pNew->pRange, &nRangeMax[New], Size / sizeof(EFI_MEMORY_DESCRIPTOR)))
+            {
+                free(pNewBuf);
+                break;
+            }
+
+            free(pMapBuf);
+            pMapBuf = pNewBuf;
+            MapBufSize = Size;
+        }
+
+        if (EFI_SUCCESS != Status)
+        {
+            fMapChanged = 1;
+            break;
+        }
+
+        nRet = 0;
+
+        if (false == fForce && NULL != pCur && MapKey == pCur->MapKey && pMat == pMatPrev)
+            break;                                                  // unchanged
+
+        pNew->nRanges = torange(pMapBuf, Size / DescSize, DescSize, pNew->pRange);
+        pNew->nAttrRanges = NULL == pMat ? 0 : torange(&pMat[1], pMat->NumberOfEntries, pMat->DescriptorSize, pNew->pAttrRange);
+        pNew->MapKey = MapKey;
+        pNew->Generation = NULL == pCur ? 1 : pCur->Generation + 1;
+        pMatPrev = pMat;
+
+        _InterlockedExchangePointer((void* volatile*)&pMemMapIdx, pNew);
+
+        PageWalkFlush4UEFI();                                       // page attributes may have changed as well
+
+    } while (0);
+
+    return nRet;
+}
+
+/** covered()
+
+    Check a memory range against a range array
+
+    @param[in] pRange       range array, sorted, coalesced
+    @param[in] nRanges      number of ranges
+    @param[in] qwStart      first byte to check
+    @param[in] qwEnd        first byte behind the range to check
+    @param[in] Access       MEMACC_xxx requested
+    @param[in] fHoles       true, if addresses not in the range array are accessible
+
+    @retval true, if the requested access is granted for the whole range
+
+**/
+static bool covered(const MEMMAPRANGE* pRange, uint32_t nRanges, uint64_t qwStart, uint64_t qwEnd, uint32_t Access, bool fHoles)
+{
+    uint32_t i, lo = 0, hi = nRanges;
+
+    while (lo < hi)                                                 // find the first range that ends behind qwStart
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (pRange[mid].End <= qwStart)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (i = lo; qwStart < qwEnd; i++)                              // walk all ranges the request spans
+    {
+        if (i >= nRanges || pRange[i].Start >= qwEnd)
+            return fHoles;
+
+        if (pRange[i].Start > qwStart && false == fHoles)           // gap between ranges
+            return false;
+
+        if (pRange[i].Deny & Access)
+            return false;
+
+        qwStart = pRange[i].End;
+    }
+
+    return true;
+}
+
+/** __MemMapIdxGet()
+Synopsis
+    MEMMAPIDX* __MemMapIdxGet(void);
+Description
+    Get the memory map index. The index is built on first use on the BSP.
+Paramters
+    none
+Returns
+    pointer to the index
+    NULL, if the memory map is not available or not yet built on the BSP
+**/
+MEMMAPIDX* __MemMapIdxGet(void)
+{
+    static EFI_GUID MemoryMapChangeGuid = EFI_EVENT_GROUP_MEMORY_MAP_CHANGE;
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+
+    if (NULL == pMemMapIdx && 0 > __ThreadPoolSelf())
+    {
+        if (false == fAtExit)
+            fAtExit = 0 == atexit(closeevent);
+
+        if (fAtExit && NULL == MapEvent)
+            if (EFI_SUCCESS != pBS->CreateEventEx(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, mapchanged, NULL, &MemoryMapChangeGuid, &MapEvent))
+                MapEvent = NULL;                                    // UEFI 1.10, compare the map key on each miss
+
+        snapshot(true);
+    }
+
+    return pMemMapIdx;
+}
+
+/** __MemMapIdxCheck()
+Synopsis
+    bool __MemMapIdxCheck(uint64_t qwAddress, uint64_t qwSize, uint32_t Access);
+Description
+    Check, whether the requested access is granted for a memory range. The range may
+    span multiple memory map descriptors.
+
+    On a miss the memory map is retrieved once more, only if it has changed since the
+    snapshot was taken. The check is repeated, only if the memory map key has changed.
+
+    NOTE: If the memory map is not available, e.g. after ExitBootServices(), access is granted.
+    NOTE: Addresses not described by the memory map, e.g. MMIO, are not accessible.
+    NOTE: On APs the snapshot taken on the BSP is used, the memory map is never retrieved.
+Paramters
+    uint64_t qwAddress      :   physical address of the first byte
+    uint64_t qwSize         :   number of bytes
+    uint32_t Access         :   MEMACC_READ, MEMACC_WRITE, MEMACC_EXECUTE
+Returns
+    true, if the access is granted
+**/
+bool __MemMapIdxCheck(uint64_t qwAddress, uint64_t qwSize, uint32_t Access)
+{
+    MEMMAPIDX* pIdx = __MemMapIdxGet();
+    uint64_t qwEnd = qwAddress + qwSize;
+    uint32_t Generation;
+    bool fRet = false;
+    int nTry;
+
+    do {
+        if (0 == qwSize || NULL == pIdx)
+        {
+            fRet = true;
+            break;
+        }
+
+        if (qwEnd < qwAddress)                                      // wrap around
+            break;
+
+        for (nTry = 0; nTry < 2; nTry++, pIdx = pMemMapIdx)         // retry once with a refreshed snapshot
+        {
+            Generation = pIdx->Generation;
+
+            fRet = covered(pIdx->pRange, pIdx->nRanges, qwAddress, qwEnd, Access, false)
+                && covered(pIdx->pAttrRange, pIdx->nAttrRanges, qwAddress, qwEnd, Access, true);
+
+            if (true == fRet || 0 <= __ThreadPoolSelf() || 0 == fMapChanged)
+                break;                                              // no boot services on APs, no change since the snapshot
+
+            if (0 != snapshot(false) || Generation == pMemMapIdx->Generation)
+                break;
+        }
+
+    } while (0);
+
+    return fRet;
+}
+
+/** MemoryMapIndexRebuild4UEFI()
+Synopsis
+    int MemoryMapIndexRebuild4UEFI(void);
+Description
+    Take a new snapshot of the memory map, regardless of the memory map key
+
+    NOTE: BSP only, on APs ERROR_NOT_SUPPORTED is set
+Paramters
+    none
+Returns
+    number of ranges in the index
+    0, if the memory map is not available
+**/
+int MemoryMapIndexRebuild4UEFI(void)
+{
+    int nRet;
+    INSTR_ENTER();
+
+    if (0 <= __ThreadPoolSelf())
+    {
+        SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+        nRet = 0;
+    }
+    else if (NULL == pMemMapIdx)
+        nRet = NULL == __MemMapIdxGet() ? 0 : (int)pMemMapIdx->nRanges;
+    else
+        nRet = 0 == snapshot(true) ? (int)pMemMapIdx->nRanges : 0;
+
+    INSTR_LEAVE(MemoryMapIndexRebuild, 0);
+
+    return nRet;
+}
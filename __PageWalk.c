@@ -0,0 +1,266 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __PageWalk.c
+
+Abstract:
+
+    4-level/5-level page table walker, used by IsBadReadPtr()/IsBadWritePtr()/IsBadCodePtr()
+
+    The present, R/W and XD bits are accumulated over all levels, 1GiB and 2MiB
+    pages are recognized. A direct mapped software translation cache holds the
+    result per 4KiB page, so that repeated probes of hot regions skip the walk.
+
+    The page tables are read through PGWALKCTX.Bias, so that the walker also works
+    on page table images that are not identity mapped, e.g. synthetic ones.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (__readcr0, __readcr3, __readcr4, __readmsr)
+
+#define CR0_WP          (1ULL << 16)
+#define CR0_PG          (1ULL << 31)
+#define CR4_LA57        (1ULL << 12)
+#define MSR_EFER        0xC0000080
+#define EFER_NXE        (1ULL << 11)
+
+#define PTE_P           (1ULL << 0)                                 // present
+#define PTE_RW          (1ULL << 1)                                 // read/write
+#define PTE_PS          (1ULL << 7)                                 // page size, in PDPTE and PDE
+#define PTE_XD          (1ULL << 63)                                // execute disable
+#define PTE_FRAME       0x000FFFFFFFFFF000ULL                       // physical address bits 51:12
+
+typedef struct _PGTLBENTRY {
+    uint64_t Tag;                                                   // linear address bits 63:12
+    uint32_t Epoch;                                                 // valid, if equal to the current epoch
+    uint16_t Deny;                                                  // MEMACC_xxx not granted
+    uint16_t PageShift;                                             // 12, 21 or 30
+}PGTLBENTRY;
+
+static PGTLBENTRY Tlb[PGTLB_SIZE];
+static uint32_t Epoch = 1;                                          // incremented on flush, 0 is never valid
+static PGWALKCTX Ctx;
+static bool fCtxFixed = false;                                      // context set by PageWalkSetContext4UEFI()
+
+/** PageWalkContextInit4UEFI()
+Synopsis
+    void PageWalkContextInit4UEFI(PGWALKCTX* pCtx);
+Description
+    Initialize a page walk context from the control registers of the current processor
+Paramters
+    PGWALKCTX* pCtx         :   receives CR3, paging levels, CR0.WP and IA32_EFER.NXE
+Returns
+    none
+**/
+void PageWalkContextInit4UEFI(PGWALKCTX* pCtx)
+{
+    uint64_t qwCr0;
+    INSTR_ENTER();
+
+    qwCr0 = __readcr0();
+
+    memset(pCtx, 0, sizeof(PGWALKCTX));
+
+    if (CR0_PG & qwCr0)
+    {
+        pCtx->Cr3 = __readcr3() & PTE_FRAME;
+        pCtx->Levels = (CR4_LA57 & __readcr4()) ? 5 : 4;
+        pCtx->fWp = 0 != (CR0_WP & qwCr0);
+        pCtx->fNxe = 0 != (EFER_NXE & __readmsr(MSR_EFER));
+    }
+
+    INSTR_LEAVE(PageWalkContextInit, 0);
+}
+
+/** PageWalkSetContext4UEFI()
+Synopsis
+    void PageWalkSetContext4UEFI(const PGWALKCTX* pCtx);
+Description
+    Walk the page tables described by pCtx instead of the live ones, e.g. a synthetic
+    page table image. The software translation cache is flushed.
+Paramters
+    const PGWALKCTX* pCtx   :   page walk context, NULL to return to the live page tables
+Returns
+    none
+**/
+void PageWalkSetContext4UEFI(const PGWALKCTX* pCtx)
+{
+    INSTR_ENTER();
+
+    fCtxFixed = NULL != pCtx;
+
+    if (fCtxFixed)
+        Ctx = *pCtx;
+    else
+        memset(&Ctx, 0, sizeof(PGWALKCTX));
+
+    PageWalkFlush4UEFI();
+
+    INSTR_LEAVE(PageWalkSetContext, 0);
+}
+
+/** PageWalkFlush4UEFI()
+Synopsis
+    void PageWalkFlush4UEFI(void);
+Description
+    Invalidate the software translation cache, e.g. after page attributes were changed.
+    Called by the memory map index on each new snapshot.
+Paramters
+    none
+Returns
+    none
+**/
+void PageWalkFlush4UEFI(void)
+{
+    INSTR_ENTER();
+
+    if (0 == ++Epoch)
+    {
+        memset(Tlb, 0, sizeof(Tlb));
+        Epoch = 1;
+    }
+
+    INSTR_LEAVE(PageWalkFlush, 0);
+}
+
+/** __PageWalk()
+Synopsis
+    uint32_t __PageWalk(const PGWALKCTX* pCtx, uint64_t qwLinear, uint32_t* pPageShift);
+Description
+    Walk the page tables for a linear address, without the software translation cache.
+    Writes are denied only if CR0.WP is set, since UEFI runs at CPL 0.
+Paramters
+    const PGWALKCTX* pCtx   :   page walk context
+    uint64_t qwLinear       :   linear address
+    uint32_t* pPageShift    :   receives log2 of the size of the page or the not present region
+Returns
+    MEMACC_xxx not granted
+**/
+uint32_t __PageWalk(const PGWALKCTX* pCtx, uint64_t qwLinear, uint32_t* pPageShift)
+{
+    uint32_t Level, Shift = 12 + 9 * pCtx->Levels, Deny = MEMACC_READ | MEMACC_WRITE | MEMACC_EXECUTE;
+    uint64_t qwTable = pCtx->Cr3 & PTE_FRAME, qwEntry = 0, qwRW = PTE_RW, qwXD = 0;
+
+    do {
+        if ((int64_t)(qwLinear << (64 - Shift)) >> (64 - Shift) != (int64_t)qwLinear)
+            break;                                                  // not canonical
+
+        for (Level = pCtx->Levels; Level > 0; Level--)
+        {
+            Shift -= 9;
+            qwEntry = ((const uint64_t*)(pCtx->Bias + (intptr_t)qwTable))[(qwLinear >> Shift) & 511];
+
+            if (0 == (PTE_P & qwEntry))
+                break;
+
+            qwRW &= qwEntry;
+            qwXD |= qwEntry;
+
+            if (1 == Level || ((2 == Level || 3 == Level) && (PTE_PS & qwEntry)))
+                break;                                              // 4KiB, 2MiB or 1GiB page
+
+            qwTable = qwEntry & PTE_FRAME;
+        }
+
+        if (0 == (PTE_P & qwEntry))
+            break;
+
+        Deny = 0;
+
+        if (pCtx->fWp && 0 == (PTE_RW & qwRW))
+            Deny |= MEMACC_WRITE;
+
+        if (pCtx->fNxe && (PTE_XD & qwXD))
+            Deny |= MEMACC_EXECUTE;
+
+    } while (0);
+
+    if (NULL != pPageShift)
+        *pPageShift = Shift < 12 ? 12 : Shift;
+
+    return Deny;
+}
+
+/** __PageWalkCheck()
+Synopsis
+    bool __PageWalkCheck(uint64_t qwAddress, uint64_t qwSize, uint32_t Access);
+Description
+    Check, whether the requested access is granted for a linear address range by the
+    page tables. Each page of the range is looked up in the software translation cache
+    first, large pages are skipped at once.
+
+    The live page tables are used, unless a context was set by PageWalkSetContext4UEFI().
+    The cache is flushed, if CR3 has changed.
+
+    NOTE: If paging is disabled, access is granted.
+Paramters
+    uint64_t qwAddress      :   linear address of the first byte
+    uint64_t qwSize         :   number of bytes
+    uint32_t Access         :   MEMACC_READ, MEMACC_WRITE, MEMACC_EXECUTE
+Returns
+    true, if the access is granted
+**/
+bool __PageWalkCheck(uint64_t qwAddress, uint64_t qwSize, uint32_t Access)
+{
+    uint64_t qwEnd = qwAddress + qwSize, qwPage = qwAddress & ~0xFFFULL;
+    bool fRet = true;
+
+    do {
+        if (0 == qwSize)
+            break;
+
+        if (qwEnd < qwAddress)                                      // wrap around
+        {
+            fRet = false;
+            break;
+        }
+
+        if (false == fCtxFixed && (__readcr3() & PTE_FRAME) != Ctx.Cr3)
+        {
+            PageWalkContextInit4UEFI(&Ctx);
+            PageWalkFlush4UEFI();
+        }
+
+        if (0 == Ctx.Cr3)
+            break;
+
+        while (qwPage < qwEnd)
+        {
+            PGTLBENTRY* pTlb = &Tlb[(qwPage >> 12) % PGTLB_SIZE];
+            uint32_t PageShift;
+
+            if (Epoch != pTlb->Epoch || (qwPage >> 12) != pTlb->Tag)
+            {
+                pTlb->Deny = (uint16_t)__PageWalk(&Ctx, qwPage, &PageShift);
+                pTlb->PageShift = (uint16_t)PageShift;
+                pTlb->Tag = qwPage >> 12;
+                pTlb->Epoch = Epoch;
+            }
+
+            if (pTlb->Deny & Access)
+            {
+                fRet = false;
+                break;
+            }
+
+            qwPage = (qwPage | ((1ULL << pTlb->PageShift) - 1)) + 1;
+
+            if (0 == qwPage)                                        // end of the address space
+                break;
+        }
+
+    } while (0);
+
+    return fRet;
+}
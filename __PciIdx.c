@@ -0,0 +1,381 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __PciIdx.c
+
+Abstract:
+
+    One-time parse of the MCFG table into the ECAM segment list and one-time
+    enumeration of all PCI functions, used by the PCI configuration space access
+    and the PCI device lookups instead of parsing MCFG and probing all buses on
+    each call.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <IndustryStandard/Acpi62.h>
+#include <IndustryStandard/MemoryMappedConfigurationSpaceAccessTable.h>
+#include "Win324UEFI.h"
+
+#define PCI_HEADER_TYPE_MF  0x80                                    // multi-function device
+
+static PCIIDX PciIdx;
+static INITONCE SegOnce = INITONCE_STATIC_INIT;
+static INITONCE DevOnce = INITONCE_STATIC_INIT;
+static PCIIDX* pSort = NULL;                                        // index being sorted, for cmpclass()
+
+static int cmpseg(const void* p1, const void* p2)
+{
+    const PCIECAMSEG* pS1 = p1, * pS2 = p2;
+
+    if (pS1->Segment != pS2->Segment)
+        return pS1->Segment < pS2->Segment ? -1 : 1;
+
+    if (pS1->StartBus != pS2->StartBus)
+        return pS1->StartBus < pS2->StartBus ? -1 : 1;
+
+    return 0;
+}
+
+static int cmpclass(const void* p1, const void* p2)
+{
+    const PCIDEVENTRY* pE1 = &pSort->pEntry[*(const uint32_t*)p1], * pE2 = &pSort->pEntry[*(const uint32_t*)p2];
+
+    if (pE1->BaseClass != pE2->BaseClass)
+        return pE1->BaseClass < pE2->BaseClass ? -1 : 1;
+
+    if (pE1->SubClass != pE2->SubClass)
+        return pE1->SubClass < pE2->SubClass ? -1 : 1;
+
+    return pE1->PciAddress == pE2->PciAddress ? 0 : (pE1->PciAddress < pE2->PciAddress ? -1 : 1);
+}
+
+/** initseg()
+
+    Parse the MCFG table into the ECAM segment list, sorted by segment and start bus.
+    MCFG is ignored while a snapshot is replayed, since it doesn't describe this platform.
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    index to fill
+    @param[out] Context     not used
+
+    @retval 1, always. An empty list selects CF8/CFC
+
+**/
+static int initseg(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    const ACPITBLIDXENTRY* pEntry = __AcpiTblIdxFind('GFCM', 0);
+    const EFI_ACPI_MEMORY_MAPPED_ENHANCED_CONFIGURATION_SPACE_BASE_ADDRESS_ALLOCATION_STRUCTURE* pAlloc;
+    PCIIDX* pIdx = Parameter;
+    uint32_t n, i;
+
+    pIdx->nSegments = 0;
+    pIdx->pSegment = NULL;
+
+    do {
+        if (NULL == pEntry || NULL == __AcpiTblIdxGet()->pRsdp)     // not available or snapshot replayed
+            break;
+
+        if (pEntry->Length < sizeof(EFI_ACPI_MEMORY_MAPPED_CONFIGURATION_BASE_ADDRESS_TABLE_HEADER))
+            break;
+
+        pAlloc = (const void*)((const uint8_t*)pEntry->pTable + sizeof(EFI_ACPI_MEMORY_MAPPED_CONFIGURATION_BASE_ADDRESS_TABLE_HEADER));
+        n = (pEntry->Length - sizeof(EFI_ACPI_MEMORY_MAPPED_CONFIGURATION_BASE_ADDRESS_TABLE_HEADER)) / sizeof(*pAlloc);
+
+        if (0 == n || NULL == (pIdx->pSegment = malloc(n * sizeof(PCIECAMSEG))))
+            break;
+
+        for (i = 0; i < n; i++)
+        {
+            if (0 == pAlloc[i].BaseAddress || pAlloc[i].StartBusNumber > pAlloc[i].EndBusNumber)
+                continue;                                           // damaged allocation structure
+
+            pIdx->pSegment[pIdx->nSegments].BaseAddress = pAlloc[i].BaseAddress;
+            pIdx->pSegment[pIdx->nSegments].Segment = pAlloc[i].PciSegmentGroupNumber;
+            pIdx->pSegment[pIdx->nSegments].StartBus = pAlloc[i].StartBusNumber;
+            pIdx->pSegment[pIdx->nSegments].EndBus = pAlloc[i].EndBusNumber;
+            pIdx->pSegment[pIdx->nSegments++].Reserved = 0;
+        }
+
+        qsort(pIdx->pSegment, pIdx->nSegments, sizeof(PCIECAMSEG), cmpseg);
+
+    } while (0);
+
+    return 1;
+}
+
+/** addentry()
+
+    Read the configuration header of a present function into the index.
+    The entry array grows by doubling.
+
+    @param[in] pIdx         index to fill
+    @param[in] pnMax        capacity of pIdx->pEntry[]
+    @param[in] PciAddress   function address
+    @param[in] dwId         vendor/device ID register
+
+    @retval header type register
+    @retval 0xFF, if out of memory
+
+**/
+static uint8_t addentry(PCIIDX* pIdx, uint32_t* pnMax, uint32_t PciAddress, uint32_t dwId)
+{
+    PCIDEVENTRY* pEntry;
+    uint32_t dwClass, dwHdr, i;
+
+    if (pIdx->nEntries == *pnMax)
+    {
+        pEntry = realloc(pIdx->pEntry, 2 * *pnMax * sizeof(PCIDEVENTRY));
+
+        if (NULL == pEntry)
+            return 0xFF;
+
+        pIdx->pEntry = pEntry;
+        *pnMax *= 2;
+    }
+
+    dwClass = __PciCfgRead(PciAddress, 0x08, 4);
+    dwHdr = __PciCfgRead(PciAddress, 0x0C, 4);
+    pEntry = &pIdx->pEntry[pIdx->nEntries++];
+
+    pEntry->PciAddress = PciAddress;
+    pEntry->VendorId = (uint16_t)dwId;
+    pEntry->DeviceId = (uint16_t)(dwId >> 16);
+    pEntry->RevisionId = (uint8_t)dwClass;
+    pEntry->ProgIf = (uint8_t)(dwClass >> 8);
+    pEntry->SubClass = (uint8_t)(dwClass >> 16);
+    pEntry->BaseClass = (uint8_t)(dwClass >> 24);
+    pEntry->HeaderType = (uint8_t)(dwHdr >> 16) & ~PCI_HEADER_TYPE_MF;
+    pEntry->nBars = 0 == pEntry->HeaderType ? 6 : (1 == pEntry->HeaderType ? 2 : 0);
+    pEntry->Reserved = 0;
+    pEntry->EcamAddress = __PciEcam(PciAddress, 0);
+
+    for (i = 0; i < 6; i++)
+        pEntry->Bar[i] = i < pEntry->nBars ? __PciCfgRead(PciAddress, 0x10 + 4 * i, 4) : 0;
+
+    return (uint8_t)(dwHdr >> 16);
+}
+
+/** scanbus()
+
+    Probe device 0..31 of a bus, function 1..7 only for multi-function devices
+
+    @param[in] pIdx     index to fill
+    @param[in] pnMax    capacity of pIdx->pEntry[]
+    @param[in] Segment  segment group number
+    @param[in] Bus      bus number
+
+    @retval 0 success
+    @retval -1 out of memory
+
+**/
+static int scanbus(PCIIDX* pIdx, uint32_t* pnMax, uint16_t Segment, uint8_t Bus)
+{
+    uint32_t Dev, Func, nFunc, dwId;
+    uint8_t HeaderType;
+    int nRet = 0;
+
+    for (Dev = 0; Dev < 32 && 0 == nRet; Dev++)
+    {
+        for (Func = 0, nFunc = 1; Func < nFunc; Func++)
+        {
+            dwId = __PciCfgRead(PCI_ADDRESS(Segment, Bus, Dev, Func), 0x00, 4);
+
+            if (0xFFFF == (uint16_t)dwId || 0 == (uint16_t)dwId)
+                continue;                                           // not present
+
+            HeaderType = addentry(pIdx, pnMax, PCI_ADDRESS(Segment, Bus, Dev, Func), dwId);
+
+            if (0xFF == HeaderType)
+            {
+                nRet = -1;
+                break;
+            }
+
+            if (0 == Func && (PCI_HEADER_TYPE_MF & HeaderType))
+                nFunc = 8;
+        }
+    }
+
+    return nRet;
+}
+
+/** initdev()
+
+    Enumerate all buses of all ECAM segments, or bus 0..255 of segment 0 through CF8/CFC,
+    and sort the class order.
+
+    NOTE:   All buses are probed, not only those reached through bridges, since
+            host bridges may decode bus ranges that no bridge leads to.
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    index to fill
+    @param[out] Context     not used
+
+    @retval 1 success
+    @retval 0 out of memory
+
+**/
+static int initdev(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    PCIIDX* pIdx = Parameter;
+    uint32_t nMax = 64, s, Bus, i;
+    int nRet = 0;
+
+    pIdx->nEntries = 0;
+    pIdx->pEntry = malloc(nMax * sizeof(PCIDEVENTRY));
+    pIdx->pClassOrder = NULL;
+
+    do {
+
+        if (NULL == pIdx->pEntry)
+            break;
+
+        if (0 == pIdx->nSegments)
+        {
+            for (Bus = 0; Bus < 256; Bus++)
+                if (0 != scanbus(pIdx, &nMax, 0, (uint8_t)Bus))
+                    break;
+
+            if (Bus < 256)
+                break;
+        }
+
+        for (s = 0; s < pIdx->nSegments; s++)
+        {
+            for (Bus = pIdx->pSegment[s].StartBus; Bus <= pIdx->pSegment[s].EndBus; Bus++)
+                if (0 != scanbus(pIdx, &nMax, pIdx->pSegment[s].Segment, (uint8_t)Bus))
+                    break;
+
+            if (Bus <= pIdx->pSegment[s].EndBus)
+                break;
+        }
+
+        if (s < pIdx->nSegments)
+            break;
+
+        //
+        // entries are in address order already, class order behind the entries
+        //
+        pIdx->pClassOrder = malloc((pIdx->nEntries + 1) * sizeof(uint32_t));
+
+        if (NULL == pIdx->pClassOrder)
+            break;
+
+        for (i = 0; i < pIdx->nEntries; i++)
+            pIdx->pClassOrder[i] = i;
+
+        pSort = pIdx;
+        qsort(pIdx->pClassOrder, pIdx->nEntries, sizeof(uint32_t), cmpclass);
+        pSort = NULL;
+
+        nRet = 1;
+
+    } while (0);
+
+    if (0 == nRet)
+    {
+        free(pIdx->pEntry);
+        pIdx->pEntry = NULL;
+        pIdx->nEntries = 0;
+    }
+
+    return nRet;
+}
+
+/** __PciEcam()
+Synopsis
+    uint64_t __PciEcam(uint32_t PciAddress, uint32_t Offset);
+Description
+    Get the memory mapped address of a configuration space register.
+    The ECAM segment list is built on first use.
+Paramters
+    uint32_t PciAddress :   PCI_ADDRESS()
+    uint32_t Offset     :   register offset 0..4095
+Returns
+    address of the register
+    0, if the bus is not decoded by any ECAM segment
+**/
+uint64_t __PciEcam(uint32_t PciAddress, uint32_t Offset)
+{
+    uint64_t qwRet = 0;
+    uint32_t i;
+
+    InitOnceExecuteOnce4UEFI(&SegOnce, initseg, &PciIdx, NULL);
+
+    for (i = 0; i < PciIdx.nSegments; i++)
+    {
+        if (PciIdx.pSegment[i].Segment == PCI_SEGMENT(PciAddress)
+            && PciIdx.pSegment[i].StartBus <= PCI_BUS(PciAddress)
+            && PciIdx.pSegment[i].EndBus >= PCI_BUS(PciAddress))
+        {
+            qwRet = PciIdx.pSegment[i].BaseAddress + ((uint64_t)(PciAddress & 0xFFFF) << 12) + Offset;
+            break;
+        }
+    }
+
+    return qwRet;
+}
+
+/** __PciIdxGet()
+Synopsis
+    PCIIDX* __PciIdxGet(void);
+Description
+    Get the PCI device index. The index is built on first use.
+Paramters
+    none
+Returns
+    pointer to the index
+    NULL, if out of memory
+**/
+PCIIDX* __PciIdxGet(void)
+{
+    PCIIDX* pRet = NULL;
+
+    InitOnceExecuteOnce4UEFI(&SegOnce, initseg, &PciIdx, NULL);
+
+    if (0 != InitOnceExecuteOnce4UEFI(&DevOnce, initdev, &PciIdx, NULL))
+        pRet = &PciIdx;
+
+    return pRet;
+}
+
+/** PciIndexRebuild4UEFI()
+Synopsis
+    int PciIndexRebuild4UEFI(void);
+Description
+    Discard and rebuild the ECAM segment list and the PCI device index, e.g. after
+    the ACPI table index was rebuilt or bridges were reprogrammed.
+Paramters
+    none
+Returns
+    number of functions in the index
+**/
+int PciIndexRebuild4UEFI(void)
+{
+    int nRet;
+    INSTR_ENTER();
+
+    free(PciIdx.pSegment);
+    free(PciIdx.pEntry);
+    free(PciIdx.pClassOrder);
+    memset(&PciIdx, 0, sizeof(PCIIDX));
+
+    InitOnceInitialize4UEFI(&SegOnce);
+    InitOnceInitialize4UEFI(&DevOnce);
+
+    nRet = NULL == __PciIdxGet() ? 0 : (int)PciIdx.nEntries;
+
+    INSTR_LEAVE(PciIndexRebuild, 0);
+
+    return nRet;
+}
@@ -0,0 +1,316 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __SmbiosIdx.c
+
+Abstract:
+
+    One-time index of all SMBIOS structures, used by GetSystemFirmwareTable('RSMB')
+    and the SMBIOS structure lookups instead of walking the string-terminated
+    structure chain on each call.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <Guid\SmBios.h>
+#include <IndustryStandard/SmBios.h>
+#include "Win324UEFI.h"
+
+#define IsEqualGUID(rguid1, rguid2) (!memcmp(rguid1, rguid2, sizeof(GUID))) //guiddef.h
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+static INITONCE SmbiosIdxOnce = INITONCE_STATIC_INIT;
+static SMBIOSIDX SmbiosIdx;
+static SMBIOSIDX* pSmbiosIdx = NULL;
+static SMBIOSIDX* pSort = NULL;                                     // index being sorted, for cmphandle()
+
+static int cmpentry(const void* p1, const void* p2)
+{
+    const SMBIOSIDXENTRY* pE1 = p1, * pE2 = p2;
+
+    if (pE1->Type != pE2->Type)
+        return pE1->Type < pE2->Type ? -1 : 1;
+
+    if (pE1->Offset != pE2->Offset)
+        return pE1->Offset < pE2->Offset ? -1 : 1;
+
+    return 0;
+}
+
+static int cmphandle(const void* p1, const void* p2)
+{
+    uint16_t h1 = pSort->pEntry[*(const uint32_t*)p1].Handle, h2 = pSort->pEntry[*(const uint32_t*)p2].Handle;
+
+    return h1 == h2 ? 0 : (h1 < h2 ? -1 : 1);
+}
+
+/** findentrypoint()
+
+    Locate the SMBIOS entry point in the configuration table, SMBIOS 3.x first
+
+    @param[out] pRaw        receives version information
+    @param[out] pTblAddr    receives the structure table address
+    @param[out] pTblSize    receives the (maximum) structure table size
+
+    @retval physical address of the entry point
+    @retval 0, if no SMBIOS available
+
+**/
+static uint64_t findentrypoint(RAWSMBIOSDATA* pRaw, uint64_t* pTblAddr, uint32_t* pTblSize)
+{
+    static EFI_GUID Smbios3TableGuid = SMBIOS3_TABLE_GUID;
+    static EFI_GUID SmbiosTableGuid = SMBIOS_TABLE_GUID;
+    EFI_CONFIGURATION_TABLE* pCfg = pEfiSystemTable->ConfigurationTable;
+    SMBIOS_TABLE_3_0_ENTRY_POINT* pEP3 = NULL;
+    SMBIOS_TABLE_ENTRY_POINT* pEP2 = NULL;
+    uint64_t qwRet = 0;
+    int i;
+
+    for (i = 0; i < (int)pEfiSystemTable->NumberOfTableEntries; i++)
+    {
+        if (IsEqualGUID(&Smbios3TableGuid, &pCfg[i].VendorGuid))
+            pEP3 = pCfg[i].VendorTable;
+        else if (IsEqualGUID(&SmbiosTableGuid, &pCfg[i].VendorGuid))
+            pEP2 = pCfg[i].VendorTable;
+    }
+
+    if (NULL != pEP3 && 0 == memcmp(pEP3->AnchorString, "_SM3_", 5))
+    {
+        pRaw->Used20CallingMethod = 0;
+        pRaw->SMBIOSMajorVersion = pEP3->MajorVersion;
+        pRaw->SMBIOSMinorVersion = pEP3->MinorVersion;
+        pRaw->DmiRevision = pEP3->DocRev;
+        *pTblAddr = pEP3->TableAddress;
+        *pTblSize = pEP3->TableMaximumSize;
+        qwRet = (uint64_t)pEP3;
+    }
+    else if (NULL != pEP2 && 0 == memcmp(pEP2->AnchorString, "_SM_", 4))
+    {
+        pRaw->Used20CallingMethod = 0;
+        pRaw->SMBIOSMajorVersion = pEP2->MajorVersion;
+        pRaw->SMBIOSMinorVersion = pEP2->MinorVersion;
+        pRaw->DmiRevision = pEP2->SmbiosBcdRevision;
+        *pTblAddr = pEP2->TableAddress;
+        *pTblSize = pEP2->TableLength;
+        qwRet = (uint64_t)pEP2;
+    }
+
+    return qwRet;
+}
+
+/** walk()
+
+    Walk the structure chain once, up to and including the end-of-table structure
+
+    @param[in]  pTbl    structure table
+    @param[in]  size    maximum size of the table
+    @param[out] pEntry  receives the entries, may be NULL to count only
+    @param[out] pnEntry receives the number of structures
+
+    @retval size of the structure table in bytes
+
+**/
+static uint32_t walk(const uint8_t* pTbl, uint32_t size, SMBIOSIDXENTRY* pEntry, uint32_t* pnEntry)
+{
+    uint32_t offs = 0, next, n = 0;
+
+    while (offs + sizeof(SMBIOS_STRUCTURE) <= size)
+    {
+        const SMBIOS_STRUCTURE* pStruct = (const void*)&pTbl[offs];
+
+        if (pStruct->Length < sizeof(SMBIOS_STRUCTURE))
+            break;                                                  // damaged structure
+
+        //
+        // string-set ends with a double NUL
+        //
+        for (next = offs + pStruct->Length; next + 1 < size; next++)
+            if (0 == pTbl[next] && 0 == pTbl[next + 1])
+                break;
+
+        if (next + 1 >= size)
+            break;                                                  // unterminated string-set
+
+        next += 2;
+
+        if (NULL != pEntry)
+        {
+            pEntry[n].Type = pStruct->Type;
+            pEntry[n].Length = pStruct->Length;
+            pEntry[n].Handle = pStruct->Handle;
+            pEntry[n].Instance = 0;
+            pEntry[n].Offset = offs;
+            pEntry[n].Size = next - offs;
+        }
+
+        n++;
+        offs = next;
+
+        if (127 == pStruct->Type)                                   // end-of-table
+            break;
+    }
+
+    *pnEntry = n;
+
+    return offs;
+}
+
+/** buildidx()
+
+    InitOnceExecuteOnce() callback, locate the entry point, copy the structure table
+    to RawSMBIOSData and index it
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    index to fill
+    @param[out] Context     not used
+
+    @retval 1   success
+    @retval 0   no SMBIOS, out of memory or called on an AP, retried on next use
+
+**/
+static int buildidx(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    SMBIOSIDX* pIdx = Parameter;
+    RAWSMBIOSDATA Raw;
+    uint64_t qwTblAddr = 0;
+    uint32_t TblSize = 0, n, i, t;
+    int nRet = 0;
+
+    memset(pIdx, 0, sizeof(SMBIOSIDX));
+
+    do {
+
+        if (0 <= __ThreadPoolSelf())                                // no AllocatePool() on APs
+            break;
+
+        pIdx->EntryPointAddress = findentrypoint(&Raw, &qwTblAddr, &TblSize);
+
+        if (0 == pIdx->EntryPointAddress || 0 == qwTblAddr)
+            break;
+
+        pIdx->TableAddress = qwTblAddr;
+        Raw.Length = walk((const void*)qwTblAddr, TblSize, NULL, &n);
+
+        //
+        // single allocation for entries, handle order and RawSMBIOSData
+        //
+        pIdx->pEntry = malloc(n * (sizeof(SMBIOSIDXENTRY) + sizeof(uint32_t)) + sizeof(RAWSMBIOSDATA) + Raw.Length);
+
+        if (NULL == pIdx->pEntry)
+            break;
+
+        pIdx->pHandleOrder = (void*)&pIdx->pEntry[n];
+        pIdx->pRaw = (void*)&pIdx->pHandleOrder[n];
+        pIdx->RawSize = (uint32_t)sizeof(RAWSMBIOSDATA) + Raw.Length;
+
+        memcpy(pIdx->pRaw, &Raw, sizeof(RAWSMBIOSDATA));
+        memcpy(pIdx->pRaw->SMBIOSTableData, (const void*)qwTblAddr, Raw.Length);
+
+        walk(pIdx->pRaw->SMBIOSTableData, Raw.Length, pIdx->pEntry, &pIdx->nEntries);
+
+        //
+        // sort by type and table order, number the instances and get the start of each type
+        //
+        qsort(pIdx->pEntry, pIdx->nEntries, sizeof(SMBIOSIDXENTRY), cmpentry);
+
+        for (i = 0, t = 0; i < pIdx->nEntries; i++)
+        {
+            if (0 != i && pIdx->pEntry[i - 1].Type == pIdx->pEntry[i].Type)
+                pIdx->pEntry[i].Instance = pIdx->pEntry[i - 1].Instance + 1;
+
+            while (t <= pIdx->pEntry[i].Type)
+                pIdx->TypeFirst[t++] = i;
+
+            pIdx->pHandleOrder[i] = i;
+        }
+
+        while (t <= 256)
+            pIdx->TypeFirst[t++] = pIdx->nEntries;
+
+        pSort = pIdx;
+        qsort(pIdx->pHandleOrder, pIdx->nEntries, sizeof(uint32_t), cmphandle);
+        pSort = NULL;
+
+        pSmbiosIdx = pIdx;
+        nRet = 1;
+
+    } while (0);
+
+    return nRet;
+}
+
+/** __SmbiosIdxGet()
+Synopsis
+    SMBIOSIDX* __SmbiosIdxGet(void);
+Description
+    Get the SMBIOS index. The index is built once on first use on the BSP, also if
+    called concurrently on multiple processors.
+Paramters
+    none
+Returns
+    pointer to the index
+    NULL, if no SMBIOS available or not yet built on the BSP
+**/
+SMBIOSIDX* __SmbiosIdxGet(void)
+{
+    InitOnceExecuteOnce4UEFI(&SmbiosIdxOnce, buildidx, &SmbiosIdx, NULL);
+
+    return pSmbiosIdx;
+}
+
+/** SmbiosIndexRebuild4UEFI()
+Synopsis
+    int SmbiosIndexRebuild4UEFI(void);
+Description
+    Discard and rebuild the SMBIOS index, e.g. after structures were added
+    by EFI_SMBIOS_PROTOCOL
+
+    NOTE: BSP only, on APs ERROR_NOT_SUPPORTED is set
+Paramters
+    none
+Returns
+    number of structures in the index
+    0, if no SMBIOS available
+**/
+int SmbiosIndexRebuild4UEFI(void)
+{
+    int nRet;
+    INSTR_ENTER();
+
+    do {
+
+        nRet = 0;
+
+        if (0 <= __ThreadPoolSelf())
+        {
+            SetLastError4UEFI(ERROR_NOT_SUPPORTED);
+            break;
+        }
+
+        if (NULL != pSmbiosIdx)
+            free(pSmbiosIdx->pEntry);
+
+        pSmbiosIdx = NULL;
+        InitOnceInitialize4UEFI(&SmbiosIdxOnce);
+
+        nRet = NULL == __SmbiosIdxGet() ? 0 : (int)pSmbiosIdx->nEntries;
+
+    } while (0);
+
+    INSTR_LEAVE(SmbiosIndexRebuild, 0);
+
+    return nRet;
+}
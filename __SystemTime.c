@@ -0,0 +1,327 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __SystemTime.c
+
+Abstract:
+
+    System time extrapolated from the TSC
+
+    GetTime() takes tens of microseconds for the CMOS RTC and resolves whole seconds
+    only. It is read once and anchored to the TSC: GetTime() is polled for the edge
+    of the RTC second, the TSC at that edge corresponds to the RTC time with zero
+    fraction. Afterwards the system time is the anchor time plus the TSC counts
+    since the anchor, converted by a precomputed multiplier, see __TscScaleInit().
+
+    Every SYSTIME_RESYNC_SEC seconds GetTime() is read once more. As long as the
+    extrapolated time lies within the RTC second read, the anchor is kept. Otherwise
+    the TSC has drifted or the RTC was set, and the RTC edge is polled for a new anchor.
+    A new anchor never moves the time returned backwards: the time extrapolated from
+    the old anchor at the moment of the change is kept as a floor, the time stands
+    still until the new anchor has caught up.
+
+    GetTime() is called on the BSP only, APs extrapolate from the current anchor.
+    The anchor is published by a sequence count, readers never wait for a lock.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_ReadWriteBarrier, _InterlockedIncrement, _mm_lfence)
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+#define DAYS_1601_TO_1600_03_01 306     // days from March 1, 1600 to January 1, 1601
+#define RTC_EDGE_TIMEOUT_SEC    2       // give up polling a stuck RTC
+
+static INITONCE ScaleOnce = INITONCE_STATIC_INIT;
+static TSCSCALE FtScale;                                            // TSC to 100ns units
+static volatile long Seq;                                           // odd while the anchor is changed
+static uint64_t AnchorTsc;                                          // TSC at the anchor...
+static uint64_t AnchorFt;                                           // ... and the system time at that TSC
+static uint64_t FloorFt;                                            // system time never returned below
+static bool fAnchored;
+static volatile uint64_t ResyncTsc;                                 // TSC of the next RTC check
+static volatile int32_t BiasMin;                                    // local time minus UTC, in minutes
+
+/** scaleinit()
+
+    InitOnceExecuteOnce() callback, set up the TSC to 100ns conversion
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    not used
+    @param[in] Context      not used
+
+    @retval 1
+
+**/
+static int scaleinit(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    __TscScaleInit(&FtScale, SYSTIME_PER_SEC);
+
+    return 1;
+}
+
+/** extrapolate()
+
+    Get the system time of a TSC value from the current anchor
+
+    @param[in] qwTsc    TSC value
+
+    @retval system time in 100ns units since January 1, 1601 UTC
+
+**/
+static uint64_t extrapolate(uint64_t qwTsc)
+{
+    uint64_t qwFt = AnchorFt + (qwTsc > AnchorTsc ? __TscScale(&FtScale, qwTsc - AnchorTsc) : 0);
+
+    return qwFt > FloorFt ? qwFt : FloorFt;
+}
+
+/** rtcread()
+
+    Read the RTC and convert it to UTC
+
+    @param[out] pTime   receives the EFI time
+    @param[out] pqwFt   receives the system time in 100ns units since January 1, 1601 UTC
+    @param[out] pBias   receives local time minus UTC, in minutes
+
+    @retval true, success
+    @retval false, GetTime() failed or returned an invalid time
+
+**/
+static bool rtcread(EFI_TIME* pTime, uint64_t* pqwFt, int32_t* pBias)
+{
+    bool fRet = false;
+    int64_t Sec;
+
+    do {
+
+        if (EFI_SUCCESS != pEfiSystemTable->RuntimeServices->GetTime(pTime, NULL))
+            break;
+
+        if (pTime->Year < 1601 || pTime->Month < 1 || pTime->Month > 12 || pTime->Day < 1 || pTime->Day > 31
+            || pTime->Hour > 23 || pTime->Minute > 59 || pTime->Second > 59 || pTime->Nanosecond > 999999999)
+            break;
+
+        //
+        // UEFI 2.7 and later: Localtime = UTC + TimeZone, an unspecified time zone is taken as UTC
+        //
+        *pBias = EFI_UNSPECIFIED_TIMEZONE == pTime->TimeZone ? 0 : pTime->TimeZone;
+        *pBias += (EFI_TIME_IN_DAYLIGHT & pTime->Daylight) ? 60 : 0;
+
+        Sec = (int64_t)__SystemTimeDays(pTime->Year, pTime->Month, pTime->Day) * 86400
+            + pTime->Hour * 3600 + pTime->Minute * 60 + pTime->Second - *pBias * 60;
+
+        if (0 > Sec)
+            break;
+
+        *pqwFt = (uint64_t)Sec * SYSTIME_PER_SEC + pTime->Nanosecond / 100;
+        fRet = true;
+
+    } while (0);
+
+    return fRet;
+}
+
+/** rtcedge()
+
+    Poll the RTC for the edge of its second. An RTC that reports a fraction
+    of the second does not need to be polled.
+
+    @param[out] pqwTsc  receives the TSC at the edge
+    @param[out] pqwFt   receives the system time at the edge
+    @param[out] pBias   receives local time minus UTC, in minutes
+
+    @retval true, success
+    @retval false, GetTime() failed
+
+**/
+static bool rtcedge(uint64_t* pqwTsc, uint64_t* pqwFt, int32_t* pBias)
+{
+    EFI_TIME Time;
+    uint64_t qwFt0, qwTsc0, qwTsc1, qwTimeout;
+    bool fRet = false;
+
+    do {
+
+        qwTsc0 = __rdtsc();
+
+        if (!rtcread(&Time, &qwFt0, pBias))
+            break;
+
+        *pqwTsc = qwTsc0 + (__rdtsc() - qwTsc0) / 2;
+        *pqwFt = qwFt0;
+        fRet = true;
+
+        if (0 != Time.Nanosecond)
+            break;
+
+        qwTimeout = qwTsc0 + RTC_EDGE_TIMEOUT_SEC * __TscPerSec();
+
+        for (qwTsc1 = __rdtsc(); qwTsc1 < qwTimeout; qwTsc0 = qwTsc1, qwTsc1 = __rdtsc())
+        {
+            if (!rtcread(&Time, pqwFt, pBias))
+            {
+                fRet = false;
+                break;
+            }
+
+            if (qwFt0 != *pqwFt)                                    // the edge lies between both reads
+            {
+                *pqwTsc = qwTsc0 + (qwTsc1 - qwTsc0) / 2;
+                break;
+            }
+        }
+
+    } while (0);
+
+    return fRet;
+}
+
+/** anchor()
+
+    Publish a new anchor, the time extrapolated from the old anchor becomes the floor.
+    The floor is taken while readers are forced to retry, so no reader can return
+    a time above it from the old anchor.
+
+    @param[in] qwTsc    TSC of the anchor
+    @param[in] qwFt     system time at that TSC
+
+    @retval VOID
+
+**/
+static void anchor(uint64_t qwTsc, uint64_t qwFt)
+{
+    uint64_t qwFloor;
+
+    _InterlockedIncrement(&Seq);                                    // odd Seq visible before the TSC is read
+    _mm_lfence();                                                   // RDTSC not executed ahead
+
+    qwFloor = fAnchored ? extrapolate(__rdtsc()) : 0;
+
+    AnchorTsc = qwTsc;
+    AnchorFt = qwFt;
+    FloorFt = qwFloor;
+    fAnchored = true;
+
+    _ReadWriteBarrier();
+    Seq++;
+}
+
+/** resync()
+
+    Check the anchor against the RTC, BSP only
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void resync(void)
+{
+    EFI_TIME Time;
+    uint64_t qwTsc0, qwTsc1, qwFt, qwExt;
+    int32_t Bias;
+    bool fRead;
+
+    qwTsc0 = __rdtsc();
+    fRead = rtcread(&Time, &qwFt, &Bias);
+    qwTsc1 = __rdtsc();
+
+    ResyncTsc = qwTsc1 + SYSTIME_RESYNC_SEC * __TscPerSec();
+
+    if (fRead)
+    {
+        BiasMin = Bias;
+        qwExt = extrapolate(qwTsc0 + (qwTsc1 - qwTsc0) / 2);
+
+        if (0 != Time.Nanosecond)
+        {
+            if (!fAnchored || qwExt > qwFt + SYSTIME_PER_SEC / 1000 || qwFt > qwExt + SYSTIME_PER_SEC / 1000)
+                anchor(qwTsc0 + (qwTsc1 - qwTsc0) / 2, qwFt);
+        }
+        else if (!fAnchored || qwExt < qwFt || qwExt >= qwFt + SYSTIME_PER_SEC)
+        {
+            if (rtcedge(&qwTsc0, &qwFt, &Bias))
+                anchor(qwTsc0, qwFt);
+        }
+    }
+}
+
+/** __SystemTimeNow()
+Synopsis
+    uint64_t __SystemTimeNow(void);
+Description
+    Get the current system time. The first call on the BSP anchors the RTC,
+    that takes up to one second. Before that, APs get the time since reset.
+Paramters
+    VOID
+Returns
+    system time in 100ns units since January 1, 1601 UTC
+**/
+uint64_t __SystemTimeNow(void)
+{
+    uint64_t qwRet;
+    long s;
+
+    InitOnceExecuteOnce4UEFI(&ScaleOnce, scaleinit, NULL, NULL);
+
+    if (__rdtsc() >= ResyncTsc && 0 > __ThreadPoolSelf())
+        resync();
+
+    do {
+        s = Seq;
+        _ReadWriteBarrier();                                        // x64 loads are not reordered with other loads
+        qwRet = extrapolate(__rdtsc());
+        _ReadWriteBarrier();
+    } while ((1 & s) || s != Seq);
+
+    return qwRet;
+}
+
+/** __SystemTimeBias()
+Synopsis
+    int32_t __SystemTimeBias(void);
+Description
+    Get the difference of local time and UTC, reported by the RTC at the last check
+Paramters
+    VOID
+Returns
+    local time minus UTC, in minutes
+**/
+int32_t __SystemTimeBias(void)
+{
+    return BiasMin;
+}
+
+/** __SystemTimeDays()
+Synopsis
+    uint32_t __SystemTimeDays(uint32_t Year, uint32_t Month, uint32_t Day);
+Description
+    Get the number of days of a date of the gregorian calendar since January 1, 1601
+Paramters
+    uint32_t Year   :   year, 1601 or later
+    uint32_t Month  :   month, 1 = January
+    uint32_t Day    :   day of the month
+Returns
+    number of days
+**/
+uint32_t __SystemTimeDays(uint32_t Year, uint32_t Month, uint32_t Day)
+{
+    uint32_t y = Year - 1600 - (Month <= 2), yoe = y % 400;         // years start on March 1, in 400 year eras
+    uint32_t doy = (153 * (Month > 2 ? Month - 3 : Month + 9) + 2) / 5 + Day - 1;
+
+    return y / 400 * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - DAYS_1601_TO_1600_03_01;
+}
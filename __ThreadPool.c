@@ -0,0 +1,553 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __ThreadPool.c
+
+Abstract:
+
+    Work-stealing thread pool on top of EFI_MP_SERVICES_PROTOCOL
+
+    On first use each enabled, healthy AP is started once by StartupThisAP() in
+    non-blocking mode. It runs a worker loop, that pops items from the bottom of
+    its own deque and, if that is empty, steals from the top of the other deques.
+    Idle workers spin with PAUSE and exponential backoff, see __SpinBackoff().
+
+    The deques are protected by short spin locks, so that the BSP and workers may
+    push into any deque. Thread objects come from a pool allocated on the BSP,
+    since APs must not call boot services, e.g. AllocatePool() behind malloc().
+
+    NOTE: ThreadPoolShutdown4UEFI() returns all APs to the MP services. It is
+          registered with atexit(), so that no AP runs image code after unload.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <intrin.h>
+#include <Protocol/MpService.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (_InterlockedIncrement, _InterlockedDecrement, _ReadWriteBarrier)
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+typedef struct _WORKDEQUE {
+    volatile long Lock;                 // spin lock
+    volatile uint32_t Top;              // next item to steal
+    volatile uint32_t Bottom;           // next free slot, the owner's end
+    UINTN ProcessorNumber;              // processor number of the owner
+    EFI_EVENT Event;                    // StartupThisAP() WaitEvent, signaled when the worker loop has returned
+    THREADOBJ* pCurrent;                // item running on the owner, NULL if idle
+    THREADOBJ* pItem[THREADPOOL_DEQUE];
+}WORKDEQUE;
+
+static bool fInit = false;
+static bool fAtExit = false;
+static volatile bool fShutdown = false;
+static EFI_MP_SERVICES_PROTOCOL* pMp;
+static UINTN nProcessors;
+static int32_t* pWorkerOfCpu;                                       // processor number -> deque index, -1 for the BSP
+static WORKDEQUE* pDeque;                                           // one per worker
+static volatile uint32_t nWorkers;
+static volatile long nRunning;                                      // worker loops not yet returned
+static uint32_t RoundRobin;                                         // next deque for items submitted by the BSP
+static THREADOBJ* pItemPool;
+static THREADOBJ* pFreeList;
+static volatile long FreeLock;
+static THREADOBJ* pBspCurrent;                                      // item running on the BSP, NULL for the application
+
+/** push()
+
+    Push an item to the bottom of a deque
+
+    @param[in] pD       deque
+    @param[in] pThread  item
+
+    @retval true    success
+    @retval false   deque is full
+
+**/
+static bool push(WORKDEQUE* pD, THREADOBJ* pThread)
+{
+    bool fRet = false;
+
+    __SpinLock(&pD->Lock);
+
+    if (pD->Bottom - pD->Top < THREADPOOL_DEQUE)
+    {
+        pD->pItem[pD->Bottom % THREADPOOL_DEQUE] = pThread;
+        pD->Bottom++;
+        fRet = true;
+    }
+
+    __SpinUnlock(&pD->Lock);
+
+    return fRet;
+}
+
+/** take()
+
+    Take an item from a deque, the owner pops the newest item at the bottom,
+    thieves steal the oldest one at the top
+
+    @param[in] pD       deque
+    @param[in] fOwner   calling processor owns the deque
+
+    @retval item
+    @retval NULL, if the deque is empty
+
+**/
+static THREADOBJ* take(WORKDEQUE* pD, bool fOwner)
+{
+    THREADOBJ* pRet = NULL;
+
+    if (pD->Top != pD->Bottom)                                      // don't take the lock for an empty deque
+    {
+        __SpinLock(&pD->Lock);
+
+        if (pD->Top != pD->Bottom)
+            pRet = fOwner ? pD->pItem[--pD->Bottom % THREADPOOL_DEQUE] : pD->pItem[pD->Top++ % THREADPOOL_DEQUE];
+
+        __SpinUnlock(&pD->Lock);
+    }
+
+    return pRet;
+}
+
+/** self()
+
+    Get the deque index of the calling processor
+
+    @param[in] VOID
+
+    @retval deque index
+    @retval -1, if called on the BSP or without workers
+
+**/
+static int32_t self(void)
+{
+    UINTN ProcessorNumber;
+    int32_t nRet = -1;
+
+    if (0 != nWorkers && EFI_SUCCESS == pMp->WhoAmI(pMp, &ProcessorNumber) && ProcessorNumber < nProcessors)
+        nRet = pWorkerOfCpu[ProcessorNumber];
+
+    return nRet;
+}
+
+/** run()
+
+    Run an item, signal the thread object and drop the reference of the execution.
+    The item is the current thread of the processor while it runs, items run nested
+    by waiting items restore their predecessor.
+
+    @param[in] Self     deque index of the calling processor, -1 for the BSP
+    @param[in] pThread  item
+
+    @retval VOID
+
+**/
+static void run(int32_t Self, THREADOBJ* pThread)
+{
+    THREADOBJ** ppCurrent = 0 <= Self ? &pDeque[Self].pCurrent : &pBspCurrent;
+    THREADOBJ* pPrev = *ppCurrent;
+
+    *ppCurrent = pThread;
+
+    if (NULL != pThread->pfnCallback)
+        pThread->pfnCallback(NULL, pThread->lpParameter);
+    else
+        pThread->ExitCode = pThread->pfnStart(pThread->lpParameter);
+
+    *ppCurrent = pPrev;
+
+    _ReadWriteBarrier();
+    pThread->Hdr.fSignaled = true;
+
+    __ThreadRelease(pThread);
+}
+
+/** runone()
+
+    Run one item, taken from the own deque first or stolen from the others
+
+    @param[in] Self     deque index of the calling processor, -1 for the BSP
+
+    @retval true    an item was run
+    @retval false   all deques are empty
+
+**/
+static bool runone(int32_t Self)
+{
+    THREADOBJ* pThread = NULL;
+    uint32_t i, n = nWorkers, Victim;
+
+    if (0 <= Self)
+        pThread = take(&pDeque[Self], true);
+
+    for (i = 0, Victim = (uint32_t)(Self + 1); NULL == pThread && i < n; i++, Victim++)
+        pThread = take(&pDeque[Victim % n], false);
+
+    if (NULL != pThread)
+        run(Self, pThread);
+
+    return NULL != pThread;
+}
+
+/** worker()
+
+    Worker loop, started on each AP. Returns on shutdown, when all deques are empty.
+
+    @param[in] Buffer   own deque
+
+    @retval VOID
+
+**/
+static void EFIAPI worker(void* Buffer)
+{
+    int32_t Self = (int32_t)((WORKDEQUE*)Buffer - pDeque);
+    uint32_t Backoff = 1;
+
+    while (1)
+    {
+        if (runone(Self))
+        {
+            Backoff = 1;
+            continue;
+        }
+
+        if (fShutdown)
+            break;
+
+        __SpinBackoff(&Backoff);
+    }
+
+    _InterlockedDecrement(&nRunning);
+}
+
+/** init()
+
+    Allocate the thread object pool and start the workers on first use
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void init(void)
+{
+    static EFI_GUID MpServiceProtocolGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    EFI_PROCESSOR_INFORMATION Info;
+    UINTN nEnabled, Bsp, i;
+    uint32_t Flags = PROCESSOR_ENABLED_BIT | PROCESSOR_HEALTH_STATUS_BIT;
+
+    do {
+        if (fInit)
+            break;
+
+        fInit = true;
+        fShutdown = false;
+
+        pItemPool = calloc(THREADPOOL_ITEMS, sizeof(THREADOBJ));
+
+        if (NULL == pItemPool)
+            break;
+
+        for (i = 0; i < THREADPOOL_ITEMS; i++)
+        {
+            pItemPool[i].ThreadId = (uint32_t)i + THREADID_MAIN + 1;
+            pItemPool[i].pNextFree = i + 1 < THREADPOOL_ITEMS ? &pItemPool[i + 1] : NULL;
+        }
+
+        pFreeList = pItemPool;
+
+        if (false == fAtExit)
+            fAtExit = 0 == atexit(ThreadPoolShutdown4UEFI);
+
+        if (EFI_SUCCESS != pBS->LocateProtocol(&MpServiceProtocolGuid, NULL, (void**)&pMp))
+            break;
+
+        if (EFI_SUCCESS != pMp->GetNumberOfProcessors(pMp, &nProcessors, &nEnabled) || 2 > nEnabled)
+            break;
+
+        if (EFI_SUCCESS != pMp->WhoAmI(pMp, &Bsp))
+            break;
+
+        pDeque = calloc(nProcessors, sizeof(WORKDEQUE));
+        pWorkerOfCpu = malloc(nProcessors * sizeof(int32_t));
+
+        if (NULL == pDeque || NULL == pWorkerOfCpu)
+            break;
+
+        for (i = 0; i < nProcessors; i++)
+            pWorkerOfCpu[i] = -1;
+
+        for (i = 0; i < nProcessors; i++)
+        {
+            WORKDEQUE* pD = &pDeque[nWorkers];
+
+            if (i == Bsp || EFI_SUCCESS != pMp->GetProcessorInfo(pMp, i, &Info) || Flags != (Flags & Info.StatusFlag))
+                continue;
+
+            if (EFI_SUCCESS != pBS->CreateEvent(0, TPL_CALLBACK, NULL, NULL, &pD->Event))
+                continue;
+
+            pD->ProcessorNumber = i;
+            pWorkerOfCpu[i] = (int32_t)nWorkers;
+            _InterlockedIncrement(&nRunning);
+
+            if (EFI_SUCCESS != pMp->StartupThisAP(pMp, worker, i, pD->Event, 0, pD, NULL))
+            {
+                _InterlockedDecrement(&nRunning);
+                pWorkerOfCpu[i] = -1;
+                pBS->CloseEvent(pD->Event);
+                pD->Event = NULL;
+                continue;
+            }
+
+            nWorkers++;
+        }
+
+    } while (0);
+}
+
+/** __ThreadAlloc()
+Synopsis
+    THREADOBJ* __ThreadAlloc(void);
+Description
+    Take a thread object from the pool. If the pool is exhausted, the calling
+    processor runs queued items until an object is released.
+Paramters
+    none
+Returns
+    thread object, initialized with one reference and ExitCode STILL_ACTIVE
+    NULL, if no object is available
+**/
+THREADOBJ* __ThreadAlloc(void)
+{
+    THREADOBJ* pThread;
+    uint32_t ThreadId;
+
+    init();
+
+    do {
+        __SpinLock(&FreeLock);
+
+        if (NULL != (pThread = pFreeList))
+            pFreeList = pThread->pNextFree;
+
+        __SpinUnlock(&FreeLock);
+
+    } while (NULL == pThread && runone(self()));
+
+    if (NULL != pThread)
+    {
+        ThreadId = pThread->ThreadId;
+        memset(pThread, 0, sizeof(THREADOBJ));
+        pThread->ThreadId = ThreadId;
+        pThread->Hdr.fManualReset = true;
+        pThread->ExitCode = STILL_ACTIVE;
+        pThread->nRef = 1;
+    }
+
+    return pThread;
+}
+
+/** __ThreadSubmit()
+Synopsis
+    void __ThreadSubmit(THREADOBJ* pThread);
+Description
+    Queue a thread object to a worker. A worker queues to its own deque, the BSP
+    round-robin to all deques. If there are no workers or all deques are full,
+    the item runs on the calling processor.
+Paramters
+    THREADOBJ* pThread      :   thread object from __ThreadAlloc()
+Returns
+    none
+**/
+void __ThreadSubmit(THREADOBJ* pThread)
+{
+    uint32_t n = nWorkers, i, First;
+    int32_t Self = self();
+    bool fQueued = false;
+
+    if (0 != n)
+    {
+        First = 0 <= Self ? (uint32_t)Self : RoundRobin++;
+
+        for (i = 0; false == fQueued && i < n; i++)
+            fQueued = push(&pDeque[(First + i) % n], pThread);
+    }
+
+    if (false == fQueued)
+        run(Self, pThread);
+}
+
+/** __ThreadRelease()
+Synopsis
+    void __ThreadRelease(THREADOBJ* pThread);
+Description
+    Drop a reference of a thread object, return it to the pool on the last one
+Paramters
+    THREADOBJ* pThread      :   thread object
+Returns
+    none
+**/
+void __ThreadRelease(THREADOBJ* pThread)
+{
+    if (0 == _InterlockedDecrement(&pThread->nRef))
+    {
+        pThread->Hdr.Signature = 0;
+
+        __SpinLock(&FreeLock);
+        pThread->pNextFree = pFreeList;
+        pFreeList = pThread;
+        __SpinUnlock(&FreeLock);
+    }
+}
+
+/** __ThreadPoolHelp()
+Synopsis
+    bool __ThreadPoolHelp(void);
+Description
+    Run one queued item on the calling processor, used by the BSP while it waits
+Paramters
+    none
+Returns
+    true, if an item was run
+**/
+bool __ThreadPoolHelp(void)
+{
+    return fInit && runone(self());
+}
+
+/** __ThreadSelfId()
+Synopsis
+    uint32_t __ThreadSelfId(void);
+Description
+    Get the thread id of the item running on the calling processor
+Paramters
+    none
+Returns
+    ThreadId of the running item
+    THREADID_MAIN, if called by the application on the BSP
+**/
+uint32_t __ThreadSelfId(void)
+{
+    THREADOBJ* pThread = pBspCurrent;
+    int32_t Self;
+
+    if (fInit && 0 <= (Self = self()))
+        pThread = pDeque[Self].pCurrent;
+
+    return NULL != pThread ? pThread->ThreadId : THREADID_MAIN;
+}
+
+/** __ThreadPoolSelf()
+Synopsis
+    int32_t __ThreadPoolSelf(void);
+Description
+    Get the worker index of the calling processor, e.g. to select per processor caches
+Paramters
+    none
+Returns
+    worker index 0 .. ThreadPoolWorkerCount4UEFI() - 1
+    -1, if called on the BSP or without workers
+**/
+int32_t __ThreadPoolSelf(void)
+{
+    return fInit ? self() : -1;
+}
+
+/** ThreadPoolWorkerCount4UEFI()
+Synopsis
+    uint32_t ThreadPoolWorkerCount4UEFI(void);
+Description
+    Get the number of APs running a worker loop. Starts the workers, if not yet done.
+Paramters
+    none
+Returns
+    number of workers, 0 if items run on the BSP
+**/
+uint32_t ThreadPoolWorkerCount4UEFI(void)
+{
+    uint32_t nRet;
+    INSTR_ENTER();
+
+    init();
+    nRet = nWorkers;
+
+    INSTR_LEAVE(ThreadPoolWorkerCount, 0);
+
+    return nRet;
+}
+
+/** ThreadPoolShutdown4UEFI()
+Synopsis
+    void ThreadPoolShutdown4UEFI(void);
+Description
+    Run all queued items, stop the workers and return the APs to the MP services.
+    The next submission starts the workers again.
+
+    NOTE: All thread handles must be closed before. Otherwise the thread object
+          pool is not released.
+Paramters
+    none
+Returns
+    none
+**/
+void ThreadPoolShutdown4UEFI(void)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    THREADOBJ* pThread;
+    uint32_t i, nFree = 0;
+    UINTN Index;
+    INSTR_ENTER();
+
+    if (fInit)
+    {
+        while (runone(-1))
+            ;
+
+        fShutdown = true;
+
+        while (0 != nRunning)
+            _mm_pause();
+
+        for (i = 0; i < nWorkers; i++)
+        {
+            pBS->WaitForEvent(1, &pDeque[i].Event, &Index);
+            pBS->CloseEvent(pDeque[i].Event);
+        }
+
+        for (pThread = pFreeList; NULL != pThread; pThread = pThread->pNextFree)
+            nFree++;
+
+        if (THREADPOOL_ITEMS == nFree)
+            free(pItemPool);
+
+        free(pDeque);
+        free(pWorkerOfCpu);
+
+        pItemPool = pFreeList = NULL;
+        pDeque = NULL;
+        pWorkerOfCpu = NULL;
+        pMp = NULL;
+        nProcessors = 0;
+        nWorkers = 0;
+        fInit = false;
+    }
+
+    INSTR_LEAVE(ThreadPoolShutdown, 0);
+}
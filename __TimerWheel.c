@@ -0,0 +1,306 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __TimerWheel.c
+
+Abstract:
+
+    Hierarchical timer wheel for the waitable timers
+
+    WHEEL_LEVELS levels of WHEEL_SLOTS slots each, level L holds timers that expire
+    within 64^(L+1) ticks of 1ms. A slot is a doubly linked list of TIMEROBJ, so that
+    arming and cancelling is O(1) and does not allocate memory. When the level 0 index
+    wraps, the due slot of the next level is cascaded down.
+
+    The wheel is not driven by an event notification function, that would run at
+    TPL_CALLBACK, but advanced from the TSC by the waiting functions. The periodic
+    UEFI timer event is only used to block in WaitForEvent() between two ticks.
+
+--*/
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+//
+// externs
+//
+extern EFI_SYSTEM_TABLE* pEfiSystemTable;
+
+#define WHEEL_TICK_100NS    10000                                   // 1ms tick, in 100ns units for SetTimer()
+
+static TIMEROBJ* pSlot[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t nLevel[WHEEL_LEVELS];                               // number of timers per level
+static uint32_t nArmed;                                             // number of timers in the wheel
+static uint64_t qwTickTsc;                                          // TSC counts per tick
+static uint64_t qwCurTick;                                          // next tick to be processed
+static EFI_EVENT TickEvent;
+
+/** init()
+
+    Initialize the tick length on first use
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void init(void)
+{
+    if (0 == qwTickTsc)
+    {
+        qwTickTsc = __TscPerSec() / 1000;
+
+        if (0 == qwTickTsc)
+            qwTickTsc = 1;
+
+        qwCurTick = __rdtsc() / qwTickTsc;
+    }
+}
+
+/** link()
+
+    Insert a timer into the slot of its due tick
+
+    @param[in] pTimer   timer object, not linked
+
+    @retval VOID
+
+**/
+static void link(TIMEROBJ* pTimer)
+{
+    uint64_t qwDueTick = (pTimer->DueTsc + qwTickTsc - 1) / qwTickTsc;
+    uint32_t Level, Index;
+
+    if (qwDueTick < qwCurTick)                                      // overdue, fire at the next tick
+        qwDueTick = qwCurTick;
+
+    for (Level = 0; Level < WHEEL_LEVELS - 1; Level++)
+        if ((qwDueTick >> (WHEEL_BITS * Level)) - (qwCurTick >> (WHEEL_BITS * Level)) < WHEEL_SLOTS)
+            break;
+
+    if ((qwDueTick >> (WHEEL_BITS * Level)) - (qwCurTick >> (WHEEL_BITS * Level)) < WHEEL_SLOTS)
+        Index = (uint32_t)(qwDueTick >> (WHEEL_BITS * Level)) % WHEEL_SLOTS;
+    else                                                            // beyond the wheel, park in the last slot
+        Index = (uint32_t)((qwCurTick >> (WHEEL_BITS * Level)) + WHEEL_SLOTS - 1) % WHEEL_SLOTS;
+
+    pTimer->Slot = (uint16_t)(Level * WHEEL_SLOTS + Index);
+    pTimer->pPrev = NULL;
+    pTimer->pNext = pSlot[Level][Index];
+
+    if (NULL != pTimer->pNext)
+        pTimer->pNext->pPrev = pTimer;
+
+    pSlot[Level][Index] = pTimer;
+    pTimer->fArmed = true;
+    nLevel[Level]++;
+    nArmed++;
+}
+
+/** unlink()
+
+    Remove a timer from its slot
+
+    @param[in] pTimer   timer object, linked
+
+    @retval VOID
+
+**/
+static void unlink(TIMEROBJ* pTimer)
+{
+    uint32_t Level = pTimer->Slot / WHEEL_SLOTS, Index = pTimer->Slot % WHEEL_SLOTS;
+
+    if (NULL != pTimer->pPrev)
+        pTimer->pPrev->pNext = pTimer->pNext;
+    else
+        pSlot[Level][Index] = pTimer->pNext;
+
+    if (NULL != pTimer->pNext)
+        pTimer->pNext->pPrev = pTimer->pPrev;
+
+    pTimer->pNext = pTimer->pPrev = NULL;
+    pTimer->fArmed = false;
+    nLevel[Level]--;
+    nArmed--;
+}
+
+/** __TimerWheelArm()
+Synopsis
+    void __TimerWheelArm(TIMEROBJ* pTimer);
+Description
+    Link a timer into the timer wheel at pTimer->DueTsc. An armed timer is re-armed.
+Paramters
+    TIMEROBJ* pTimer        :   timer object with DueTsc and PeriodTsc set
+Returns
+    none
+**/
+void __TimerWheelArm(TIMEROBJ* pTimer)
+{
+    init();
+
+    if (pTimer->fArmed)
+        unlink(pTimer);
+
+    link(pTimer);
+}
+
+/** __TimerWheelCancel()
+Synopsis
+    void __TimerWheelCancel(TIMEROBJ* pTimer);
+Description
+    Unlink a timer from the timer wheel. The signaled state is not changed.
+Paramters
+    TIMEROBJ* pTimer        :   timer object
+Returns
+    none
+**/
+void __TimerWheelCancel(TIMEROBJ* pTimer)
+{
+    if (pTimer->fArmed)
+        unlink(pTimer);
+}
+
+/** __TimerWheelExpire()
+Synopsis
+    void __TimerWheelExpire(TIMEROBJ* pTimer, uint64_t qwTscNow);
+Description
+    Signal an armed timer, if its due time has passed. A periodic timer is re-armed
+    to the next period after qwTscNow, missed periods are skipped.
+
+    The waiting functions call it for the awaited timers, so that these expire at
+    TSC precision instead of tick precision.
+Paramters
+    TIMEROBJ* pTimer        :   timer object
+    uint64_t qwTscNow       :   current TSC
+Returns
+    none
+**/
+void __TimerWheelExpire(TIMEROBJ* pTimer, uint64_t qwTscNow)
+{
+    if (pTimer->fArmed && pTimer->DueTsc <= qwTscNow)
+    {
+        unlink(pTimer);
+
+        pTimer->Hdr.fSignaled = true;
+
+        if (0 != pTimer->PeriodTsc)
+        {
+            pTimer->DueTsc += ((qwTscNow - pTimer->DueTsc) / pTimer->PeriodTsc + 1) * pTimer->PeriodTsc;
+            link(pTimer);
+        }
+    }
+}
+
+/** __TimerWheelAdvance()
+Synopsis
+    void __TimerWheelAdvance(uint64_t qwTscNow);
+Description
+    Process all ticks up to qwTscNow: cascade higher levels down when the lower
+    index wraps and signal the timers of the level 0 slots.
+    Runs of empty level 0 slots are skipped.
+Paramters
+    uint64_t qwTscNow       :   current TSC
+Returns
+    none
+**/
+void __TimerWheelAdvance(uint64_t qwTscNow)
+{
+    uint64_t qwNowTick;
+
+    init();
+
+    qwNowTick = qwTscNow / qwTickTsc;
+
+    while (qwCurTick <= qwNowTick)
+    {
+        uint32_t Level, Top;
+        TIMEROBJ* pTimer, * pNext;
+
+        if (0 == nArmed)
+        {
+            qwCurTick = qwNowTick + 1;
+            break;
+        }
+
+        if (0 != (qwCurTick % WHEEL_SLOTS) && 0 == nLevel[0])       // nothing to do until the next cascade
+        {
+            qwCurTick = (qwCurTick | (WHEEL_SLOTS - 1)) + 1;
+
+            if (qwCurTick > qwNowTick)                              // don't skip ahead of the current time
+                qwCurTick = qwNowTick + 1;
+            continue;
+        }
+
+        //
+        // cascade from the highest level, whose lower indices all wrapped
+        //
+        for (Top = 0; Top < WHEEL_LEVELS - 1; Top++)
+            if (0 != ((qwCurTick >> (WHEEL_BITS * Top)) % WHEEL_SLOTS))
+                break;
+
+        for (Level = Top; Level > 0; Level--)
+        {
+            uint32_t Index = (uint32_t)(qwCurTick >> (WHEEL_BITS * Level)) % WHEEL_SLOTS;
+
+            for (pTimer = pSlot[Level][Index]; NULL != pTimer; pTimer = pNext)
+            {
+                pNext = pTimer->pNext;
+                unlink(pTimer);
+                link(pTimer);
+            }
+        }
+
+        //
+        // signal the timers of the current tick
+        //
+        for (pTimer = pSlot[0][qwCurTick % WHEEL_SLOTS]; NULL != pTimer; pTimer = pNext)
+        {
+            pNext = pTimer->pNext;
+            __TimerWheelExpire(pTimer, qwTscNow);
+        }
+
+        qwCurTick++;
+    }
+}
+
+/** __TimerWheelEvent()
+Synopsis
+    void* __TimerWheelEvent(void);
+Description
+    Get the periodic UEFI timer event of the timer wheel, created on first use
+Paramters
+    none
+Returns
+    EFI_EVENT to be passed to WaitForEvent()
+    NULL, if the event can not be created
+**/
+void* __TimerWheelEvent(void)
+{
+    EFI_BOOT_SERVICES* pBS = pEfiSystemTable->BootServices;
+    EFI_EVENT Event = NULL;
+
+    do {
+        if (NULL != TickEvent)
+            break;
+
+        if (EFI_SUCCESS != pBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Event))
+            break;
+
+        if (EFI_SUCCESS != pBS->SetTimer(Event, TimerPeriodic, WHEEL_TICK_100NS))
+        {
+            pBS->CloseEvent(Event);
+            break;
+        }
+
+        TickEvent = Event;
+
+    } while (0);
+
+    return TickEvent;
+}
@@ -0,0 +1,735 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __TopologyIdx.c
+
+Abstract:
+
+    One-time index of the processor and NUMA topology, taken from MADT, SRAT and
+    SLIT, used by GetLogicalProcessorInformationEx() and the GetNuma*() functions
+    instead of walking the ACPI tables on each call.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <intrin.h>
+#include <IndustryStandard/Acpi62.h>
+#include "Win324UEFI.h"
+
+#define DOMAIN_NONE 0xFFFFFFFF                                      // processor without SRAT affinity
+
+static TOPOIDX TopologyIdx;
+static INITONCE TopologyOnce = INITONCE_STATIC_INIT;
+static TOPOIDX* pSort = NULL;                                       // index being sorted, for cmpapic()
+
+static int cmpu32(const void* p1, const void* p2)
+{
+    uint32_t d1 = *(const uint32_t*)p1, d2 = *(const uint32_t*)p2;
+
+    return d1 == d2 ? 0 : (d1 < d2 ? -1 : 1);
+}
+
+static int cmpcpu(const void* p1, const void* p2)
+{
+    const TOPOCPU* pC1 = p1, * pC2 = p2;
+
+    if (pC1->Node != pC2->Node)
+        return pC1->Node < pC2->Node ? -1 : 1;
+
+    return pC1->ApicId == pC2->ApicId ? 0 : (pC1->ApicId < pC2->ApicId ? -1 : 1);
+}
+
+static int cmpapic(const void* p1, const void* p2)
+{
+    return cmpu32(&pSort->pCpu[*(const uint32_t*)p1].ApicId, &pSort->pCpu[*(const uint32_t*)p2].ApicId);
+}
+
+static int cmpmem(const void* p1, const void* p2)
+{
+    const TOPOMEM* pM1 = p1, * pM2 = p2;
+
+    return pM1->Base == pM2->Base ? 0 : (pM1->Base < pM2->Base ? -1 : 1);
+}
+
+/** apicshift()
+
+    Get the APIC ID shifts of core and package from CPUID leaf 0Bh,
+    from the logical processor count of CPUID leaf 1 otherwise
+
+    @param[in] pIdx index to fill
+
+    @retval VOID
+
+**/
+static void apicshift(TOPOIDX* pIdx)
+{
+    int regs[4];
+    uint32_t Sub, Type, n;
+
+    pIdx->SmtShift = pIdx->PkgShift = 0;
+
+    __cpuid(regs, 0);
+
+    if (regs[0] >= 0xB)
+        for (Sub = 0; Sub < 8; Sub++)
+        {
+            __cpuidex(regs, 0xB, Sub);
+            Type = ((uint32_t)regs[2] >> 8) & 0xFF;
+
+            if (0 == Type || 0 == (regs[1] & 0xFFFF))
+                break;                                              // last level
+
+            if (1 == Type)
+                pIdx->SmtShift = (uint8_t)(regs[0] & 0x1F);
+
+            pIdx->PkgShift = (uint8_t)(regs[0] & 0x1F);
+        }
+
+    if (0 == pIdx->PkgShift)
+    {
+        __cpuid(regs, 1);
+
+        for (n = (1 << 28) & regs[3] ? ((uint32_t)regs[1] >> 16) & 0xFF : 1; (1u << pIdx->PkgShift) < n;)
+            pIdx->PkgShift++;
+    }
+}
+
+/** madt()
+
+    Walk the MADT for enabled local APIC and local x2APIC structures
+
+    @param[out] pCpu    receives the processors, may be NULL to count only
+
+    @retval number of processors, including duplicates
+
+**/
+static uint32_t madt(TOPOCPU* pCpu)
+{
+    const ACPITBLIDXENTRY* pEntry = __AcpiTblIdxFind('CIPA', 0);
+    const uint8_t* pTbl;
+    uint32_t offs, n = 0, ApicId, AcpiUid;
+
+    for (offs = sizeof(EFI_ACPI_6_2_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER); NULL != pEntry && offs + 2 <= pEntry->Length; offs += pTbl[1])
+    {
+        pTbl = (const uint8_t*)pEntry->pTable + offs;
+
+        if (pTbl[1] < 2 || offs + pTbl[1] > pEntry->Length)
+            break;                                                  // damaged structure
+
+        if (EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC == pTbl[0] && pTbl[1] >= sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_STRUCTURE))
+        {
+            const EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_STRUCTURE* pApic = (const void*)pTbl;
+
+            if (0 == (EFI_ACPI_6_2_LOCAL_APIC_ENABLED & pApic->Flags))
+                continue;
+
+            ApicId = pApic->ApicId;
+            AcpiUid = pApic->AcpiProcessorUid;
+        }
+        else if (EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC == pTbl[0] && pTbl[1] >= sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_STRUCTURE))
+        {
+            const EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_STRUCTURE* pX2Apic = (const void*)pTbl;
+
+            if (0 == (EFI_ACPI_6_2_LOCAL_APIC_ENABLED & pX2Apic->Flags))
+                continue;
+
+            ApicId = pX2Apic->X2ApicId;
+            AcpiUid = pX2Apic->AcpiProcessorUid;
+        }
+        else
+            continue;
+
+        if (NULL != pCpu)
+        {
+            memset(&pCpu[n], 0, sizeof(TOPOCPU));
+            pCpu[n].ApicId = ApicId;
+            pCpu[n].AcpiUid = AcpiUid;
+            pCpu[n].ProximityDomain = DOMAIN_NONE;
+        }
+
+        n++;
+    }
+
+    return n;
+}
+
+/** srat()
+
+    Walk the SRAT for enabled processor and memory affinity structures.
+    The proximity domain of a processor is stored to its pCpu[] entry.
+
+    @param[in] pIdx     index to fill, pApicOrder[] valid
+    @param[out] pMem    receives the memory ranges, may be NULL to count only
+
+    @retval number of memory ranges
+
+**/
+static uint32_t srat(TOPOIDX* pIdx, TOPOMEM* pMem)
+{
+    const ACPITBLIDXENTRY* pEntry = __AcpiTblIdxFind('TARS', 0);
+    const uint8_t* pTbl;
+    const TOPOCPU* pCpu;
+    uint32_t offs, n = 0, Domain, ApicId;
+
+    for (offs = sizeof(EFI_ACPI_6_2_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER); NULL != pEntry && offs + 2 <= pEntry->Length; offs += pTbl[1])
+    {
+        pTbl = (const uint8_t*)pEntry->pTable + offs;
+
+        if (pTbl[1] < 2 || offs + pTbl[1] > pEntry->Length)
+            break;                                                  // damaged structure
+
+        if (EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_AFFINITY == pTbl[0] && pTbl[1] >= sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_AFFINITY_STRUCTURE))
+        {
+            const EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_AFFINITY_STRUCTURE* pAff = (const void*)pTbl;
+
+            if (0 == (EFI_ACPI_6_2_PROCESSOR_LOCAL_APIC_SAPIC_ENABLED & pAff->Flags))
+                continue;
+
+            ApicId = pAff->ApicId;
+            Domain = pAff->ProximityDomain7To0 | (uint32_t)pAff->ProximityDomain31To8[0] << 8
+                | (uint32_t)pAff->ProximityDomain31To8[1] << 16 | (uint32_t)pAff->ProximityDomain31To8[2] << 24;
+        }
+        else if (EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_AFFINITY == pTbl[0] && pTbl[1] >= sizeof(EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_AFFINITY_STRUCTURE))
+        {
+            const EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_AFFINITY_STRUCTURE* pAff = (const void*)pTbl;
+
+            if (0 == (EFI_ACPI_6_2_PROCESSOR_LOCAL_X2APIC_ENABLED & pAff->Flags))
+                continue;
+
+            ApicId = pAff->X2ApicId;
+            Domain = pAff->ProximityDomain;
+        }
+        else if (EFI_ACPI_6_2_MEMORY_AFFINITY == pTbl[0] && pTbl[1] >= sizeof(EFI_ACPI_6_2_MEMORY_AFFINITY_STRUCTURE))
+        {
+            const EFI_ACPI_6_2_MEMORY_AFFINITY_STRUCTURE* pAff = (const void*)pTbl;
+
+            if (0 == (EFI_ACPI_6_2_MEMORY_ENABLED & pAff->Flags) || (0 == pAff->LengthLow && 0 == pAff->LengthHigh))
+                continue;
+
+            if (NULL != pMem)
+            {
+                memset(&pMem[n], 0, sizeof(TOPOMEM));
+                pMem[n].Base = (uint64_t)pAff->AddressBaseHigh << 32 | pAff->AddressBaseLow;
+                pMem[n].Length = (uint64_t)pAff->LengthHigh << 32 | pAff->LengthLow;
+                pMem[n].ProximityDomain = pAff->ProximityDomain;
+                pMem[n].Flags = pAff->Flags;
+            }
+
+            n++;
+            continue;
+        }
+        else
+            continue;
+
+        if (NULL != pMem && NULL != (pCpu = __TopologyIdxFindApic(ApicId)))
+            ((TOPOCPU*)pCpu)->ProximityDomain = Domain;
+    }
+
+    return n;
+}
+
+/** nodeof()
+
+    Translate a proximity domain into a node number
+
+    @param[in] pIdx     index, pNodeDomain[] valid
+    @param[in] Domain   proximity domain
+
+    @retval node number
+
+**/
+static uint16_t nodeof(const TOPOIDX* pIdx, uint32_t Domain)
+{
+    uint32_t lo = 0, hi = pIdx->nNodes, mid;
+
+    while (lo < hi)                                                 // binary search, the domain is present
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (pIdx->pNodeDomain[mid] < Domain)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (uint16_t)lo;
+}
+
+/** distance()
+
+    Fill the distance matrix from the SLIT. Localities not covered by the SLIT
+    get NUMA_LOCAL_DISTANCE and NUMA_REMOTE_DISTANCE.
+
+    @param[in] pIdx index to fill, pNodeDomain[] valid
+
+    @retval VOID
+
+**/
+static void distance(TOPOIDX* pIdx)
+{
+    const ACPITBLIDXENTRY* pEntry = __AcpiTblIdxFind('TILS', 0);
+    const uint8_t* pMatrix = NULL;
+    uint64_t N = 0;
+    uint32_t i, j;
+
+    if (NULL != pEntry && pEntry->Length >= sizeof(EFI_ACPI_6_2_SYSTEM_LOCALITY_DISTANCE_INFORMATION_TABLE_HEADER))
+    {
+        N = ((const EFI_ACPI_6_2_SYSTEM_LOCALITY_DISTANCE_INFORMATION_TABLE_HEADER*)pEntry->pTable)->NumberOfSystemLocalities;
+        pMatrix = (const uint8_t*)pEntry->pTable + sizeof(EFI_ACPI_6_2_SYSTEM_LOCALITY_DISTANCE_INFORMATION_TABLE_HEADER);
+
+        if (N > 0xFFFF || N * N > pEntry->Length - sizeof(EFI_ACPI_6_2_SYSTEM_LOCALITY_DISTANCE_INFORMATION_TABLE_HEADER))
+            N = 0;                                                  // damaged table
+    }
+
+    for (i = 0; i < pIdx->nNodes; i++)
+        for (j = 0; j < pIdx->nNodes; j++)
+            if (pIdx->pNodeDomain[i] < N && pIdx->pNodeDomain[j] < N)
+                pIdx->pDistance[i * pIdx->nNodes + j] = pMatrix[pIdx->pNodeDomain[i] * N + pIdx->pNodeDomain[j]];
+            else
+                pIdx->pDistance[i * pIdx->nNodes + j] = i == j ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+}
+
+/** affinityrecord()
+
+    Write a processor or NUMA node record with a group affinity for each group in use
+
+    @param[out] pBuf        receives the record, may be NULL to get the size only
+    @param[in] Relationship LOGPROCREL_CORE, LOGPROCREL_PACKAGE, LOGPROCREL_NUMANODE
+    @param[in] Value        PROCREL.Flags or NUMANODEREL.NodeNumber
+    @param[in] pMask        processor mask of each group
+    @param[in] nGroups      number of groups
+
+    @retval size of the record in bytes
+
+**/
+static uint32_t affinityrecord(uint8_t* pBuf, uint32_t Relationship, uint32_t Value, const uintptr_t* pMask, uint16_t nGroups)
+{
+    LOGPROCINFOEX* pInfo = (void*)pBuf;
+    GROUPAFFINITY* pGa;
+    uint16_t g, n = 0;
+    uint32_t Size;
+
+    for (g = 0; g < nGroups; g++)
+        n += 0 != pMask[g];
+
+    Size = (uint32_t)offsetof(LOGPROCINFOEX, Processor.GroupMask) + (0 == n ? 1 : n) * (uint32_t)sizeof(GROUPAFFINITY);
+
+    if (NULL != pInfo)
+    {
+        memset(pInfo, 0, Size);
+        pInfo->Relationship = Relationship;
+        pInfo->Size = Size;
+
+        if (LOGPROCREL_NUMANODE == Relationship)
+        {
+            pInfo->NumaNode.NodeNumber = Value;
+            pInfo->NumaNode.GroupCount = 0 == n ? 1 : n;            // memory only node: empty mask of group 0
+            pGa = pInfo->NumaNode.GroupMask;
+        }
+        else
+        {
+            pInfo->Processor.Flags = (uint8_t)Value;
+            pInfo->Processor.GroupCount = 0 == n ? 1 : n;
+            pGa = pInfo->Processor.GroupMask;
+        }
+
+        for (g = 0, n = 0; g < nGroups; g++)
+            if (0 != pMask[g])
+            {
+                pGa[n].Mask = pMask[g];
+                pGa[n++].Group = g;
+            }
+    }
+
+    return Size;
+}
+
+/** records()
+
+    Generate the LOGPROCINFOEX records of all relationships, sorted by relationship.
+    Cores and packages are runs of equal APIC ID >> shift in APIC ID order.
+
+    @param[in] pIdx     index, processors, nodes and groups valid
+    @param[out] pBuf    receives the records, may be NULL to get the size only
+    @param[in] pMask    scratch processor mask of each group
+
+    @retval size of all records in bytes
+
+**/
+static uint32_t records(TOPOIDX* pIdx, uint8_t* pBuf, uintptr_t* pMask)
+{
+    LOGPROCINFOEX* pInfo;
+    const TOPOCPU* pCpu;
+    uint32_t Rel, Offs = 0, i, j, n, Shift;
+    uint16_t g;
+
+    for (Rel = LOGPROCREL_CORE; Rel <= LOGPROCREL_GROUP; Rel++)
+    {
+        pIdx->InfoFirst[Rel] = Offs;
+
+        if (LOGPROCREL_CORE == Rel || LOGPROCREL_PACKAGE == Rel)
+        {
+            Shift = LOGPROCREL_CORE == Rel ? pIdx->SmtShift : pIdx->PkgShift;
+
+            for (i = 0; i < pIdx->nCpus; i = j)
+            {
+                memset(pMask, 0, pIdx->nGroups * sizeof(uintptr_t));
+
+                for (j = i, n = 0; j < pIdx->nCpus; j++, n++)
+                {
+                    pCpu = &pIdx->pCpu[pIdx->pApicOrder[j]];
+
+                    if (pCpu->ApicId >> Shift != pIdx->pCpu[pIdx->pApicOrder[i]].ApicId >> Shift)
+                        break;
+
+                    pMask[pCpu->Group] |= (uintptr_t)1 << pCpu->Number;
+                }
+
+                Offs += affinityrecord(NULL == pBuf ? NULL : &pBuf[Offs], Rel, LOGPROCREL_CORE == Rel && 1 < n ? LTP_PC_SMT : 0, pMask, pIdx->nGroups);
+            }
+        }
+        else if (LOGPROCREL_NUMANODE == Rel)
+        {
+            for (i = 0, j = 0; i < pIdx->nNodes; i++)               // processors are sorted by node
+            {
+                memset(pMask, 0, pIdx->nGroups * sizeof(uintptr_t));
+
+                for (; j < pIdx->nCpus && i == pIdx->pCpu[j].Node; j++)
+                    pMask[pIdx->pCpu[j].Group] |= (uintptr_t)1 << pIdx->pCpu[j].Number;
+
+                Offs += affinityrecord(NULL == pBuf ? NULL : &pBuf[Offs], Rel, i, pMask, pIdx->nGroups);
+            }
+        }
+        else if (LOGPROCREL_GROUP == Rel)
+        {
+            n = (uint32_t)offsetof(LOGPROCINFOEX, Group.GroupInfo) + pIdx->nGroups * (uint32_t)sizeof(PROCGROUPINFO);
+
+            if (NULL != pBuf)
+            {
+                pInfo = (void*)&pBuf[Offs];
+                memset(pInfo, 0, n);
+                pInfo->Relationship = Rel;
+                pInfo->Size = n;
+                pInfo->Group.MaximumGroupCount = pIdx->nGroups;
+                pInfo->Group.ActiveGroupCount = pIdx->nGroups;
+
+                for (i = 0; i < pIdx->nCpus; i++)
+                {
+                    g = pIdx->pCpu[i].Group;
+                    pInfo->Group.GroupInfo[g].MaximumProcessorCount++;
+                    pInfo->Group.GroupInfo[g].ActiveProcessorCount++;
+                    pInfo->Group.GroupInfo[g].ActiveProcessorMask |= (uintptr_t)1 << pIdx->pCpu[i].Number;
+                }
+            }
+
+            Offs += n;
+        }
+    }
+
+    pIdx->InfoFirst[LOGPROCREL_GROUP + 1] = Offs;
+
+    return Offs;
+}
+
+/** release()
+
+    Free all arrays of the index
+
+    @param[in] pIdx index
+
+    @retval VOID
+
+**/
+static void release(TOPOIDX* pIdx)
+{
+    free(pIdx->pCpu);
+    free(pIdx->pApicOrder);
+    free(pIdx->pNodeDomain);
+    free(pIdx->pDistance);
+    free(pIdx->pMem);
+    free(pIdx->pInfo);
+    memset(pIdx, 0, sizeof(TOPOIDX));
+}
+
+/** buildidx()
+
+    Parse MADT, SRAT and SLIT, number the processors and generate the records
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    index to fill
+    @param[out] Context     not used
+
+    @retval 1 success
+    @retval 0 out of memory
+
+**/
+static int buildidx(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    TOPOIDX* pIdx = Parameter;
+    uintptr_t* pMask = NULL;
+    uint32_t n, i, j, nNodeCpus;
+    uint16_t Group = 0, Number = 0;
+    int nRet = 0;
+
+    release(pIdx);
+    apicshift(pIdx);
+
+    do {
+
+        //
+        // enabled processors from MADT, the executing processor without MADT
+        //
+        n = madt(NULL);
+        pIdx->pCpu = malloc((0 == n ? 1 : n) * sizeof(TOPOCPU));
+        pIdx->pApicOrder = malloc((0 == n ? 1 : n) * sizeof(uint32_t));
+
+        if (NULL == pIdx->pCpu || NULL == pIdx->pApicOrder)
+            break;
+
+        if (0 == (pIdx->nCpus = madt(pIdx->pCpu)))
+        {
+            memset(pIdx->pCpu, 0, sizeof(TOPOCPU));
+            pIdx->pCpu[0].ApicId = __ApicId();
+            pIdx->pCpu[0].ProximityDomain = DOMAIN_NONE;
+            pIdx->nCpus = 1;
+        }
+
+        qsort(pIdx->pCpu, pIdx->nCpus, sizeof(TOPOCPU), cmpcpu);    // Node is 0 for all, sorted by APIC ID
+
+        for (i = 1, j = 1; i < pIdx->nCpus; i++)                    // drop duplicates listed as APIC and x2APIC
+            if (pIdx->pCpu[i].ApicId != pIdx->pCpu[j - 1].ApicId)
+                pIdx->pCpu[j++] = pIdx->pCpu[i];
+
+        pIdx->nCpus = j;
+
+        for (i = 0; i < pIdx->nCpus; i++)
+            pIdx->pApicOrder[i] = i;
+
+        //
+        // SRAT affinity, then the nodes as ascending proximity domains
+        //
+        n = srat(pIdx, NULL);
+        pIdx->pMem = malloc((0 == n ? 1 : n) * sizeof(TOPOMEM));
+        pIdx->pNodeDomain = malloc((pIdx->nCpus + n) * sizeof(uint32_t));
+
+        if (NULL == pIdx->pMem || NULL == pIdx->pNodeDomain)
+            break;
+
+        pIdx->nMem = srat(pIdx, pIdx->pMem);
+
+        for (i = 0; i < pIdx->nCpus; i++)
+            if (DOMAIN_NONE != pIdx->pCpu[i].ProximityDomain)
+                pIdx->pNodeDomain[pIdx->nNodes++] = pIdx->pCpu[i].ProximityDomain;
+
+        for (i = 0; i < pIdx->nMem; i++)
+            pIdx->pNodeDomain[pIdx->nNodes++] = pIdx->pMem[i].ProximityDomain;
+
+        if (0 == pIdx->nNodes)
+            pIdx->pNodeDomain[pIdx->nNodes++] = 0;                  // no SRAT, single node
+
+        qsort(pIdx->pNodeDomain, pIdx->nNodes, sizeof(uint32_t), cmpu32);
+
+        for (i = 1, j = 1; i < pIdx->nNodes; i++)
+            if (pIdx->pNodeDomain[i] != pIdx->pNodeDomain[j - 1])
+                pIdx->pNodeDomain[j++] = pIdx->pNodeDomain[i];
+
+        pIdx->nNodes = j;
+
+        for (i = 0; i < pIdx->nCpus; i++)
+        {
+            if (DOMAIN_NONE == pIdx->pCpu[i].ProximityDomain)       // no affinity, first node
+                pIdx->pCpu[i].ProximityDomain = pIdx->pNodeDomain[0];
+
+            pIdx->pCpu[i].Node = nodeof(pIdx, pIdx->pCpu[i].ProximityDomain);
+            pIdx->pCpu[i].CoreId = pIdx->pCpu[i].ApicId >> pIdx->SmtShift;
+            pIdx->pCpu[i].PackageId = pIdx->pCpu[i].ApicId >> pIdx->PkgShift;
+        }
+
+        for (i = 0; i < pIdx->nMem; i++)
+            pIdx->pMem[i].Node = nodeof(pIdx, pIdx->pMem[i].ProximityDomain);
+
+        qsort(pIdx->pMem, pIdx->nMem, sizeof(TOPOMEM), cmpmem);
+
+        //
+        // distances
+        //
+        pIdx->pDistance = malloc(pIdx->nNodes * pIdx->nNodes);
+
+        if (NULL == pIdx->pDistance)
+            break;
+
+        distance(pIdx);
+
+        //
+        // logical processor numbers by node and APIC ID, a node starts a new group if it doesn't fit
+        //
+        qsort(pIdx->pCpu, pIdx->nCpus, sizeof(TOPOCPU), cmpcpu);
+
+        for (i = 0; i < pIdx->nCpus; i++)
+        {
+            if (0 == i || pIdx->pCpu[i].Node != pIdx->pCpu[i - 1].Node)
+            {
+                for (j = i; j < pIdx->nCpus && pIdx->pCpu[j].Node == pIdx->pCpu[i].Node; j++)
+                    ;
+
+                nNodeCpus = j - i < MAXIMUM_PROC_PER_GROUP ? j - i : MAXIMUM_PROC_PER_GROUP;
+
+                if (0 != Number && Number + nNodeCpus > MAXIMUM_PROC_PER_GROUP)
+                    Group++, Number = 0;
+            }
+
+            if (MAXIMUM_PROC_PER_GROUP == Number)
+                Group++, Number = 0;
+
+            pIdx->pCpu[i].Group = Group;
+            pIdx->pCpu[i].Number = (uint8_t)Number++;
+        }
+
+        pIdx->nGroups = Group + 1;
+
+        pSort = pIdx;
+        qsort(pIdx->pApicOrder, pIdx->nCpus, sizeof(uint32_t), cmpapic);
+        pSort = NULL;
+
+        //
+        // LOGPROCINFOEX records
+        //
+        pMask = malloc(pIdx->nGroups * sizeof(uintptr_t));
+
+        if (NULL == pMask)
+            break;
+
+        pIdx->cbInfo = records(pIdx, NULL, pMask);
+        pIdx->pInfo = malloc(pIdx->cbInfo);
+
+        if (NULL == pIdx->pInfo)
+            break;
+
+        records(pIdx, pIdx->pInfo, pMask);
+
+        nRet = 1;
+
+    } while (0);
+
+    free(pMask);
+
+    if (0 == nRet)
+        release(pIdx);
+
+    return nRet;
+}
+
+/** __ApicId()
+Synopsis
+    uint32_t __ApicId(void);
+Description
+    Get the x2APIC ID of the executing processor from CPUID leaf 0Bh,
+    the initial APIC ID from CPUID leaf 1 otherwise. Safe on APs.
+Paramters
+    none
+Returns
+    APIC ID
+**/
+uint32_t __ApicId(void)
+{
+    int regs[4];
+
+    __cpuid(regs, 0);
+
+    if (regs[0] >= 0xB)
+    {
+        __cpuidex(regs, 0xB, 0);
+
+        if (0 != (regs[1] & 0xFFFF))
+            return (uint32_t)regs[3];
+    }
+
+    __cpuid(regs, 1);
+
+    return (uint32_t)regs[1] >> 24;
+}
+
+/** __TopologyIdxFindApic()
+Synopsis
+    const TOPOCPU* __TopologyIdxFindApic(uint32_t ApicId);
+Description
+    Get the processor with the given APIC ID from the index being built or the index
+Paramters
+    uint32_t ApicId :   x2APIC ID or local APIC ID
+Returns
+    pointer to the processor
+    NULL, if not found
+**/
+const TOPOCPU* __TopologyIdxFindApic(uint32_t ApicId)
+{
+    const TOPOIDX* pIdx = &TopologyIdx;
+    const TOPOCPU* pRet = NULL;
+    uint32_t lo = 0, hi = pIdx->nCpus, mid;
+
+    while (lo < hi)                                                 // binary search in APIC ID order
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (pIdx->pCpu[pIdx->pApicOrder[mid]].ApicId < ApicId)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < pIdx->nCpus && ApicId == pIdx->pCpu[pIdx->pApicOrder[lo]].ApicId)
+        pRet = &pIdx->pCpu[pIdx->pApicOrder[lo]];
+
+    return pRet;
+}
+
+/** __TopologyIdxGet()
+Synopsis
+    TOPOIDX* __TopologyIdxGet(void);
+Description
+    Get the topology index. The index is built on first use.
+Paramters
+    none
+Returns
+    pointer to the index
+    NULL, if out of memory
+**/
+TOPOIDX* __TopologyIdxGet(void)
+{
+    return 0 != InitOnceExecuteOnce4UEFI(&TopologyOnce, buildidx, &TopologyIdx, NULL) ? &TopologyIdx : NULL;
+}
+
+/** TopologyIndexRebuild4UEFI()
+Synopsis
+    int TopologyIndexRebuild4UEFI(void);
+Description
+    Discard and rebuild the topology index, e.g. after the ACPI table index was rebuilt
+Paramters
+    none
+Returns
+    number of logical processors in the index
+    0, if out of memory
+**/
+int TopologyIndexRebuild4UEFI(void)
+{
+    int nRet;
+    INSTR_ENTER();
+
+    release(&TopologyIdx);
+    InitOnceInitialize4UEFI(&TopologyOnce);
+
+    nRet = NULL == __TopologyIdxGet() ? 0 : (int)TopologyIdx.nCpus;
+
+    INSTR_LEAVE(TopologyIndexRebuild, 0);
+
+    return nRet;
+}
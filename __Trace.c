@@ -0,0 +1,490 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __Trace.c
+
+Abstract:
+
+    Binary event trace into per processor rings
+
+    An event is written by the executing processor into its own ring. The slot is
+    reserved by an interlocked increment of the ring head, the event becomes valid
+    by storing its position last. Processors not listed in the topology index share
+    an additional ring, the reservation keeps them apart.
+
+    The ring of the executing processor is the position of its APIC ID in the
+    topology index, looked up by binary search for each event. The APIC ID is read
+    by a single CPUID, the leaf is chosen once by TraceStart4UEFI(). No processor
+    state is changed, IA32_TSC_AUX is left to the OS loaded later.
+
+--*/
+#include <uefi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <intrin.h>
+#include "Win324UEFI.h"
+
+#pragma intrinsic (__rdtsc, _ReturnAddress, _InterlockedIncrement64, _ReadWriteBarrier)
+
+#define TRACEARG_NONE       0
+#define TRACEARG_DEC        1           // decimal
+#define TRACEARG_HEX        2           // hexadecimal
+#define TRACEARG_CHR4       3           // multi character constant, e.g. 'ACPI'
+#define TRACEARG_SIG        4           // table signature in memory order, e.g. 'TDSS' for "SSDT"
+
+typedef struct _TRACERING {
+    volatile int64_t Head;              // number of events reserved
+    uint64_t Mask;                      // number of slots - 1
+    TRACEEVENT* pEvent;                 // slots
+    uint8_t Pad[40];                    // one cache line per ring
+}TRACERING;
+
+typedef struct _TRACEDESC {
+    const char* strName;
+    uint8_t ArgType[4];                 // TRACEARG_...
+    const char* strArg[4];
+}TRACEDESC;
+
+static const TRACEDESC TraceDesc[TRACEID_MAX] = {
+    [TRACEID_GetSystemFirmwareTable] = { "GetSystemFirmwareTable -->",
+        { TRACEARG_CHR4, TRACEARG_SIG, TRACEARG_HEX, TRACEARG_DEC }, { "Provider", "TableID", "Buffer", "BufferSize" } },
+    [TRACEID_GetSystemFirmwareTableAcpi] = { "GetSystemFirmwareTable <--",
+        { TRACEARG_DEC, TRACEARG_DEC, TRACEARG_HEX, TRACEARG_NONE }, { "nRet", "Instance", "Address" } },
+};
+
+static TRACERING* pRing;                                            // nRings, the last one shared
+static uint32_t nRings;
+static volatile bool fEnabled;
+static bool fLeafB;                                                 // x2APIC ID from CPUID leaf 0Bh
+
+/** apicid()
+
+    Get the APIC ID of the executing processor, same as __ApicId() with the CPUID
+    leaf chosen by TraceStart4UEFI()
+
+    @param[in] VOID
+
+    @retval APIC ID
+
+**/
+static uint32_t apicid(void)
+{
+    int regs[4];
+
+    if (fLeafB)
+        __cpuidex(regs, 0xB, 0);
+    else
+        __cpuid(regs, 1);
+
+    return fLeafB ? (uint32_t)regs[3] : (uint32_t)regs[1] >> 24;
+}
+
+/** ringof()
+
+    Get the ring of a processor from its APIC ID
+
+    @param[in] ApicId   APIC ID of the processor
+
+    @retval ring number, the shared ring for processors not in the topology index
+
+**/
+static uint32_t ringof(uint32_t ApicId)
+{
+    const TOPOIDX* pIdx = __TopologyIdxGet();
+    const TOPOCPU* pCpu = NULL == pIdx ? NULL : __TopologyIdxFindApic(ApicId);
+    uint32_t Ring = nRings - 1;
+
+    if (NULL != pCpu && (uint32_t)(pCpu - pIdx->pCpu) < nRings - 1)   // not rebuilt with more processors
+        Ring = (uint32_t)(pCpu - pIdx->pCpu);
+
+    return Ring;
+}
+
+/** release()
+
+    Free the rings
+
+    @param[in] VOID
+
+    @retval VOID
+
+**/
+static void release(void)
+{
+    uint32_t r;
+
+    for (r = 0; NULL != pRing && r < nRings; r++)
+        free(pRing[r].pEvent);
+
+    free(pRing);
+    pRing = NULL;
+    nRings = 0;
+}
+
+/** cmpevent()
+
+    qsort() callback, order events by TSC, ring and position
+
+    @param[in] p1   event
+    @param[in] p2   event
+
+    @retval -1, 0, 1
+
+**/
+static int cmpevent(const void* p1, const void* p2)
+{
+    const TRACEEVENT* e1 = p1, * e2 = p2;
+
+    if (e1->Tsc != e2->Tsc)
+        return e1->Tsc < e2->Tsc ? -1 : 1;
+
+    if (e1->Cpu != e2->Cpu)
+        return e1->Cpu < e2->Cpu ? -1 : 1;
+
+    return e1->Seq < e2->Seq ? -1 : (e1->Seq > e2->Seq);
+}
+
+/** collect()
+
+    Copy the valid events of all rings and sort them by TSC. Events overwritten or
+    being written during the copy are skipped.
+
+    @param[out] pEvent  receives the events, may be NULL
+    @param[in]  nMax    number of events pEvent can take
+    @param[out] pnLost  receives the number of events overwritten
+
+    @retval number of events available, may exceed nMax
+
+**/
+static uint32_t collect(TRACEEVENT* pEvent, uint32_t nMax, uint64_t* pnLost)
+{
+    TRACEEVENT Event;
+    uint64_t qwHead, i;
+    uint32_t r, nRet = 0;
+
+    *pnLost = 0;
+
+    for (r = 0; r < nRings; r++)
+    {
+        qwHead = (uint64_t)pRing[r].Head;
+        *pnLost += qwHead > pRing[r].Mask + 1 ? qwHead - pRing[r].Mask - 1 : 0;
+
+        for (i = 0; i <= pRing[r].Mask; i++)
+        {
+            Event = pRing[r].pEvent[i];
+            _ReadWriteBarrier();
+
+            if (0 == Event.Seq || Event.Seq > qwHead || Event.Seq + pRing[r].Mask < qwHead || Event.Seq != pRing[r].pEvent[i].Seq)
+                continue;
+
+            if (NULL != pEvent && nRet < nMax)
+                pEvent[nRet] = Event;
+
+            nRet++;
+        }
+    }
+
+    if (NULL != pEvent)
+        qsort(pEvent, nRet < nMax ? nRet : nMax, sizeof(TRACEEVENT), cmpevent);
+
+    return nRet;
+}
+
+/** printarg()
+
+    Print an argument of an event
+
+    @param[in] fp       output stream
+    @param[in] Type     TRACEARG_...
+    @param[in] strName  argument name, NULL for an unnamed argument
+    @param[in] qwArg    argument
+
+    @retval VOID
+
+**/
+static void printarg(FILE* fp, uint8_t Type, const char* strName, uint64_t qwArg)
+{
+    char c[4];
+    uint32_t i;
+
+    if (NULL != strName)
+        fprintf(fp, " %s ", strName);
+    else
+        fprintf(fp, " ");
+
+    for (i = 0; i < 4; i++)                                         // printable characters only
+    {
+        c[i] = (char)(0xFF & (TRACEARG_CHR4 == Type ? qwArg >> (24 - 8 * i) : qwArg >> (8 * i)));
+        c[i] = ' ' <= c[i] && c[i] <= '~' ? c[i] : '.';
+    }
+
+    if (TRACEARG_DEC == Type)
+        fprintf(fp, "%lld", (long long)qwArg);
+    else if (TRACEARG_CHR4 == Type || TRACEARG_SIG == Type)
+        fprintf(fp, "%c%c%c%c", c[0], c[1], c[2], c[3]);
+    else
+        fprintf(fp, "0x%llX", (unsigned long long)qwArg);
+}
+
+/** TraceStart4UEFI()
+Synopsis
+    int TraceStart4UEFI(uint32_t nEventsPerCpu);
+Description
+    Allocate the rings and start recording. Events recorded before are discarded.
+
+    NOTE: Call on the BSP only, the rings are allocated from boot services memory.
+          No processor may record an event meanwhile, since the former rings are freed.
+Paramters
+    uint32_t nEventsPerCpu  :   number of events per processor, rounded up to a power of 2
+Returns
+    1, success
+    0, failure, last error is set
+**/
+int TraceStart4UEFI(uint32_t nEventsPerCpu)
+{
+    const TOPOIDX* pIdx;
+    uint64_t nSlots;
+    uint32_t r;
+    int regs[4], nRet = 0;
+
+    do {
+
+        if (0 <= __ThreadPoolSelf() || 0 == nEventsPerCpu || nEventsPerCpu > 0x80000000)
+        {
+            SetLastError4UEFI(0 <= __ThreadPoolSelf() ? ERROR_NOT_SUPPORTED : ERROR_INVALID_PARAMETER);
+            break;
+        }
+
+        fEnabled = false;
+        release();
+
+        if (NULL == (pIdx = __TopologyIdxGet()))
+        {
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        for (nSlots = 1; nSlots < nEventsPerCpu; nSlots <<= 1)
+            ;
+
+        nRings = pIdx->nCpus + 1;
+        pRing = calloc(nRings, sizeof(TRACERING));
+
+        for (r = 0; NULL != pRing && r < nRings; r++)
+        {
+            pRing[r].Mask = nSlots - 1;
+
+            if (NULL == (pRing[r].pEvent = calloc((size_t)nSlots, sizeof(TRACEEVENT))))
+                break;
+        }
+
+        if (NULL == pRing || r < nRings)
+        {
+            release();
+            SetLastError4UEFI(ERROR_NOT_ENOUGH_MEMORY);
+            break;
+        }
+
+        __cpuid(regs, 0);                                           // same choice as __ApicId()
+        fLeafB = regs[0] >= 0xB;
+
+        if (fLeafB)
+        {
+            __cpuidex(regs, 0xB, 0);
+            fLeafB = 0 != (regs[1] & 0xFFFF);
+        }
+
+        _ReadWriteBarrier();
+        fEnabled = true;
+        nRet = 1;
+
+    } while (0);
+
+    return nRet;
+}
+
+/** TraceStop4UEFI()
+Synopsis
+    void TraceStop4UEFI(void);
+Description
+    Stop recording. The events recorded are kept for TraceDump4UEFI() and
+    TracePrint4UEFI() until the next TraceStart4UEFI(). Safe on APs.
+Paramters
+    none
+Returns
+    none
+**/
+void TraceStop4UEFI(void)
+{
+    fEnabled = false;
+}
+
+/** TraceEvent4UEFI()
+Synopsis
+    void TraceEvent4UEFI(uint32_t Id, uint64_t Arg0, uint64_t Arg1, uint64_t Arg2, uint64_t Arg3);
+Description
+    Record an event into the ring of the executing processor. Safe on APs.
+    Without TraceStart4UEFI() or after TraceStop4UEFI() nothing is recorded.
+Paramters
+    uint32_t Id     :   TRACEID_..., TRACEID_USER and above for application events
+    uint64_t Arg0   :   arguments
+    uint64_t Arg1   :
+    uint64_t Arg2   :
+    uint64_t Arg3   :
+Returns
+    none
+**/
+void TraceEvent4UEFI(uint32_t Id, uint64_t Arg0, uint64_t Arg1, uint64_t Arg2, uint64_t Arg3)
+{
+    TRACERING* pR;
+    TRACEEVENT* pEvent;
+    uint64_t qwTsc, qwPos;
+    uint32_t ApicId, Ring;
+
+    if (fEnabled)
+    {
+        qwTsc = __rdtsc();
+        ApicId = apicid();
+        Ring = ringof(ApicId);
+
+        pR = &pRing[Ring];
+        qwPos = (uint64_t)_InterlockedIncrement64(&pR->Head);
+        pEvent = &pR->pEvent[(qwPos - 1) & pR->Mask];
+
+        pEvent->Seq = 0;
+        _ReadWriteBarrier();                                        // x64 stores are not reordered with older stores
+
+        pEvent->Tsc = qwTsc;
+        pEvent->Caller = (uint64_t)(uintptr_t)_ReturnAddress();
+        pEvent->ApicId = ApicId;
+        pEvent->Cpu = (uint16_t)Ring;
+        pEvent->Id = (uint16_t)Id;
+        pEvent->Arg[0] = Arg0;
+        pEvent->Arg[1] = Arg1;
+        pEvent->Arg[2] = Arg2;
+        pEvent->Arg[3] = Arg3;
+
+        _ReadWriteBarrier();
+        pEvent->Seq = qwPos;
+    }
+}
+
+/** TraceDump4UEFI()
+Synopsis
+    uint32_t TraceDump4UEFI(void* pBuffer, uint32_t BufferSize);
+Description
+    Write all events recorded as a binary blob:
+
+        TRACEDUMPHDR, followed by TRACEEVENT[] in TSC order
+
+    Same as with GetSystemFirmwareTable(), the required size is returned, if the
+    buffer is too small.
+Paramters
+    void* pBuffer           :   receives the blob, may be NULL
+    uint32_t BufferSize     :   size of pBuffer in bytes
+Returns
+    number of bytes written to the buffer, or required buffer size
+**/
+uint32_t TraceDump4UEFI(void* pBuffer, uint32_t BufferSize)
+{
+    TRACEDUMPHDR* pHdr = pBuffer;
+    uint64_t nLost;
+    uint32_t nMax = 0, nEvents, nRet;
+
+    if (NULL != pBuffer && BufferSize >= sizeof(TRACEDUMPHDR))
+        nMax = (BufferSize - sizeof(TRACEDUMPHDR)) / sizeof(TRACEEVENT);
+
+    nEvents = collect(0 == nMax ? NULL : (TRACEEVENT*)&pHdr[1], nMax, &nLost);
+    nRet = sizeof(TRACEDUMPHDR) + nEvents * sizeof(TRACEEVENT);
+
+    if (NULL != pBuffer && BufferSize >= nRet)
+    {
+        pHdr->Signature = TRACEDUMP_SIGNATURE;
+        pHdr->HdrSize = sizeof(TRACEDUMPHDR);
+        pHdr->nEvents = nEvents;
+        pHdr->EventSize = sizeof(TRACEEVENT);
+        pHdr->TscPerSec = __TscPerSec();
+        pHdr->nLost = nLost;
+    }
+
+    return nRet;
+}
+
+/** TracePrint4UEFI()
+Synopsis
+    uint32_t TracePrint4UEFI(const char* strFileName);
+Description
+    Decode all events recorded in TSC order to text: time in us since the first event,
+    processor, APIC ID, return address into the trace site, event name and arguments
+Paramters
+    const char* strFileName :   output file, NULL for stdout
+Returns
+    number of events printed
+    0, if the output file can not be opened or the events do not fit into memory
+**/
+uint32_t TracePrint4UEFI(const char* strFileName)
+{
+    TRACEEVENT* pEvent = NULL;
+    const TRACEDESC* pDesc;
+    double usPerTsc = 1.0E6 / (double)__TscPerSec();
+    uint64_t nLost;
+    uint32_t n, i, a, nRet = 0;
+    FILE* fp = NULL;
+
+    do {
+
+        n = collect(NULL, 0, &nLost);
+
+        if (0 != n && NULL == (pEvent = malloc(n * sizeof(TRACEEVENT))))
+            break;
+
+        i = collect(pEvent, n, &nLost);
+        n = i < n ? i : n;                                          // no more than counted before
+
+        if (NULL == (fp = NULL == strFileName ? stdout : fopen(strFileName, "w")))
+            break;
+
+        fprintf(fp, "%u events, %llu lost\n", n, (unsigned long long)nLost);
+
+        for (i = 0; i < n; i++)
+        {
+            pDesc = pEvent[i].Id < TRACEID_MAX ? &TraceDesc[pEvent[i].Id] : NULL;
+
+            fprintf(fp, "%14.3f %4u %5u %016llX ", (double)(pEvent[i].Tsc - pEvent[0].Tsc) * usPerTsc,
+                pEvent[i].Cpu, pEvent[i].ApicId, (unsigned long long)pEvent[i].Caller);
+
+            if (NULL != pDesc && NULL != pDesc->strName)
+                fprintf(fp, "%s", pDesc->strName);
+            else
+                fprintf(fp, "event 0x%04X", pEvent[i].Id);
+
+            for (a = 0; a < 4; a++)
+            {
+                if (NULL == pDesc || NULL == pDesc->strName)
+                    printarg(fp, TRACEARG_HEX, NULL, pEvent[i].Arg[a]);
+                else if (TRACEARG_NONE != pDesc->ArgType[a])
+                    printarg(fp, pDesc->ArgType[a], pDesc->strArg[a], pEvent[i].Arg[a]);
+            }
+
+            fprintf(fp, "\n");
+        }
+
+        nRet = n;
+
+    } while (0);
+
+    if (NULL != fp && stdout != fp)
+        fclose(fp);
+
+    free(pEvent);
+
+    return nRet;
+}
@@ -0,0 +1,598 @@
+/*++
+
+Copyright (c) 2021-2022, Kilian Kegel. All rights reserved.<BR>
+
+    SPDX-License-Identifier: GNU General Public License v3.0 only
+
+Module Name:
+
+    __TscPerSec.c
+
+Abstract:
+
+    One-time calibration of the TimeStampCounter (TSC) frequency.
+
+    The frequency is taken from CPUID leaf 15h, if the processor reports an
+    invariant TSC and the TSC/crystal ratio and crystal clock. Otherwise the TSC is
+    calibrated once against the first available reference clock of
+        1. the HPET main counter, address taken from the HPET table
+        2. the ACPI PM timer, port taken from the FADT X_PM_TMR_BLK/PM_TMR_BLK
+    or, if none of them is available, taken from the CPUID leaf 16h base frequency.
+    The 8254 PIT is the last resort. The result is cached for all timing functions,
+    the calibration runs once by InitOnceExecuteOnce(), also on concurrent first use.
+
+    HPET and PM timer are sampled on counter edges, each edge bracketed by two TSC
+    reads. The window ends as soon as the bracket widths fall below CAL_TARGET_PPM of
+    the elapsed time, but after CAL_MAX_WINDOW_US at most, instead of the 50ms of the PIT.
+
+--*/
+
+#include <uefi.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <intrin.h>
+#include <IndustryStandard/Acpi62.h>
+#include <IndustryStandard/HighPrecisionEventTimerTable.h>
+#include "Win324UEFI.h"
+
+extern void _disable(void);
+extern void _enable(void);
+
+#pragma intrinsic (_disable, _enable)
+
+#define TIMER 2
+
+#define CAL_TARGET_PPM      10          // stop, if the error estimate is below 10ppm...
+#define CAL_MIN_WINDOW_US   1000        // ... but not before 1ms...
+#define CAL_MAX_WINDOW_US   20000       // ... and not after 20ms
+#define CAL_START_EDGES     8           // the narrowest of the first edges starts the window
+#define CAL_DEAD_READS      100000      // reference clock is dead, if no edge within that many reads
+
+#define HPET_GCAP_ID        0x000       // general capabilities and ID register, period in fs in bits 63:32
+#define HPET_GEN_CONF       0x010       // general configuration register
+#define HPET_ENABLE_CNF     (1ULL << 0)
+#define HPET_MAIN_CNT       0x0F0       // main counter value register
+#define HPET_MAX_PERIOD     100000000   // 100ns in fs, maximum period allowed by the specification
+
+#define PMTMR_FREQ          3579545     // ACPI PM timer frequency
+#define FADT_TMR_VAL_EXT    (1 << 8)    // 32 bit PM timer, otherwise 24 bit
+#define GAS_SYSTEM_MEMORY   0
+#define GAS_SYSTEM_IO       1
+
+typedef struct _REFCLK {
+    uint32_t (*pfnRead)(uintptr_t Address);
+    uintptr_t Address;                  // MMIO address or I/O port of the counter
+    uint32_t Mask;                      // counter width
+    uint64_t PerSec;                    // counts per second
+    uint32_t Last;                      // value of the last read
+    uint64_t LastTsc;                   // TSC before the last read
+}REFCLK;
+
+typedef struct _REFEDGE {
+    uint32_t Count;                     // new counter value
+    uint64_t Tsc;                       // TSC in the middle of the bracket
+    uint64_t Width;                     // TSC counts between the read before the edge and the read after
+}REFEDGE;
+
+static uint64_t qwTscPerSec = 0;
+static TSCCALSRC TscCalSrc = TSCCALSRC_NONE;
+static INITONCE TscInitOnce = INITONCE_STATIC_INIT;
+
+/** calibratecpuid()
+
+    Get the TSC frequency from CPUID leaf 15h "Time Stamp Counter and Nominal Core Crystal Clock"
+    If the crystal clock is not enumerated, derive it from the base frequency in CPUID leaf 16h.
+
+    NOTE: Only used with an invariant TSC, CPUID 80000007h EDX[8]
+
+    @param[out] pSrc calibration source
+
+    @retval number of CPU clock per second
+    @retval 0, if not available
+
+**/
+static uint64_t calibratecpuid(TSCCALSRC* pSrc)
+{
+    int regs[4];    // EAX, EBX, ECX, EDX
+    uint64_t qwRet = 0;
+    unsigned maxleaf, maxextleaf;
+
+    do {
+        __cpuid(regs, 0x80000000);
+        maxextleaf = (unsigned)regs[0];
+
+        if (maxextleaf < 0x80000007)
+            break;
+
+        __cpuid(regs, 0x80000007);
+        if (0 == (regs[3] & (1 << 8)))                      // invariant TSC?
+            break;
+
+        __cpuid(regs, 0);
+        maxleaf = (unsigned)regs[0];
+
+        if (maxleaf < 0x15)
+            break;
+
+        __cpuid(regs, 0x15);
+        if (0 == regs[0] || 0 == regs[1])                   // TSC/crystal ratio not enumerated
+            break;
+
+        if (0 != regs[2])                                   // crystal clock frequency enumerated
+        {
+            qwRet = (uint64_t)(unsigned)regs[2] * (unsigned)regs[1] / (unsigned)regs[0];
+            *pSrc = TSCCALSRC_CPUID15;
+        }
+        else if (maxleaf >= 0x16)
+        {
+            //
+            // crystal = base * denominator / numerator -> TSC = crystal * numerator / denominator ->
+            // TSC = processor base frequency
+            //
+            __cpuid(regs, 0x16);
+            if (0 == (regs[0] & 0xFFFF))                    // base frequency in MHz
+                break;
+
+            qwRet = (uint64_t)(regs[0] & 0xFFFF) * 1000000ULL;
+            *pSrc = TSCCALSRC_CPUID16;
+        }
+
+    } while (0);
+
+    return qwRet;
+}
+
+/** calibratepit()
+
+    calibratepit() returns the TimeStampCounter counts per second
+
+    NTSC Color Subcarrier:  f = 3.579545MHz * 4 ->
+                            f = 14.31818MHz / 12 -> 1.193181818...MHz
+    PIT 8254 input clk:     f = 1.193181818MHz
+                            f = 11931818181Hz / 59659 ->
+                            f = 20Hz -> t = 1/f
+                            t = 50ms
+                            ========
+                            50ms * 20 ->
+
+                                  1s
+                            ===============
+
+    @param[in] VOID
+
+    @retval number of CPU clock per second
+
+**/
+static uint64_t calibratepit(void)
+{
+    size_t eflags = __readeflags();         // save flaags
+    unsigned long long qwTSCPerTick, qwTSCEnd, qwTSCStart, qwTSCDrift;
+    unsigned char counterLoHi[2];
+    unsigned short* pwCount = (unsigned short*)&counterLoHi[0];
+    unsigned short wCountDrift;
+
+    _disable();
+
+    outp(0x61, 0);                          // stop counter
+    outp(0x43, (TIMER << 6) + 0x34);        // program timer 2 for MODE 2
+    outp(0x42, 0xFF);                       // write counter value low 65535
+    outp(0x42, 0xFF);                       // write counter value high 65535
+    outp(0x61, 1);                          // start counter
+
+    qwTSCStart = __rdtsc();                 // get TSC start
+
+    //
+    // repeat counter latch command until 50ms
+    //
+    do                                                      //
+    {                                                       //
+        outp(0x43, (TIMER << 6) + 0x0);                     // counter latch timer 2
+        counterLoHi[0] = (unsigned char)inp(0x40 + TIMER);  // get low byte
+        counterLoHi[1] = (unsigned char)inp(0x40 + TIMER);  // get high byte
+                                                            //
+    } while (*pwCount > (65535 - 59659));                   // until 59659 ticks gone
+
+    qwTSCEnd = __rdtsc();                                   // get TSC end ~50ms
+
+    *pwCount = 65535 - *pwCount;                            // get true, not inverted, number of clock ticks...
+                                                            // ... that really happened
+    wCountDrift = *pwCount - 59659;                         // get the number of additional ticks gone through
+
+    //
+    // approximate the additional number of TSC
+    //
+    qwTSCPerTick = (qwTSCEnd - qwTSCStart) / *pwCount;      // get number of CPU TSC per 8254 ClkTick (1,19MHz)
+    qwTSCDrift = wCountDrift * qwTSCPerTick;                // get TSC drift
+
+    //printf("PITticks gone: %04d, PITticksDrift: %04d, TSCPerTick: %lld, TSCDrift: %5lld, TSC end/start diff: %lld, end - start - TSCDrift: %lld, TSC/Sec: %lld\n",
+    //    *pwCount,                                         /* PITticks gone            */
+    //    wCountDrift,                                      /* PITticksDrift            */
+    //    qwTSCPerTick,                                     /* TSCPerTick               */
+    //    qwTSCDrift,                                       /* TSCDrift                 */
+    //    qwTSCEnd - qwTSCStart,                            /* TSC end/start diff       */
+    //    qwTSCEnd - qwTSCDrift - qwTSCStart,               /* end - start - TSCDrift   */
+    //    20 * (qwTSCEnd - qwTSCStart - qwTSCDrift)         /* TSC/Sec                  */
+    //);
+
+    if (0x200 & eflags)                                     // restore IF interrupt flag
+        _enable();
+
+    return 20 * (qwTSCEnd - qwTSCStart - qwTSCDrift);       // subtract the drift from TSC difference, scale to 1 second
+}
+
+/** readmmio32()
+
+    Read a 32 bit memory mapped counter
+
+    @param[in] Address counter address
+
+    @retval counter value
+
+**/
+static uint32_t readmmio32(uintptr_t Address)
+{
+    return *(volatile uint32_t*)Address;
+}
+
+/** readio32()
+
+    Read a 32 bit I/O port counter
+
+    @param[in] Address counter port
+
+    @retval counter value
+
+**/
+static uint32_t readio32(uintptr_t Address)
+{
+    return (uint32_t)inpd((unsigned short)Address);
+}
+
+/** nextedge()
+
+    Poll the reference clock until its value changes. The change happened after
+    the previous read and before the current one, both are bracketed by the TSC.
+
+    @param[in,out] pClk     reference clock
+    @param[out] pEdge       new counter value and TSC bracket
+
+    @retval true    success
+    @retval false   the counter does not count
+
+**/
+static bool nextedge(REFCLK* pClk, REFEDGE* pEdge)
+{
+    uint64_t qwTsc0, qwTsc1;
+    uint32_t i, Count;
+
+    for (i = 0; i < CAL_DEAD_READS; i++)
+    {
+        qwTsc0 = __rdtsc();
+        Count = pClk->pfnRead(pClk->Address) & pClk->Mask;
+        qwTsc1 = __rdtsc();
+
+        if (Count != pClk->Last)
+        {
+            pEdge->Count = Count;
+            pEdge->Width = qwTsc1 - pClk->LastTsc;
+            pEdge->Tsc = pClk->LastTsc + pEdge->Width / 2;
+            pClk->Last = Count;
+            pClk->LastTsc = qwTsc0;
+            return true;
+        }
+
+        pClk->LastTsc = qwTsc0;
+    }
+
+    return false;
+}
+
+/** calibrateref()
+
+    Calibrate the TSC against a reference clock with an adaptive window
+
+    The error of the TSC difference of two edges is at most the sum of the half
+    bracket widths. Edges are taken until that error drops below CAL_TARGET_PPM of
+    the elapsed time or CAL_MAX_WINDOW_US has passed.
+
+    @param[in] pClk reference clock, pfnRead, Address, Mask and PerSec set
+
+    @retval number of CPU clock per second
+    @retval 0, if the reference clock does not count
+
+**/
+static uint64_t calibrateref(REFCLK* pClk)
+{
+    size_t eflags = __readeflags();
+    uint64_t qwRet = 0, qwMinCount = pClk->PerSec * CAL_MIN_WINDOW_US / 1000000, qwMaxCount = pClk->PerSec * CAL_MAX_WINDOW_US / 1000000;
+    REFEDGE Start = { 0 }, Edge;
+    uint32_t i;
+
+    _disable();
+
+    do {
+        pClk->LastTsc = __rdtsc();
+        pClk->Last = pClk->pfnRead(pClk->Address) & pClk->Mask;
+
+        for (i = 0; i < CAL_START_EDGES; i++)
+        {
+            if (false == nextedge(pClk, &Edge))
+                break;
+
+            if (0 == i || Edge.Width < Start.Width)
+                Start = Edge;
+        }
+
+        if (i < CAL_START_EDGES)
+            break;
+
+        while (nextedge(pClk, &Edge))
+        {
+            uint64_t qwCount = (Edge.Count - Start.Count) & pClk->Mask;
+            uint64_t qwTsc = Edge.Tsc - Start.Tsc;
+
+            if (qwCount < qwMinCount)
+                continue;
+
+            if (qwCount >= qwMaxCount || (Start.Width + Edge.Width) / 2 * 1000000 <= CAL_TARGET_PPM * qwTsc)
+            {
+                qwRet = qwTsc * pClk->PerSec / qwCount;
+                break;
+            }
+        }
+
+    } while (0);
+
+    if (0x200 & eflags)                                     // restore IF interrupt flag
+        _enable();
+
+    return qwRet;
+}
+
+/** calibratehpet()
+
+    Calibrate the TSC against the HPET main counter. The counter is enabled
+    temporarily, if it is halted.
+
+    @param[in] VOID
+
+    @retval number of CPU clock per second
+    @retval 0, if not available
+
+**/
+static uint64_t calibratehpet(void)
+{
+    const ACPITBLIDXENTRY* pEntry = __AcpiTblIdxFind('TEPH', 0);
+    const EFI_ACPI_HIGH_PRECISION_EVENT_TIMER_TABLE_HEADER* pHpet;
+    REFCLK Clk = { readmmio32, 0, 0xFFFFFFFF, 0 };
+    uint64_t qwRet = 0, qwConf, qwPeriod;
+    uintptr_t Base;
+
+    do {
+        if (NULL == pEntry || NULL == __AcpiTblIdxGet()->pRsdp)     // not available or snapshot replayed
+            break;
+
+        if (pEntry->Length < sizeof(EFI_ACPI_HIGH_PRECISION_EVENT_TIMER_TABLE_HEADER))
+            break;
+
+        pHpet = pEntry->pTable;
+
+        if (GAS_SYSTEM_MEMORY != pHpet->BaseAddressLower32Bit.AddressSpaceId || 0 == pHpet->BaseAddressLower32Bit.Address)
+            break;
+
+        Base = (uintptr_t)pHpet->BaseAddressLower32Bit.Address;
+        qwPeriod = *(volatile uint64_t*)(Base + HPET_GCAP_ID) >> 32;
+
+        if (0 == qwPeriod || HPET_MAX_PERIOD < qwPeriod)
+            break;
+
+        qwConf = *(volatile uint64_t*)(Base + HPET_GEN_CONF);
+
+        if (0 == (HPET_ENABLE_CNF & qwConf))
+            *(volatile uint64_t*)(Base + HPET_GEN_CONF) = qwConf | HPET_ENABLE_CNF;
+
+        Clk.Address = Base + HPET_MAIN_CNT;
+        Clk.PerSec = 1000000000000000ULL / qwPeriod;
+        qwRet = calibrateref(&Clk);
+
+        if (0 == (HPET_ENABLE_CNF & qwConf))
+            *(volatile uint64_t*)(Base + HPET_GEN_CONF) = qwConf;
+
+    } while (0);
+
+    return qwRet;
+}
+
+/** calibratepmtimer()
+
+    Calibrate the TSC against the ACPI PM timer. X_PM_TMR_BLK takes precedence
+    over PM_TMR_BLK.
+
+    @param[in] VOID
+
+    @retval number of CPU clock per second
+    @retval 0, if not available
+
+**/
+static uint64_t calibratepmtimer(void)
+{
+    const ACPITBLIDXENTRY* pEntry = __AcpiTblIdxFind('PCAF', 0);
+    const EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* pFADT;
+    REFCLK Clk = { readio32, 0, 0x00FFFFFF, PMTMR_FREQ };
+    uint64_t qwRet = 0;
+
+    do {
+        if (NULL == pEntry || NULL == __AcpiTblIdxGet()->pRsdp)     // not available or snapshot replayed
+            break;
+
+        if (pEntry->Length < offsetof(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, Flags) + sizeof(uint32_t))
+            break;
+
+        pFADT = pEntry->pTable;
+
+        if (FADT_TMR_VAL_EXT & pFADT->Flags)
+            Clk.Mask = 0xFFFFFFFF;
+
+        if (pEntry->Length >= offsetof(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, XPmTmrBlk) + sizeof(EFI_ACPI_2_0_GENERIC_ADDRESS_STRUCTURE)
+            && 0 != pFADT->XPmTmrBlk.Address)
+        {
+            if (GAS_SYSTEM_MEMORY == pFADT->XPmTmrBlk.AddressSpaceId)
+                Clk.pfnRead = readmmio32;
+            else if (GAS_SYSTEM_IO != pFADT->XPmTmrBlk.AddressSpaceId)
+                break;
+
+            Clk.Address = (uintptr_t)pFADT->XPmTmrBlk.Address;
+        }
+        else if (0 != pFADT->PmTmrBlk && 4 == pFADT->PmTmrLen)
+            Clk.Address = pFADT->PmTmrBlk;
+        else
+            break;
+
+        qwRet = calibrateref(&Clk);
+
+    } while (0);
+
+    return qwRet;
+}
+
+/** calibrate()
+
+    InitOnceExecuteOnce() callback, determine the TSC frequency from the best source available
+
+    @param[in] InitOnce     one-time initialization structure
+    @param[in] Parameter    not used
+    @param[in] Context      not used
+
+    @retval 1
+
+**/
+static int calibrate(INITONCE* InitOnce, void* Parameter, void** Context)
+{
+    TSCCALSRC Src = TSCCALSRC_NONE;
+    uint64_t qwTsc = calibratecpuid(&Src);
+
+    if (TSCCALSRC_CPUID15 != Src) {                         // nominal base frequency or none, prefer a measurement
+        uint64_t qwNominal = qwTsc;
+        TSCCALSRC NominalSrc = Src;
+
+        if (0 != (qwTsc = calibratehpet()))
+            Src = TSCCALSRC_HPET;
+        else if (0 != (qwTsc = calibratepmtimer()))
+            Src = TSCCALSRC_PMTIMER;
+        else if (0 != (qwTsc = qwNominal))
+            Src = NominalSrc;
+        else {
+            qwTsc = calibratepit();
+            Src = TSCCALSRC_PIT;
+        }
+    }
+
+    TscCalSrc = Src;
+    qwTscPerSec = qwTsc;
+
+    return 1;
+}
+
+/** __TscPerSec()
+Synopsis
+    uint64_t __TscPerSec(void);
+Description
+    Get the number of TSC counts per second.
+    The frequency is determined on first use and cached.
+Paramters
+    none
+Returns
+    number of TSC counts per second
+**/
+uint64_t __TscPerSec(void)
+{
+    InitOnceExecuteOnce4UEFI(&TscInitOnce, calibrate, NULL, NULL);
+
+    return qwTscPerSec;
+}
+
+/** GetTscCalibrationSource4UEFI()
+Synopsis
+    TSCCALSRC GetTscCalibrationSource4UEFI(uint64_t* pTscPerSec);
+Description
+    Get the source the TSC frequency was determined from. Calibrates the TSC, if not yet done.
+Paramters
+    uint64_t* pTscPerSec    :   receives the number of TSC counts per second, may be NULL
+Returns
+    TSCCALSRC_CPUID15       :   CPUID leaf 15h TSC/crystal ratio and crystal clock
+    TSCCALSRC_CPUID16       :   CPUID leaf 16h processor base frequency
+    TSCCALSRC_PIT           :   calibrated against 8254 PIT timer 2
+    TSCCALSRC_HPET          :   calibrated against the HPET main counter
+    TSCCALSRC_PMTIMER       :   calibrated against the ACPI PM timer
+**/
+TSCCALSRC GetTscCalibrationSource4UEFI(uint64_t* pTscPerSec)
+{
+    uint64_t qwTsc;
+    INSTR_ENTER();
+
+    qwTsc = __TscPerSec();
+
+    if (NULL != pTscPerSec)
+        *pTscPerSec = qwTsc;
+
+    INSTR_LEAVE(GetTscCalibrationSource, 0);
+
+    return TscCalSrc;
+}
+
+/** __TscScaleInit()
+Synopsis
+    void __TscScaleInit(TSCSCALE* pScale, uint64_t qwUnitsPerSec);
+Description
+    Precompute a fixed point multiplier and shift, that converts TSC counts to
+    the given time units without a divide:
+
+        units = (TSC * Mul) >> Shift, with Mul = UnitsPerSec * 2^Shift / TscPerSec
+
+Paramters
+    TSCSCALE* pScale        :   receives multiplier and shift
+    uint64_t qwUnitsPerSec  :   target units per second, e.g. 1000 for milliseconds
+Returns
+    none
+**/
+void __TscScaleInit(TSCSCALE* pScale, uint64_t qwUnitsPerSec)
+{
+    uint64_t qwTscPerSec = __TscPerSec();
+    uint64_t q = qwUnitsPerSec / qwTscPerSec, r = qwUnitsPerSec % qwTscPerSec;
+    uint32_t Shift = 63, i;
+
+    while (q >> (63 - Shift) && Shift > 1)                  // keep Mul below 2^63
+        Shift--;
+
+    for (i = 0; i < Shift; i++)                             // long division (UnitsPerSec << Shift) / TscPerSec
+    {
+        q <<= 1;
+        r <<= 1;
+        if (r >= qwTscPerSec) {
+            r -= qwTscPerSec;
+            q |= 1;
+        }
+    }
+
+    pScale->Mul = q;
+    pScale->Shift = Shift;
+}
+
+/** __TscScale()
+Synopsis
+    uint64_t __TscScale(const TSCSCALE* pScale, uint64_t qwTsc);
+Description
+    Convert TSC counts to the units precomputed by __TscScaleInit()
+Paramters
+    const TSCSCALE* pScale  :   multiplier and shift
+    uint64_t qwTsc          :   TSC counts
+Returns
+    time in units
+**/
+uint64_t __TscScale(const TSCSCALE* pScale, uint64_t qwTsc)
+{
+    uint64_t hi, lo = _umul128(qwTsc, pScale->Mul, &hi);
+
+    return (hi << (64 - pScale->Shift)) | (lo >> pScale->Shift);
+}